@@ -0,0 +1,535 @@
+#include <mapped_file.h>
+#include <mesh_asset.h>
+#include <mesh_optimizer.h>
+#include <mesh_simplifier.h>
+#include <meshlet.h>
+#include <obj_importer.h>
+#include <texture_compression.h>
+#include <texture_importer.h>
+#include <texture_mips.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// Scene and camera path of --bench-culling: a square grid of copies of the
+// mesh, flown through along a circle at the height of the mesh's center
+constexpr uint32_t CULL_BENCH_GRID_SIDE = 16;
+constexpr uint32_t CULL_BENCH_FRAMES = 600;
+// Each run replays the whole path, the fastest one is reported
+constexpr uint32_t CULL_BENCH_RUNS = 5;
+
+double elapsed_ms(Clock::time_point const start, Clock::time_point const end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+bool ends_with(std::string const &str, char const *suffix) {
+    size_t const len = std::strlen(suffix);
+    return str.size() >= len && str.compare(str.size() - len, len, suffix) == 0;
+}
+
+// Peak resident set size of this process in KiB
+size_t peak_rss_kib() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize / 1024;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024; // bytes on macOS
+#else
+    return usage.ru_maxrss; // KiB on Linux
+#endif
+#endif
+}
+
+void print_usage(char const *exe) {
+    std::cout << "Usage: " << exe << " [--quantize] <input.obj> <output.mesh>\n"
+              << "       " << exe << " --bench-load <file.obj|file.mesh>\n"
+              << "       " << exe << " --analyze <file.obj>\n"
+              << "       " << exe << " --bench-culling <file.obj|file.mesh>\n"
+              << "       " << exe << " --bench-texture <image.png>\n"
+              << "  --quantize       store oct-encoded normals and half uvs\n"
+              << "  --bench-load     time loading a mesh into a staging buffer\n"
+              << "                   the way the engine does, and report peak RSS\n"
+              << "  --analyze        simulate the vertex cache and vertex fetch\n"
+              << "                   before and after optimizing the mesh, and\n"
+              << "                   report the LOD chain with each level's error\n"
+              << "  --bench-culling  cull the meshlets of a grid of copies of the\n"
+              << "                   mesh along a camera path, report the triangles\n"
+              << "                   culled per frame and the scalar and SIMD cost\n"
+              << "  --bench-texture  time decoding an image, generating its mips with\n"
+              << "                   the scalar and SIMD filters and compressing it\n"
+              << "                   to each format, on a single thread\n";
+}
+
+// One row of vertex cache and fetch statistics for the whole mesh
+void print_mesh_stats(char const *label, assets::MeshData const &mesh) {
+    uint32_t const *indices = mesh.indices.data();
+    size_t const index_count = mesh.indices.size();
+    size_t const vertex_count = mesh.vertices.size();
+
+    assets::VertexCacheStats const fifo = assets::analyze_vertex_cache(
+        indices, index_count, vertex_count, 16, assets::CacheModel::Fifo);
+    assets::VertexCacheStats const lru = assets::analyze_vertex_cache(
+        indices, index_count, vertex_count, assets::VERTEX_CACHE_SIZE, assets::CacheModel::Lru);
+    assets::VertexFetchStats const fetch = assets::analyze_vertex_fetch(
+        indices, index_count, vertex_count, sizeof(assets::VertexFull));
+
+    std::printf(
+        "%-10s %9.3f %9.3f %9.3f %9.3f %9.3f\n", label, fifo.acmr, fifo.atvr,
+        lru.acmr, lru.atvr, fetch.overfetch);
+}
+
+void print_mesh_stats_header() {
+    std::printf(
+        "%-10s %9s %9s %9s %9s %9s\n", "", "ACMR", "ATVR", "ACMR", "ATVR", "overfetch");
+    std::printf("%-10s %19s %19s\n", "", "(FIFO 16)", "(LRU 32)");
+}
+
+int analyze(char const *input_path) {
+    assets::MeshData mesh;
+    std::string error;
+    if (!assets::load_obj(input_path, mesh, error)) {
+        std::cout << "[ERROR] Failed to load \"" << input_path << "\": " << error << std::endl;
+        return 1;
+    }
+
+    std::cout << input_path << ": " << mesh.vertices.size() << " vertices, "
+              << mesh.indices.size() / 3 << " triangles" << std::endl;
+    print_mesh_stats_header();
+    print_mesh_stats("before", mesh);
+
+    Clock::time_point const start = Clock::now();
+    assets::optimize_mesh(mesh);
+    double const optimize_ms = elapsed_ms(start, Clock::now());
+
+    print_mesh_stats("after", mesh);
+    std::cout << "Optimized in " << optimize_ms << " ms" << std::endl;
+
+    if (!mesh.meshlets.empty()) {
+        uint32_t vertices = 0;
+        uint32_t culls_backfaces = 0;
+        for (assets::Meshlet const &meshlet : mesh.meshlets) {
+            vertices += meshlet.vertex_count;
+            culls_backfaces += meshlet.cone_cutoff <= 1.0f;
+        }
+        std::cout << mesh.meshlets.size() << " meshlets, on average "
+                  << (double)mesh.indices.size() / 3 / mesh.meshlets.size() << " triangles and "
+                  << (double)vertices / mesh.meshlets.size() << " vertices, "
+                  << culls_backfaces << " with a normal cone narrow enough to cull" << std::endl;
+    }
+
+    Clock::time_point const lod_start = Clock::now();
+    assets::build_lod_chain(mesh);
+    double const lod_ms = elapsed_ms(lod_start, Clock::now());
+
+    // Errors are in the mesh's units, relative to the size of its bounds
+    glm::vec3 bounds_min(std::numeric_limits<float>::max());
+    glm::vec3 bounds_max(std::numeric_limits<float>::lowest());
+    for (assets::VertexFull const &vertex : mesh.vertices) {
+        glm::vec3 const position(vertex.position[0], vertex.position[1], vertex.position[2]);
+        bounds_min = glm::min(bounds_min, position);
+        bounds_max = glm::max(bounds_max, position);
+    }
+    float const diagonal = glm::length(bounds_max - bounds_min);
+
+    std::cout << mesh.lods.size() << " levels of detail, built in " << lod_ms << " ms" << std::endl;
+    std::printf("%-5s %9s %9s %9s %9s\n", "LOD", "triangles", "error", "% of size", "ACMR");
+    for (size_t i = 0; i < mesh.lods.size(); i++) {
+        assets::MeshLod const &lod = mesh.lods[i];
+        assets::VertexCacheStats const cache = assets::analyze_vertex_cache(
+            mesh.indices.data() + lod.first_index, lod.index_count, mesh.vertices.size(),
+            16, assets::CacheModel::Fifo);
+        std::printf(
+            "%-5zu %9u %9.5f %9.3f %9.3f\n", i, lod.index_count / 3, lod.error,
+            diagonal > 0.0f ? 100.0f * lod.error / diagonal : 0.0f, cache.acmr);
+    }
+    return 0;
+}
+
+int bake(char const *input_path, char const *output_path, bool const quantize) {
+    assets::MeshData mesh;
+    std::string error;
+    if (!assets::load_obj(input_path, mesh, error)) {
+        std::cout << "[ERROR] Failed to load \"" << input_path << "\": " << error << std::endl;
+        return 1;
+    }
+
+    // Reorder for the vertex cache, overdraw and vertex fetch, then append
+    // the coarser levels of detail
+    assets::optimize_mesh(mesh);
+    assets::build_lod_chain(mesh);
+
+    assets::VertexFormat const format =
+        quantize ? assets::VertexFormat::Quantized : assets::VertexFormat::Full;
+    if (!assets::write_mesh_asset(output_path, mesh, format)) {
+        std::cout << "[ERROR] Failed to write \"" << output_path << "\"." << std::endl;
+        return 1;
+    }
+
+    std::cout << "[INFO] Baked \"" << input_path << "\" into \"" << output_path << "\": "
+              << mesh.vertices.size() << " vertices, " << mesh.lods[0].index_count / 3
+              << " triangles, " << mesh.submeshes.size() << " submeshes, "
+              << mesh.lods.size() << " levels of detail ("
+              << (quantize ? "quantized" : "full") << ")." << std::endl;
+    return 0;
+}
+
+// Mirrors the engine's load paths up to the point where data would be handed
+// to the GPU: everything ends up in one contiguous staging allocation.
+int bench_load(char const *path) {
+    Clock::time_point const start = Clock::now();
+    std::vector<char> staging;
+    size_t vertex_count = 0;
+    size_t index_count = 0;
+
+    if (ends_with(path, ".obj")) {
+        assets::MeshData mesh;
+        std::string error;
+        if (!assets::load_obj(path, mesh, error)) {
+            std::cout << "[ERROR] Failed to load \"" << path << "\": " << error << std::endl;
+            return 1;
+        }
+        size_t const vertices_size = mesh.vertices.size() * sizeof(assets::VertexFull);
+        size_t const indices_size = mesh.indices.size() * sizeof(uint32_t);
+        staging.resize(vertices_size + indices_size);
+        std::memcpy(staging.data(), mesh.vertices.data(), vertices_size);
+        std::memcpy(staging.data() + vertices_size, mesh.indices.data(), indices_size);
+        vertex_count = mesh.vertices.size();
+        index_count = mesh.indices.size();
+    } else {
+        MappedFile file;
+        assets::MeshAssetView view;
+        if (!file.open(path) || !assets::read_mesh_asset(file.data(), file.size(), view)) {
+            std::cout << "[ERROR] Failed to load \"" << path << "\"." << std::endl;
+            return 1;
+        }
+        staging.resize(view.vertices_size + view.indices_size);
+        std::memcpy(staging.data(), view.vertices, view.vertices_size);
+        std::memcpy(staging.data() + view.vertices_size, view.indices, view.indices_size);
+        vertex_count = view.header->vertex_count;
+        index_count = view.header->index_count;
+    }
+
+    double const load_ms = elapsed_ms(start, Clock::now());
+    std::cout << path << ": " << load_ms << " ms, peak RSS " << peak_rss_kib()
+              << " KiB, " << vertex_count << " vertices, " << index_count
+              << " indices, " << staging.size() << " bytes staged" << std::endl;
+    return 0;
+}
+
+struct CullFrame {
+    glm::vec4 planes[6];
+    glm::vec3 camera;
+};
+
+// Culls every copy for every frame of the path, one frame's stats at a time.
+// Returns the time of the whole path in ms.
+template <typename Cull>
+double replay_path(
+    std::vector<CullFrame> const &path, std::vector<glm::mat4> const &transforms,
+    assets::MeshletCullData const &data, Cull const &cull,
+    std::vector<assets::MeshletCullStats> &out_stats
+) {
+    out_stats.assign(path.size(), assets::MeshletCullStats{});
+    Clock::time_point const start = Clock::now();
+    for (size_t f = 0; f < path.size(); f++) {
+        for (glm::mat4 const &transform : transforms) {
+            glm::vec4 planes[6];
+            glm::vec3 camera;
+            assets::to_object_space(transform, path[f].planes, path[f].camera, planes, camera);
+            cull(data, planes, camera, 0.0f, out_stats[f], nullptr);
+        }
+    }
+    return elapsed_ms(start, Clock::now());
+}
+
+void print_triangle_row(
+    char const *label, std::vector<assets::MeshletCullStats> const &stats,
+    uint32_t assets::MeshletCullStats::*field, double const triangles_per_frame
+) {
+    uint32_t min = ~0u;
+    uint32_t max = 0;
+    double sum = 0.0;
+    for (assets::MeshletCullStats const &frame : stats) {
+        min = std::min(min, frame.*field);
+        max = std::max(max, frame.*field);
+        sum += frame.*field;
+    }
+    double const avg = sum / stats.size();
+    std::printf(
+        "%-9s %11.0f %11u %11u %8.1f%%\n", label, avg, min, max,
+        100.0 * avg / triangles_per_frame);
+}
+
+int bench_culling(char const *path) {
+    assets::MeshData mesh;
+    // Of a sphere around the origin holding the mesh
+    float radius = 0.0f;
+    if (ends_with(path, ".obj")) {
+        std::string error;
+        if (!assets::load_obj(path, mesh, error)) {
+            std::cout << "[ERROR] Failed to load \"" << path << "\": " << error << std::endl;
+            return 1;
+        }
+        assets::optimize_mesh(mesh);
+        for (assets::VertexFull const &vertex : mesh.vertices) {
+            radius = std::max(radius, glm::length(glm::vec3(
+                vertex.position[0], vertex.position[1], vertex.position[2])));
+        }
+    } else {
+        // Only the meshlets and bounds are needed
+        MappedFile file;
+        assets::MeshAssetView view;
+        if (!file.open(path) || !assets::read_mesh_asset(file.data(), file.size(), view)) {
+            std::cout << "[ERROR] Failed to load \"" << path << "\"." << std::endl;
+            return 1;
+        }
+        mesh.meshlets.assign(view.meshlets, view.meshlets + view.header->meshlet_count);
+        glm::vec3 extent;
+        for (int i = 0; i < 3; i++) {
+            extent[i] = std::max(
+                std::abs(view.header->bounds_min[i]), std::abs(view.header->bounds_max[i]));
+        }
+        radius = glm::length(extent);
+    }
+    if (mesh.meshlets.empty()) {
+        std::cout << "[ERROR] \"" << path << "\" has no meshlets." << std::endl;
+        return 1;
+    }
+
+    assets::MeshletCullData data;
+    assets::build_meshlet_cull_data(mesh.meshlets.data(), mesh.meshlets.size(), data);
+    uint32_t triangles = 0;
+    for (assets::Meshlet const &meshlet : mesh.meshlets) {
+        triangles += meshlet.triangle_count;
+    }
+
+    // A mesh diameter of space between neighboring copies
+    float const spacing = std::max(radius, 0.5f) * 4.0f;
+    float const half_extent = (CULL_BENCH_GRID_SIDE - 1) * spacing * 0.5f;
+    std::vector<glm::mat4> transforms;
+    for (uint32_t z = 0; z < CULL_BENCH_GRID_SIDE; z++) {
+        for (uint32_t x = 0; x < CULL_BENCH_GRID_SIDE; x++) {
+            transforms.push_back(glm::translate(
+                glm::mat4(1.0f),
+                glm::vec3(x * spacing - half_extent, 0.0f, z * spacing - half_extent)));
+        }
+    }
+
+    // Recorded once so that both runs see exactly the same frames
+    std::vector<CullFrame> camera_path(CULL_BENCH_FRAMES);
+    glm::mat4 const proj =
+        glm::perspective(glm::radians(70.0f), 16.0f / 9.0f, 0.1f, 4.0f * half_extent + spacing);
+    for (uint32_t f = 0; f < CULL_BENCH_FRAMES; f++) {
+        float const angle = glm::two_pi<float>() * f / CULL_BENCH_FRAMES;
+        glm::vec3 const eye(
+            0.5f * half_extent * std::cos(angle), 0.0f, 0.5f * half_extent * std::sin(angle));
+        glm::vec3 const forward(-std::sin(angle), -0.1f, std::cos(angle));
+        glm::mat4 viewproj = proj * glm::lookAt(eye, eye + forward, glm::vec3(0.0f, 1.0f, 0.0f));
+        assets::extract_frustum_planes(viewproj, camera_path[f].planes);
+        camera_path[f].camera = eye;
+    }
+
+    std::vector<assets::MeshletCullStats> scalar_stats;
+    std::vector<assets::MeshletCullStats> simd_stats;
+    double scalar_ms = 0.0;
+    double simd_ms = 0.0;
+    for (uint32_t run = 0; run < CULL_BENCH_RUNS; run++) {
+        double const run_scalar_ms = replay_path(
+            camera_path, transforms, data, assets::cull_meshlets_scalar, scalar_stats);
+        double const run_simd_ms =
+            replay_path(camera_path, transforms, data, assets::cull_meshlets, simd_stats);
+        scalar_ms = run == 0 ? run_scalar_ms : std::min(scalar_ms, run_scalar_ms);
+        simd_ms = run == 0 ? run_simd_ms : std::min(simd_ms, run_simd_ms);
+    }
+
+    uint32_t mismatches = 0;
+    for (uint32_t f = 0; f < CULL_BENCH_FRAMES; f++) {
+        mismatches += std::memcmp(&scalar_stats[f], &simd_stats[f], sizeof(assets::MeshletCullStats)) != 0;
+    }
+
+    double const meshlets_per_frame = (double)mesh.meshlets.size() * transforms.size();
+    double const triangles_per_frame = (double)triangles * transforms.size();
+    std::cout << path << ": " << transforms.size() << " copies of " << mesh.meshlets.size()
+              << " meshlets, " << triangles_per_frame << " triangles per frame, "
+              << CULL_BENCH_FRAMES << " frames" << std::endl;
+
+    std::printf("Triangles per frame\n");
+    std::printf("%-9s %11s %11s %11s %9s\n", "", "avg", "min", "max", "of all");
+    print_triangle_row("visible", simd_stats, &assets::MeshletCullStats::visible_triangles, triangles_per_frame);
+    print_triangle_row("frustum", simd_stats, &assets::MeshletCullStats::frustum_culled_triangles, triangles_per_frame);
+    print_triangle_row("backface", simd_stats, &assets::MeshletCullStats::backface_culled_triangles, triangles_per_frame);
+
+    std::printf("Culling cost per frame, fastest of %u runs\n", CULL_BENCH_RUNS);
+    std::printf(
+        "%-9s %8.3f ms %8.2f ns per meshlet\n", "scalar", scalar_ms / CULL_BENCH_FRAMES,
+        scalar_ms * 1e6 / (CULL_BENCH_FRAMES * meshlets_per_frame));
+    std::printf(
+        "%-9s %8.3f ms %8.2f ns per meshlet, %.2fx\n", "simd", simd_ms / CULL_BENCH_FRAMES,
+        simd_ms * 1e6 / (CULL_BENCH_FRAMES * meshlets_per_frame), scalar_ms / simd_ms);
+
+    if (mismatches > 0) {
+        std::cout << "[ERROR] Scalar and SIMD culling differed in " << mismatches << " frames."
+                  << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Mip chain of an sRGB image down to 1x1, returns the time it took
+template <typename Downsample>
+double build_mip_chain(
+    assets::Rgba8Image const &image, Downsample const &downsample,
+    std::vector<assets::Rgba8Image> &out_levels) {
+    Clock::time_point const start = Clock::now();
+    out_levels.clear();
+    // Each level is read from the one before, which must stay in place
+    out_levels.reserve(assets::mip_level_count(image.width, image.height));
+    assets::Rgba8Image const *level = &image;
+    while (level->width > 1 || level->height > 1) {
+        out_levels.push_back(assets::allocate_next_mip(*level));
+        downsample(*level, true, out_levels.back(), 0, out_levels.back().height);
+        level = &out_levels.back();
+    }
+    return elapsed_ms(start, Clock::now());
+}
+
+int bench_texture(char const *path) {
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cout << "[ERROR] Failed to open \"" << path << "\"." << std::endl;
+        return 1;
+    }
+
+    Clock::time_point const decode_start = Clock::now();
+    assets::Rgba8Image image;
+    std::string error;
+    if (!assets::decode_image(file.data(), file.size(), image, error)) {
+        std::cout << "[ERROR] Failed to decode \"" << path << "\": " << error << std::endl;
+        return 1;
+    }
+    double const decode_ms = elapsed_ms(decode_start, Clock::now());
+    bool const alpha = assets::has_alpha(image);
+    std::cout << path << ": " << image.width << "x" << image.height
+              << (alpha ? " with alpha" : " opaque") << ", decoded in " << decode_ms << " ms, "
+              << image.pixels.size() / (1024.0 * 1024.0) << " MiB as RGBA8" << std::endl;
+
+    std::vector<assets::Rgba8Image> scalar_levels;
+    std::vector<assets::Rgba8Image> simd_levels;
+    double const scalar_ms =
+        build_mip_chain(image, assets::downsample_rows_scalar, scalar_levels);
+    double const simd_ms = build_mip_chain(image, assets::downsample_rows, simd_levels);
+    std::printf("sRGB mip chain of %zu levels\n", simd_levels.size());
+    std::printf("%-9s %9.1f ms\n", "scalar", scalar_ms);
+    std::printf("%-9s %9.1f ms, %.2fx\n", "simd", simd_ms, scalar_ms / simd_ms);
+
+    uint32_t mismatches = 0;
+    for (size_t i = 0; i < simd_levels.size(); i++) {
+        mismatches += scalar_levels[i].pixels != simd_levels[i].pixels;
+    }
+
+    // The whole chain, RGBA8 being the size without compression
+    std::printf("Compression of the chain\n");
+    std::printf("%-9s %9s %9s\n", "", "time", "size");
+    assets::TextureFormat const formats[] = {
+        assets::TextureFormat::Rgba8,
+        alpha ? assets::TextureFormat::Bc3 : assets::TextureFormat::Bc1,
+        assets::TextureFormat::Bc7};
+    char const *const format_names[] = {"RGBA8", alpha ? "BC3" : "BC1", "BC7"};
+    for (int f = 0; f < 3; f++) {
+        Clock::time_point const start = Clock::now();
+        uint64_t size = 0;
+        for (size_t i = 0; i <= simd_levels.size(); i++) {
+            assets::Rgba8Image const &level = i == 0 ? image : simd_levels[i - 1];
+            uint64_t const level_size =
+                assets::texture_image_size(formats[f], level.width, level.height);
+            if (formats[f] != assets::TextureFormat::Rgba8) {
+                std::vector<uint8_t> blocks(level_size);
+                assets::compress_block_rows(
+                    level, formats[f], 0, (level.height + 3) / 4, blocks.data());
+            }
+            size += level_size;
+        }
+        std::printf(
+            "%-9s %9.1f ms %6.1f MiB\n", format_names[f], elapsed_ms(start, Clock::now()),
+            size / (1024.0 * 1024.0));
+    }
+
+    if (mismatches > 0) {
+        std::cout << "[ERROR] Scalar and SIMD mips differed in " << mismatches << " levels."
+                  << std::endl;
+        return 1;
+    }
+    return 0;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    bool quantize = false;
+    std::vector<char const *> paths;
+    char const *bench_path = nullptr;
+    char const *analyze_path = nullptr;
+    char const *bench_culling_path = nullptr;
+    char const *bench_texture_path = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--quantize") == 0) {
+            quantize = true;
+        } else if (std::strcmp(argv[i], "--bench-load") == 0 && i + 1 < argc) {
+            bench_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--analyze") == 0 && i + 1 < argc) {
+            analyze_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--bench-culling") == 0 && i + 1 < argc) {
+            bench_culling_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--bench-texture") == 0 && i + 1 < argc) {
+            bench_texture_path = argv[++i];
+        } else if (argv[i][0] != '-') {
+            paths.push_back(argv[i]);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (bench_path) {
+        return bench_load(bench_path);
+    }
+    if (analyze_path) {
+        return analyze(analyze_path);
+    }
+    if (bench_culling_path) {
+        return bench_culling(bench_culling_path);
+    }
+    if (bench_texture_path) {
+        return bench_texture(bench_texture_path);
+    }
+    if (paths.size() != 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    return bake(paths[0], paths[1], quantize);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+
+// Read-only memory mapping of a whole file. The OS pages the file in on
+// demand, so nothing is copied until the data is actually touched.
+class MappedFile {
+  public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(MappedFile const &) = delete;
+    MappedFile &operator=(MappedFile const &) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    // Maps the file, returns false if it can't be opened or is empty
+    bool open(char const *const filepath);
+    void close();
+
+    bool is_open() const { return ptr != nullptr; }
+    void const *data() const { return ptr; }
+    size_t size() const { return length; }
+
+  private:
+    void *ptr{nullptr};
+    size_t length{0};
+#ifdef _WIN32
+    void *mapping{nullptr};
+#endif
+};
@@ -0,0 +1,335 @@
+#include <mesh_asset.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+namespace {
+constexpr uint64_t SECTION_ALIGNMENT = 16;
+
+uint64_t align_up(uint64_t const offset) {
+    return (offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+}
+
+float sign_not_zero(float const value) { return value >= 0.0f ? 1.0f : -1.0f; }
+
+void write_padding(std::ofstream &file, uint64_t const target_offset) {
+    static char const zeros[SECTION_ALIGNMENT] = {};
+    uint64_t const offset = (uint64_t)file.tellp();
+    file.write(zeros, target_offset - offset);
+}
+} // namespace
+
+namespace assets {
+
+size_t vertex_size(VertexFormat const format) {
+    switch (format) {
+    case VertexFormat::Full:
+        return sizeof(VertexFull);
+    case VertexFormat::Quantized:
+        return sizeof(VertexQuantized);
+    }
+    return 0;
+}
+
+bool read_mesh_asset(void const *data, size_t const size, MeshAssetView &out_view) {
+    if (size < sizeof(MeshAssetHeader)) {
+        return false;
+    }
+
+    auto const *header = (MeshAssetHeader const *)data;
+    if (std::memcmp(header->magic, MESH_ASSET_MAGIC, 4) != 0
+        || header->version != MESH_ASSET_VERSION
+        || (header->index_size != 2 && header->index_size != 4)) {
+        return false;
+    }
+
+    size_t const vtx_size = vertex_size((VertexFormat)header->vertex_format);
+    if (vtx_size == 0) {
+        return false;
+    }
+
+    // Every section must lie within the data
+    auto const in_bounds = [size](uint64_t const offset, uint64_t const bytes) {
+        return offset <= size && bytes <= size - offset;
+    };
+    uint64_t const vertices_size = (uint64_t)header->vertex_count * vtx_size;
+    uint64_t const indices_size = (uint64_t)header->index_count * header->index_size;
+    uint64_t const submeshes_size = (uint64_t)header->submesh_count * sizeof(Submesh);
+    uint64_t const materials_size =
+        (uint64_t)header->material_count * MESH_ASSET_MATERIAL_NAME_SIZE;
+    uint64_t const meshlets_size = (uint64_t)header->meshlet_count * sizeof(Meshlet);
+    uint64_t const lods_size = (uint64_t)header->lod_count * sizeof(MeshLod);
+    if (!in_bounds(header->vertex_offset, vertices_size)
+        || !in_bounds(header->index_offset, indices_size)
+        || !in_bounds(header->submesh_offset, submeshes_size)
+        || !in_bounds(header->material_offset, materials_size)
+        || !in_bounds(header->meshlet_offset, meshlets_size)
+        || !in_bounds(header->lod_offset, lods_size)) {
+        return false;
+    }
+
+    // The sections are used in place, so each must be aligned for its structs
+    auto const aligned = [](uint64_t const offset) {
+        return offset % SECTION_ALIGNMENT == 0;
+    };
+    if (!aligned(header->vertex_offset) || !aligned(header->index_offset)
+        || !aligned(header->submesh_offset) || !aligned(header->material_offset)
+        || !aligned(header->meshlet_offset) || !aligned(header->lod_offset)) {
+        return false;
+    }
+
+    // Every index must name a vertex that exists
+    char const *const index_bytes = (char const *)data + header->index_offset;
+    if (header->index_size == 2) {
+        auto const *indices = (uint16_t const *)index_bytes;
+        for (uint32_t i = 0; i < header->index_count; i++) {
+            if (indices[i] >= header->vertex_count) {
+                return false;
+            }
+        }
+    } else {
+        auto const *indices = (uint32_t const *)index_bytes;
+        for (uint32_t i = 0; i < header->index_count; i++) {
+            if (indices[i] >= header->vertex_count) {
+                return false;
+            }
+        }
+    }
+
+    // Every level, submesh and meshlet must draw indices that exist
+    auto const indices_exist = [header](uint64_t const first_index, uint64_t const count) {
+        return first_index <= header->index_count && count <= header->index_count - first_index;
+    };
+    auto const *lods = (MeshLod const *)((char const *)data + header->lod_offset);
+    for (uint32_t i = 0; i < header->lod_count; i++) {
+        if (!indices_exist(lods[i].first_index, lods[i].index_count)) {
+            return false;
+        }
+    }
+    auto const *submeshes = (Submesh const *)((char const *)data + header->submesh_offset);
+    for (uint32_t i = 0; i < header->submesh_count; i++) {
+        if (!indices_exist(submeshes[i].first_index, submeshes[i].index_count)) {
+            return false;
+        }
+    }
+    auto const *meshlets = (Meshlet const *)((char const *)data + header->meshlet_offset);
+    for (uint32_t i = 0; i < header->meshlet_count; i++) {
+        if (!indices_exist(meshlets[i].first_index, (uint64_t)meshlets[i].triangle_count * 3)) {
+            return false;
+        }
+    }
+
+    char const *const bytes = (char const *)data;
+    out_view.header = header;
+    out_view.vertices = bytes + header->vertex_offset;
+    out_view.vertices_size = vertices_size;
+    out_view.indices = bytes + header->index_offset;
+    out_view.indices_size = indices_size;
+    out_view.submeshes = submeshes;
+    out_view.materials = bytes + header->material_offset;
+    out_view.meshlets = meshlets;
+    out_view.lods = lods;
+    return true;
+}
+
+bool write_mesh_asset(
+    char const *filepath, MeshData const &mesh, VertexFormat const format
+) {
+    // 16-bit indices halve the index data whenever they're enough
+    uint32_t const index_size =
+        mesh.vertices.size() <= std::numeric_limits<uint16_t>::max() + 1 ? 2 : 4;
+
+    MeshAssetHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MESH_ASSET_MAGIC, 4);
+    header.version = MESH_ASSET_VERSION;
+    header.vertex_format = (uint32_t)format;
+    header.index_size = index_size;
+    header.vertex_count = (uint32_t)mesh.vertices.size();
+    header.index_count = (uint32_t)mesh.indices.size();
+    header.submesh_count = (uint32_t)mesh.submeshes.size();
+    header.material_count = (uint32_t)mesh.materials.size();
+    header.meshlet_count = (uint32_t)mesh.meshlets.size();
+    header.lod_count = (uint32_t)mesh.lods.size();
+
+    header.vertex_offset = align_up(sizeof(MeshAssetHeader));
+    header.index_offset = align_up(
+        header.vertex_offset + (uint64_t)header.vertex_count * vertex_size(format));
+    header.submesh_offset =
+        align_up(header.index_offset + (uint64_t)header.index_count * index_size);
+    header.material_offset = align_up(
+        header.submesh_offset + (uint64_t)header.submesh_count * sizeof(Submesh));
+    header.meshlet_offset = align_up(
+        header.material_offset
+        + (uint64_t)header.material_count * MESH_ASSET_MATERIAL_NAME_SIZE);
+    header.lod_offset = align_up(
+        header.meshlet_offset + (uint64_t)header.meshlet_count * sizeof(Meshlet));
+
+    glm::vec3 bounds_min(std::numeric_limits<float>::max());
+    glm::vec3 bounds_max(std::numeric_limits<float>::lowest());
+    for (VertexFull const &vertex : mesh.vertices) {
+        glm::vec3 const position(vertex.position[0], vertex.position[1], vertex.position[2]);
+        bounds_min = glm::min(bounds_min, position);
+        bounds_max = glm::max(bounds_max, position);
+    }
+    if (mesh.vertices.empty()) {
+        bounds_min = bounds_max = glm::vec3(0.0f);
+    }
+    for (int i = 0; i < 3; i++) {
+        header.bounds_min[i] = bounds_min[i];
+        header.bounds_max[i] = bounds_max[i];
+    }
+
+    std::ofstream file(filepath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    file.write((char const *)&header, sizeof(header));
+
+    write_padding(file, header.vertex_offset);
+    if (format == VertexFormat::Full) {
+        file.write(
+            (char const *)mesh.vertices.data(),
+            mesh.vertices.size() * sizeof(VertexFull));
+    } else {
+        std::vector<VertexQuantized> quantized(mesh.vertices.size());
+        for (size_t i = 0; i < mesh.vertices.size(); i++) {
+            VertexFull const &src = mesh.vertices[i];
+            VertexQuantized &dst = quantized[i];
+            std::memcpy(dst.position, src.position, sizeof(dst.position));
+            oct_encode(glm::vec3(src.normal[0], src.normal[1], src.normal[2]), dst.normal);
+            dst.uv[0] = float_to_half(src.uv[0]);
+            dst.uv[1] = float_to_half(src.uv[1]);
+        }
+        file.write(
+            (char const *)quantized.data(),
+            quantized.size() * sizeof(VertexQuantized));
+    }
+
+    write_padding(file, header.index_offset);
+    if (index_size == 2) {
+        std::vector<uint16_t> const indices(mesh.indices.begin(), mesh.indices.end());
+        file.write((char const *)indices.data(), indices.size() * sizeof(uint16_t));
+    } else {
+        file.write(
+            (char const *)mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+    }
+
+    write_padding(file, header.submesh_offset);
+    file.write(
+        (char const *)mesh.submeshes.data(), mesh.submeshes.size() * sizeof(Submesh));
+
+    write_padding(file, header.material_offset);
+    for (std::string const &material : mesh.materials) {
+        char name[MESH_ASSET_MATERIAL_NAME_SIZE] = {};
+        std::strncpy(name, material.c_str(), sizeof(name) - 1);
+        file.write(name, sizeof(name));
+    }
+
+    write_padding(file, header.meshlet_offset);
+    file.write(
+        (char const *)mesh.meshlets.data(), mesh.meshlets.size() * sizeof(Meshlet));
+
+    write_padding(file, header.lod_offset);
+    file.write((char const *)mesh.lods.data(), mesh.lods.size() * sizeof(MeshLod));
+
+    return (bool)file;
+}
+
+void oct_encode(glm::vec3 const &n, int16_t out[2]) {
+    // Project onto the octahedron, then fold the lower half over the upper one
+    float const l1_norm = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    glm::vec2 p = l1_norm > 0.0f ? glm::vec2(n.x, n.y) / l1_norm : glm::vec2(0.0f);
+    if (n.z < 0.0f) {
+        p = glm::vec2(
+            (1.0f - std::abs(p.y)) * sign_not_zero(p.x),
+            (1.0f - std::abs(p.x)) * sign_not_zero(p.y));
+    }
+
+    out[0] = (int16_t)std::round(std::clamp(p.x, -1.0f, 1.0f) * 32767.0f);
+    out[1] = (int16_t)std::round(std::clamp(p.y, -1.0f, 1.0f) * 32767.0f);
+}
+
+glm::vec3 oct_decode(int16_t const in[2]) {
+    glm::vec3 n(
+        std::max(in[0] / 32767.0f, -1.0f), std::max(in[1] / 32767.0f, -1.0f), 0.0f);
+    n.z = 1.0f - std::abs(n.x) - std::abs(n.y);
+    float const t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+uint16_t float_to_half(float const value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t const sign = (bits >> 16) & 0x8000;
+    uint32_t const float_exponent = (bits >> 23) & 0xff;
+    int32_t const exponent = (int32_t)float_exponent - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    // Infinity and NaN
+    if (float_exponent == 0xff) {
+        return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+    }
+    // Too large, clamps to infinity
+    if (exponent >= 31) {
+        return (uint16_t)(sign | 0x7c00);
+    }
+    // Too small for a normal half, becomes subnormal or zero
+    if (exponent <= 0) {
+        if (exponent < -10) {
+            return (uint16_t)sign;
+        }
+        mantissa |= 0x800000;
+        uint32_t const shift = (uint32_t)(14 - exponent);
+        uint32_t half_mantissa = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1) {
+            half_mantissa++;
+        }
+        return (uint16_t)(sign | half_mantissa);
+    }
+
+    // Rounding may carry into the exponent, which is still the correct result
+    uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000) {
+        half++;
+    }
+    return (uint16_t)half;
+}
+
+float half_to_float(uint16_t const value) {
+    uint32_t const sign = (uint32_t)(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+
+    uint32_t bits;
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        } else {
+            // Subnormal half, normalize it for the float
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400)) {
+                mantissa <<= 1;
+                exponent--;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+        }
+    } else if (exponent == 31) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+} // namespace assets
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace assets {
+
+// Layout of the vertices stored in a mesh asset. The engine uploads them as is,
+// so each format maps directly to a vertex input description.
+enum class VertexFormat : uint32_t {
+    // float3 position, float3 normal, float2 uv (32 bytes)
+    Full = 0,
+    // float3 position, octahedral snorm16x2 normal, half2 uv (20 bytes)
+    Quantized = 1,
+};
+
+struct VertexFull {
+    float position[3];
+    float normal[3];
+    float uv[2];
+};
+
+struct VertexQuantized {
+    float position[3];
+    int16_t normal[2];
+    uint16_t uv[2];
+};
+
+// Contiguous range of indices drawn with one material
+struct Submesh {
+    uint32_t first_index;
+    uint32_t index_count;
+    uint32_t material;
+};
+
+// Cluster of at most MESHLET_MAX_VERTICES vertices and MESHLET_MAX_TRIANGLES
+// triangles, contiguous in the index buffer, with the bounds it is culled by.
+// 64 bytes, the same layout as the meshlets of a std430 buffer.
+struct Meshlet {
+    float center[3];
+    float radius;
+    // Cone holding the normals of all triangles. From any viewpoint p with
+    // dot(cone_apex - p, cone_axis) > cone_cutoff * length(cone_apex - p) they
+    // all face away. A cutoff above 1 means the cone is too wide to ever pass.
+    float cone_apex[3];
+    float cone_cutoff;
+    float cone_axis[3];
+    uint32_t first_index;
+    uint32_t triangle_count;
+    uint32_t vertex_count;
+    uint32_t reserved[2];
+};
+
+// Range of indices drawing the whole mesh at one level of detail. The first
+// level is the full mesh with its submeshes and meshlets. The coarser ones
+// are simplified across submeshes and drawn with a single material.
+struct MeshLod {
+    uint32_t first_index;
+    uint32_t index_count;
+    // How far the surface may be from the full detail one, in the units of
+    // the positions, see simplify()
+    float error;
+    uint32_t reserved;
+};
+
+// Mesh as loaded from a source file, always at full precision
+struct MeshData {
+    std::vector<VertexFull> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<Submesh> submeshes;
+    std::vector<std::string> materials;
+    // Empty until build_meshlets()
+    std::vector<Meshlet> meshlets;
+    // Empty until build_lod_chain(), then the full detail level first
+    std::vector<MeshLod> lods;
+};
+
+constexpr char MESH_ASSET_MAGIC[4] = {'V', 'K', 'M', 'S'};
+// Bump whenever the layout of the file changes
+constexpr uint32_t MESH_ASSET_VERSION = 3;
+constexpr size_t MESH_ASSET_MATERIAL_NAME_SIZE = 64;
+
+// Starts every mesh asset file. All offsets are from the start of the file and
+// aligned to 16 bytes, so each section can be used straight from a mapping.
+struct MeshAssetHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t vertex_format; // VertexFormat
+    uint32_t index_size;    // 2 or 4 bytes
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t submesh_count;
+    uint32_t material_count;
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    uint64_t submesh_offset;  // Submesh[submesh_count]
+    uint64_t material_offset; // char[material_count][MATERIAL_NAME_SIZE]
+    float bounds_min[3];
+    float bounds_max[3];
+    uint32_t meshlet_count;
+    uint32_t lod_count;
+    uint64_t meshlet_offset; // Meshlet[meshlet_count]
+    uint64_t lod_offset;     // MeshLod[lod_count], coarser ones after
+};
+
+// Sections of a mesh asset that lives in memory, usually a file mapping
+struct MeshAssetView {
+    MeshAssetHeader const *header;
+    void const *vertices;
+    size_t vertices_size;
+    void const *indices;
+    size_t indices_size;
+    Submesh const *submeshes;
+    char const *materials;
+    Meshlet const *meshlets;
+    MeshLod const *lods;
+
+    VertexFormat vertex_format() const {
+        return (VertexFormat)header->vertex_format;
+    }
+    char const *material_name(uint32_t const material) const {
+        return materials + material * MESH_ASSET_MATERIAL_NAME_SIZE;
+    }
+};
+
+size_t vertex_size(VertexFormat const format);
+
+// Validates the header, section bounds and alignment and the index ranges of
+// an in-memory mesh asset
+bool read_mesh_asset(void const *data, size_t const size, MeshAssetView &out_view);
+
+bool write_mesh_asset(
+    char const *filepath, MeshData const &mesh, VertexFormat const format);
+
+// Octahedral encoding of a unit vector into two snorm16 values
+void oct_encode(glm::vec3 const &n, int16_t out[2]);
+glm::vec3 oct_decode(int16_t const in[2]);
+
+uint16_t float_to_half(float const value);
+float half_to_float(uint16_t const value);
+
+} // namespace assets
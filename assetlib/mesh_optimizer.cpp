@@ -0,0 +1,475 @@
+#include <mesh_optimizer.h>
+
+#include <meshlet.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+// Forsyth's scoring parameters, from "Linear-Speed Vertex Cache Optimisation"
+constexpr float CACHE_DECAY_POWER = 1.5f;
+constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+constexpr float VALENCE_BOOST_SCALE = 2.0f;
+constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+// Clusters for overdraw ordering are found with a FIFO of typical hardware size
+constexpr uint32_t OVERDRAW_CACHE_SIZE = 16;
+
+// Lines of the simulated vertex fetch cache
+constexpr size_t FETCH_LINE_SIZE = 64;
+constexpr size_t FETCH_LINE_COUNT = 64;
+
+// Triangles using each vertex, stored as one list per vertex
+struct TriangleAdjacency {
+    std::vector<uint32_t> counts;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> triangles;
+};
+
+void build_adjacency(
+    TriangleAdjacency &adjacency, uint32_t const *indices,
+    size_t const index_count, size_t const vertex_count
+) {
+    adjacency.counts.assign(vertex_count, 0);
+    adjacency.offsets.assign(vertex_count, 0);
+    adjacency.triangles.resize(index_count);
+
+    for (size_t i = 0; i < index_count; i++) {
+        adjacency.counts[indices[i]]++;
+    }
+
+    uint32_t offset = 0;
+    for (size_t v = 0; v < vertex_count; v++) {
+        adjacency.offsets[v] = offset;
+        offset += adjacency.counts[v];
+    }
+
+    // Fill each list, using counts as the write cursor and restoring it after
+    std::fill(adjacency.counts.begin(), adjacency.counts.end(), 0);
+    for (size_t i = 0; i < index_count; i++) {
+        uint32_t const v = indices[i];
+        adjacency.triangles[adjacency.offsets[v] + adjacency.counts[v]++] = (uint32_t)(i / 3);
+    }
+}
+
+float vertex_score(int const cache_position, uint32_t const remaining_valence) {
+    // Vertices with no triangles left don't matter anymore
+    if (remaining_valence == 0) {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cache_position >= 0) {
+        if (cache_position < 3) {
+            // The last triangle's vertices get a fixed score, so that the next
+            // triangle isn't biased towards any one edge of it
+            score = LAST_TRIANGLE_SCORE;
+        } else {
+            float const scaler = 1.0f / (assets::VERTEX_CACHE_SIZE - 3);
+            score = std::pow(1.0f - (cache_position - 3) * scaler, CACHE_DECAY_POWER);
+        }
+    }
+
+    // Prefer vertices with few triangles left, to get rid of lone triangles
+    // before they are stranded
+    score += VALENCE_BOOST_SCALE * std::pow((float)remaining_valence, -VALENCE_BOOST_POWER);
+    return score;
+}
+
+// Approximate FIFO: a vertex is in the cache if fewer than cache_size
+// vertices were added after it. Returns the number of misses.
+uint32_t update_fifo_cache(
+    uint32_t const *triangle, uint32_t const cache_size,
+    std::vector<uint32_t> &cache_timestamps, uint32_t &timestamp
+) {
+    uint32_t misses = 0;
+    for (int k = 0; k < 3; k++) {
+        uint32_t const v = triangle[k];
+        if (timestamp - cache_timestamps[v] > cache_size) {
+            cache_timestamps[v] = timestamp++;
+            misses++;
+        }
+    }
+    return misses;
+}
+} // namespace
+
+namespace assets {
+
+VertexCacheStats analyze_vertex_cache(
+    uint32_t const *indices, size_t const index_count, size_t const vertex_count,
+    uint32_t const cache_size, CacheModel const model
+) {
+    VertexCacheStats stats = {};
+    stats.triangles = (uint32_t)(index_count / 3);
+
+    std::vector<bool> referenced(vertex_count, false);
+    for (size_t i = 0; i < index_count; i++) {
+        if (!referenced[indices[i]]) {
+            referenced[indices[i]] = true;
+            stats.vertices++;
+        }
+    }
+
+    if (model == CacheModel::Fifo) {
+        // Exact FIFO, timestamps start past the cache size so that no vertex
+        // counts as cached before it was first added
+        std::vector<uint32_t> cache_timestamps(vertex_count, 0);
+        uint32_t timestamp = cache_size + 1;
+        for (size_t i = 0; i < index_count; i++) {
+            uint32_t const v = indices[i];
+            if (timestamp - cache_timestamps[v] > cache_size) {
+                cache_timestamps[v] = timestamp++;
+                stats.vertices_transformed++;
+            }
+        }
+    } else {
+        // Most recently used vertex first
+        std::vector<uint32_t> cache;
+        cache.reserve(cache_size + 1);
+        for (size_t i = 0; i < index_count; i++) {
+            uint32_t const v = indices[i];
+            auto const found = std::find(cache.begin(), cache.end(), v);
+            if (found == cache.end()) {
+                stats.vertices_transformed++;
+                cache.insert(cache.begin(), v);
+                if (cache.size() > cache_size) {
+                    cache.pop_back();
+                }
+            } else {
+                std::rotate(cache.begin(), found, found + 1);
+            }
+        }
+    }
+
+    if (stats.triangles > 0) {
+        stats.acmr = (float)stats.vertices_transformed / stats.triangles;
+    }
+    if (stats.vertices > 0) {
+        stats.atvr = (float)stats.vertices_transformed / stats.vertices;
+    }
+    return stats;
+}
+
+VertexFetchStats analyze_vertex_fetch(
+    uint32_t const *indices, size_t const index_count, size_t const vertex_count,
+    size_t const vertex_size
+) {
+    VertexFetchStats stats = {};
+
+    std::vector<bool> referenced(vertex_count, false);
+    size_t unique_vertices = 0;
+
+    uint64_t line_tags[FETCH_LINE_COUNT];
+    std::fill(line_tags, line_tags + FETCH_LINE_COUNT, ~0ull);
+
+    for (size_t i = 0; i < index_count; i++) {
+        uint32_t const v = indices[i];
+        if (!referenced[v]) {
+            referenced[v] = true;
+            unique_vertices++;
+        }
+
+        // A vertex may straddle two lines
+        uint64_t const start = (uint64_t)v * vertex_size;
+        uint64_t const end = start + vertex_size;
+        for (uint64_t line = start / FETCH_LINE_SIZE; line <= (end - 1) / FETCH_LINE_SIZE; line++) {
+            uint64_t &tag = line_tags[line % FETCH_LINE_COUNT];
+            if (tag != line) {
+                tag = line;
+                stats.bytes_fetched += FETCH_LINE_SIZE;
+            }
+        }
+    }
+
+    if (unique_vertices > 0) {
+        stats.overfetch = (float)stats.bytes_fetched / (unique_vertices * vertex_size);
+    }
+    return stats;
+}
+
+void optimize_vertex_cache(
+    uint32_t *destination, uint32_t const *indices, size_t const index_count,
+    size_t const vertex_count
+) {
+    size_t const triangle_count = index_count / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+
+    TriangleAdjacency adjacency;
+    build_adjacency(adjacency, indices, index_count, vertex_count);
+
+    std::vector<int> cache_positions(vertex_count, -1);
+    std::vector<float> vertex_scores(vertex_count);
+    for (size_t v = 0; v < vertex_count; v++) {
+        vertex_scores[v] = vertex_score(-1, adjacency.counts[v]);
+    }
+
+    std::vector<float> triangle_scores(triangle_count);
+    std::vector<bool> emitted(triangle_count, false);
+    for (size_t t = 0; t < triangle_count; t++) {
+        triangle_scores[t] = vertex_scores[indices[3 * t + 0]]
+            + vertex_scores[indices[3 * t + 1]]
+            + vertex_scores[indices[3 * t + 2]];
+    }
+
+    // Start with the best triangle overall
+    size_t current = std::max_element(triangle_scores.begin(), triangle_scores.end())
+        - triangle_scores.begin();
+
+    // Holds the cache plus the 3 vertices that may be pushed out of it
+    uint32_t cache[VERTEX_CACHE_SIZE + 3];
+    size_t cache_count = 0;
+
+    // Next triangle in input order to fall back to when the cache is cold
+    size_t input_cursor = 0;
+
+    for (size_t output = 0; output < triangle_count; output++) {
+        uint32_t const *triangle = indices + 3 * current;
+        destination[3 * output + 0] = triangle[0];
+        destination[3 * output + 1] = triangle[1];
+        destination[3 * output + 2] = triangle[2];
+        emitted[current] = true;
+
+        // Remove the triangle from its vertices' lists
+        for (int k = 0; k < 3; k++) {
+            uint32_t const v = triangle[k];
+            uint32_t *list = &adjacency.triangles[adjacency.offsets[v]];
+            uint32_t &count = adjacency.counts[v];
+            for (uint32_t i = 0; i < count; i++) {
+                if (list[i] == current) {
+                    list[i] = list[count - 1];
+                    count--;
+                    break;
+                }
+            }
+        }
+
+        // Move the triangle's vertices to the front of the LRU cache
+        uint32_t new_cache[VERTEX_CACHE_SIZE + 3];
+        size_t new_cache_count = 0;
+        for (int k = 0; k < 3; k++) {
+            new_cache[new_cache_count++] = triangle[k];
+        }
+        for (size_t i = 0; i < cache_count; i++) {
+            uint32_t const v = cache[i];
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                new_cache[new_cache_count++] = v;
+            }
+        }
+
+        // Rescore every vertex whose cache position changed, including the
+        // ones that just fell out of the cache
+        for (size_t i = 0; i < new_cache_count; i++) {
+            uint32_t const v = new_cache[i];
+            cache_positions[v] = i < VERTEX_CACHE_SIZE ? (int)i : -1;
+            vertex_scores[v] = vertex_score(cache_positions[v], adjacency.counts[v]);
+        }
+
+        // Rescore their triangles and pick the best one as the next
+        float best_score = -1.0f;
+        size_t best = triangle_count;
+        for (size_t i = 0; i < new_cache_count; i++) {
+            uint32_t const v = new_cache[i];
+            uint32_t const *list = &adjacency.triangles[adjacency.offsets[v]];
+            for (uint32_t j = 0; j < adjacency.counts[v]; j++) {
+                uint32_t const t = list[j];
+                float const score = vertex_scores[indices[3 * t + 0]]
+                    + vertex_scores[indices[3 * t + 1]]
+                    + vertex_scores[indices[3 * t + 2]];
+                triangle_scores[t] = score;
+                if (score > best_score) {
+                    best_score = score;
+                    best = t;
+                }
+            }
+        }
+
+        cache_count = std::min(new_cache_count, (size_t)VERTEX_CACHE_SIZE);
+        std::copy(new_cache, new_cache + cache_count, cache);
+
+        // Nothing in the cache has triangles left, continue with the next
+        // triangle in input order instead of scanning all of them
+        if (best == triangle_count) {
+            while (input_cursor < triangle_count && emitted[input_cursor]) {
+                input_cursor++;
+            }
+            best = input_cursor;
+        }
+        current = best;
+    }
+}
+
+void optimize_overdraw(
+    uint32_t *destination, uint32_t const *indices, size_t const index_count,
+    float const *positions, size_t const position_stride,
+    size_t const vertex_count, float const threshold
+) {
+    size_t const triangle_count = index_count / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+
+    // Hard boundaries, where all three vertices miss and the cache is cold
+    std::vector<uint32_t> cache_timestamps(vertex_count, 0);
+    uint32_t timestamp = OVERDRAW_CACHE_SIZE + 1;
+    std::vector<size_t> hard_clusters;
+    for (size_t t = 0; t < triangle_count; t++) {
+        uint32_t const misses = update_fifo_cache(
+            indices + 3 * t, OVERDRAW_CACHE_SIZE, cache_timestamps, timestamp);
+        if (t == 0 || misses == 3) {
+            hard_clusters.push_back(t);
+        }
+    }
+
+    // Soft boundaries, splitting each cluster further wherever the cluster so
+    // far is within the threshold of the whole cluster's ACMR
+    std::vector<size_t> clusters;
+    for (size_t c = 0; c < hard_clusters.size(); c++) {
+        size_t const start = hard_clusters[c];
+        size_t const end = c + 1 < hard_clusters.size() ? hard_clusters[c + 1] : triangle_count;
+
+        // Flush the cache between simulations by skipping ahead
+        timestamp += OVERDRAW_CACHE_SIZE + 1;
+        uint32_t cluster_misses = 0;
+        for (size_t t = start; t < end; t++) {
+            cluster_misses += update_fifo_cache(
+                indices + 3 * t, OVERDRAW_CACHE_SIZE, cache_timestamps, timestamp);
+        }
+        float const cluster_threshold = threshold * cluster_misses / (end - start);
+
+        clusters.push_back(start);
+        timestamp += OVERDRAW_CACHE_SIZE + 1;
+        uint32_t running_misses = 0;
+        uint32_t running_triangles = 0;
+        for (size_t t = start; t < end; t++) {
+            running_misses += update_fifo_cache(
+                indices + 3 * t, OVERDRAW_CACHE_SIZE, cache_timestamps, timestamp);
+            running_triangles++;
+
+            if ((float)running_misses / running_triangles <= cluster_threshold && t + 1 < end) {
+                clusters.push_back(t + 1);
+                timestamp += OVERDRAW_CACHE_SIZE + 1;
+                running_misses = 0;
+                running_triangles = 0;
+            }
+        }
+    }
+
+    auto const position = [&](uint32_t const v) {
+        float const *p = (float const *)((char const *)positions + v * position_stride);
+        return glm::vec3(p[0], p[1], p[2]);
+    };
+
+    glm::vec3 mesh_centroid(0.0f);
+    for (size_t i = 0; i < index_count; i++) {
+        mesh_centroid += position(indices[i]);
+    }
+    mesh_centroid /= (float)index_count;
+
+    // Clusters facing away from the center of the mesh are drawn first, since
+    // they are the most likely to occlude the rest
+    std::vector<float> sort_keys(clusters.size());
+    for (size_t c = 0; c < clusters.size(); c++) {
+        size_t const start = clusters[c];
+        size_t const end = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+
+        glm::vec3 centroid(0.0f);
+        glm::vec3 normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = start; t < end; t++) {
+            glm::vec3 const p0 = position(indices[3 * t + 0]);
+            glm::vec3 const p1 = position(indices[3 * t + 1]);
+            glm::vec3 const p2 = position(indices[3 * t + 2]);
+
+            // The cross product's length is twice the triangle's area
+            glm::vec3 const n = glm::cross(p1 - p0, p2 - p0);
+            float const triangle_area = glm::length(n);
+
+            centroid += (p0 + p1 + p2) * (triangle_area / 3.0f);
+            normal += n;
+            area += triangle_area;
+        }
+
+        float const normal_length = glm::length(normal);
+        if (area > 0.0f && normal_length > 0.0f) {
+            sort_keys[c] = glm::dot(centroid / area - mesh_centroid, normal / normal_length);
+        } else {
+            sort_keys[c] = 0.0f;
+        }
+    }
+
+    std::vector<size_t> order(clusters.size());
+    for (size_t c = 0; c < clusters.size(); c++) {
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t const a, size_t const b) {
+        return sort_keys[a] > sort_keys[b];
+    });
+
+    size_t output = 0;
+    for (size_t const c : order) {
+        size_t const start = clusters[c];
+        size_t const end = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+        std::copy(indices + 3 * start, indices + 3 * end, destination + 3 * output);
+        output += end - start;
+    }
+}
+
+size_t optimize_vertex_fetch_remap(
+    uint32_t *remap, uint32_t const *indices, size_t const index_count,
+    size_t const vertex_count
+) {
+    std::fill(remap, remap + vertex_count, ~0u);
+
+    uint32_t next_vertex = 0;
+    for (size_t i = 0; i < index_count; i++) {
+        uint32_t const v = indices[i];
+        if (remap[v] == ~0u) {
+            remap[v] = next_vertex++;
+        }
+    }
+    return next_vertex;
+}
+
+void optimize_mesh(MeshData &mesh) {
+    size_t const vertex_count = mesh.vertices.size();
+    if (vertex_count == 0 || mesh.indices.empty()) {
+        return;
+    }
+
+    // Submeshes are drawn separately, so each one is optimized on its own
+    std::vector<uint32_t> scratch;
+    for (Submesh const &submesh : mesh.submeshes) {
+        uint32_t *indices = mesh.indices.data() + submesh.first_index;
+        scratch.resize(submesh.index_count);
+
+        optimize_vertex_cache(scratch.data(), indices, submesh.index_count, vertex_count);
+        optimize_overdraw(
+            indices, scratch.data(), submesh.index_count,
+            mesh.vertices[0].position, sizeof(VertexFull), vertex_count, 1.05f);
+    }
+
+    // Meshlets keep the order of their seeds, which follows the order above
+    build_meshlets(mesh);
+
+    std::vector<uint32_t> remap(vertex_count);
+    size_t const new_vertex_count = optimize_vertex_fetch_remap(
+        remap.data(), mesh.indices.data(), mesh.indices.size(), vertex_count);
+
+    std::vector<VertexFull> vertices(new_vertex_count);
+    for (size_t v = 0; v < vertex_count; v++) {
+        if (remap[v] != ~0u) {
+            vertices[remap[v]] = mesh.vertices[v];
+        }
+    }
+    mesh.vertices.swap(vertices);
+
+    for (uint32_t &index : mesh.indices) {
+        index = remap[index];
+    }
+}
+
+} // namespace assets
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <mesh_asset.h>
+
+namespace assets {
+
+// Post-transform cache size the optimizers target. Forsyth's algorithm is
+// tuned for an LRU cache of this size, which also does well on the smaller
+// FIFO caches of real hardware.
+constexpr uint32_t VERTEX_CACHE_SIZE = 32;
+
+enum class CacheModel {
+    Fifo, // Vertices leave in the order they came in, like most hardware
+    Lru,  // Hits move a vertex back to the front, the model Forsyth assumes
+};
+
+struct VertexCacheStats {
+    uint32_t vertices_transformed; // cache misses
+    uint32_t triangles;
+    uint32_t vertices;             // unique vertices referenced
+    float acmr;                    // misses per triangle, 0.5 at best, 3 at worst
+    float atvr;                    // misses per vertex, 1 at best
+};
+
+struct VertexFetchStats {
+    uint64_t bytes_fetched;
+    float overfetch; // bytes fetched over the size of the referenced vertices, 1 at best
+};
+
+// Simulates a post-transform vertex cache of the given size over the triangle
+// list
+VertexCacheStats analyze_vertex_cache(
+    uint32_t const *indices, size_t const index_count, size_t const vertex_count,
+    uint32_t const cache_size, CacheModel const model);
+
+// Simulates vertex fetch through a small direct-mapped cache of 64 byte lines,
+// with vertices laid out contiguously vertex_size bytes apart
+VertexFetchStats analyze_vertex_fetch(
+    uint32_t const *indices, size_t const index_count, size_t const vertex_count,
+    size_t const vertex_size);
+
+// Reorders triangles for the post-transform cache with Tom Forsyth's linear
+// speed vertex cache optimization. destination may not alias indices.
+void optimize_vertex_cache(
+    uint32_t *destination, uint32_t const *indices, size_t const index_count,
+    size_t const vertex_count);
+
+// Reorders clusters of a cache optimized triangle list so that triangles
+// facing outwards come first, reducing overdraw (Sander et al., "Fast
+// Triangle Reordering for Vertex Locality and Reduced Overdraw"). Clusters
+// are split where the cache is cold anyway, and further as long as their ACMR
+// stays within threshold times the ACMR of the unsplit cluster.
+// destination may not alias indices.
+void optimize_overdraw(
+    uint32_t *destination, uint32_t const *indices, size_t const index_count,
+    float const *positions, size_t const position_stride,
+    size_t const vertex_count, float const threshold);
+
+// Builds a remap table that orders vertices by first use in the index
+// buffer. Unused vertices are mapped to ~0u. Returns the new vertex count.
+size_t optimize_vertex_fetch_remap(
+    uint32_t *remap, uint32_t const *indices, size_t const index_count,
+    size_t const vertex_count);
+
+// Runs all of the above on every submesh, splits them into meshlets (see
+// build_meshlets()), then reorders the vertices of the whole mesh into fetch
+// order
+void optimize_mesh(MeshData &mesh);
+
+} // namespace assets
@@ -0,0 +1,373 @@
+#include <mesh_simplifier.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+
+#include <mesh_optimizer.h>
+#include <mesh_welding.h>
+
+namespace {
+// Border planes count this many times as much as the triangles' own, so that
+// open edges only move along themselves
+constexpr double BORDER_WEIGHT = 10.0;
+// Collapses that turn a triangle's normal by more than about 78 degrees are
+// skipped, which also catches flips
+constexpr float MIN_NORMAL_DOT = 0.2f;
+// The chain stops before levels with fewer triangles than this
+constexpr size_t MIN_LOD_TRIANGLES = 32;
+// or when a level keeps more than this much of the one before
+constexpr float MAX_LOD_REDUCTION = 0.85f;
+
+// Symmetric 4x4 matrix of the squared distance to a set of planes, so that
+// the error of a point p is p^T A p + 2 b^T p + c
+struct Quadric {
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c;
+
+    void add_plane(glm::dvec3 const &n, double const d, double const weight) {
+        a00 += weight * n.x * n.x;
+        a01 += weight * n.x * n.y;
+        a02 += weight * n.x * n.z;
+        a11 += weight * n.y * n.y;
+        a12 += weight * n.y * n.z;
+        a22 += weight * n.z * n.z;
+        b0 += weight * n.x * d;
+        b1 += weight * n.y * d;
+        b2 += weight * n.z * d;
+        c += weight * d * d;
+    }
+
+    void add(Quadric const &other) {
+        a00 += other.a00;
+        a01 += other.a01;
+        a02 += other.a02;
+        a11 += other.a11;
+        a12 += other.a12;
+        a22 += other.a22;
+        b0 += other.b0;
+        b1 += other.b1;
+        b2 += other.b2;
+        c += other.c;
+    }
+
+    // Rounding may take it slightly below zero
+    double error(glm::vec3 const &p) const {
+        double const x = p.x, y = p.y, z = p.z;
+        double const e = a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z
+            + a11 * y * y + 2.0 * a12 * y * z + a22 * z * z
+            + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+        return std::max(e, 0.0);
+    }
+};
+
+struct Collapse {
+    double cost;
+    uint32_t from;
+    uint32_t to;
+    // Versions of both vertices when the cost was computed, the collapse is
+    // stale once either changed
+    uint32_t from_version;
+    uint32_t to_version;
+
+    bool operator>(Collapse const &other) const { return cost > other.cost; }
+};
+
+uint64_t edge_key(uint32_t const a, uint32_t const b) {
+    return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+}
+} // namespace
+
+namespace assets {
+
+size_t simplify(
+    uint32_t *destination, uint32_t const *indices, size_t const index_count,
+    VertexFull const *vertices, size_t const vertex_count,
+    size_t const target_index_count, float const max_error, float &out_error
+) {
+    out_error = 0.0f;
+    size_t const triangle_count = index_count / 3;
+
+    // Corners of every triangle, as vertices and as welded positions
+    std::vector<uint32_t> corners(indices, indices + triangle_count * 3);
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> const welded = weld_positions(vertices, vertex_count, &positions);
+    size_t const welded_count = positions.size();
+    std::vector<uint32_t> welded_corners(triangle_count * 3);
+    for (size_t i = 0; i < triangle_count * 3; i++) {
+        welded_corners[i] = welded[corners[i]];
+    }
+
+    // The vertices used at each welded position, flattened
+    std::vector<uint32_t> copy_offsets(welded_count + 1, 0);
+    std::vector<uint8_t> used(vertex_count, 0);
+    for (uint32_t const corner : corners) {
+        if (!used[corner]) {
+            used[corner] = 1;
+            copy_offsets[welded[corner] + 1]++;
+        }
+    }
+    for (size_t w = 0; w < welded_count; w++) {
+        copy_offsets[w + 1] += copy_offsets[w];
+    }
+    std::vector<uint32_t> copies(copy_offsets[welded_count]);
+    {
+        std::vector<uint32_t> fill(copy_offsets.begin(), copy_offsets.end() - 1);
+        for (size_t v = 0; v < vertex_count; v++) {
+            if (used[v]) {
+                copies[fill[welded[v]]++] = (uint32_t)v;
+            }
+        }
+    }
+
+    // Triangles that are degenerate once welded cover no area, they are
+    // dropped right away
+    std::vector<uint8_t> triangle_alive(triangle_count, 1);
+    size_t live_triangles = 0;
+    std::vector<std::vector<uint32_t>> vertex_triangles(welded_count);
+    std::vector<Quadric> quadrics(welded_count, Quadric{});
+    std::unordered_map<uint64_t, uint32_t> edge_uses;
+    for (size_t t = 0; t < triangle_count; t++) {
+        uint32_t const *const w = &welded_corners[t * 3];
+        if (w[0] == w[1] || w[1] == w[2] || w[2] == w[0]) {
+            triangle_alive[t] = 0;
+            continue;
+        }
+        live_triangles++;
+
+        glm::dvec3 const p0 = positions[w[0]];
+        glm::dvec3 const normal =
+            glm::cross(glm::dvec3(positions[w[1]]) - p0, glm::dvec3(positions[w[2]]) - p0);
+        double const length = glm::length(normal);
+        glm::dvec3 const n = length > 0.0 ? normal / length : glm::dvec3(0.0);
+        for (int k = 0; k < 3; k++) {
+            quadrics[w[k]].add_plane(n, -glm::dot(n, p0), 1.0);
+            vertex_triangles[w[k]].push_back((uint32_t)t);
+            edge_uses[edge_key(w[k], w[(k + 1) % 3])]++;
+        }
+    }
+
+    // Edges used by a single triangle are open borders, a plane through each
+    // and perpendicular to its triangle keeps them from moving inwards
+    for (size_t t = 0; t < triangle_count; t++) {
+        if (!triangle_alive[t]) {
+            continue;
+        }
+        uint32_t const *const w = &welded_corners[t * 3];
+        glm::dvec3 const p0 = positions[w[0]];
+        glm::dvec3 const normal =
+            glm::cross(glm::dvec3(positions[w[1]]) - p0, glm::dvec3(positions[w[2]]) - p0);
+        for (int k = 0; k < 3; k++) {
+            uint32_t const a = w[k];
+            uint32_t const b = w[(k + 1) % 3];
+            if (edge_uses[edge_key(a, b)] != 1) {
+                continue;
+            }
+            glm::dvec3 const pa = positions[a];
+            glm::dvec3 const border = glm::cross(glm::dvec3(positions[b]) - pa, normal);
+            double const length = glm::length(border);
+            if (length > 0.0) {
+                glm::dvec3 const n = border / length;
+                quadrics[a].add_plane(n, -glm::dot(n, pa), BORDER_WEIGHT);
+                quadrics[b].add_plane(n, -glm::dot(n, pa), BORDER_WEIGHT);
+            }
+        }
+    }
+
+    std::vector<uint8_t> vertex_alive(welded_count, 1);
+    std::vector<uint32_t> versions(welded_count, 0);
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+
+    // Collapses the cheaper way around, the merged quadric measured at the
+    // position the edge collapses to
+    auto const push_edge = [&](uint32_t const a, uint32_t const b) {
+        Quadric merged = quadrics[a];
+        merged.add(quadrics[b]);
+        double const a_to_b = merged.error(positions[b]);
+        double const b_to_a = merged.error(positions[a]);
+        if (a_to_b <= b_to_a) {
+            queue.push({a_to_b, a, b, versions[a], versions[b]});
+        } else {
+            queue.push({b_to_a, b, a, versions[b], versions[a]});
+        }
+    };
+    for (size_t t = 0; t < triangle_count; t++) {
+        if (triangle_alive[t]) {
+            uint32_t const *const w = &welded_corners[t * 3];
+            for (int k = 0; k < 3; k++) {
+                // Interior edges are shared by two triangles, push them once
+                uint32_t const a = w[k];
+                uint32_t const b = w[(k + 1) % 3];
+                if (a < b || edge_uses[edge_key(a, b)] == 1) {
+                    push_edge(a, b);
+                }
+            }
+        }
+    }
+
+    // The copy at a welded position closest in normal and UV to a vertex
+    auto const closest_copy = [&](uint32_t const target, uint32_t const vertex) {
+        VertexFull const &from = vertices[vertex];
+        uint32_t best = copies[copy_offsets[target]];
+        float best_distance = std::numeric_limits<float>::max();
+        for (uint32_t i = copy_offsets[target]; i < copy_offsets[target + 1]; i++) {
+            VertexFull const &to = vertices[copies[i]];
+            float distance = 0.0f;
+            for (int k = 0; k < 3; k++) {
+                distance += (to.normal[k] - from.normal[k]) * (to.normal[k] - from.normal[k]);
+            }
+            for (int k = 0; k < 2; k++) {
+                distance += (to.uv[k] - from.uv[k]) * (to.uv[k] - from.uv[k]);
+            }
+            if (distance < best_distance) {
+                best_distance = distance;
+                best = copies[i];
+            }
+        }
+        return best;
+    };
+
+    double const max_cost = (double)max_error * max_error;
+    double max_collapse_cost = 0.0;
+    // Collapse after which each vertex's edge to the merged one was pushed
+    std::vector<uint32_t> pushed(welded_count, ~0u);
+    uint32_t collapse_count = 0;
+    while (live_triangles * 3 > target_index_count && !queue.empty()) {
+        Collapse const collapse = queue.top();
+        queue.pop();
+        uint32_t const from = collapse.from;
+        uint32_t const to = collapse.to;
+        if (!vertex_alive[from] || !vertex_alive[to]
+            || versions[from] != collapse.from_version
+            || versions[to] != collapse.to_version) {
+            continue;
+        }
+        if (collapse.cost > max_cost) {
+            break;
+        }
+
+        // Triangles around from that survive must keep facing the same way
+        bool flips = false;
+        for (uint32_t const t : vertex_triangles[from]) {
+            uint32_t const *const w = &welded_corners[t * 3];
+            if (!triangle_alive[t] || w[0] == to || w[1] == to || w[2] == to) {
+                continue;
+            }
+            glm::vec3 before[3], after[3];
+            for (int k = 0; k < 3; k++) {
+                before[k] = positions[w[k]];
+                after[k] = w[k] == from ? positions[to] : before[k];
+            }
+            glm::vec3 const n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+            glm::vec3 const n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+            float const lengths = glm::length(n0) * glm::length(n1);
+            if (!(glm::dot(n0, n1) > MIN_NORMAL_DOT * lengths)) {
+                flips = true;
+                break;
+            }
+        }
+        if (flips) {
+            continue;
+        }
+
+        // Triangles on the edge vanish, the others move their corner over
+        for (uint32_t const t : vertex_triangles[from]) {
+            uint32_t *const w = &welded_corners[t * 3];
+            if (!triangle_alive[t]) {
+                continue;
+            }
+            if (w[0] == to || w[1] == to || w[2] == to) {
+                triangle_alive[t] = 0;
+                live_triangles--;
+                continue;
+            }
+            for (int k = 0; k < 3; k++) {
+                if (w[k] == from) {
+                    w[k] = to;
+                    corners[t * 3 + k] = closest_copy(to, corners[t * 3 + k]);
+                }
+            }
+            vertex_triangles[to].push_back(t);
+        }
+        quadrics[to].add(quadrics[from]);
+        vertex_alive[from] = 0;
+        vertex_triangles[from].clear();
+        versions[to]++;
+        max_collapse_cost = std::max(max_collapse_cost, collapse.cost);
+        collapse_count++;
+
+        std::vector<uint32_t> &around = vertex_triangles[to];
+        around.erase(
+            std::remove_if(around.begin(), around.end(),
+                [&](uint32_t const t) { return !triangle_alive[t]; }),
+            around.end());
+
+        // Only edges touching the merged vertex changed cost
+        for (uint32_t const t : around) {
+            for (int k = 0; k < 3; k++) {
+                uint32_t const w = welded_corners[t * 3 + k];
+                if (w != to && pushed[w] != collapse_count) {
+                    push_edge(to, w);
+                    pushed[w] = collapse_count;
+                }
+            }
+        }
+    }
+
+    size_t count = 0;
+    for (size_t t = 0; t < triangle_count; t++) {
+        if (triangle_alive[t]) {
+            destination[count++] = corners[t * 3 + 0];
+            destination[count++] = corners[t * 3 + 1];
+            destination[count++] = corners[t * 3 + 2];
+        }
+    }
+    out_error = (float)std::sqrt(max_collapse_cost);
+    return count;
+}
+
+void build_lod_chain(MeshData &mesh) {
+    // The chain always starts from the full detail level
+    if (!mesh.lods.empty()) {
+        mesh.indices.resize(mesh.lods[0].index_count);
+        mesh.lods.clear();
+    }
+    mesh.lods.push_back({0, (uint32_t)mesh.indices.size(), 0.0f, 0});
+
+    std::vector<uint32_t> simplified;
+    std::vector<uint32_t> optimized;
+    while (mesh.lods.size() < MAX_MESH_LODS) {
+        MeshLod const previous = mesh.lods.back();
+        size_t const target_index_count = previous.index_count / 6 * 3;
+        if (target_index_count < MIN_LOD_TRIANGLES * 3) {
+            break;
+        }
+
+        // Each level simplifies the one before, so their errors add up
+        float error = 0.0f;
+        simplified.resize(previous.index_count);
+        size_t const index_count = simplify(
+            simplified.data(), mesh.indices.data() + previous.first_index,
+            previous.index_count, mesh.vertices.data(), mesh.vertices.size(),
+            target_index_count, std::numeric_limits<float>::max(), error);
+        if (index_count > previous.index_count * MAX_LOD_REDUCTION) {
+            break;
+        }
+
+        optimized.resize(index_count);
+        optimize_vertex_cache(
+            optimized.data(), simplified.data(), index_count, mesh.vertices.size());
+
+        MeshLod lod = {};
+        lod.first_index = (uint32_t)mesh.indices.size();
+        lod.index_count = (uint32_t)index_count;
+        lod.error = previous.error + error;
+        mesh.indices.insert(mesh.indices.end(), optimized.begin(), optimized.end());
+        mesh.lods.push_back(lod);
+    }
+}
+
+} // namespace assets
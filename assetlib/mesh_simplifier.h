@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <mesh_asset.h>
+
+namespace assets {
+
+// Levels of a LOD chain, the full detail one included
+constexpr uint32_t MAX_MESH_LODS = 8;
+
+// Simplifies a triangle list down to at most target_index_count indices with
+// edge collapses ordered by the quadric error metric (Garland and Heckbert,
+// "Surface Simplification Using Quadric Error Metrics"). A vertex is only
+// ever collapsed onto a neighbor, so the result indexes the same vertices.
+//
+// Vertices at the same position collapse together, and a triangle corner
+// moves to the copy whose normal and UV are closest to its old ones. Open
+// borders are held in place by planes along them, and collapses that would
+// flip a triangle are skipped. Stops early when no collapse is left or the
+// next would move the surface by more than max_error.
+//
+// Returns the new index count. out_error gets the largest distance a moved
+// vertex may have ended up from the planes of the original triangles around
+// it, the root of its quadric error, in the units of the positions.
+// destination may alias indices.
+size_t simplify(
+    uint32_t *destination, uint32_t const *indices, size_t const index_count,
+    VertexFull const *vertices, size_t const vertex_count,
+    size_t const target_index_count, float const max_error, float &out_error);
+
+// Replaces mesh.lods with a chain of up to MAX_MESH_LODS levels. The first
+// covers the indices already there, each following one halves the triangles
+// of the one before, with simplify(), and is appended to mesh.indices after
+// a vertex cache optimization. The chain ends early once simplification
+// stalls or the levels get too small to be worth a draw of their own.
+void build_lod_chain(MeshData &mesh);
+
+} // namespace assets
@@ -0,0 +1,38 @@
+#include <mesh_welding.h>
+
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+struct PositionHash {
+    size_t operator()(glm::vec3 const &p) const {
+        // -0 equals 0, so it must hash like it
+        glm::vec3 const zeroed = p + 0.0f;
+        uint32_t bits[3];
+        std::memcpy(bits, &zeroed, sizeof(bits));
+        return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+    }
+};
+} // namespace
+
+namespace assets {
+
+std::vector<uint32_t> weld_positions(
+    VertexFull const *vertices, size_t const vertex_count,
+    std::vector<glm::vec3> *out_positions
+) {
+    std::unordered_map<glm::vec3, uint32_t, PositionHash> ids;
+    ids.reserve(vertex_count);
+    std::vector<uint32_t> welded(vertex_count);
+    for (size_t v = 0; v < vertex_count; v++) {
+        glm::vec3 const position = position_of(vertices[v]);
+        auto const inserted = ids.emplace(position, (uint32_t)ids.size());
+        if (inserted.second && out_positions) {
+            out_positions->push_back(position);
+        }
+        welded[v] = inserted.first->second;
+    }
+    return welded;
+}
+
+} // namespace assets
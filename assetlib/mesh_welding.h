@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <mesh_asset.h>
+
+// Internal to assetlib, shared by the mesh processing that needs to see
+// through seams
+namespace assets {
+
+inline glm::vec3 position_of(VertexFull const &vertex) {
+    return glm::vec3(vertex.position[0], vertex.position[1], vertex.position[2]);
+}
+
+// Same id for every vertex at the same position, so that the copies on both
+// sides of a normal or UV seam are treated as one. Ids are given in the order
+// positions first appear, and appended to out_positions if given.
+std::vector<uint32_t> weld_positions(
+    VertexFull const *vertices, size_t const vertex_count,
+    std::vector<glm::vec3> *out_positions = nullptr);
+
+} // namespace assets
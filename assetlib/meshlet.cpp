@@ -0,0 +1,482 @@
+#include <meshlet.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <glm/gtc/matrix_inverse.hpp>
+#include <mesh_welding.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MESHLET_CULL_SSE2 1
+#endif
+
+namespace {
+// Narrower normal cones than this can't be backfacing from anywhere useful,
+// the cone test is disabled for them
+constexpr float MIN_CONE_DOT = 0.1f;
+// Never passes, dot(v, axis) <= length(v) for a unit axis
+constexpr float DISABLED_CONE_CUTOFF = 2.0f;
+
+// Zero for degenerate triangles
+glm::vec3 triangle_normal(assets::VertexFull const *vertices, uint32_t const *triangle) {
+    glm::vec3 const a = position_of(vertices[triangle[0]]);
+    glm::vec3 const n = glm::cross(
+        position_of(vertices[triangle[1]]) - a, position_of(vertices[triangle[2]]) - a);
+    float const length = glm::length(n);
+    return length > 0.0f ? n / length : glm::vec3(0.0f);
+}
+
+// Bounding sphere around the center of the bounding box, and the normal cone
+// as in meshoptimizer's meshopt_computeClusterBounds
+void compute_bounds(
+    assets::Meshlet &meshlet, uint32_t const *indices, assets::VertexFull const *vertices
+) {
+    uint32_t const index_count = meshlet.triangle_count * 3;
+
+    glm::vec3 bounds_min(std::numeric_limits<float>::max());
+    glm::vec3 bounds_max(std::numeric_limits<float>::lowest());
+    for (uint32_t i = 0; i < index_count; i++) {
+        glm::vec3 const position = position_of(vertices[indices[i]]);
+        bounds_min = glm::min(bounds_min, position);
+        bounds_max = glm::max(bounds_max, position);
+    }
+    glm::vec3 const center = (bounds_min + bounds_max) * 0.5f;
+    float radius = 0.0f;
+    for (uint32_t i = 0; i < index_count; i++) {
+        radius = std::max(radius, glm::length(position_of(vertices[indices[i]]) - center));
+    }
+
+    glm::vec3 normal_sum(0.0f);
+    for (uint32_t t = 0; t < meshlet.triangle_count; t++) {
+        normal_sum += triangle_normal(vertices, indices + t * 3);
+    }
+    float const normal_length = glm::length(normal_sum);
+    glm::vec3 const axis = normal_length > 0.0f ? normal_sum / normal_length : glm::vec3(0.0f);
+
+    // The cone must hold the normal furthest from the axis
+    float min_dot = 1.0f;
+    for (uint32_t t = 0; t < meshlet.triangle_count; t++) {
+        glm::vec3 const normal = triangle_normal(vertices, indices + t * 3);
+        if (normal != glm::vec3(0.0f)) {
+            min_dot = std::min(min_dot, glm::dot(axis, normal));
+        }
+    }
+
+    for (int i = 0; i < 3; i++) {
+        meshlet.center[i] = center[i];
+        meshlet.cone_axis[i] = axis[i];
+        meshlet.cone_apex[i] = center[i];
+    }
+    meshlet.radius = radius;
+
+    if (normal_length == 0.0f || min_dot <= MIN_CONE_DOT) {
+        meshlet.cone_cutoff = DISABLED_CONE_CUTOFF;
+        return;
+    }
+
+    // Moves the apex back along the axis until every triangle's plane is in
+    // front of it, so that the cone test holds for points anywhere in the
+    // meshlet rather than only at its center
+    float max_t = 0.0f;
+    for (uint32_t t = 0; t < meshlet.triangle_count; t++) {
+        glm::vec3 const normal = triangle_normal(vertices, indices + t * 3);
+        float const along_axis = glm::dot(axis, normal);
+        if (along_axis > 0.0f) {
+            glm::vec3 const p0 = position_of(vertices[indices[t * 3]]);
+            max_t = std::max(max_t, glm::dot(center - p0, normal) / along_axis);
+        }
+    }
+    glm::vec3 const apex = center - axis * max_t;
+    for (int i = 0; i < 3; i++) {
+        meshlet.cone_apex[i] = apex[i];
+    }
+    meshlet.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+}
+
+// Scratch shared by the submeshes of one mesh
+struct MeshletBuilder {
+    assets::MeshData &mesh;
+    std::vector<uint32_t> welded;
+    // Meshlet each vertex was last added to
+    std::vector<uint32_t> vertex_meshlet;
+
+    // Per submesh: the triangles around each welded vertex, flattened
+    std::vector<uint32_t> adjacency_offsets;
+    std::vector<uint32_t> adjacency;
+    std::vector<glm::vec3> normals;
+    std::vector<uint8_t> emitted;
+    // Meshlet each triangle was last made a candidate of
+    std::vector<uint32_t> candidate_meshlet;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> reordered;
+
+    explicit MeshletBuilder(assets::MeshData &mesh)
+        : mesh(mesh), welded(weld_positions(mesh.vertices.data(), mesh.vertices.size())),
+          vertex_meshlet(mesh.vertices.size(), ~0u) {}
+
+    uint32_t new_vertices(uint32_t const *triangle, uint32_t const meshlet) const {
+        return (vertex_meshlet[triangle[0]] != meshlet) + (vertex_meshlet[triangle[1]] != meshlet)
+            + (vertex_meshlet[triangle[2]] != meshlet);
+    }
+
+    void build_adjacency(uint32_t const *indices, uint32_t const triangle_count) {
+        adjacency_offsets.assign(mesh.vertices.size() + 1, 0);
+        for (uint32_t i = 0; i < triangle_count * 3; i++) {
+            adjacency_offsets[welded[indices[i]] + 1]++;
+        }
+        for (size_t v = 1; v < adjacency_offsets.size(); v++) {
+            adjacency_offsets[v] += adjacency_offsets[v - 1];
+        }
+
+        adjacency.resize(triangle_count * 3);
+        std::vector<uint32_t> cursor(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+        for (uint32_t i = 0; i < triangle_count * 3; i++) {
+            adjacency[cursor[welded[indices[i]]]++] = i / 3;
+        }
+    }
+
+    void build_submesh(assets::Submesh const &submesh) {
+        uint32_t *indices = mesh.indices.data() + submesh.first_index;
+        uint32_t const triangle_count = submesh.index_count / 3;
+        if (triangle_count == 0) {
+            return;
+        }
+
+        build_adjacency(indices, triangle_count);
+        normals.resize(triangle_count);
+        for (uint32_t t = 0; t < triangle_count; t++) {
+            normals[t] = triangle_normal(mesh.vertices.data(), indices + t * 3);
+        }
+        emitted.assign(triangle_count, 0);
+        candidate_meshlet.assign(triangle_count, ~0u);
+        reordered.clear();
+        reordered.reserve(triangle_count * 3);
+        size_t const first_meshlet = mesh.meshlets.size();
+
+        uint32_t next_unemitted = 0;
+        while (reordered.size() < triangle_count * 3) {
+            uint32_t const meshlet_id = (uint32_t)mesh.meshlets.size();
+            assets::Meshlet meshlet = {};
+            meshlet.first_index = submesh.first_index + (uint32_t)reordered.size();
+            glm::vec3 normal_sum(0.0f);
+            candidates.clear();
+
+            while (emitted[next_unemitted]) {
+                next_unemitted++;
+            }
+            uint32_t triangle = next_unemitted;
+
+            while (true) {
+                uint32_t const *corners = indices + triangle * 3;
+                meshlet.vertex_count += new_vertices(corners, meshlet_id);
+                meshlet.triangle_count++;
+                normal_sum += normals[triangle];
+                emitted[triangle] = 1;
+
+                for (int k = 0; k < 3; k++) {
+                    reordered.push_back(corners[k]);
+                    vertex_meshlet[corners[k]] = meshlet_id;
+
+                    uint32_t const welded_vertex = welded[corners[k]];
+                    for (uint32_t a = adjacency_offsets[welded_vertex];
+                         a < adjacency_offsets[welded_vertex + 1]; a++) {
+                        uint32_t const neighbor = adjacency[a];
+                        if (!emitted[neighbor] && candidate_meshlet[neighbor] != meshlet_id) {
+                            candidate_meshlet[neighbor] = meshlet_id;
+                            candidates.push_back(neighbor);
+                        }
+                    }
+                }
+
+                if (meshlet.triangle_count == assets::MESHLET_MAX_TRIANGLES) {
+                    break;
+                }
+                triangle = pick_next(indices, meshlet, meshlet_id, normal_sum);
+                if (triangle == ~0u) {
+                    // Nothing left nearby, fall back to index order
+                    while (next_unemitted < triangle_count && emitted[next_unemitted]) {
+                        next_unemitted++;
+                    }
+                    if (next_unemitted == triangle_count
+                        || meshlet.vertex_count + new_vertices(indices + next_unemitted * 3, meshlet_id)
+                               > assets::MESHLET_MAX_VERTICES) {
+                        break;
+                    }
+                    triangle = next_unemitted;
+                }
+            }
+
+            mesh.meshlets.push_back(meshlet);
+        }
+
+        std::copy(reordered.begin(), reordered.end(), indices);
+        for (size_t m = first_meshlet; m < mesh.meshlets.size(); m++) {
+            assets::Meshlet &meshlet = mesh.meshlets[m];
+            compute_bounds(meshlet, mesh.indices.data() + meshlet.first_index, mesh.vertices.data());
+        }
+    }
+
+    // Candidate adding the fewest vertices, then the one facing most like the
+    // meshlet. Drops candidates that are taken or can no longer fit.
+    uint32_t pick_next(
+        uint32_t const *indices, assets::Meshlet const &meshlet, uint32_t const meshlet_id,
+        glm::vec3 const &normal_sum
+    ) {
+        uint32_t best = ~0u;
+        uint32_t best_new_vertices = 4;
+        float best_dot = std::numeric_limits<float>::lowest();
+        for (size_t c = 0; c < candidates.size();) {
+            uint32_t const candidate = candidates[c];
+            uint32_t const added = new_vertices(indices + candidate * 3, meshlet_id);
+            if (emitted[candidate] || meshlet.vertex_count + added > assets::MESHLET_MAX_VERTICES) {
+                candidates[c] = candidates.back();
+                candidates.pop_back();
+                continue;
+            }
+
+            float const dot = glm::dot(normals[candidate], normal_sum);
+            if (added < best_new_vertices || (added == best_new_vertices && dot > best_dot)) {
+                best = candidate;
+                best_new_vertices = added;
+                best_dot = dot;
+            }
+            c++;
+        }
+        return best;
+    }
+};
+
+glm::vec4 matrix_row(glm::mat4 const &m, int const row) {
+    return glm::vec4(m[0][row], m[1][row], m[2][row], m[3][row]);
+}
+
+glm::vec4 normalize_plane(glm::vec4 const &plane) {
+    return plane / glm::length(glm::vec3(plane));
+}
+
+void pad_to_width(std::vector<float> &values, float const padding) {
+    values.resize(
+        (values.size() + assets::MESHLET_CULL_WIDTH - 1) / assets::MESHLET_CULL_WIDTH
+            * assets::MESHLET_CULL_WIDTH,
+        padding);
+}
+} // namespace
+
+namespace assets {
+
+void build_meshlets(MeshData &mesh) {
+    mesh.meshlets.clear();
+    if (mesh.vertices.empty() || mesh.indices.empty()) {
+        return;
+    }
+
+    MeshletBuilder builder(mesh);
+    for (Submesh const &submesh : mesh.submeshes) {
+        builder.build_submesh(submesh);
+    }
+}
+
+void extract_frustum_planes(glm::mat4 const &viewproj, glm::vec4 out_planes[6]) {
+    // A point is inside if -w <= x <= w, -w <= y <= w and 0 <= z <= w in clip
+    // space, each of which is a plane in world space
+    glm::vec4 const x = matrix_row(viewproj, 0);
+    glm::vec4 const y = matrix_row(viewproj, 1);
+    glm::vec4 const z = matrix_row(viewproj, 2);
+    glm::vec4 const w = matrix_row(viewproj, 3);
+    out_planes[0] = normalize_plane(w + x); // left
+    out_planes[1] = normalize_plane(w - x); // right
+    out_planes[2] = normalize_plane(w + y); // top, y points down
+    out_planes[3] = normalize_plane(w - y); // bottom
+    out_planes[4] = normalize_plane(z);     // near
+    out_planes[5] = normalize_plane(w - z); // far
+}
+
+void to_object_space(
+    glm::mat4 const &transform, glm::vec4 const planes[6], glm::vec3 const &camera,
+    glm::vec4 out_planes[6], glm::vec3 &out_camera
+) {
+    // A world space plane p becomes p * transform. Renormalizing it takes the
+    // scale out, leaving distances in object units like the meshlets' radii.
+    for (int p = 0; p < 6; p++) {
+        out_planes[p] = normalize_plane(planes[p] * transform);
+    }
+    out_camera = glm::vec3(glm::affineInverse(transform) * glm::vec4(camera, 1.0f));
+}
+
+void build_meshlet_cull_data(
+    Meshlet const *meshlets, size_t const count, MeshletCullData &out_data
+) {
+    out_data = {};
+    out_data.count = (uint32_t)count;
+    for (size_t i = 0; i < count; i++) {
+        Meshlet const &meshlet = meshlets[i];
+        out_data.center_x.push_back(meshlet.center[0]);
+        out_data.center_y.push_back(meshlet.center[1]);
+        out_data.center_z.push_back(meshlet.center[2]);
+        out_data.radius.push_back(meshlet.radius);
+        out_data.apex_x.push_back(meshlet.cone_apex[0]);
+        out_data.apex_y.push_back(meshlet.cone_apex[1]);
+        out_data.apex_z.push_back(meshlet.cone_apex[2]);
+        out_data.cutoff.push_back(meshlet.cone_cutoff);
+        out_data.axis_x.push_back(meshlet.cone_axis[0]);
+        out_data.axis_y.push_back(meshlet.cone_axis[1]);
+        out_data.axis_z.push_back(meshlet.cone_axis[2]);
+        out_data.triangle_count.push_back(meshlet.triangle_count);
+    }
+
+    // A sphere of radius -infinity is outside every plane
+    for (std::vector<float> *values :
+         {&out_data.center_x, &out_data.center_y, &out_data.center_z, &out_data.apex_x,
+          &out_data.apex_y, &out_data.apex_z, &out_data.axis_x, &out_data.axis_y,
+          &out_data.axis_z}) {
+        pad_to_width(*values, 0.0f);
+    }
+    pad_to_width(out_data.radius, -std::numeric_limits<float>::infinity());
+    pad_to_width(out_data.cutoff, DISABLED_CONE_CUTOFF);
+    out_data.triangle_count.resize(out_data.radius.size(), 0);
+}
+
+uint32_t cull_meshlets_scalar(
+    MeshletCullData const &data, glm::vec4 const planes[6], glm::vec3 const &camera,
+    float const slack, MeshletCullStats &stats, uint32_t *out_visible
+) {
+    uint32_t visible_count = 0;
+    for (uint32_t i = 0; i < data.count; i++) {
+        float const min_distance = -(data.radius[i] + slack);
+        bool inside = true;
+        for (int p = 0; p < 6; p++) {
+            float const distance = planes[p].x * data.center_x[i] + planes[p].y * data.center_y[i]
+                + planes[p].z * data.center_z[i] + planes[p].w;
+            inside = inside && distance > min_distance;
+        }
+
+        float const to_apex_x = data.apex_x[i] - camera.x;
+        float const to_apex_y = data.apex_y[i] - camera.y;
+        float const to_apex_z = data.apex_z[i] - camera.z;
+        float const along_axis = to_apex_x * data.axis_x[i] + to_apex_y * data.axis_y[i]
+            + to_apex_z * data.axis_z[i];
+        float const length = std::sqrt(
+            to_apex_x * to_apex_x + to_apex_y * to_apex_y + to_apex_z * to_apex_z);
+        bool const backfacing = along_axis > (data.cutoff[i] + slack) * length;
+
+        if (!inside) {
+            stats.frustum_culled_triangles += data.triangle_count[i];
+        } else if (backfacing) {
+            stats.backface_culled_triangles += data.triangle_count[i];
+        } else {
+            stats.visible_triangles += data.triangle_count[i];
+            if (out_visible) {
+                out_visible[visible_count] = i;
+            }
+            visible_count++;
+        }
+    }
+
+    stats.visible_meshlets += visible_count;
+    return visible_count;
+}
+
+#ifdef MESHLET_CULL_SSE2
+uint32_t cull_meshlets(
+    MeshletCullData const &data, glm::vec4 const planes[6], glm::vec3 const &camera,
+    float const slack, MeshletCullStats &stats, uint32_t *out_visible
+) {
+    __m128 plane_x[6], plane_y[6], plane_z[6], plane_w[6];
+    for (int p = 0; p < 6; p++) {
+        plane_x[p] = _mm_set1_ps(planes[p].x);
+        plane_y[p] = _mm_set1_ps(planes[p].y);
+        plane_z[p] = _mm_set1_ps(planes[p].z);
+        plane_w[p] = _mm_set1_ps(planes[p].w);
+    }
+    __m128 const camera_x = _mm_set1_ps(camera.x);
+    __m128 const camera_y = _mm_set1_ps(camera.y);
+    __m128 const camera_z = _mm_set1_ps(camera.z);
+    __m128 const slack4 = _mm_set1_ps(slack);
+    __m128 const sign_bit = _mm_set1_ps(-0.0f);
+
+    // Triangle counts are summed per lane with masks, and across lanes once
+    // at the end
+    __m128i visible_triangles = _mm_setzero_si128();
+    __m128i frustum_culled = _mm_setzero_si128();
+    __m128i backface_culled = _mm_setzero_si128();
+    uint32_t visible_count = 0;
+
+    for (uint32_t i = 0; i < data.count; i += MESHLET_CULL_WIDTH) {
+        __m128 const center_x = _mm_loadu_ps(&data.center_x[i]);
+        __m128 const center_y = _mm_loadu_ps(&data.center_y[i]);
+        __m128 const center_z = _mm_loadu_ps(&data.center_z[i]);
+        __m128 const min_distance =
+            _mm_xor_ps(_mm_add_ps(_mm_loadu_ps(&data.radius[i]), slack4), sign_bit);
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; p++) {
+            __m128 const distance = _mm_add_ps(
+                _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(plane_x[p], center_x), _mm_mul_ps(plane_y[p], center_y)),
+                    _mm_mul_ps(plane_z[p], center_z)),
+                plane_w[p]);
+            inside = _mm_and_ps(inside, _mm_cmpgt_ps(distance, min_distance));
+        }
+
+        __m128 const to_apex_x = _mm_sub_ps(_mm_loadu_ps(&data.apex_x[i]), camera_x);
+        __m128 const to_apex_y = _mm_sub_ps(_mm_loadu_ps(&data.apex_y[i]), camera_y);
+        __m128 const to_apex_z = _mm_sub_ps(_mm_loadu_ps(&data.apex_z[i]), camera_z);
+        __m128 const along_axis = _mm_add_ps(
+            _mm_add_ps(
+                _mm_mul_ps(to_apex_x, _mm_loadu_ps(&data.axis_x[i])),
+                _mm_mul_ps(to_apex_y, _mm_loadu_ps(&data.axis_y[i]))),
+            _mm_mul_ps(to_apex_z, _mm_loadu_ps(&data.axis_z[i])));
+        __m128 const length = _mm_sqrt_ps(_mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(to_apex_x, to_apex_x), _mm_mul_ps(to_apex_y, to_apex_y)),
+            _mm_mul_ps(to_apex_z, to_apex_z)));
+        __m128 const backfacing = _mm_cmpgt_ps(
+            along_axis, _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(&data.cutoff[i]), slack4), length));
+
+        __m128 const visible = _mm_andnot_ps(backfacing, inside);
+        __m128i const triangles = _mm_loadu_si128((__m128i const *)&data.triangle_count[i]);
+        visible_triangles = _mm_add_epi32(
+            visible_triangles, _mm_and_si128(triangles, _mm_castps_si128(visible)));
+        frustum_culled = _mm_add_epi32(
+            frustum_culled, _mm_andnot_si128(_mm_castps_si128(inside), triangles));
+        backface_culled = _mm_add_epi32(
+            backface_culled,
+            _mm_and_si128(triangles, _mm_castps_si128(_mm_and_ps(inside, backfacing))));
+
+        // Padding is never visible, so no lane past the count can be set
+        int mask = _mm_movemask_ps(visible);
+        while (mask) {
+            int lane = 0;
+            while (!(mask & (1 << lane))) {
+                lane++;
+            }
+            mask &= mask - 1;
+            if (out_visible) {
+                out_visible[visible_count] = i + (uint32_t)lane;
+            }
+            visible_count++;
+        }
+    }
+
+    uint32_t lanes[MESHLET_CULL_WIDTH];
+    _mm_storeu_si128((__m128i *)lanes, visible_triangles);
+    stats.visible_triangles += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm_storeu_si128((__m128i *)lanes, frustum_culled);
+    stats.frustum_culled_triangles += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm_storeu_si128((__m128i *)lanes, backface_culled);
+    stats.backface_culled_triangles += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+    stats.visible_meshlets += visible_count;
+    return visible_count;
+}
+#else
+uint32_t cull_meshlets(
+    MeshletCullData const &data, glm::vec4 const planes[6], glm::vec3 const &camera,
+    float const slack, MeshletCullStats &stats, uint32_t *out_visible
+) {
+    return cull_meshlets_scalar(data, planes, camera, slack, stats, out_visible);
+}
+#endif
+
+} // namespace assets
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <mesh_asset.h>
+
+namespace assets {
+
+// The sizes mesh shading hardware is usually tuned for. 124 triangles keep a
+// meshlet's primitive indices and their count within 128 * 3 bytes.
+constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// Splits every submesh into meshlets and reorders its triangles so that each
+// meshlet's are contiguous, then computes their bounds into mesh.meshlets.
+// A meshlet grows from a seed triangle over its neighbors, those sharing a
+// vertex position, preferring the one that adds the fewest vertices and then
+// the one facing most like the meshlet so far, which keeps the normal cones
+// narrow. When no neighbor fits, the next triangle in index order does.
+void build_meshlets(MeshData &mesh);
+
+// Planes of the frustum of a view projection matrix, normalized with normals
+// pointing inwards. The depth range is Vulkan's, 0 to w.
+void extract_frustum_planes(glm::mat4 const &viewproj, glm::vec4 out_planes[6]);
+
+// Moves frustum planes and a camera position into the space of an object
+// with the given transform, made of rotation, translation and uniform scale,
+// so that its meshlets can be culled without transforming each of them
+void to_object_space(
+    glm::mat4 const &transform, glm::vec4 const planes[6], glm::vec3 const &camera,
+    glm::vec4 out_planes[6], glm::vec3 &out_camera);
+
+// Meshlet bounds as a structure of arrays for culling MESHLET_CULL_WIDTH at a
+// time. The arrays are padded to a multiple of it with meshlets that are
+// always outside the frustum.
+constexpr uint32_t MESHLET_CULL_WIDTH = 4;
+
+struct MeshletCullData {
+    uint32_t count{0}; // without the padding
+    std::vector<float> center_x, center_y, center_z, radius;
+    std::vector<float> apex_x, apex_y, apex_z, cutoff;
+    std::vector<float> axis_x, axis_y, axis_z;
+    std::vector<uint32_t> triangle_count;
+};
+
+void build_meshlet_cull_data(
+    Meshlet const *meshlets, size_t const count, MeshletCullData &out_data);
+
+// Totals of one or more cull_meshlets() calls. A meshlet outside the frustum
+// counts as frustum culled even if it also faces away.
+struct MeshletCullStats {
+    uint32_t visible_meshlets;
+    uint32_t visible_triangles;
+    uint32_t frustum_culled_triangles;
+    uint32_t backface_culled_triangles;
+};
+
+// Tests each meshlet's sphere against the frustum planes (normalized, normals
+// pointing inwards), then the normal cone of those inside against the camera
+// position, all in the space the meshlets are in. Adds the results to
+// stats and writes the index of each visible meshlet to out_visible, if it
+// isn't null, in order. Returns the number of visible meshlets.
+//
+// A positive slack keeps meshlets that fail a test by less than it: spheres
+// that far outside a plane, in the planes' units, and cones within that much
+// of their cutoff. A negative one culls those that pass by less. Culling with
+// both brackets a result computed with different rounding, e.g. on the GPU.
+uint32_t cull_meshlets(
+    MeshletCullData const &data, glm::vec4 const planes[6], glm::vec3 const &camera,
+    float const slack, MeshletCullStats &stats, uint32_t *out_visible = nullptr);
+
+// Same tests one meshlet at a time, with the same rounding as cull_meshlets().
+// The fallback where SSE2 isn't available.
+uint32_t cull_meshlets_scalar(
+    MeshletCullData const &data, glm::vec4 const planes[6], glm::vec3 const &camera,
+    float const slack, MeshletCullStats &stats, uint32_t *out_visible = nullptr);
+
+} // namespace assets
@@ -0,0 +1,118 @@
+#include <obj_importer.h>
+
+#include <tiny_obj_loader.h>
+
+#include <unordered_map>
+
+namespace {
+// Identifies a vertex by the OBJ attributes it was built from
+struct ObjVertexKey {
+    int position;
+    int normal;
+    int uv;
+
+    bool operator==(ObjVertexKey const &other) const {
+        return position == other.position && normal == other.normal && uv == other.uv;
+    }
+};
+
+struct ObjVertexKeyHash {
+    size_t operator()(ObjVertexKey const &key) const {
+        size_t seed = std::hash<int>{}(key.position);
+        seed ^= std::hash<int>{}(key.normal) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        seed ^= std::hash<int>{}(key.uv) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        return seed;
+    }
+};
+} // namespace
+
+namespace assets {
+
+bool load_obj(char const *filepath, MeshData &out_mesh, std::string &out_error) {
+    std::string const path = filepath;
+    size_t const slash = path.find_last_of("/\\");
+    std::string const base_dir = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn;
+    if (!tinyobj::LoadObj(
+            &attrib, &shapes, &materials, &warn, &out_error, filepath,
+            base_dir.c_str())) {
+        return false;
+    }
+
+    out_mesh = MeshData();
+    for (tinyobj::material_t const &material : materials) {
+        out_mesh.materials.push_back(material.name);
+    }
+    // Faces without a material (id -1) go into an extra default material
+    uint32_t const default_material = (uint32_t)out_mesh.materials.size();
+
+    // Triangles are bucketed by material so each submesh is one index range
+    std::vector<std::vector<uint32_t>> material_indices(materials.size() + 1);
+    std::unordered_map<ObjVertexKey, uint32_t, ObjVertexKeyHash> unique_vertices;
+
+    for (tinyobj::shape_t const &shape : shapes) {
+        // LoadObj triangulates, so every face has 3 vertices
+        size_t const face_count = shape.mesh.num_face_vertices.size();
+        for (size_t f = 0; f < face_count; f++) {
+            int const material_id = shape.mesh.material_ids[f];
+            uint32_t const material =
+                material_id >= 0 ? (uint32_t)material_id : default_material;
+
+            for (size_t v = 0; v < 3; v++) {
+                tinyobj::index_t const idx = shape.mesh.indices[3 * f + v];
+                ObjVertexKey const key = {idx.vertex_index, idx.normal_index, idx.texcoord_index};
+
+                auto const found = unique_vertices.find(key);
+                if (found != unique_vertices.end()) {
+                    material_indices[material].push_back(found->second);
+                    continue;
+                }
+
+                VertexFull vertex = {};
+                vertex.position[0] = attrib.vertices[3 * idx.vertex_index + 0];
+                vertex.position[1] = attrib.vertices[3 * idx.vertex_index + 1];
+                vertex.position[2] = attrib.vertices[3 * idx.vertex_index + 2];
+                if (idx.normal_index >= 0) {
+                    vertex.normal[0] = attrib.normals[3 * idx.normal_index + 0];
+                    vertex.normal[1] = attrib.normals[3 * idx.normal_index + 1];
+                    vertex.normal[2] = attrib.normals[3 * idx.normal_index + 2];
+                }
+                if (idx.texcoord_index >= 0) {
+                    // OBJ has v pointing up, Vulkan samples with v pointing down
+                    vertex.uv[0] = attrib.texcoords[2 * idx.texcoord_index + 0];
+                    vertex.uv[1] = 1.0f - attrib.texcoords[2 * idx.texcoord_index + 1];
+                }
+
+                uint32_t const index = (uint32_t)out_mesh.vertices.size();
+                out_mesh.vertices.push_back(vertex);
+                unique_vertices.emplace(key, index);
+                material_indices[material].push_back(index);
+            }
+        }
+    }
+
+    for (uint32_t material = 0; material < material_indices.size(); material++) {
+        std::vector<uint32_t> const &indices = material_indices[material];
+        if (indices.empty()) {
+            continue;
+        }
+        if (material == default_material) {
+            out_mesh.materials.push_back("default");
+        }
+
+        Submesh submesh;
+        submesh.first_index = (uint32_t)out_mesh.indices.size();
+        submesh.index_count = (uint32_t)indices.size();
+        submesh.material = material;
+        out_mesh.submeshes.push_back(submesh);
+        out_mesh.indices.insert(out_mesh.indices.end(), indices.begin(), indices.end());
+    }
+
+    return true;
+}
+
+} // namespace assets
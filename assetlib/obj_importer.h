@@ -0,0 +1,12 @@
+#pragma once
+
+#include <mesh_asset.h>
+
+namespace assets {
+
+// Parses an OBJ file (and the MTL files next to it) into an indexed mesh.
+// Vertices sharing the same position, normal and uv indices are merged, and
+// triangles are grouped into one submesh per material.
+bool load_obj(char const *filepath, MeshData &out_mesh, std::string &out_error);
+
+} // namespace assets
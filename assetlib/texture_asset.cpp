@@ -0,0 +1,153 @@
+#include <texture_asset.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace {
+constexpr uint64_t SECTION_ALIGNMENT = 16;
+
+uint64_t align_up(uint64_t const offset) {
+    return (offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+}
+
+void write_padding(std::ofstream &file, uint64_t const target_offset) {
+    static char const zeros[SECTION_ALIGNMENT] = {};
+    uint64_t const offset = (uint64_t)file.tellp();
+    file.write(zeros, target_offset - offset);
+}
+} // namespace
+
+namespace assets {
+
+uint32_t texture_block_extent(TextureFormat const format) {
+    return format == TextureFormat::Rgba8 ? 1 : 4;
+}
+
+uint32_t texture_block_size(TextureFormat const format) {
+    switch (format) {
+    case TextureFormat::Rgba8:
+        return 4;
+    case TextureFormat::Bc1:
+        return 8;
+    case TextureFormat::Bc3:
+    case TextureFormat::Bc7:
+        return 16;
+    }
+    return 0;
+}
+
+uint64_t texture_image_size(
+    TextureFormat const format, uint32_t const width, uint32_t const height
+) {
+    uint32_t const extent = texture_block_extent(format);
+    uint64_t const blocks_x = (width + extent - 1) / extent;
+    uint64_t const blocks_y = (height + extent - 1) / extent;
+    return blocks_x * blocks_y * texture_block_size(format);
+}
+
+uint64_t hash_bytes(void const *data, size_t const size) {
+    uint64_t hash = 14695981039346656037ull;
+    auto const *bytes = (uint8_t const *)data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+bool read_texture_asset(void const *data, size_t const size, TextureAssetView &out_view) {
+    if (size < sizeof(TextureAssetHeader)) {
+        return false;
+    }
+
+    auto const *header = (TextureAssetHeader const *)data;
+    if (std::memcmp(header->magic, TEXTURE_ASSET_MAGIC, 4) != 0
+        || header->version != TEXTURE_ASSET_VERSION
+        || texture_block_size((TextureFormat)header->format) == 0
+        || header->width == 0 || header->height == 0 || header->mip_count == 0) {
+        return false;
+    }
+
+    // No more levels than the full chain down to 1x1
+    uint32_t chain_length = 1;
+    while ((std::max(header->width, header->height) >> chain_length) != 0) {
+        chain_length++;
+    }
+    if (header->mip_count > chain_length) {
+        return false;
+    }
+
+    // Every section must lie within the data
+    auto const in_bounds = [size](uint64_t const offset, uint64_t const bytes) {
+        return offset <= size && bytes <= size - offset;
+    };
+    uint64_t const mips_size = (uint64_t)header->mip_count * sizeof(TextureMip);
+    if (!in_bounds(header->mip_offset, mips_size)
+        || !in_bounds(header->texel_offset, header->texel_size)
+        || header->mip_offset % SECTION_ALIGNMENT != 0
+        || header->texel_offset % SECTION_ALIGNMENT != 0) {
+        return false;
+    }
+
+    // Every level must have the extent of its place in the chain, start on a
+    // block and hold exactly the texels of its extent
+    auto const *mips = (TextureMip const *)((char const *)data + header->mip_offset);
+    TextureFormat const format = (TextureFormat)header->format;
+    uint32_t const block_size = texture_block_size(format);
+    for (uint32_t i = 0; i < header->mip_count; i++) {
+        if (mips[i].width != std::max(header->width >> i, 1u)
+            || mips[i].height != std::max(header->height >> i, 1u)
+            || mips[i].offset % block_size != 0
+            || mips[i].size != texture_image_size(format, mips[i].width, mips[i].height)
+            || mips[i].offset > header->texel_size
+            || mips[i].size > header->texel_size - mips[i].offset) {
+            return false;
+        }
+    }
+
+    out_view.header = header;
+    out_view.mips = mips;
+    out_view.texels = (uint8_t const *)data + header->texel_offset;
+    return true;
+}
+
+bool write_texture_asset(
+    char const *filepath, TextureData const &texture, uint64_t const source_hash
+) {
+    if (texture.mips.empty()) {
+        return false;
+    }
+
+    TextureAssetHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, TEXTURE_ASSET_MAGIC, 4);
+    header.version = TEXTURE_ASSET_VERSION;
+    header.format = (uint32_t)texture.format;
+    header.srgb = texture.srgb ? 1 : 0;
+    header.width = texture.mips[0].width;
+    header.height = texture.mips[0].height;
+    header.mip_count = (uint32_t)texture.mips.size();
+    header.source_hash = source_hash;
+    header.mip_offset = align_up(sizeof(TextureAssetHeader));
+    header.texel_offset =
+        align_up(header.mip_offset + (uint64_t)header.mip_count * sizeof(TextureMip));
+    header.texel_size = texture.texels.size();
+
+    std::ofstream file(filepath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    file.write((char const *)&header, sizeof(header));
+
+    write_padding(file, header.mip_offset);
+    file.write(
+        (char const *)texture.mips.data(), texture.mips.size() * sizeof(TextureMip));
+
+    write_padding(file, header.texel_offset);
+    file.write((char const *)texture.texels.data(), texture.texels.size());
+
+    return (bool)file;
+}
+
+} // namespace assets
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace assets {
+
+// Layout of a texture asset's texels. The engine uploads them as is, so each
+// format maps directly to a VkFormat.
+enum class TextureFormat : uint32_t {
+    Rgba8 = 0,
+    // 4x4 blocks: RGB with 1-bit alpha in 8 bytes
+    Bc1 = 1,
+    // 4x4 blocks: BC1 color and interpolated alpha in 16 bytes
+    Bc3 = 2,
+    // 4x4 blocks: RGBA at higher quality than BC3 in 16 bytes
+    Bc7 = 3,
+};
+
+// 8-bit RGBA pixels, rows tightly packed
+struct Rgba8Image {
+    uint32_t width{0};
+    uint32_t height{0};
+    std::vector<uint8_t> pixels;
+};
+
+struct TextureMip {
+    uint32_t width;
+    uint32_t height;
+    uint64_t offset; // from the start of the texel data
+    uint64_t size;
+};
+
+// Texture with its whole mip chain, as built by build_texture()
+struct TextureData {
+    TextureFormat format{TextureFormat::Rgba8};
+    bool srgb{false};
+    std::vector<TextureMip> mips;
+    std::vector<uint8_t> texels;
+};
+
+constexpr char TEXTURE_ASSET_MAGIC[4] = {'V', 'K', 'T', 'X'};
+// Bump whenever the layout of the file changes
+constexpr uint32_t TEXTURE_ASSET_VERSION = 1;
+
+// Starts every texture asset file. Offsets are from the start of the file
+// and aligned to 16 bytes, so the texels can be uploaded straight from a
+// mapping.
+struct TextureAssetHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t format; // TextureFormat
+    uint32_t srgb;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mip_count;
+    uint32_t reserved;
+    // Of the file the texture was built from, so that a cached texture can
+    // tell whether it's still current
+    uint64_t source_hash;
+    uint64_t mip_offset; // TextureMip[mip_count]
+    uint64_t texel_offset;
+    uint64_t texel_size;
+};
+
+// Sections of a texture asset that lives in memory, usually a file mapping
+struct TextureAssetView {
+    TextureAssetHeader const *header;
+    TextureMip const *mips;
+    uint8_t const *texels;
+
+    TextureFormat format() const { return (TextureFormat)header->format; }
+};
+
+// Width and height in texels of the blocks of a format, 1 for Rgba8
+uint32_t texture_block_extent(TextureFormat const format);
+// Bytes of one block of a format
+uint32_t texture_block_size(TextureFormat const format);
+// Bytes of a whole width x height image in a format
+uint64_t texture_image_size(
+    TextureFormat const format, uint32_t const width, uint32_t const height);
+
+// FNV-1a, for telling source files apart
+uint64_t hash_bytes(void const *data, size_t const size);
+
+// Validates the header, the mip chain and the section bounds and alignment of
+// an in-memory texture asset
+bool read_texture_asset(void const *data, size_t const size, TextureAssetView &out_view);
+
+bool write_texture_asset(
+    char const *filepath, TextureData const &texture, uint64_t const source_hash);
+
+} // namespace assets
@@ -0,0 +1,444 @@
+#include <texture_compression.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+constexpr uint32_t BLOCK_PIXELS = 16;
+// Power iterations for the principal axis, plenty for 4x4 pixels
+constexpr int AXIS_ITERATIONS = 8;
+// BC7 interpolation weights of its 4-bit indices, out of 64
+constexpr uint32_t BC7_WEIGHTS[16] = {
+    0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// Pixels of a block as floats, 0 to 255
+using BlockPixels = float[BLOCK_PIXELS][4];
+
+void load_block(
+    assets::Rgba8Image const &image, uint32_t const block_x, uint32_t const block_y,
+    BlockPixels &out_pixels) {
+    for (uint32_t y = 0; y < 4; y++) {
+        uint32_t const row = std::min(block_y * 4 + y, image.height - 1);
+        for (uint32_t x = 0; x < 4; x++) {
+            uint32_t const column = std::min(block_x * 4 + x, image.width - 1);
+            uint8_t const *pixel = image.pixels.data() + ((size_t)row * image.width + column) * 4;
+            for (int c = 0; c < 4; c++) {
+                out_pixels[y * 4 + x][c] = pixel[c];
+            }
+        }
+    }
+}
+
+float squared_distance(float const *a, float const *b, int const channels) {
+    float sum = 0.0f;
+    for (int c = 0; c < channels; c++) {
+        float const d = a[c] - b[c];
+        sum += d * d;
+    }
+    return sum;
+}
+
+// Ends of the line through the first channels of the pixels along their
+// principal axis, covering all of them
+void fit_line(
+    BlockPixels const &pixels, int const channels, float out_start[4], float out_end[4]) {
+    float mean[4] = {};
+    for (uint32_t i = 0; i < BLOCK_PIXELS; i++) {
+        for (int c = 0; c < channels; c++) {
+            mean[c] += pixels[i][c];
+        }
+    }
+    for (int c = 0; c < channels; c++) {
+        mean[c] /= BLOCK_PIXELS;
+    }
+
+    float covariance[4][4] = {};
+    for (uint32_t i = 0; i < BLOCK_PIXELS; i++) {
+        for (int a = 0; a < channels; a++) {
+            for (int b = a; b < channels; b++) {
+                covariance[a][b] += (pixels[i][a] - mean[a]) * (pixels[i][b] - mean[b]);
+            }
+        }
+    }
+    for (int a = 0; a < channels; a++) {
+        for (int b = 0; b < a; b++) {
+            covariance[a][b] = covariance[b][a];
+        }
+    }
+
+    // Starting from the diagonal converges for everything but pathological
+    // blocks, which then just get a worse axis
+    float axis[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    for (int iteration = 0; iteration < AXIS_ITERATIONS; iteration++) {
+        float next[4] = {};
+        float length = 0.0f;
+        for (int a = 0; a < channels; a++) {
+            for (int b = 0; b < channels; b++) {
+                next[a] += covariance[a][b] * axis[b];
+            }
+            length = std::max(length, std::abs(next[a]));
+        }
+        if (length == 0.0f) {
+            // A flat block, every pixel is the mean
+            for (int c = 0; c < channels; c++) {
+                out_start[c] = out_end[c] = mean[c];
+            }
+            return;
+        }
+        for (int c = 0; c < channels; c++) {
+            axis[c] = next[c] / length;
+        }
+    }
+
+    float length_squared = 0.0f;
+    for (int c = 0; c < channels; c++) {
+        length_squared += axis[c] * axis[c];
+    }
+    float min_t = 0.0f;
+    float max_t = 0.0f;
+    for (uint32_t i = 0; i < BLOCK_PIXELS; i++) {
+        float t = 0.0f;
+        for (int c = 0; c < channels; c++) {
+            t += (pixels[i][c] - mean[c]) * axis[c];
+        }
+        t /= length_squared;
+        min_t = std::min(min_t, t);
+        max_t = std::max(max_t, t);
+    }
+    for (int c = 0; c < channels; c++) {
+        out_start[c] = std::clamp(mean[c] + axis[c] * min_t, 0.0f, 255.0f);
+        out_end[c] = std::clamp(mean[c] + axis[c] * max_t, 0.0f, 255.0f);
+    }
+}
+
+// Least squares endpoints for pixels interpolated at weights from start to
+// end. Returns false if the weights don't determine them, all being equal.
+bool refit_line(
+    BlockPixels const &pixels, int const channels, float const weights[BLOCK_PIXELS],
+    float out_start[4], float out_end[4]) {
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = {}, bx[4] = {};
+    for (uint32_t i = 0; i < BLOCK_PIXELS; i++) {
+        float const b = weights[i];
+        float const a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < channels; c++) {
+            ax[c] += a * pixels[i][c];
+            bx[c] += b * pixels[i][c];
+        }
+    }
+
+    float const determinant = aa * bb - ab * ab;
+    if (std::abs(determinant) < 1e-6f) {
+        return false;
+    }
+    for (int c = 0; c < channels; c++) {
+        out_start[c] = std::clamp((ax[c] * bb - bx[c] * ab) / determinant, 0.0f, 255.0f);
+        out_end[c] = std::clamp((bx[c] * aa - ax[c] * ab) / determinant, 0.0f, 255.0f);
+    }
+    return true;
+}
+
+uint16_t to_565(float const color[3]) {
+    uint32_t const r = (uint32_t)std::lround(color[0] * (31.0f / 255.0f));
+    uint32_t const g = (uint32_t)std::lround(color[1] * (63.0f / 255.0f));
+    uint32_t const b = (uint32_t)std::lround(color[2] * (31.0f / 255.0f));
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+void from_565(uint16_t const packed, float out_color[3]) {
+    uint32_t const r = (packed >> 11) & 31;
+    uint32_t const g = (packed >> 5) & 63;
+    uint32_t const b = packed & 31;
+    out_color[0] = (float)((r << 3) | (r >> 2));
+    out_color[1] = (float)((g << 2) | (g >> 4));
+    out_color[2] = (float)((b << 3) | (b >> 2));
+}
+
+struct Bc1Block {
+    uint16_t color0;
+    uint16_t color1;
+    uint32_t indices;
+};
+
+// Encodes the colors of the pixels with the given endpoints in four color
+// mode. Returns the squared error and the weight of color1 for each pixel.
+float encode_bc1(
+    BlockPixels const &pixels, float const start[3], float const end[3], Bc1Block &out_block,
+    float out_weights[BLOCK_PIXELS]) {
+    uint16_t color0 = to_565(start);
+    uint16_t color1 = to_565(end);
+    // Four color mode needs color0 to be the larger
+    if (color0 < color1) {
+        std::swap(color0, color1);
+    }
+
+    float palette[4][3];
+    from_565(color0, palette[0]);
+    from_565(color1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+        palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+    static float const palette_weights[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+    // With equal colors the block is in three color mode, where only the
+    // first index still means the same
+    int const palette_size = color0 == color1 ? 1 : 4;
+
+    float error = 0.0f;
+    uint32_t indices = 0;
+    for (uint32_t i = 0; i < BLOCK_PIXELS; i++) {
+        uint32_t best_index = 0;
+        float best_distance = squared_distance(pixels[i], palette[0], 3);
+        for (int p = 1; p < palette_size; p++) {
+            float const distance = squared_distance(pixels[i], palette[p], 3);
+            if (distance < best_distance) {
+                best_distance = distance;
+                best_index = p;
+            }
+        }
+        indices |= best_index << (i * 2);
+        out_weights[i] = palette_weights[best_index];
+        error += best_distance;
+    }
+
+    out_block = {color0, color1, indices};
+    return error;
+}
+
+void compress_bc1(BlockPixels const &pixels, uint8_t *out) {
+    float start[4], end[4];
+    fit_line(pixels, 3, start, end);
+
+    Bc1Block block;
+    float weights[BLOCK_PIXELS];
+    float const error = encode_bc1(pixels, start, end, block, weights);
+
+    // The weights are of color1 against color0, whichever order the
+    // endpoints ended up in, and that's what the refit solves for
+    float refit_start[4], refit_end[4];
+    if (error > 0.0f && refit_line(pixels, 3, weights, refit_start, refit_end)) {
+        Bc1Block refit_block;
+        float refit_weights[BLOCK_PIXELS];
+        if (encode_bc1(pixels, refit_start, refit_end, refit_block, refit_weights) < error) {
+            block = refit_block;
+        }
+    }
+
+    std::memcpy(out, &block.color0, 2);
+    std::memcpy(out + 2, &block.color1, 2);
+    std::memcpy(out + 4, &block.indices, 4);
+}
+
+void compress_bc4(BlockPixels const &pixels, int const channel, uint8_t *out) {
+    float low = 255.0f;
+    float high = 0.0f;
+    for (uint32_t i = 0; i < BLOCK_PIXELS; i++) {
+        low = std::min(low, pixels[i][channel]);
+        high = std::max(high, pixels[i][channel]);
+    }
+
+    // The larger value first selects the mode with six interpolated values,
+    // from index 2 nearest the first to index 7 nearest the second
+    out[0] = (uint8_t)high;
+    out[1] = (uint8_t)low;
+    uint64_t indices = 0;
+    if (high > low) {
+        float const scale = 7.0f / (high - low);
+        for (uint32_t i = 0; i < BLOCK_PIXELS; i++) {
+            uint64_t const step = (uint64_t)std::lround((high - pixels[i][channel]) * scale);
+            uint64_t const index = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+            indices |= index << (i * 3);
+        }
+    }
+    for (int i = 0; i < 6; i++) {
+        out[2 + i] = (uint8_t)(indices >> (i * 8));
+    }
+}
+
+struct BitWriter {
+    uint8_t *out;
+    uint32_t position{0};
+
+    void write(uint32_t const value, uint32_t const bits) {
+        for (uint32_t i = 0; i < bits; i++) {
+            if ((value >> i) & 1) {
+                out[(position + i) / 8] |= (uint8_t)(1 << ((position + i) % 8));
+            }
+        }
+        position += bits;
+    }
+};
+
+struct Bc7Mode6Block {
+    uint32_t endpoints[2][4]; // 7 bits each
+    uint32_t shared_bits[2];
+    uint8_t indices[BLOCK_PIXELS];
+};
+
+// Encodes the pixels as a BC7 mode 6 block with endpoints quantized from
+// start and end, trying every shared bit combination. Returns the squared
+// error and the weight of the second endpoint for each pixel.
+float encode_bc7_mode6(
+    BlockPixels const &pixels, float const start[4], float const end[4],
+    Bc7Mode6Block &out_block, float out_weights[BLOCK_PIXELS]) {
+    float best_error = -1.0f;
+    for (uint32_t bits = 0; bits < 4; bits++) {
+        Bc7Mode6Block block;
+        block.shared_bits[0] = bits & 1;
+        block.shared_bits[1] = bits >> 1;
+
+        float endpoints[2][4];
+        for (int e = 0; e < 2; e++) {
+            float const *source = e == 0 ? start : end;
+            for (int c = 0; c < 4; c++) {
+                long const quantized =
+                    std::lround((source[c] - (float)block.shared_bits[e]) * 0.5f);
+                block.endpoints[e][c] = (uint32_t)std::clamp(quantized, 0l, 127l);
+                endpoints[e][c] = (float)(block.endpoints[e][c] * 2 + block.shared_bits[e]);
+            }
+        }
+
+        float palette[16][4];
+        for (int p = 0; p < 16; p++) {
+            for (int c = 0; c < 4; c++) {
+                uint32_t const first = (uint32_t)endpoints[0][c];
+                uint32_t const second = (uint32_t)endpoints[1][c];
+                palette[p][c] = (float)(
+                    ((64 - BC7_WEIGHTS[p]) * first + BC7_WEIGHTS[p] * second + 32) >> 6);
+            }
+        }
+
+        // Projecting onto the line lands next to the nearest entry, the
+        // weights being spaced almost evenly
+        float direction[4];
+        float length_squared = 0.0f;
+        for (int c = 0; c < 4; c++) {
+            direction[c] = endpoints[1][c] - endpoints[0][c];
+            length_squared += direction[c] * direction[c];
+        }
+        float error = 0.0f;
+        for (uint32_t i = 0; i < BLOCK_PIXELS; i++) {
+            int guess = 0;
+            if (length_squared > 0.0f) {
+                float t = 0.0f;
+                for (int c = 0; c < 4; c++) {
+                    t += (pixels[i][c] - endpoints[0][c]) * direction[c];
+                }
+                guess = (int)std::lround(std::clamp(t / length_squared, 0.0f, 1.0f) * 15.0f);
+            }
+            int best_index = guess;
+            float best_distance = squared_distance(pixels[i], palette[guess], 4);
+            for (int p = std::max(guess - 1, 0); p <= std::min(guess + 1, 15); p++) {
+                float const distance = squared_distance(pixels[i], palette[p], 4);
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    best_index = p;
+                }
+            }
+            block.indices[i] = (uint8_t)best_index;
+            error += best_distance;
+        }
+
+        if (best_error < 0.0f || error < best_error) {
+            best_error = error;
+            out_block = block;
+        }
+    }
+
+    for (uint32_t i = 0; i < BLOCK_PIXELS; i++) {
+        out_weights[i] = BC7_WEIGHTS[out_block.indices[i]] / 64.0f;
+    }
+    return best_error;
+}
+
+void compress_bc7(BlockPixels const &pixels, uint8_t *out) {
+    float start[4], end[4];
+    fit_line(pixels, 4, start, end);
+
+    Bc7Mode6Block block;
+    float weights[BLOCK_PIXELS];
+    float const error = encode_bc7_mode6(pixels, start, end, block, weights);
+
+    float refit_start[4], refit_end[4];
+    if (error > 0.0f && refit_line(pixels, 4, weights, refit_start, refit_end)) {
+        Bc7Mode6Block refit_block;
+        float refit_weights[BLOCK_PIXELS];
+        if (encode_bc7_mode6(pixels, refit_start, refit_end, refit_block, refit_weights) < error) {
+            block = refit_block;
+        }
+    }
+
+    // The first index is stored without its top bit, which swapping the
+    // endpoints clears, the weights being symmetric
+    if (block.indices[0] >= 8) {
+        std::swap(block.endpoints[0], block.endpoints[1]);
+        std::swap(block.shared_bits[0], block.shared_bits[1]);
+        for (uint8_t &index : block.indices) {
+            index = (uint8_t)(15 - index);
+        }
+    }
+
+    std::memset(out, 0, 16);
+    BitWriter writer{out};
+    writer.write(1 << 6, 7);
+    for (int c = 0; c < 4; c++) {
+        writer.write(block.endpoints[0][c], 7);
+        writer.write(block.endpoints[1][c], 7);
+    }
+    writer.write(block.shared_bits[0], 1);
+    writer.write(block.shared_bits[1], 1);
+    writer.write(block.indices[0], 3);
+    for (uint32_t i = 1; i < BLOCK_PIXELS; i++) {
+        writer.write(block.indices[i], 4);
+    }
+}
+} // namespace
+
+namespace assets {
+
+bool has_alpha(Rgba8Image const &image) {
+    for (size_t i = 3; i < image.pixels.size(); i += 4) {
+        if (image.pixels[i] != 255) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void compress_block_rows(
+    Rgba8Image const &image, TextureFormat const format,
+    uint32_t const first_block_row, uint32_t const block_row_count, uint8_t *out
+) {
+    uint32_t const blocks_x = (image.width + 3) / 4;
+    uint32_t const block_size = texture_block_size(format);
+
+    for (uint32_t block_y = first_block_row; block_y < first_block_row + block_row_count;
+         block_y++) {
+        for (uint32_t block_x = 0; block_x < blocks_x; block_x++) {
+            BlockPixels pixels;
+            load_block(image, block_x, block_y, pixels);
+
+            uint8_t *block = out + ((size_t)block_y * blocks_x + block_x) * block_size;
+            switch (format) {
+            case TextureFormat::Bc1:
+                compress_bc1(pixels, block);
+                break;
+            case TextureFormat::Bc3:
+                compress_bc4(pixels, 3, block);
+                compress_bc1(pixels, block + 8);
+                break;
+            case TextureFormat::Bc7:
+                compress_bc7(pixels, block);
+                break;
+            case TextureFormat::Rgba8:
+                break;
+            }
+        }
+    }
+}
+
+} // namespace assets
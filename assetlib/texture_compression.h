@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+#include <texture_asset.h>
+
+namespace assets {
+
+// Whether any pixel of the image is less than fully opaque
+bool has_alpha(Rgba8Image const &image);
+
+// Compresses the 4x4 blocks of rows [first_block_row, first_block_row +
+// block_row_count) of image into format, a block compressed one, writing
+// them where they go among those of the whole image starting at out. Block
+// rows are independent, so separate ranges can be compressed in parallel.
+// Blocks hanging over the edge repeat its pixels.
+//
+// Every format fits endpoints along the principal axis of the block's
+// colors, then refines them by least squares for the indices they got:
+//  - Bc1 ignores alpha and always uses the four color mode.
+//  - Bc3 adds the alpha as a BC4 block.
+//  - Bc7 uses mode 6 only: a single RGBA line with 16 indices, trying all
+//    four shared bit combinations. That's where most of BC7's gain over BC3
+//    for this kind of content is.
+void compress_block_rows(
+    Rgba8Image const &image, TextureFormat const format,
+    uint32_t const first_block_row, uint32_t const block_row_count, uint8_t *out);
+
+} // namespace assets
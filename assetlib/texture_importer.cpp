@@ -0,0 +1,97 @@
+#include <texture_importer.h>
+
+#include <texture_compression.h>
+#include <texture_mips.h>
+
+#include <job_system.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+// Rows of pixels, or of blocks, a job works on. Large enough that a job
+// outweighs its scheduling, small enough that the smaller levels still
+// split.
+constexpr uint32_t DOWNSAMPLE_GRAIN_ROWS = 64;
+constexpr uint32_t COMPRESS_GRAIN_BLOCK_ROWS = 8;
+
+template <typename F>
+void for_rows(
+    jobs::JobSystem *jobs, uint32_t const count, uint32_t const grain, F const &function) {
+    if (jobs) {
+        jobs->parallel_for(count, grain, function);
+    } else {
+        function(0u, count);
+    }
+}
+} // namespace
+
+namespace assets {
+
+bool decode_image(
+    void const *data, size_t const size, Rgba8Image &out_image, std::string &out_error
+) {
+    int width, height, channels;
+    stbi_uc *pixels = stbi_load_from_memory(
+        (stbi_uc const *)data, (int)size, &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+        out_error = stbi_failure_reason();
+        return false;
+    }
+
+    out_image.width = (uint32_t)width;
+    out_image.height = (uint32_t)height;
+    out_image.pixels.assign(pixels, pixels + (size_t)width * height * 4);
+    stbi_image_free(pixels);
+    return true;
+}
+
+void build_texture(
+    Rgba8Image &&image, TextureFormat const format, bool const srgb, jobs::JobSystem *jobs,
+    TextureData &out_texture
+) {
+    out_texture.format = format;
+    out_texture.srgb = srgb;
+    out_texture.mips.clear();
+
+    uint32_t const levels = mip_level_count(image.width, image.height);
+    uint64_t texel_size = 0;
+    for (uint32_t i = 0, width = image.width, height = image.height; i < levels; i++) {
+        TextureMip const mip{width, height, texel_size, texture_image_size(format, width, height)};
+        out_texture.mips.push_back(mip);
+        texel_size += mip.size;
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+    }
+    out_texture.texels.resize(texel_size);
+
+    Rgba8Image level = std::move(image);
+    for (uint32_t i = 0; i < levels; i++) {
+        uint8_t *out = out_texture.texels.data() + out_texture.mips[i].offset;
+        if (format == TextureFormat::Rgba8) {
+            std::memcpy(out, level.pixels.data(), level.pixels.size());
+        } else {
+            uint32_t const block_rows = (level.height + 3) / 4;
+            for_rows(
+                jobs, block_rows, COMPRESS_GRAIN_BLOCK_ROWS,
+                [&](uint32_t const begin, uint32_t const end) {
+                    compress_block_rows(level, format, begin, end - begin, out);
+                });
+        }
+
+        if (i + 1 < levels) {
+            Rgba8Image next = allocate_next_mip(level);
+            for_rows(
+                jobs, next.height, DOWNSAMPLE_GRAIN_ROWS,
+                [&](uint32_t const begin, uint32_t const end) {
+                    downsample_rows(level, srgb, next, begin, end - begin);
+                });
+            level = std::move(next);
+        }
+    }
+}
+
+} // namespace assets
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include <texture_asset.h>
+
+namespace jobs {
+class JobSystem;
+}
+
+namespace assets {
+
+// Decodes a PNG, JPEG, TGA or BMP file in memory into RGBA pixels
+bool decode_image(
+    void const *data, size_t const size, Rgba8Image &out_image, std::string &out_error);
+
+// Builds a texture with a full mip chain from image in format. Each level is
+// box filtered from the one before, in linear space when srgb is set, then
+// compressed. Both are split into row ranges run on jobs, if given, image
+// itself being reused for the chain.
+void build_texture(
+    Rgba8Image &&image, TextureFormat const format, bool const srgb, jobs::JobSystem *jobs,
+    TextureData &out_texture);
+
+} // namespace assets
@@ -0,0 +1,199 @@
+#include <texture_mips.h>
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TEXTURE_MIPS_SSE2 1
+#endif
+
+namespace {
+// Linear values are quantized to 16 bits to look up their sRGB encoding, fine
+// enough that every 8-bit sRGB value survives a round trip
+constexpr uint32_t LINEAR_STEPS = 65535;
+// Averages the four linear values and scales them to a lookup index at once,
+// exact since multiplying by 0.25 is
+constexpr float AVERAGE_TO_INDEX = LINEAR_STEPS * 0.25f;
+
+struct SrgbTables {
+    float to_linear[256];
+    uint8_t from_linear[LINEAR_STEPS + 1];
+};
+
+SrgbTables make_srgb_tables() {
+    SrgbTables tables;
+    for (uint32_t i = 0; i < 256; i++) {
+        float const s = i / 255.0f;
+        tables.to_linear[i] =
+            s <= 0.04045f ? s / 12.92f : std::pow((s + 0.055f) / 1.055f, 2.4f);
+    }
+    for (uint32_t i = 0; i <= LINEAR_STEPS; i++) {
+        float const l = (float)i / LINEAR_STEPS;
+        float const s = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+        tables.from_linear[i] = (uint8_t)std::lround(std::clamp(s, 0.0f, 1.0f) * 255.0f);
+    }
+    return tables;
+}
+
+SrgbTables const &srgb_tables() {
+    static SrgbTables const tables = make_srgb_tables();
+    return tables;
+}
+
+// Rows of the 2x2 footprint of a destination row, the last one repeated when
+// the source is a single row high
+struct SourceRows {
+    uint8_t const *top;
+    uint8_t const *bottom;
+};
+
+SourceRows source_rows(assets::Rgba8Image const &source, uint32_t const row) {
+    uint32_t const top = row * 2;
+    uint32_t const bottom = std::min(top + 1, source.height - 1);
+    size_t const pitch = (size_t)source.width * 4;
+    return {source.pixels.data() + top * pitch, source.pixels.data() + bottom * pitch};
+}
+
+void downsample_pixel(
+    SourceRows const &rows, uint32_t const source_width, bool const srgb, uint32_t const x,
+    uint8_t *out) {
+    uint32_t const left = x * 2;
+    uint32_t const right = std::min(left + 1, source_width - 1);
+    uint8_t const *p00 = rows.top + left * 4;
+    uint8_t const *p01 = rows.top + right * 4;
+    uint8_t const *p10 = rows.bottom + left * 4;
+    uint8_t const *p11 = rows.bottom + right * 4;
+
+    uint32_t first_linear = 0;
+    if (srgb) {
+        SrgbTables const &tables = srgb_tables();
+        float const *l = tables.to_linear;
+        for (int c = 0; c < 3; c++) {
+            float const sum = (l[p00[c]] + l[p01[c]]) + (l[p10[c]] + l[p11[c]]);
+            out[c] = tables.from_linear[std::lrint(sum * AVERAGE_TO_INDEX)];
+        }
+        first_linear = 3;
+    }
+    for (uint32_t c = first_linear; c < 4; c++) {
+        out[c] = (uint8_t)((p00[c] + p01[c] + p10[c] + p11[c] + 2) >> 2);
+    }
+}
+
+#ifdef TEXTURE_MIPS_SSE2
+// Averages 2x2 blocks of the 4 pixels at each of top and bottom into 2,
+// as 16-bit lanes
+__m128i average_linear(__m128i const top, __m128i const bottom) {
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const left =
+        _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+    __m128i const right =
+        _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+    // Pixels 0 and 2 against 1 and 3, each lane pair then covers a 2x2 block
+    __m128i const sum =
+        _mm_add_epi16(_mm_unpacklo_epi64(left, right), _mm_unpackhi_epi64(left, right));
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+
+__m128 to_linear(float const *table, uint8_t const *pixel) {
+    return _mm_setr_ps(table[pixel[0]], table[pixel[1]], table[pixel[2]], 0.0f);
+}
+#endif
+} // namespace
+
+namespace assets {
+
+uint32_t mip_level_count(uint32_t const width, uint32_t const height) {
+    uint32_t levels = 1;
+    for (uint32_t extent = std::max(width, height); extent > 1; extent /= 2) {
+        levels++;
+    }
+    return levels;
+}
+
+Rgba8Image allocate_next_mip(Rgba8Image const &source) {
+    Rgba8Image mip;
+    mip.width = std::max(source.width / 2, 1u);
+    mip.height = std::max(source.height / 2, 1u);
+    mip.pixels.resize((size_t)mip.width * mip.height * 4);
+    return mip;
+}
+
+void downsample_rows_scalar(
+    Rgba8Image const &source, bool const srgb, Rgba8Image &destination,
+    uint32_t const first_row, uint32_t const row_count
+) {
+    for (uint32_t y = first_row; y < first_row + row_count; y++) {
+        SourceRows const rows = source_rows(source, y);
+        uint8_t *out = destination.pixels.data() + (size_t)y * destination.width * 4;
+        for (uint32_t x = 0; x < destination.width; x++) {
+            downsample_pixel(rows, source.width, srgb, x, out + x * 4);
+        }
+    }
+}
+
+#ifdef TEXTURE_MIPS_SSE2
+void downsample_rows(
+    Rgba8Image const &source, bool const srgb, Rgba8Image &destination,
+    uint32_t const first_row, uint32_t const row_count
+) {
+    SrgbTables const &tables = srgb_tables();
+    __m128 const average_to_index = _mm_set1_ps(AVERAGE_TO_INDEX);
+
+    for (uint32_t y = first_row; y < first_row + row_count; y++) {
+        SourceRows const rows = source_rows(source, y);
+        uint8_t *out = destination.pixels.data() + (size_t)y * destination.width * 4;
+
+        // Both columns of a block always exist here, the source is at least
+        // twice as wide as the part of the destination covered
+        uint32_t x = 0;
+        if (!srgb) {
+            for (; x + 4 <= destination.width; x += 4) {
+                uint8_t const *top = rows.top + x * 8;
+                uint8_t const *bottom = rows.bottom + x * 8;
+                __m128i const first = average_linear(
+                    _mm_loadu_si128((__m128i const *)top),
+                    _mm_loadu_si128((__m128i const *)bottom));
+                __m128i const second = average_linear(
+                    _mm_loadu_si128((__m128i const *)(top + 16)),
+                    _mm_loadu_si128((__m128i const *)(bottom + 16)));
+                _mm_storeu_si128((__m128i *)(out + x * 4), _mm_packus_epi16(first, second));
+            }
+        } else if (source.width >= 2) {
+            // The lookups are scalar, the averaging of a pixel's channels
+            // and their conversion to table indices aren't
+            alignas(16) int32_t indices[4];
+            for (; x < destination.width; x++) {
+                uint8_t const *top = rows.top + x * 8;
+                uint8_t const *bottom = rows.bottom + x * 8;
+                __m128 const sum = _mm_add_ps(
+                    _mm_add_ps(
+                        to_linear(tables.to_linear, top), to_linear(tables.to_linear, top + 4)),
+                    _mm_add_ps(
+                        to_linear(tables.to_linear, bottom),
+                        to_linear(tables.to_linear, bottom + 4)));
+                _mm_store_si128(
+                    (__m128i *)indices, _mm_cvtps_epi32(_mm_mul_ps(sum, average_to_index)));
+
+                uint8_t *pixel = out + x * 4;
+                pixel[0] = tables.from_linear[indices[0]];
+                pixel[1] = tables.from_linear[indices[1]];
+                pixel[2] = tables.from_linear[indices[2]];
+                pixel[3] = (uint8_t)((top[3] + top[7] + bottom[3] + bottom[7] + 2) >> 2);
+            }
+        }
+        for (; x < destination.width; x++) {
+            downsample_pixel(rows, source.width, srgb, x, out + x * 4);
+        }
+    }
+}
+#else
+void downsample_rows(
+    Rgba8Image const &source, bool const srgb, Rgba8Image &destination,
+    uint32_t const first_row, uint32_t const row_count
+) {
+    downsample_rows_scalar(source, srgb, destination, first_row, row_count);
+}
+#endif
+
+} // namespace assets
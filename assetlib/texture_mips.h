@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+#include <texture_asset.h>
+
+namespace assets {
+
+// Levels of a full mip chain of a width x height image, down to 1x1
+uint32_t mip_level_count(uint32_t const width, uint32_t const height);
+
+// Image with the extent of the level after source, half of it rounded down
+// but at least 1, and its pixels left zeroed for downsample_rows()
+Rgba8Image allocate_next_mip(Rgba8Image const &source);
+
+// Fills rows [first_row, first_row + row_count) of destination, allocated
+// with allocate_next_mip(), with the 2x2 box filtered pixels of source. Rows
+// are independent, so separate ranges can be filled in parallel.
+//
+// sRGB colors are averaged in linear space, or mips would darken wherever
+// light and dark texels meet. Alpha is always linear. An odd last row or
+// column of the source only contributes through its neighbor being dropped,
+// like most box filtered chains.
+void downsample_rows(
+    Rgba8Image const &source, bool const srgb, Rgba8Image &destination,
+    uint32_t const first_row, uint32_t const row_count);
+
+// Same filter one pixel at a time, with the same rounding as
+// downsample_rows(). The fallback where SSE2 isn't available.
+void downsample_rows_scalar(
+    Rgba8Image const &source, bool const srgb, Rgba8Image &destination,
+    uint32_t const first_row, uint32_t const row_count);
+
+} // namespace assets
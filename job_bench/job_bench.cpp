@@ -0,0 +1,371 @@
+#include <job_system.h>
+#include <spsc_queue.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+double elapsed_ms(Clock::time_point const start, Clock::time_point const end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void print_usage(char const *exe) {
+    std::cout << "Usage: " << exe << " [--threads N] [--stress]\n"
+              << "  --threads N      highest thread count to measure scaling up to,\n"
+              << "                   defaults to the hardware thread count\n"
+              << "  --stress         check the deque, queue and scheduler under contention\n"
+              << "                   instead of benchmarking, meant for TSan builds\n";
+}
+
+// Stand-in for real work that the compiler can't optimize away
+uint32_t burn(uint32_t const seed, uint32_t const iterations) {
+    uint32_t x = seed | 1;
+    for (uint32_t i = 0; i < iterations; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+    }
+    return x;
+}
+
+// Jobs per second when each one does nothing, all started from one thread
+void bench_empty_jobs(jobs::JobSystem &system) {
+    constexpr uint32_t JOB_COUNT = 1000000;
+    constexpr uint32_t BATCH_SIZE = 1024;
+
+    Clock::time_point const start = Clock::now();
+    for (uint32_t batch = 0; batch < JOB_COUNT; batch += BATCH_SIZE) {
+        jobs::Counter counter;
+        for (uint32_t i = 0; i < BATCH_SIZE; i++) {
+            system.run(counter, []() {});
+        }
+        system.wait(counter);
+    }
+    double const ms = elapsed_ms(start, Clock::now());
+
+    std::printf(
+        "Empty jobs:        %8.2f M jobs/s (%.1f ns per job)\n",
+        JOB_COUNT / ms / 1000.0, ms * 1e6 / JOB_COUNT);
+}
+
+// Time to start one empty job per thread and wait for all of them
+void bench_fan_out_fan_in(jobs::JobSystem &system) {
+    constexpr uint32_t ROUNDS = 10000;
+    uint32_t const width = system.thread_count();
+
+    Clock::time_point const start = Clock::now();
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        jobs::Counter counter;
+        for (uint32_t i = 0; i < width; i++) {
+            system.run(counter, []() {});
+        }
+        system.wait(counter);
+    }
+    double const ms = elapsed_ms(start, Clock::now());
+
+    std::printf(
+        "Fan-out/fan-in:    %8.2f us per round of %u jobs\n", ms * 1000.0 / ROUNDS, width);
+}
+
+// parallel_for over a fixed amount of work with 1 to max_threads threads
+void bench_scaling(uint32_t const max_threads) {
+    constexpr uint32_t ITEMS = 1 << 16;
+    constexpr uint32_t ITERATIONS = 2000;
+
+    std::vector<uint32_t> results(ITEMS);
+    auto work = [&results](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            results[i] = burn(i, ITERATIONS);
+        }
+    };
+
+    double single_ms = 0.0;
+    std::printf("Scaling (parallel_for, %u items):\n", ITEMS);
+    for (uint32_t threads = 1; threads <= max_threads; threads *= 2) {
+        jobs::JobSystem system;
+        system.init(threads > 1 ? threads - 1 : 1);
+
+        // Warm up the threads, then take the best of a few runs
+        double best_ms = 0.0;
+        for (int run = 0; run < 4; run++) {
+            Clock::time_point const start = Clock::now();
+            // The baseline is a single range, which runs on the calling thread
+            system.parallel_for(ITEMS, threads == 1 ? ITEMS : 0, work);
+            double const ms = elapsed_ms(start, Clock::now());
+            if (run > 0 && (best_ms == 0.0 || ms < best_ms)) {
+                best_ms = ms;
+            }
+        }
+        system.cleanup();
+
+        if (threads == 1) {
+            single_ms = best_ms;
+        }
+        std::printf(
+            "  %3u threads: %9.3f ms, %5.2fx\n", threads, best_ms, single_ms / best_ms);
+
+        if (threads < max_threads && threads * 2 > max_threads) {
+            threads = max_threads / 2;
+        }
+    }
+}
+
+bool check(bool const condition, char const *what) {
+    if (!condition) {
+        std::printf("FAILED: %s\n", what);
+    }
+    return condition;
+}
+
+// The owner pushes and pops while thieves steal, every job must be taken
+// exactly once
+bool stress_deque() {
+    constexpr uint32_t JOB_COUNT = 200000;
+    constexpr uint32_t THIEF_COUNT = 3;
+
+    std::vector<jobs::Job> items(JOB_COUNT);
+    std::vector<std::atomic<uint32_t>> taken(JOB_COUNT);
+    jobs::WorkStealingDeque deque(256);
+    std::atomic<bool> done{false};
+
+    auto take = [&](jobs::Job *job) { taken[job - items.data()].fetch_add(1); };
+
+    std::vector<std::thread> thieves;
+    for (uint32_t i = 0; i < THIEF_COUNT; i++) {
+        thieves.emplace_back([&]() {
+            while (!done.load()) {
+                if (jobs::Job *job = deque.steal()) {
+                    take(job);
+                }
+            }
+        });
+    }
+
+    for (uint32_t i = 0; i < JOB_COUNT; i++) {
+        while (!deque.push(&items[i])) {
+            if (jobs::Job *job = deque.pop()) {
+                take(job);
+            }
+        }
+        // Pop every now and then so that pops race steals for the last job
+        if (i % 3 == 0) {
+            if (jobs::Job *job = deque.pop()) {
+                take(job);
+            }
+        }
+    }
+    while (jobs::Job *job = deque.pop()) {
+        take(job);
+    }
+
+    // Let the thieves finish whatever they are stealing
+    while (deque.size() > 0) {
+        std::this_thread::yield();
+    }
+    done.store(true);
+    for (std::thread &thief : thieves) {
+        thief.join();
+    }
+
+    bool ok = true;
+    for (uint32_t i = 0; i < JOB_COUNT; i++) {
+        ok &= taken[i].load() == 1;
+    }
+    return check(ok, "deque took every job exactly once");
+}
+
+// A small queue keeps the producer running into a full ring and the consumer
+// into an empty one, every item must come out once and in order
+bool stress_spsc_queue() {
+    constexpr uint32_t ITEM_COUNT = 1000000;
+
+    jobs::SpscQueue<uint32_t> queue(64);
+    bool in_order = true;
+    std::thread consumer([&]() {
+        uint32_t expected = 0;
+        while (expected < ITEM_COUNT) {
+            uint32_t item;
+            if (!queue.pop(item)) {
+                std::this_thread::yield();
+                continue;
+            }
+            in_order &= item == expected;
+            expected++;
+        }
+    });
+
+    for (uint32_t i = 0; i < ITEM_COUNT; i++) {
+        while (!queue.push(i)) {
+            std::this_thread::yield();
+        }
+    }
+    consumer.join();
+
+    uint32_t item;
+    bool const drained = !queue.pop(item);
+    return check(in_order && drained, "SPSC queue passed every item once and in order");
+}
+
+// Jobs that start more jobs on the counter being waited on
+void spawn_tree(
+    jobs::JobSystem &system, jobs::Counter &counter, std::atomic<uint32_t> &visited,
+    uint32_t const depth) {
+    visited.fetch_add(1, std::memory_order_relaxed);
+    if (depth == 0) {
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        system.run(counter, [&system, &counter, &visited, depth]() {
+            spawn_tree(system, counter, visited, depth - 1);
+        });
+    }
+}
+
+bool stress_scheduler(uint32_t const worker_count) {
+    bool ok = true;
+
+    jobs::JobSystem system;
+    system.init(worker_count);
+
+    // Nested parallel_for, every item written once by whoever runs it
+    {
+        constexpr uint32_t OUTER = 64;
+        constexpr uint32_t INNER = 1000;
+        std::vector<uint32_t> values(OUTER * INNER, 0);
+        system.parallel_for(OUTER, 1, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t o = begin; o < end; o++) {
+                system.parallel_for(INNER, 16, [&, o](uint32_t b, uint32_t e) {
+                    for (uint32_t i = b; i < e; i++) {
+                        values[o * INNER + i] += o * INNER + i;
+                    }
+                });
+            }
+        });
+        bool all_set = true;
+        for (uint32_t i = 0; i < OUTER * INNER; i++) {
+            all_set &= values[i] == i;
+        }
+        ok &= check(all_set, "nested parallel_for covered every item once");
+    }
+
+    // More jobs than ring slots, started from inside jobs
+    {
+        constexpr uint32_t DEPTH = 14;
+        jobs::Counter counter;
+        std::atomic<uint32_t> visited{0};
+        spawn_tree(system, counter, visited, DEPTH);
+        system.wait(counter);
+        ok &= check(visited.load() == (2u << DEPTH) - 1, "job tree ran every job");
+    }
+
+    // Threads that aren't workers starting and waiting on jobs at the same
+    // time as the main thread, with background jobs mixed in
+    {
+        constexpr uint32_t EXTERNAL_THREADS = 3;
+        constexpr uint32_t JOBS_PER_THREAD = 5000;
+        std::atomic<uint32_t> ran{0};
+        std::atomic<uint32_t> background_ran{0};
+
+        jobs::Counter background;
+        for (int i = 0; i < 8; i++) {
+            system.run(background, [&]() {
+                burn(1, 100000);
+                background_ran.fetch_add(1);
+            }, jobs::Priority::Background);
+        }
+
+        std::vector<std::thread> external;
+        for (uint32_t t = 0; t < EXTERNAL_THREADS; t++) {
+            external.emplace_back([&]() {
+                jobs::Counter counter;
+                for (uint32_t i = 0; i < JOBS_PER_THREAD; i++) {
+                    system.run(counter, [&]() { ran.fetch_add(1); });
+                }
+                system.wait(counter);
+            });
+        }
+        jobs::Counter counter;
+        for (uint32_t i = 0; i < JOBS_PER_THREAD; i++) {
+            system.run(counter, [&]() { ran.fetch_add(1); });
+        }
+        system.wait(counter);
+        for (std::thread &thread : external) {
+            thread.join();
+        }
+        system.wait(background);
+
+        ok &= check(
+            ran.load() == (EXTERNAL_THREADS + 1) * JOBS_PER_THREAD,
+            "jobs from other threads all ran");
+        ok &= check(background_ran.load() == 8, "background jobs all ran");
+    }
+
+    system.cleanup();
+    return ok;
+}
+
+int stress() {
+    bool ok = stress_deque();
+    ok &= stress_spsc_queue();
+    // A single worker makes the main thread and it contend for everything
+    for (uint32_t const workers : {1u, 3u, 7u}) {
+        ok &= stress_scheduler(workers);
+    }
+
+    // Starting and stopping with jobs left queued
+    for (int i = 0; i < 20; i++) {
+        jobs::JobSystem system;
+        system.init(2);
+        jobs::Counter counter;
+        std::atomic<uint32_t> ran{0};
+        for (int j = 0; j < 100; j++) {
+            system.run(counter, [&]() { ran.fetch_add(1); });
+        }
+        system.cleanup();
+        ok &= check(ran.load() == 100, "cleanup ran the queued jobs");
+    }
+
+    std::printf(ok ? "All stress tests passed.\n" : "Stress tests failed.\n");
+    return ok ? 0 : 1;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    uint32_t max_threads = std::thread::hardware_concurrency();
+    bool run_stress = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            max_threads = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--stress") == 0) {
+            run_stress = true;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (max_threads == 0) {
+        max_threads = 1;
+    }
+
+    if (run_stress) {
+        return stress();
+    }
+
+    jobs::JobSystem system;
+    system.init(max_threads > 1 ? max_threads - 1 : 1);
+    std::printf("%u threads\n", system.thread_count());
+    bench_empty_jobs(system);
+    bench_fan_out_fan_in(system);
+    system.cleanup();
+
+    bench_scaling(max_threads);
+    return 0;
+}
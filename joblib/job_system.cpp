@@ -0,0 +1,289 @@
+#include <job_system.h>
+
+namespace jobs {
+
+namespace {
+// Job slots per worker, and the capacity of its deque. Jobs started while all
+// slots are taken are allocated on the heap instead.
+constexpr uint32_t JOBS_PER_WORKER = 4096;
+
+// The system and worker index of the calling thread
+thread_local JobSystem const *current_system = nullptr;
+thread_local int current_index = -1;
+
+uint32_t xorshift(uint32_t &state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+} // namespace
+
+WorkStealingDeque::WorkStealingDeque(uint32_t const capacity)
+    : buffer(new std::atomic<Job *>[capacity]), mask((int64_t)capacity - 1) {
+}
+
+bool WorkStealingDeque::push(Job *job) {
+    int64_t const b = bottom.load(std::memory_order_relaxed);
+    int64_t const t = top.load(std::memory_order_acquire);
+    if (b - t > mask) {
+        return false;
+    }
+
+    buffer[b & mask].store(job, std::memory_order_relaxed);
+    // Publishes the job to thieves that load bottom with acquire
+    bottom.store(b + 1, std::memory_order_release);
+    return true;
+}
+
+Job *WorkStealingDeque::pop() {
+    int64_t const b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_seq_cst);
+
+    if (t > b) {
+        // Empty
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job *job = buffer[b & mask].load(std::memory_order_relaxed);
+    if (t == b) {
+        // Last job, race the thieves for it
+        if (!top.compare_exchange_strong(
+                t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            job = nullptr;
+        }
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+Job *WorkStealingDeque::steal() {
+    int64_t t = top.load(std::memory_order_seq_cst);
+    int64_t const b = bottom.load(std::memory_order_seq_cst);
+    if (t >= b) {
+        return nullptr;
+    }
+
+    Job *job = buffer[t & mask].load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(
+            t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    return job;
+}
+
+size_t WorkStealingDeque::size() const {
+    int64_t const b = bottom.load(std::memory_order_relaxed);
+    int64_t const t = top.load(std::memory_order_relaxed);
+    return b > t ? (size_t)(b - t) : 0;
+}
+
+JobSystem::Worker::Worker()
+    : deque(JOBS_PER_WORKER), jobs(new Job[JOBS_PER_WORKER]) {
+}
+
+void JobSystem::init(uint32_t worker_count, void (*on_thread_start)(uint32_t index)) {
+    if (worker_count == 0) {
+        uint32_t const hardware_threads = std::thread::hardware_concurrency();
+        worker_count = hardware_threads > 1 ? hardware_threads - 1 : 1;
+    }
+
+    stopping = false;
+    workers.reserve(worker_count + 1);
+    for (uint32_t i = 0; i <= worker_count; i++) {
+        workers.push_back(std::make_unique<Worker>());
+        workers.back()->random_state = 0x9e3779b9u * (i + 1);
+    }
+
+    current_system = this;
+    current_index = 0;
+
+    threads.reserve(worker_count);
+    for (uint32_t i = 1; i <= worker_count; i++) {
+        threads.emplace_back(&JobSystem::worker_loop, this, i, on_thread_start);
+    }
+}
+
+void JobSystem::cleanup() {
+    // Help with whatever is left, background jobs included
+    Worker *self = workers[0].get();
+    while (queued_jobs.load() > 0) {
+        if (Job *job = take_job(self, true)) {
+            execute(job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+    workers.clear();
+
+    current_system = nullptr;
+    current_index = -1;
+}
+
+int JobSystem::current_worker() const {
+    return current_system == this ? current_index : -1;
+}
+
+void JobSystem::wait(Counter &counter) {
+    int const index = current_worker();
+    Worker *self = index >= 0 ? workers[index].get() : nullptr;
+
+    while (!counter.done()) {
+        // Background jobs could take far longer than what is waited for
+        if (Job *job = take_job(self, false)) {
+            execute(job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+Job *JobSystem::allocate_job(Priority const priority) {
+    int const index = current_worker();
+    // Background jobs would hold on to a ring slot for too long
+    if (index >= 0 && priority == Priority::Normal) {
+        Worker &self = *workers[index];
+        Job *job = &self.jobs[self.next_job % JOBS_PER_WORKER];
+        // If the ring has wrapped around onto a job that is still queued or
+        // running, fall back to the heap. Waiting for the slot could deadlock
+        // when that job is running further up this thread's stack.
+        if (job->finished.load(std::memory_order_acquire)) {
+            self.next_job++;
+            job->finished.store(false, std::memory_order_relaxed);
+            job->heap_allocated = false;
+            return job;
+        }
+    }
+
+    Job *job = new Job;
+    job->heap_allocated = true;
+    return job;
+}
+
+void JobSystem::submit(Job *job, Priority const priority) {
+    // Counted before the job becomes visible, so that taking it can never
+    // bring the count below zero
+    queued_jobs.fetch_add(1);
+
+    int const index = current_worker();
+    if (priority == Priority::Background) {
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        background_jobs.push_back(job);
+        background_job_count.fetch_add(1, std::memory_order_relaxed);
+    } else if (index < 0) {
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        shared_jobs.push_back(job);
+        shared_job_count.fetch_add(1, std::memory_order_relaxed);
+    } else if (!workers[index]->deque.push(job)) {
+        // Only possible with more unfinished jobs than slots, run it right away
+        queued_jobs.fetch_sub(1);
+        execute(job);
+        return;
+    }
+
+    if (sleeping_workers.load() > 0) {
+        // Taking the lock makes sure a worker about to sleep either sees the
+        // job or is already waiting for this notification
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        wake.notify_one();
+    }
+}
+
+Job *JobSystem::take_job(Worker *self, bool const allow_background) {
+    Job *job = nullptr;
+    if (self) {
+        job = self->deque.pop();
+    }
+
+    // Steal from the others, starting at a random one to spread thieves out
+    uint32_t const count = (uint32_t)workers.size();
+    if (!job && count > 1) {
+        uint32_t const start = self ? xorshift(self->random_state) % count : 0;
+        for (uint32_t i = 0; i < count && !job; i++) {
+            Worker *victim = workers[(start + i) % count].get();
+            if (victim != self) {
+                job = victim->deque.steal();
+            }
+        }
+    }
+
+    if (!job && shared_job_count.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        if (!shared_jobs.empty()) {
+            job = shared_jobs.front();
+            shared_jobs.pop_front();
+            shared_job_count.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (!job && allow_background && background_job_count.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        if (!background_jobs.empty()) {
+            job = background_jobs.front();
+            background_jobs.pop_front();
+            background_job_count.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (job) {
+        queued_jobs.fetch_sub(1);
+    }
+    return job;
+}
+
+void JobSystem::execute(Job *job) {
+    job->execute(*job);
+
+    // Nothing may touch the counter once it reaches zero, its waiter may
+    // already have destroyed it
+    Counter *counter = job->counter;
+    if (job->heap_allocated) {
+        delete job;
+    } else {
+        job->finished.store(true, std::memory_order_release);
+    }
+    counter->pending.fetch_sub(1, std::memory_order_release);
+}
+
+void JobSystem::worker_loop(uint32_t const index, void (*on_thread_start)(uint32_t index)) {
+    current_system = this;
+    current_index = (int)index;
+    Worker *self = workers[index].get();
+
+    if (on_thread_start) {
+        on_thread_start(index);
+    }
+
+    while (true) {
+        if (Job *job = take_job(self, true)) {
+            execute(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        if (stopping) {
+            return;
+        }
+        sleeping_workers.fetch_add(1);
+        wake.wait(lock, [this]() { return stopping || queued_jobs.load() > 0; });
+        sleeping_workers.fetch_sub(1);
+        if (stopping && queued_jobs.load() == 0) {
+            return;
+        }
+    }
+}
+
+} // namespace jobs
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace jobs {
+
+class JobSystem;
+
+// Number of jobs started with it that haven't finished yet. A job can be
+// added to a counter that is being waited on, e.g. by one of its jobs.
+class Counter {
+  public:
+    bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+  private:
+    friend class JobSystem;
+    std::atomic<uint32_t> pending{0};
+};
+
+enum class Priority {
+    Normal,
+    // Long jobs (e.g. pipeline compiles) that must not delay a frame. They
+    // only run on the worker threads and never on a thread waiting on a
+    // counter.
+    Background,
+};
+
+// Bytes of captures a job's function can hold
+constexpr size_t JOB_STORAGE_SIZE = 64;
+
+struct Job {
+    void (*execute)(Job &job);
+    Counter *counter;
+    bool heap_allocated;
+    // Set once the job has run and its slot can be reused
+    std::atomic<bool> finished{true};
+    alignas(std::max_align_t) unsigned char storage[JOB_STORAGE_SIZE];
+};
+
+// Chase-Lev work-stealing deque of jobs, with a fixed power of two capacity.
+// Only the owning thread pushes and pops (LIFO, at the bottom), any thread may
+// steal (FIFO, at the top).
+class WorkStealingDeque {
+  public:
+    explicit WorkStealingDeque(uint32_t const capacity);
+
+    // Returns false if the deque is full
+    bool push(Job *job);
+    // Returns nullptr if the deque is empty
+    Job *pop();
+    // Returns nullptr if the deque is empty or another thread won the race
+    // for the top job
+    Job *steal();
+
+    // Approximate when other threads are pushing or taking jobs
+    size_t size() const;
+
+  private:
+    // Operations that decide races between pop() and steal() are seq_cst
+    // rather than relying on standalone fences, which ThreadSanitizer doesn't
+    // understand
+    std::atomic<int64_t> top{0};
+    std::atomic<int64_t> bottom{0};
+    std::unique_ptr<std::atomic<Job *>[]> buffer;
+    int64_t mask;
+};
+
+// Work-stealing scheduler. The thread calling init() becomes worker 0 and
+// runs jobs whenever it waits on a counter; the other workers are threads of
+// their own. Each worker pushes the jobs it starts onto its own deque and
+// steals from the others when that runs dry. Threads that aren't workers can
+// start jobs too, through a shared queue.
+class JobSystem {
+  public:
+    // Starts the worker threads. A worker_count of 0 uses one per hardware
+    // thread besides the calling one. There is always at least one, which
+    // background jobs rely on. on_thread_start, if set, is called first thing
+    // on each new thread, e.g. to name it for a profiler.
+    void init(uint32_t worker_count = 0, void (*on_thread_start)(uint32_t index) = nullptr);
+
+    // Runs the jobs still queued, then joins the workers. Must be called from
+    // the thread that called init().
+    void cleanup();
+
+    // Worker threads plus the thread that called init()
+    uint32_t thread_count() const { return (uint32_t)workers.size(); }
+
+    // Index of the calling thread, 0 to thread_count() - 1, or -1 if it isn't
+    // one of this system's workers
+    int current_worker() const;
+
+    // Starts a job that calls function(). Its captures are copied into the
+    // job and must fit in JOB_STORAGE_SIZE bytes.
+    template <typename F>
+    void run(Counter &counter, F &&function, Priority const priority = Priority::Normal) {
+        using Function = std::decay_t<F>;
+        static_assert(
+            sizeof(Function) <= JOB_STORAGE_SIZE,
+            "Job captures too much, capture a pointer to the data instead");
+        static_assert(alignof(Function) <= alignof(std::max_align_t), "Job is over-aligned");
+
+        Job *job = allocate_job(priority);
+        new (job->storage) Function(std::forward<F>(function));
+        job->execute = [](Job &job) {
+            Function &f = *std::launder(reinterpret_cast<Function *>(job.storage));
+            f();
+            f.~Function();
+        };
+        job->counter = &counter;
+        counter.pending.fetch_add(1, std::memory_order_relaxed);
+        submit(job, priority);
+    }
+
+    // Returns once every job of the counter has finished. Workers run other
+    // normal priority jobs while they wait.
+    void wait(Counter &counter);
+
+    // Calls function(begin, end) on ranges covering [0, count) of at most
+    // grain_size items, in parallel, and returns once all have finished. A
+    // grain_size of 0 picks one that gives each thread a few ranges.
+    template <typename F>
+    void parallel_for(uint32_t const count, uint32_t grain_size, F const &function) {
+        if (count == 0) {
+            return;
+        }
+        if (grain_size == 0) {
+            grain_size = std::max(1u, count / (thread_count() * 4));
+        }
+
+        Counter counter;
+        run_range(counter, function, 0, count, grain_size);
+        wait(counter);
+    }
+
+  private:
+    struct Worker {
+        Worker();
+
+        WorkStealingDeque deque;
+        // Ring of job slots for the jobs this worker starts. A slot is reused
+        // once the job that last used it has finished.
+        std::unique_ptr<Job[]> jobs;
+        uint32_t next_job{0};
+        uint32_t random_state;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    // Jobs started by threads that aren't workers, and background jobs
+    std::mutex shared_mutex;
+    std::deque<Job *> shared_jobs;
+    std::deque<Job *> background_jobs;
+    std::atomic<uint32_t> shared_job_count{0};
+    std::atomic<uint32_t> background_job_count{0};
+
+    // Jobs started but not yet taken by a thread. Idle workers sleep while it
+    // is 0.
+    std::atomic<int64_t> queued_jobs{0};
+    std::atomic<uint32_t> sleeping_workers{0};
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    bool stopping{false};
+
+    // Splits the range in halves until they are small enough, handing the
+    // upper halves out as jobs so that thieves take the largest ranges
+    template <typename F>
+    void run_range(
+        Counter &counter, F const &function, uint32_t begin, uint32_t end,
+        uint32_t const grain_size) {
+        while (end - begin > grain_size) {
+            uint32_t const mid = begin + (end - begin) / 2;
+            run(counter, [this, &counter, &function, mid, end, grain_size]() {
+                run_range(counter, function, mid, end, grain_size);
+            });
+            end = mid;
+        }
+        function(begin, end);
+    }
+
+    Job *allocate_job(Priority const priority);
+    void submit(Job *job, Priority const priority);
+
+    // Own deque first, then the other workers', then the shared queues.
+    // Returns nullptr if no job could be found.
+    Job *take_job(Worker *self, bool const allow_background);
+    void execute(Job *job);
+
+    void worker_loop(uint32_t const index, void (*on_thread_start)(uint32_t index));
+};
+
+} // namespace jobs
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace jobs {
+
+// Bounded lock-free queue between exactly one producer thread and one
+// consumer thread, a ring with a power of two capacity. Each index is only
+// written by one side, so pushing and popping are a load and a store each,
+// and the indices sit on their own cache lines so the two sides don't
+// invalidate each other's.
+template <typename T> class SpscQueue {
+  public:
+    // capacity is rounded up to a power of two
+    explicit SpscQueue(uint32_t const capacity) {
+        uint32_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        items = std::make_unique<T[]>(size);
+        mask = size - 1;
+    }
+
+    // Producer only. Returns false if the queue is full.
+    bool push(T const &item) {
+        uint64_t const tail = write_index.load(std::memory_order_relaxed);
+        if (tail - cached_read_index > mask) {
+            cached_read_index = read_index.load(std::memory_order_acquire);
+            if (tail - cached_read_index > mask) {
+                return false;
+            }
+        }
+        items[tail & mask] = item;
+        write_index.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Returns false if the queue is empty.
+    bool pop(T &out_item) {
+        uint64_t const head = read_index.load(std::memory_order_relaxed);
+        if (head == cached_write_index) {
+            cached_write_index = write_index.load(std::memory_order_acquire);
+            if (head == cached_write_index) {
+                return false;
+            }
+        }
+        out_item = items[head & mask];
+        read_index.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+  private:
+    static constexpr size_t CACHE_LINE = 64;
+
+    std::unique_ptr<T[]> items;
+    uint64_t mask;
+
+    // Written by the producer, with the last read index it saw
+    alignas(CACHE_LINE) std::atomic<uint64_t> write_index{0};
+    uint64_t cached_read_index{0};
+    // Written by the consumer, with the last write index it saw
+    alignas(CACHE_LINE) std::atomic<uint64_t> read_index{0};
+    uint64_t cached_write_index{0};
+};
+
+} // namespace jobs
@@ -0,0 +1,120 @@
+#include <logger.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// Calls per timed batch, half a ring so that the background thread never
+// has to catch up mid-batch
+constexpr uint32_t BATCH_SIZE = logging::RING_RECORDS / 2;
+constexpr uint32_t BATCHES = 200;
+
+#ifdef _WIN32
+constexpr char const *NULL_DEVICE = "NUL";
+#else
+constexpr char const *NULL_DEVICE = "/dev/null";
+#endif
+
+double elapsed_ns(Clock::time_point const start, Clock::time_point const end) {
+    return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+void print_usage(char const *exe) {
+    std::cout << "Usage: " << exe << " [--threads N]\n"
+              << "  --threads N      threads logging at once in the contended run,\n"
+              << "                   defaults to 4\n";
+}
+
+// Nanoseconds per call of a typical engine message: a few strings, an
+// integer and a double. Only the calls are timed, the rings are flushed
+// between batches.
+template <typename F> double time_calls(F const &log_call) {
+    double total_ns = 0.0;
+    for (uint32_t batch = 0; batch < BATCHES; batch++) {
+        Clock::time_point const start = Clock::now();
+        for (uint32_t i = 0; i < BATCH_SIZE; i++) {
+            log_call(batch * BATCH_SIZE + i);
+        }
+        total_ns += elapsed_ns(start, Clock::now());
+        logging::flush();
+    }
+    return total_ns / (BATCHES * BATCH_SIZE);
+}
+
+void log_frame(uint32_t const frame) {
+    LOG_INFO("Frame " << frame << " took " << 16.6 << " ms on \"" << "main" << "\".");
+}
+
+void log_filtered(uint32_t const frame) {
+    LOG_DEBUG("Frame " << frame << " took " << 16.6 << " ms on \"" << "main" << "\".");
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    uint32_t thread_count = 4;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            thread_count = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+
+    std::FILE *const null_output = std::fopen(NULL_DEVICE, "w");
+    if (!null_output) {
+        std::printf("Failed to open %s.\n", NULL_DEVICE);
+        return 1;
+    }
+    logging::init(null_output);
+
+    // The first call registers the thread's ring
+    log_frame(0);
+    logging::flush();
+
+    double const filtered_ns = time_calls(log_filtered);
+    double const async_ns = time_calls(log_frame);
+
+    // Every thread logging at once, each into its own ring
+    std::vector<double> thread_ns(thread_count);
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < thread_count; t++) {
+        threads.emplace_back([&thread_ns, t]() { thread_ns[t] = time_calls(log_frame); });
+    }
+    double contended_ns = 0.0;
+    for (uint32_t t = 0; t < thread_count; t++) {
+        threads[t].join();
+        contended_ns += thread_ns[t] / thread_count;
+    }
+
+    logging::shutdown();
+    uint64_t const dropped = logging::dropped_count();
+
+    // What LOG_INFO used to do: format and flush with std::endl on the
+    // calling thread
+    std::ofstream sync_output(NULL_DEVICE);
+    double const sync_ns = time_calls([&sync_output](uint32_t const frame) {
+        sync_output << "[INFO] " << "Frame " << frame << " took " << 16.6 << " ms on \""
+                    << "main" << "\"." << std::endl;
+    });
+    std::fclose(null_output);
+
+    std::printf("Log call cost (ns per call, %u calls)\n", BATCHES * BATCH_SIZE);
+    std::printf("  LOG_DEBUG, filtered out  %8.1f\n", filtered_ns);
+    std::printf("  async, one thread        %8.1f\n", async_ns);
+    std::printf("  async, %2u threads        %8.1f\n", thread_count, contended_ns);
+    std::printf("  std::cout-style, endl    %8.1f\n", sync_ns);
+    std::printf("Dropped calls: %llu\n", (unsigned long long)dropped);
+    return 0;
+}
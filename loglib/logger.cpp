@@ -0,0 +1,392 @@
+#include <logger.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace logging {
+
+namespace detail {
+std::atomic<uint8_t> min_levels[(size_t)Category::Count] = {
+    {(uint8_t)Level::Info}, {(uint8_t)Level::Info}, {(uint8_t)Level::Info}};
+} // namespace detail
+
+namespace {
+static_assert((RING_RECORDS & (RING_RECORDS - 1)) == 0, "The ring size must be a power of two");
+
+constexpr uint8_t LEVEL_OFF = (uint8_t)Level::Error + 1;
+constexpr char const *LEVEL_NAMES[] = {"debug", "info", "warn", "error"};
+constexpr char const *LEVEL_PREFIXES[] = {"[DEBUG]", "[INFO]", "[WARN]", "[ERROR]"};
+constexpr char const *CATEGORY_NAMES[] = {"engine", "input", "validation"};
+static_assert(std::size(CATEGORY_NAMES) == (size_t)Category::Count, "A category has no name");
+
+// Single producer, the thread it belongs to, and a single consumer, whoever
+// holds drain_mutex
+struct ThreadRing {
+    std::unique_ptr<detail::Record[]> records{new detail::Record[RING_RECORDS]};
+    alignas(64) std::atomic<uint64_t> write_index{0};
+    uint64_t cached_read_index{0}; // producer only
+    std::atomic<uint64_t> dropped{0};
+    alignas(64) std::atomic<uint64_t> read_index{0};
+};
+
+// Rings are never freed, a thread that has exited may still have records
+// waiting in its ring
+std::mutex rings_mutex;
+std::vector<std::unique_ptr<ThreadRing>> rings;
+thread_local ThreadRing *thread_ring = nullptr;
+
+std::mutex settings_mutex;
+Level min_level = Level::Info;
+bool category_enabled[(size_t)Category::Count] = {true, true, true};
+
+// Held while draining, which makes the drained records' memory visible to
+// whichever thread drains next
+std::mutex drain_mutex;
+std::FILE *output = stdout;
+std::vector<ThreadRing *> drain_rings;
+std::vector<uint64_t> drain_ends;
+std::vector<detail::Record const *> drain_records;
+uint64_t reported_dropped = 0;
+
+std::thread backend;
+std::atomic<bool> running{false};
+std::mutex wake_mutex;
+std::condition_variable wake;
+bool stopping = false;
+
+uint64_t now_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+ThreadRing &get_thread_ring() {
+    if (!thread_ring) {
+        std::unique_ptr<ThreadRing> ring = std::make_unique<ThreadRing>();
+        thread_ring = ring.get();
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        rings.push_back(std::move(ring));
+    }
+    return *thread_ring;
+}
+
+void update_min_levels() {
+    for (size_t i = 0; i < (size_t)Category::Count; i++) {
+        uint8_t const level = category_enabled[i] ? (uint8_t)min_level : LEVEL_OFF;
+        detail::min_levels[i].store(level, std::memory_order_relaxed);
+    }
+}
+
+template <typename T> T read_value(unsigned char const *&cursor) {
+    T value;
+    std::memcpy(&value, cursor, sizeof(T));
+    cursor += sizeof(T);
+    return value;
+}
+
+// Appends a record to line, the first part of a message with its prefix
+void format_record(
+    detail::Record const &record, bool const first_part, char *line, size_t const capacity,
+    size_t &length
+) {
+    auto append = [&](char const *data, size_t const size) {
+        size_t const copied = std::min(size, capacity - 1 - length);
+        std::memcpy(line + length, data, copied);
+        length += copied;
+    };
+    char number[32];
+    // Leaves room for the newline
+    auto append_number = [&](int const size) {
+        append(number, (size_t)std::max(size, 0));
+    };
+
+    if (first_part) {
+        char const *const prefix = LEVEL_PREFIXES[(size_t)record.level];
+        append(prefix, std::strlen(prefix));
+        if (record.category != Category::Engine) {
+            char const *const category = CATEGORY_NAMES[(size_t)record.category];
+            append("[", 1);
+            append(category, std::strlen(category));
+            append("]", 1);
+        }
+        append(" ", 1);
+    }
+
+    unsigned char const *cursor = record.payload;
+    unsigned char const *const end = record.payload + record.size;
+    while (cursor < end) {
+        detail::Tag const tag = (detail::Tag)*cursor++;
+        switch (tag) {
+            case detail::Tag::String: {
+                uint16_t const size = read_value<uint16_t>(cursor);
+                append((char const *)cursor, size);
+                cursor += size;
+                break;
+            }
+            case detail::Tag::Char: {
+                char const value = read_value<char>(cursor);
+                append(&value, 1);
+                break;
+            }
+            case detail::Tag::Bool: {
+                bool const value = read_value<bool>(cursor);
+                append(value ? "true" : "false", value ? 4 : 5);
+                break;
+            }
+            case detail::Tag::Int:
+                append_number(std::snprintf(
+                    number, sizeof(number), "%lld", (long long)read_value<int64_t>(cursor)));
+                break;
+            case detail::Tag::Uint:
+                append_number(std::snprintf(
+                    number, sizeof(number), "%llu",
+                    (unsigned long long)read_value<uint64_t>(cursor)));
+                break;
+            case detail::Tag::Double:
+                append_number(
+                    std::snprintf(number, sizeof(number), "%g", read_value<double>(cursor)));
+                break;
+            case detail::Tag::Pointer:
+                append_number(std::snprintf(
+                    number, sizeof(number), "0x%llx",
+                    (unsigned long long)read_value<uint64_t>(cursor)));
+                break;
+        }
+    }
+    if (record.truncated) {
+        append(" [truncated]", 12);
+    }
+}
+
+// Writes the records committed to every ring so far, merged by timestamp
+void drain() {
+    std::lock_guard<std::mutex> drain_lock(drain_mutex);
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        drain_rings.clear();
+        for (std::unique_ptr<ThreadRing> const &ring : rings) {
+            drain_rings.push_back(ring.get());
+        }
+    }
+
+    drain_ends.resize(drain_rings.size());
+    drain_records.clear();
+    uint64_t dropped = 0;
+    for (size_t i = 0; i < drain_rings.size(); i++) {
+        ThreadRing &ring = *drain_rings[i];
+        uint64_t const begin = ring.read_index.load(std::memory_order_relaxed);
+        uint64_t const end = ring.write_index.load(std::memory_order_acquire);
+        for (uint64_t index = begin; index < end; index++) {
+            drain_records.push_back(&ring.records[index & (RING_RECORDS - 1)]);
+        }
+        drain_ends[i] = end;
+        dropped += ring.dropped.load(std::memory_order_relaxed);
+    }
+
+    // A message's parts share a timestamp and stay together, in ring order
+    std::stable_sort(
+        drain_records.begin(), drain_records.end(),
+        [](detail::Record const *a, detail::Record const *b) { return a->time_ns < b->time_ns; });
+
+    char line[MAX_RECORD_PARTS * RECORD_PAYLOAD_SIZE * 2];
+    size_t length = 0;
+    bool first_part = true;
+    for (detail::Record const *record : drain_records) {
+        format_record(*record, first_part, line, sizeof(line), length);
+        first_part = !record->continued;
+        if (first_part) {
+            line[length++] = '\n';
+            std::fwrite(line, 1, length, output);
+            length = 0;
+        }
+    }
+    if (dropped > reported_dropped) {
+        std::fprintf(
+            output, "[WARN] %llu log calls were dropped, their thread's ring was full.\n",
+            (unsigned long long)(dropped - reported_dropped));
+        reported_dropped = dropped;
+    }
+    if (!drain_records.empty()) {
+        std::fflush(output);
+    }
+
+    // The records are only handed back to their producers once written
+    for (size_t i = 0; i < drain_rings.size(); i++) {
+        drain_rings[i]->read_index.store(drain_ends[i], std::memory_order_release);
+    }
+}
+
+void backend_main() {
+    std::unique_lock<std::mutex> lock(wake_mutex);
+    while (!stopping) {
+        // Producers never wake it, that would cost them a system call
+        wake.wait_for(lock, std::chrono::milliseconds(DRAIN_INTERVAL_MS));
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
+}
+} // namespace
+
+void init(std::FILE *out) {
+    if (running.load()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(drain_mutex);
+        output = out;
+    }
+    stopping = false;
+    backend = std::thread(backend_main);
+    running.store(true);
+}
+
+void shutdown() {
+    if (!running.load()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    backend.join();
+    running.store(false);
+    drain();
+}
+
+void flush() {
+    drain();
+}
+
+void set_min_level(Level const level) {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    min_level = level;
+    update_min_levels();
+}
+
+void set_category_enabled(Category const category, bool const enabled) {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    category_enabled[(size_t)category] = enabled;
+    update_min_levels();
+}
+
+bool parse_level(char const *name, Level &out_level) {
+    for (size_t i = 0; i < std::size(LEVEL_NAMES); i++) {
+        if (std::strcmp(name, LEVEL_NAMES[i]) == 0) {
+            out_level = (Level)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parse_category(char const *name, Category &out_category) {
+    for (size_t i = 0; i < std::size(CATEGORY_NAMES); i++) {
+        if (std::strcmp(name, CATEGORY_NAMES[i]) == 0) {
+            out_category = (Category)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t dropped_count() {
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    uint64_t dropped = 0;
+    for (std::unique_ptr<ThreadRing> const &ring : rings) {
+        dropped += ring->dropped.load(std::memory_order_relaxed);
+    }
+    return dropped;
+}
+
+namespace detail {
+Record *begin_record(uint32_t const part) {
+    ThreadRing &ring = get_thread_ring();
+    uint64_t const slot = ring.write_index.load(std::memory_order_relaxed) + part;
+    if (slot - ring.cached_read_index >= RING_RECORDS) {
+        ring.cached_read_index = ring.read_index.load(std::memory_order_acquire);
+        if (slot - ring.cached_read_index >= RING_RECORDS) {
+            // Later parts are only truncated
+            if (part == 0) {
+                ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            return nullptr;
+        }
+    }
+    return &ring.records[slot & (RING_RECORDS - 1)];
+}
+
+void commit_record(Record const &first, uint32_t const parts) {
+    ThreadRing &ring = *thread_ring;
+    ring.write_index.store(
+        ring.write_index.load(std::memory_order_relaxed) + parts, std::memory_order_release);
+
+    // Nothing would write it otherwise, and an error is likely the last
+    // thing logged before abort()
+    if (first.level == Level::Error || !running.load(std::memory_order_relaxed)) {
+        drain();
+    }
+}
+} // namespace detail
+
+RecordWriter::RecordWriter(Level const level, Category const category)
+    : first(detail::begin_record(0)), record(first) {
+    if (record) {
+        record->time_ns = now_ns();
+        record->level = level;
+        record->category = category;
+        record->truncated = false;
+        record->continued = false;
+        record->size = 0;
+    }
+}
+
+void RecordWriter::next_part() {
+    detail::Record *next =
+        parts < MAX_RECORD_PARTS ? detail::begin_record(parts) : nullptr;
+    if (!next) {
+        record->truncated = true;
+        record = nullptr;
+        return;
+    }
+    *next = {};
+    next->time_ns = record->time_ns;
+    next->level = record->level;
+    next->category = record->category;
+    record->continued = true;
+    record = next;
+    parts++;
+}
+
+RecordWriter &RecordWriter::write_string(char const *data, size_t size) {
+    // Split across as many parts as it takes
+    while (record) {
+        size_t const header = 1 + sizeof(uint16_t);
+        size_t const available = RECORD_PAYLOAD_SIZE - record->size;
+        if (available <= header) {
+            next_part();
+            continue;
+        }
+        uint16_t const length = (uint16_t)std::min(size, available - header);
+        record->payload[record->size] = (unsigned char)detail::Tag::String;
+        std::memcpy(record->payload + record->size + 1, &length, sizeof(length));
+        std::memcpy(record->payload + record->size + header, data, length);
+        record->size += (uint16_t)(header + length);
+        data += length;
+        size -= length;
+        if (size == 0) {
+            break;
+        }
+        next_part();
+    }
+    return *this;
+}
+
+} // namespace logging
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Levels below this are compiled out, e.g. -DLOG_COMPILED_LEVEL=1 drops
+// LOG_DEBUG everywhere
+#ifndef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL 0
+#endif
+
+// Asynchronous logger. A log call copies its arguments, unformatted, into a
+// lock-free ring owned by the calling thread, and a background thread
+// formats and writes them in timestamp order. Calls don't allocate or lock,
+// except for the first one on each thread, which registers its ring. When a
+// ring is full the call is dropped and counted rather than blocking.
+//
+// Errors are written before the call returns, along with everything logged
+// before them, as they usually come right before abort().
+namespace logging {
+
+enum class Level : uint8_t {
+    Debug,
+    Info,
+    Warn,
+    Error,
+};
+
+enum class Category : uint8_t {
+    Engine,
+    Input,
+    Validation, // Vulkan debug messenger
+    Count,
+};
+
+// Bytes of arguments a record holds. Longer messages continue in the next
+// records of the ring, up to MAX_RECORD_PARTS, and are truncated past that.
+constexpr uint32_t RECORD_PAYLOAD_SIZE = 242;
+constexpr uint32_t MAX_RECORD_PARTS = 8;
+// Records each thread can have waiting for the background thread
+constexpr uint32_t RING_RECORDS = 1024;
+// How often the background thread drains the rings
+constexpr uint32_t DRAIN_INTERVAL_MS = 2;
+
+// Starts the background thread, writing to out. Until then, and after
+// shutdown(), records are written by the thread logging them.
+void init(std::FILE *out = stdout);
+// Writes what is left and joins the background thread
+void shutdown();
+// Writes every record committed so far, on the calling thread
+void flush();
+
+// Runtime filtering, on top of LOG_COMPILED_LEVEL
+void set_min_level(Level const level);
+void set_category_enabled(Category const category, bool const enabled);
+// Returns false for a name that isn't a level or category
+bool parse_level(char const *name, Level &out_level);
+bool parse_category(char const *name, Category &out_category);
+
+// Calls dropped because their thread's ring was full
+uint64_t dropped_count();
+
+namespace detail {
+// Per category, the lowest level that is written, Error + 1 if none
+extern std::atomic<uint8_t> min_levels[(size_t)Category::Count];
+
+enum class Tag : uint8_t {
+    String,
+    Char,
+    Bool,
+    Int,
+    Uint,
+    Double,
+    Pointer,
+};
+
+struct Record {
+    uint64_t time_ns;
+    Level level;
+    Category category;
+    bool truncated;
+    bool continued; // in the next record
+    uint16_t size;  // of payload used
+    unsigned char payload[RECORD_PAYLOAD_SIZE];
+};
+static_assert(sizeof(Record) == 256, "Records are meant to fill four cache lines");
+
+// The calling thread's part-th next free record, nullptr if its ring is
+// full
+Record *begin_record(uint32_t const part);
+// Hands the parts of a message over to the background thread
+void commit_record(Record const &first, uint32_t const parts);
+} // namespace detail
+
+constexpr bool compiled_in(Level const level) {
+    return (int)level + 1 > LOG_COMPILED_LEVEL;
+}
+
+inline bool enabled(Level const level, Category const category) {
+    return (uint8_t)level
+        >= detail::min_levels[(size_t)category].load(std::memory_order_relaxed);
+}
+
+// Encodes the arguments of one log call into a record, each as a tag and
+// its raw bytes. Strings are copied, numbers are formatted later.
+class RecordWriter {
+  public:
+    RecordWriter(Level const level, Category const category);
+    ~RecordWriter() {
+        if (first) {
+            detail::commit_record(*first, parts);
+        }
+    }
+
+    RecordWriter(RecordWriter const &) = delete;
+    RecordWriter &operator=(RecordWriter const &) = delete;
+
+    RecordWriter &operator<<(char const *value) {
+        return write_string(value ? value : "(null)", value ? std::strlen(value) : 6);
+    }
+    RecordWriter &operator<<(std::string const &value) {
+        return write_string(value.data(), value.size());
+    }
+    RecordWriter &operator<<(std::string_view const value) {
+        return write_string(value.data(), value.size());
+    }
+    RecordWriter &operator<<(char const value) { return write(detail::Tag::Char, value); }
+    RecordWriter &operator<<(bool const value) { return write(detail::Tag::Bool, value); }
+
+    // Integers, floating point, enums (as their value) and pointers
+    template <typename T>
+    std::enable_if_t<
+        std::is_arithmetic_v<T> || std::is_enum_v<T> || std::is_pointer_v<T>, RecordWriter &>
+    operator<<(T const value) {
+        if constexpr (std::is_same_v<std::remove_cv_t<std::remove_pointer_t<T>>, char>) {
+            return *this << (char const *)value;
+        } else if constexpr (std::is_pointer_v<T>) {
+            return write(detail::Tag::Pointer, (uint64_t)(uintptr_t)value);
+        } else if constexpr (std::is_enum_v<T>) {
+            return write(detail::Tag::Int, (int64_t)value);
+        } else if constexpr (std::is_floating_point_v<T>) {
+            return write(detail::Tag::Double, (double)value);
+        } else if constexpr (std::is_signed_v<T>) {
+            return write(detail::Tag::Int, (int64_t)value);
+        } else {
+            return write(detail::Tag::Uint, (uint64_t)value);
+        }
+    }
+
+  private:
+    detail::Record *first;
+    detail::Record *record; // being written, nullptr once out of parts
+    uint32_t parts{1};
+
+    template <typename T> RecordWriter &write(detail::Tag const tag, T const value) {
+        if (record && record->size + 1 + sizeof(T) > RECORD_PAYLOAD_SIZE) {
+            next_part();
+        }
+        if (record) {
+            record->payload[record->size] = (unsigned char)tag;
+            std::memcpy(record->payload + record->size + 1, &value, sizeof(T));
+            record->size += (uint16_t)(1 + sizeof(T));
+        }
+        return *this;
+    }
+    RecordWriter &write_string(char const *data, size_t size);
+    // Continues the message in a new record, or marks it truncated
+    void next_part();
+};
+
+} // namespace logging
+
+// Writes msg, a chain of values joined with <<, if level and category pass
+// both filters. The arguments aren't evaluated otherwise, and must not log
+// themselves. level must be a constant.
+#define LOG_AT(level, category, msg)                                           \
+    do {                                                                       \
+        if constexpr (::logging::compiled_in(level)) {                         \
+            if (::logging::enabled(level, category)) {                         \
+                ::logging::RecordWriter log_writer_(level, category);          \
+                log_writer_ << msg;                                            \
+            }                                                                  \
+        }                                                                      \
+    } while (0)
+
+#define LOG_DEBUG(msg) LOG_AT(::logging::Level::Debug, ::logging::Category::Engine, msg)
+#define LOG_INFO(msg) LOG_AT(::logging::Level::Info, ::logging::Category::Engine, msg)
+#define LOG_WARN(msg) LOG_AT(::logging::Level::Warn, ::logging::Category::Engine, msg)
+#define LOG_ERROR(msg) LOG_AT(::logging::Level::Error, ::logging::Category::Engine, msg)
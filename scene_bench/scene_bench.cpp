@@ -0,0 +1,216 @@
+#include <job_system.h>
+#include <scene.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// Each group is a root with this many children, e.g. a character and its
+// attachments
+constexpr uint32_t GROUP_SIZE = 16;
+constexpr int RUNS = 5;
+
+double elapsed_ms(Clock::time_point const start, Clock::time_point const end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void print_usage(char const *exe) {
+    std::cout << "Usage: " << exe << " [--threads N] [--max-objects N]\n"
+              << "  --threads N      threads of the parallel updates, defaults to the\n"
+              << "                   hardware thread count\n"
+              << "  --max-objects N  largest scene measured, from 1000 up by 10x,\n"
+              << "                   defaults to 1000000\n";
+}
+
+// The array of structs the store replaces: every renderable in one struct,
+// children pointing at their parents
+struct Renderable {
+    void const *mesh;
+    Renderable const *parent;
+    glm::vec3 position;
+    glm::quat rotation;
+    glm::vec3 scale;
+    glm::mat4 world;
+    glm::vec4 local_bounds;
+    glm::vec4 world_bounds;
+};
+
+// Parents before children, like the store, so one pass updates everything
+void update_renderables(std::vector<Renderable> &renderables) {
+    for (Renderable &renderable : renderables) {
+        glm::mat4 const local = glm::translate(glm::mat4(1.f), renderable.position)
+            * glm::mat4_cast(renderable.rotation) * glm::scale(glm::mat4(1.f), renderable.scale);
+        renderable.world = renderable.parent ? renderable.parent->world * local : local;
+        glm::vec3 const center =
+            glm::vec3(renderable.world * glm::vec4(glm::vec3(renderable.local_bounds), 1.f));
+        float const max_scale = std::max(
+            glm::length(glm::vec3(renderable.world[0])),
+            std::max(
+                glm::length(glm::vec3(renderable.world[1])),
+                glm::length(glm::vec3(renderable.world[2]))));
+        renderable.world_bounds = glm::vec4(center, renderable.local_bounds.w * max_scale);
+    }
+}
+
+glm::vec3 group_position(uint32_t const group) {
+    return glm::vec3((float)(group % 1024), (float)(group / 1024), 0.f) * 4.f;
+}
+
+glm::vec3 child_position(uint32_t const child) {
+    float const angle = child * 0.4f;
+    return glm::vec3(std::cos(angle), std::sin(angle), 0.f);
+}
+
+// Groups of a root and GROUP_SIZE - 1 children, about count nodes. Returns
+// the roots.
+std::vector<scene::NodeId> build_scene(uint32_t const count, scene::SceneStore &store) {
+    std::vector<scene::NodeId> roots;
+    store.clear();
+    store.reserve(count);
+    for (uint32_t group = 0; group * GROUP_SIZE < count; group++) {
+        scene::NodeDesc root;
+        root.position = group_position(group);
+        root.local_bounds = glm::vec4(0.f, 0.f, 0.f, 2.f);
+        roots.push_back(store.add_node(root));
+        for (uint32_t child = 1; child < GROUP_SIZE; child++) {
+            scene::NodeDesc desc;
+            desc.parent = roots.back();
+            desc.position = child_position(child);
+            desc.scale = glm::vec3(0.25f);
+            desc.local_bounds = glm::vec4(0.f, 0.f, 0.f, 1.f);
+            desc.mesh = 0;
+            desc.material = 0;
+            store.add_node(desc);
+        }
+    }
+    return roots;
+}
+
+void build_renderables(uint32_t const count, std::vector<Renderable> &renderables) {
+    renderables.clear();
+    // Children point into the array, it must never grow
+    renderables.reserve((count + GROUP_SIZE - 1) / GROUP_SIZE * GROUP_SIZE);
+    static int const mesh = 0;
+    for (uint32_t group = 0; group * GROUP_SIZE < count; group++) {
+        Renderable root = {};
+        root.position = group_position(group);
+        root.rotation = glm::quat(1.f, 0.f, 0.f, 0.f);
+        root.scale = glm::vec3(1.f);
+        root.local_bounds = glm::vec4(0.f, 0.f, 0.f, 2.f);
+        renderables.push_back(root);
+        Renderable const *parent = &renderables.back();
+        for (uint32_t child = 1; child < GROUP_SIZE; child++) {
+            Renderable renderable = {};
+            renderable.mesh = &mesh;
+            renderable.parent = parent;
+            renderable.position = child_position(child);
+            renderable.rotation = glm::quat(1.f, 0.f, 0.f, 0.f);
+            renderable.scale = glm::vec3(0.25f);
+            renderable.local_bounds = glm::vec4(0.f, 0.f, 0.f, 1.f);
+            renderables.push_back(renderable);
+        }
+    }
+}
+
+// Best time of RUNS updates after moving every moved_stride-th root, or
+// none if moved_stride is 0
+double time_update(
+    scene::SceneStore &store, std::vector<scene::NodeId> const &roots,
+    uint32_t const moved_stride, jobs::JobSystem *job_system) {
+    double best_ms = 0.0;
+    for (int run = 0; run < RUNS; run++) {
+        if (moved_stride > 0) {
+            glm::quat const rotation =
+                glm::angleAxis(run * 0.1f, glm::vec3(0.f, 0.f, 1.f));
+            for (size_t i = 0; i < roots.size(); i += moved_stride) {
+                store.set_rotation(roots[i], rotation);
+            }
+        }
+        Clock::time_point const start = Clock::now();
+        store.update_transforms(job_system);
+        double const ms = elapsed_ms(start, Clock::now());
+        if (run == 0 || ms < best_ms) {
+            best_ms = ms;
+        }
+    }
+    return best_ms;
+}
+
+double time_renderables(std::vector<Renderable> &renderables) {
+    double best_ms = 0.0;
+    for (int run = 0; run < RUNS; run++) {
+        glm::quat const rotation = glm::angleAxis(run * 0.1f, glm::vec3(0.f, 0.f, 1.f));
+        for (size_t i = 0; i < renderables.size(); i += GROUP_SIZE) {
+            renderables[i].rotation = rotation;
+        }
+        Clock::time_point const start = Clock::now();
+        update_renderables(renderables);
+        double const ms = elapsed_ms(start, Clock::now());
+        if (run == 0 || ms < best_ms) {
+            best_ms = ms;
+        }
+    }
+    return best_ms;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    uint32_t threads = std::thread::hardware_concurrency();
+    uint32_t max_objects = 1000000;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--max-objects") == 0 && i + 1 < argc) {
+            max_objects = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    jobs::JobSystem system;
+    system.init(threads > 1 ? threads - 1 : 1);
+
+    // All moved is every node recomputed, 1% moved a hundredth of the groups
+    // and none moved only the check that nothing is dirty. AoS is the same
+    // update over an array of structs, on one thread.
+    std::printf(
+        "Transform update, best of %d, groups of %u nodes, %u threads (ms):\n", RUNS,
+        GROUP_SIZE, system.thread_count());
+    std::printf(
+        "  %9s %10s %10s %10s %10s %10s\n", "objects", "AoS", "all 1t", "all Nt", "1% Nt",
+        "none");
+    for (uint32_t count = 1000; count <= max_objects; count *= 10) {
+        scene::SceneStore store;
+        std::vector<scene::NodeId> const roots = build_scene(count, store);
+        store.update_transforms(nullptr);
+
+        std::vector<Renderable> renderables;
+        build_renderables(count, renderables);
+        double const aos_ms = time_renderables(renderables);
+
+        double const single_ms = time_update(store, roots, 1, nullptr);
+        double const parallel_ms = time_update(store, roots, 1, &system);
+        double const partial_ms = time_update(store, roots, 100, &system);
+        double const clean_ms = time_update(store, roots, 0, &system);
+        std::printf(
+            "  %9u %10.3f %10.3f %10.3f %10.3f %10.4f\n", store.size(), aos_ms, single_ms,
+            parallel_ms, partial_ms, clean_ms);
+    }
+
+    system.cleanup();
+    return 0;
+}
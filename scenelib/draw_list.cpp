@@ -0,0 +1,102 @@
+#include <draw_list.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace scene {
+
+uint64_t make_sort_key(
+    uint32_t const pipeline, uint32_t const material, uint32_t const mesh, float const depth
+) {
+    // Non-negative floats order like their bits, so the top ones are a
+    // depth of the key's width that never saturates
+    uint32_t depth_bits;
+    float const clamped = std::max(depth, 0.f);
+    std::memcpy(&depth_bits, &clamped, sizeof(depth_bits));
+    depth_bits >>= 32 - SORT_KEY_DEPTH_BITS;
+
+    uint64_t const pipeline_field = pipeline & ((1u << SORT_KEY_PIPELINE_BITS) - 1);
+    uint64_t const material_field = material & ((1u << SORT_KEY_MATERIAL_BITS) - 1);
+    uint64_t const mesh_field = mesh & ((1u << SORT_KEY_MESH_BITS) - 1);
+    return pipeline_field << (64 - SORT_KEY_PIPELINE_BITS)
+        | material_field << (SORT_KEY_MESH_BITS + SORT_KEY_DEPTH_BITS)
+        | mesh_field << SORT_KEY_DEPTH_BITS | depth_bits;
+}
+
+void radix_sort(
+    uint64_t *keys, uint32_t *values, uint32_t const count, uint64_t *key_scratch,
+    uint32_t *value_scratch
+) {
+    // Histograms of every byte in a single pass over the keys
+    uint32_t histograms[8][256] = {};
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t const key = keys[i];
+        for (uint32_t byte = 0; byte < 8; byte++) {
+            histograms[byte][(key >> (byte * 8)) & 0xff]++;
+        }
+    }
+
+    uint64_t *src_keys = keys;
+    uint32_t *src_values = values;
+    uint64_t *dst_keys = key_scratch;
+    uint32_t *dst_values = value_scratch;
+    for (uint32_t byte = 0; byte < 8; byte++) {
+        uint32_t *const histogram = histograms[byte];
+        // All keys in one bucket, the pass wouldn't move anything. With few
+        // pipelines, materials and meshes most of the high bytes are.
+        if (count == 0 || histogram[(src_keys[0] >> (byte * 8)) & 0xff] == count) {
+            continue;
+        }
+
+        uint32_t offset = 0;
+        for (uint32_t bucket = 0; bucket < 256; bucket++) {
+            uint32_t const bucket_count = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucket_count;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t const destination = histogram[(src_keys[i] >> (byte * 8)) & 0xff]++;
+            dst_keys[destination] = src_keys[i];
+            dst_values[destination] = src_values[i];
+        }
+        std::swap(src_keys, dst_keys);
+        std::swap(src_values, dst_values);
+    }
+
+    // After an odd number of passes the result is in the scratch arrays
+    if (src_keys != keys) {
+        std::copy(src_keys, src_keys + count, keys);
+        std::copy(src_values, src_values + count, values);
+    }
+}
+
+void DrawList::reserve(uint32_t const count) {
+    keys.reserve(count);
+    objects.reserve(count);
+    key_scratch.reserve(count);
+    object_scratch.reserve(count);
+    batches.reserve(count);
+}
+
+void DrawList::resize(uint32_t const count) {
+    keys.resize(count);
+    objects.resize(count);
+}
+
+void DrawList::sort() {
+    key_scratch.resize(keys.size());
+    object_scratch.resize(objects.size());
+    radix_sort(keys.data(), objects.data(), size(), key_scratch.data(), object_scratch.data());
+
+    // Depth is the only field that may differ within a batch
+    uint64_t const state_mask = ~0ull << SORT_KEY_DEPTH_BITS;
+    batches.clear();
+    for (uint32_t i = 0; i < size(); i++) {
+        if (batches.empty() || ((batches.back().key ^ keys[i]) & state_mask) != 0) {
+            batches.push_back({keys[i], i, 0});
+        }
+        batches.back().count++;
+    }
+}
+
+} // namespace scene
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace scene {
+
+// Fields of a draw's 64-bit sort key, from the most significant bits down.
+// Sorting by key groups draws by the state they bind, the most expensive
+// state change first, and orders each group front to back.
+constexpr uint32_t SORT_KEY_PIPELINE_BITS = 8;
+constexpr uint32_t SORT_KEY_MATERIAL_BITS = 12;
+constexpr uint32_t SORT_KEY_MESH_BITS = 20;
+constexpr uint32_t SORT_KEY_DEPTH_BITS = 24;
+
+// Truncates each ID to its field. depth is the view distance, at least 0.
+uint64_t make_sort_key(
+    uint32_t const pipeline, uint32_t const material, uint32_t const mesh, float const depth);
+
+inline uint32_t sort_key_pipeline(uint64_t const key) {
+    return (uint32_t)(key >> (64 - SORT_KEY_PIPELINE_BITS));
+}
+inline uint32_t sort_key_material(uint64_t const key) {
+    return (uint32_t)(key >> (SORT_KEY_MESH_BITS + SORT_KEY_DEPTH_BITS))
+        & ((1u << SORT_KEY_MATERIAL_BITS) - 1);
+}
+inline uint32_t sort_key_mesh(uint64_t const key) {
+    return (uint32_t)(key >> SORT_KEY_DEPTH_BITS) & ((1u << SORT_KEY_MESH_BITS) - 1);
+}
+
+// Sorts the keys and the values along with them, least significant byte
+// first. Bytes that are the same in every key are skipped. The scratch
+// arrays must be count long.
+void radix_sort(
+    uint64_t *keys, uint32_t *values, uint32_t const count, uint64_t *key_scratch,
+    uint32_t *value_scratch);
+
+// Run of sorted draws with the same pipeline, material and mesh, drawn with
+// a single instanced draw
+struct DrawBatch {
+    uint64_t key; // of the first draw
+    uint32_t first;
+    uint32_t count;
+};
+
+// A frame's draws, each a sort key and the object it draws. The arrays are
+// kept from frame to frame, so steady-state frames don't allocate.
+class DrawList {
+  public:
+    // Allocates room for up to count draws and as many batches up front
+    void reserve(uint32_t const count);
+    // Makes room for count draws, to be filled in with set(), e.g. by jobs
+    // each setting their own range
+    void resize(uint32_t const count);
+    void set(uint32_t const index, uint64_t const key, uint32_t const object) {
+        keys[index] = key;
+        objects[index] = object;
+    }
+
+    // Sorts the draws by key, then merges them into batches
+    void sort();
+
+    uint32_t size() const { return (uint32_t)keys.size(); }
+    uint64_t const *get_keys() const { return keys.data(); }
+    // Objects in sorted order, a batch's are [first, first + count)
+    uint32_t const *get_objects() const { return objects.data(); }
+    std::vector<DrawBatch> const &get_batches() const { return batches; }
+
+  private:
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> objects;
+    std::vector<uint64_t> key_scratch;
+    std::vector<uint32_t> object_scratch;
+    std::vector<DrawBatch> batches;
+};
+
+} // namespace scene
@@ -0,0 +1,217 @@
+#include <scene.h>
+
+#include <job_system.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace scene {
+namespace {
+// Puts each element at its new index
+template <typename T>
+void permute(std::vector<T> &values, std::vector<uint32_t> const &new_indices) {
+    std::vector<T> permuted(values.size());
+    for (size_t i = 0; i < values.size(); i++) {
+        permuted[new_indices[i]] = values[i];
+    }
+    values.swap(permuted);
+}
+} // namespace
+
+NodeId SceneStore::add_node(NodeDesc const &desc) {
+    uint32_t const index = size();
+    uint32_t const parent = desc.parent != NO_PARENT ? node_indices[desc.parent] : NO_PARENT;
+    uint32_t const depth = parent != NO_PARENT ? depths[parent] + 1 : 0;
+
+    parents.push_back(parent);
+    positions.push_back(desc.position);
+    rotations.push_back(desc.rotation);
+    scales.push_back(desc.scale);
+    world_matrices.push_back(glm::mat4(1.f));
+    local_bounds.push_back(desc.local_bounds);
+    world_bounds.push_back(desc.local_bounds);
+    meshes.push_back(desc.mesh);
+    materials.push_back(desc.material);
+    depths.push_back(depth);
+    dirty_updates.push_back(0);
+    mark_dirty(index);
+
+    NodeId const node = (NodeId)node_indices.size();
+    node_indices.push_back(index);
+    node_ids.push_back(node);
+
+    // Nodes added shallowest first stay sorted, the depth can grow by at
+    // most one since the parent is already there
+    if (sorted && depth + 1 == depth_starts.size()) {
+        depth_starts.push_back(index + 1);
+    } else if (sorted && depth + 2 == depth_starts.size()) {
+        depth_starts.back() = index + 1;
+    } else {
+        sorted = false;
+    }
+    return node;
+}
+
+void SceneStore::clear() {
+    parents.clear();
+    positions.clear();
+    rotations.clear();
+    scales.clear();
+    world_matrices.clear();
+    local_bounds.clear();
+    world_bounds.clear();
+    meshes.clear();
+    materials.clear();
+    depths.clear();
+    dirty_updates.clear();
+    dirty_count = 0;
+    node_indices.clear();
+    node_ids.clear();
+    depth_starts.assign(1, 0);
+    sorted = true;
+}
+
+void SceneStore::reserve(uint32_t const count) {
+    parents.reserve(count);
+    positions.reserve(count);
+    rotations.reserve(count);
+    scales.reserve(count);
+    world_matrices.reserve(count);
+    local_bounds.reserve(count);
+    world_bounds.reserve(count);
+    meshes.reserve(count);
+    materials.reserve(count);
+    depths.reserve(count);
+    dirty_updates.reserve(count);
+    node_indices.reserve(count);
+    node_ids.reserve(count);
+}
+
+void SceneStore::set_position(NodeId const node, glm::vec3 const &position) {
+    uint32_t const index = node_indices[node];
+    positions[index] = position;
+    mark_dirty(index);
+}
+
+void SceneStore::set_rotation(NodeId const node, glm::quat const &rotation) {
+    uint32_t const index = node_indices[node];
+    rotations[index] = rotation;
+    mark_dirty(index);
+}
+
+void SceneStore::set_scale(NodeId const node, glm::vec3 const &scale) {
+    uint32_t const index = node_indices[node];
+    scales[index] = scale;
+    mark_dirty(index);
+}
+
+void SceneStore::mark_dirty(uint32_t const index) {
+    if (dirty_updates[index] != update_index) {
+        dirty_updates[index] = update_index;
+        dirty_count++;
+    }
+}
+
+void SceneStore::sort_by_depth() {
+    // Starts of each depth, from the count of nodes at each
+    uint32_t const max_depth = *std::max_element(depths.begin(), depths.end());
+    depth_starts.assign(max_depth + 2, 0);
+    for (uint32_t const depth : depths) {
+        depth_starts[depth + 1]++;
+    }
+    for (uint32_t d = 1; d < (uint32_t)depth_starts.size(); d++) {
+        depth_starts[d] += depth_starts[d - 1];
+    }
+
+    std::vector<uint32_t> new_indices(size());
+    std::vector<uint32_t> cursors(depth_starts.begin(), depth_starts.end() - 1);
+    for (uint32_t i = 0; i < size(); i++) {
+        new_indices[i] = cursors[depths[i]]++;
+    }
+
+    for (uint32_t &parent : parents) {
+        parent = parent != NO_PARENT ? new_indices[parent] : NO_PARENT;
+    }
+    permute(parents, new_indices);
+    permute(positions, new_indices);
+    permute(rotations, new_indices);
+    permute(scales, new_indices);
+    permute(world_matrices, new_indices);
+    permute(local_bounds, new_indices);
+    permute(world_bounds, new_indices);
+    permute(meshes, new_indices);
+    permute(materials, new_indices);
+    permute(depths, new_indices);
+    permute(dirty_updates, new_indices);
+    permute(node_ids, new_indices);
+    for (uint32_t i = 0; i < size(); i++) {
+        node_indices[node_ids[i]] = i;
+    }
+    sorted = true;
+}
+
+uint32_t SceneStore::update_transforms(jobs::JobSystem *job_system) {
+    if (dirty_count == 0) {
+        return 0;
+    }
+    if (!sorted) {
+        sort_by_depth();
+    }
+
+    // Each depth only reads the world matrices of the ones before it, so
+    // its nodes can be split across jobs in any way
+    std::atomic<uint32_t> recomputed{0};
+    for (uint32_t d = 0; d + 1 < (uint32_t)depth_starts.size(); d++) {
+        uint32_t const begin = depth_starts[d];
+        uint32_t const count = depth_starts[d + 1] - begin;
+        if (job_system == nullptr || count <= TRANSFORM_UPDATE_GRAIN) {
+            recomputed += update_range(begin, begin + count);
+            continue;
+        }
+        job_system->parallel_for(
+            count, TRANSFORM_UPDATE_GRAIN, [&](uint32_t const first, uint32_t const last) {
+                recomputed.fetch_add(
+                    update_range(begin + first, begin + last), std::memory_order_relaxed);
+            });
+    }
+
+    update_index++;
+    dirty_count = 0;
+    return recomputed.load();
+}
+
+uint32_t SceneStore::update_range(uint32_t const begin, uint32_t const end) {
+    uint32_t recomputed = 0;
+    for (uint32_t i = begin; i < end; i++) {
+        // A parent recomputed in this update is marked with it too
+        uint32_t const parent = parents[i];
+        if (dirty_updates[i] != update_index
+            && (parent == NO_PARENT || dirty_updates[parent] != update_index)) {
+            continue;
+        }
+        dirty_updates[i] = update_index;
+
+        glm::mat3 const rotation = glm::mat3_cast(rotations[i]);
+        glm::vec3 const &scale = scales[i];
+        glm::mat4 const local(
+            glm::vec4(rotation[0] * scale.x, 0.f), glm::vec4(rotation[1] * scale.y, 0.f),
+            glm::vec4(rotation[2] * scale.z, 0.f), glm::vec4(positions[i], 1.f));
+        glm::mat4 const world = parent != NO_PARENT ? world_matrices[parent] * local : local;
+        world_matrices[i] = world;
+
+        // The sphere grows by the largest scale of any axis
+        glm::vec4 const &bounds = local_bounds[i];
+        float const max_scale_squared = std::max(
+            glm::dot(glm::vec3(world[0]), glm::vec3(world[0])),
+            std::max(
+                glm::dot(glm::vec3(world[1]), glm::vec3(world[1])),
+                glm::dot(glm::vec3(world[2]), glm::vec3(world[2]))));
+        glm::vec3 const center = glm::vec3(world * glm::vec4(glm::vec3(bounds), 1.f));
+        world_bounds[i] = glm::vec4(center, bounds.w * std::sqrt(max_scale_squared));
+        recomputed++;
+    }
+    return recomputed;
+}
+
+} // namespace scene
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+namespace jobs {
+class JobSystem;
+}
+
+namespace scene {
+
+// Stable handle of a node, valid for as long as the store holds it
+using NodeId = uint32_t;
+
+constexpr uint32_t NO_PARENT = UINT32_MAX;
+// Mesh and material of nodes that only group others
+constexpr uint32_t NO_MESH = UINT32_MAX;
+constexpr uint32_t NO_MATERIAL = UINT32_MAX;
+
+// Nodes updated by each job of update_transforms()
+constexpr uint32_t TRANSFORM_UPDATE_GRAIN = 1024;
+
+struct NodeDesc {
+    NodeId parent{NO_PARENT};
+    // Relative to the parent, applied scale first and translation last
+    glm::vec3 position{0.f};
+    glm::quat rotation{1.f, 0.f, 0.f, 0.f};
+    glm::vec3 scale{1.f};
+    // Bounding sphere in the node's own space, center in xyz and radius in w
+    glm::vec4 local_bounds{0.f};
+    uint32_t mesh{NO_MESH};
+    uint32_t material{NO_MATERIAL};
+};
+
+// Transform hierarchy kept as a structure of arrays, one array per field,
+// so that a pass over one field only touches that field's cache lines.
+// Nodes are ordered by depth: the roots first, then their children, and so
+// on, so every parent comes before its children and each depth is a
+// contiguous range. The arrays are indexed by that order, not by NodeId.
+// Added nodes are appended and sorted into place, keeping the order they
+// were added in within each depth, by the next update_transforms().
+//
+// Changing a node's transform only marks it dirty. update_transforms() then
+// recomputes the world matrices and bounds of the dirty nodes and all their
+// descendants, one depth after the other, splitting each depth's nodes
+// across jobs.
+class SceneStore {
+  public:
+    // The parent must already be in the store
+    NodeId add_node(NodeDesc const &desc);
+    void clear();
+    void reserve(uint32_t const count);
+
+    uint32_t size() const { return (uint32_t)parents.size(); }
+    // Where the node is in the arrays, valid until the next
+    // update_transforms() after an add_node()
+    uint32_t index_of(NodeId const node) const { return node_indices[node]; }
+
+    void set_position(NodeId const node, glm::vec3 const &position);
+    void set_rotation(NodeId const node, glm::quat const &rotation);
+    void set_scale(NodeId const node, glm::vec3 const &scale);
+
+    // Recomputes the nodes changed or added since the last update and their
+    // descendants. Runs on the calling thread without a job system. Returns
+    // the nodes recomputed.
+    uint32_t update_transforms(jobs::JobSystem *job_system);
+
+    // The arrays, size() long. They're in depth order and the world matrices
+    // and bounds are current as of the last update_transforms().
+    uint32_t const *get_parents() const { return parents.data(); }
+    glm::vec3 const *get_positions() const { return positions.data(); }
+    glm::quat const *get_rotations() const { return rotations.data(); }
+    glm::vec3 const *get_scales() const { return scales.data(); }
+    glm::mat4 const *get_world_matrices() const { return world_matrices.data(); }
+    glm::vec4 const *get_local_bounds() const { return local_bounds.data(); }
+    glm::vec4 const *get_world_bounds() const { return world_bounds.data(); }
+    uint32_t const *get_meshes() const { return meshes.data(); }
+    uint32_t const *get_materials() const { return materials.data(); }
+
+  private:
+    // Parents are array indices, NO_PARENT for roots
+    std::vector<uint32_t> parents;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+    std::vector<glm::mat4> world_matrices;
+    std::vector<glm::vec4> local_bounds;
+    std::vector<glm::vec4> world_bounds;
+    std::vector<uint32_t> meshes;
+    std::vector<uint32_t> materials;
+    std::vector<uint32_t> depths;
+    // Update a node was last marked dirty or recomputed in. A node is dirty
+    // if it equals the update about to run, so updates never clear flags.
+    std::vector<uint32_t> dirty_updates;
+    uint32_t update_index{1};
+    uint32_t dirty_count{0};
+
+    std::vector<uint32_t> node_indices; // by NodeId
+    std::vector<NodeId> node_ids;       // by array index
+    // First node of each depth, then size()
+    std::vector<uint32_t> depth_starts = {0};
+    // False once nodes have been appended out of depth order
+    bool sorted{true};
+
+    void mark_dirty(uint32_t const index);
+    // Stable counting sort of the arrays by depth
+    void sort_by_depth();
+    // Returns the nodes recomputed
+    uint32_t update_range(uint32_t const begin, uint32_t const end);
+};
+
+} // namespace scene
@@ -0,0 +1,13 @@
+#version 450
+
+layout (location = 0) in vec4 inColor;
+layout (location = 1) in vec2 inUV;
+
+layout (location = 0) out vec4 outFragColor;
+
+// imgui's font atlas, white where shapes are drawn
+layout (set = 0, binding = 0) uniform sampler2D font;
+
+void main() {
+    outFragColor = inColor * texture(font, inUV);
+}
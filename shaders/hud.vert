@@ -0,0 +1,21 @@
+#version 450
+
+layout (location = 0) in vec2 vPosition;
+layout (location = 1) in vec2 vUV;
+layout (location = 2) in vec4 vColor;
+
+layout (location = 0) out vec4 outColor;
+layout (location = 1) out vec2 outUV;
+
+// Pixels from the display's top left corner to clip space
+layout (push_constant) uniform constants {
+    vec2 scale;
+    vec2 translate;
+} PushConstants;
+
+void main() {
+    gl_Position = vec4(vPosition * PushConstants.scale + PushConstants.translate, 0.f, 1.f);
+    // imgui's colors are sRGB, the render target encodes to sRGB on write
+    outColor = vec4(pow(vColor.rgb, vec3(2.2f)), vColor.a);
+    outUV = vUV;
+}
@@ -0,0 +1,24 @@
+#version 450
+
+layout (location = 0) in vec3 vPosition;
+layout (location = 1) in vec3 vNormal;
+layout (location = 2) in vec2 vUV;
+
+layout (location = 0) out vec3 outColor;
+layout (location = 1) out vec2 outUV;
+
+layout (set = 0, binding = 0) uniform CameraBuffer {
+    mat4 view;
+    mat4 proj;
+    mat4 viewproj;
+} cameraData;
+
+layout (push_constant) uniform constants {
+    mat4 render_matrix;
+} PushConstants;
+
+void main() {
+    gl_Position = cameraData.viewproj * PushConstants.render_matrix * vec4(vPosition, 1.f);
+    outColor = vNormal * 0.5f + 0.5f;
+    outUV = vUV;
+}
@@ -0,0 +1,43 @@
+#version 450
+
+layout (location = 0) in vec3 vPosition;
+layout (location = 1) in vec2 vOctNormal;
+layout (location = 2) in vec2 vUV;
+
+layout (location = 0) out vec3 outColor;
+
+layout (set = 0, binding = 0) uniform CameraBuffer {
+    mat4 view;
+    mat4 proj;
+    mat4 viewproj;
+} cameraData;
+
+struct ObjectData {
+    mat4 model;
+    vec4 boundingSphere;
+};
+
+layout (std430, set = 1, binding = 0) readonly buffer ObjectBuffer {
+    ObjectData objects[];
+};
+
+// Applied to every object before its own transform
+layout (push_constant) uniform constants {
+    mat4 render_matrix;
+} PushConstants;
+
+// Inverse of the octahedral encoding done by the asset baker
+vec3 oct_decode(vec2 e) {
+    vec3 n = vec3(e, 1.f - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.f);
+    n.x += n.x >= 0.f ? -t : t;
+    n.y += n.y >= 0.f ? -t : t;
+    return normalize(n);
+}
+
+void main() {
+    // cull.comp puts the object index into the draw's firstInstance
+    mat4 model = objects[gl_InstanceIndex].model * PushConstants.render_matrix;
+    gl_Position = cameraData.viewproj * model * vec4(vPosition, 1.f);
+    outColor = oct_decode(vOctNormal) * 0.5f + 0.5f;
+}
@@ -0,0 +1,33 @@
+#version 450
+
+layout (location = 0) in vec3 vPosition;
+layout (location = 1) in vec2 vOctNormal;
+layout (location = 2) in vec2 vUV;
+
+layout (location = 0) out vec3 outColor;
+layout (location = 1) out vec2 outUV;
+
+layout (set = 0, binding = 0) uniform CameraBuffer {
+    mat4 view;
+    mat4 proj;
+    mat4 viewproj;
+} cameraData;
+
+layout (push_constant) uniform constants {
+    mat4 render_matrix;
+} PushConstants;
+
+// Inverse of the octahedral encoding done by the asset baker
+vec3 oct_decode(vec2 e) {
+    vec3 n = vec3(e, 1.f - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.f);
+    n.x += n.x >= 0.f ? -t : t;
+    n.y += n.y >= 0.f ? -t : t;
+    return normalize(n);
+}
+
+void main() {
+    gl_Position = cameraData.viewproj * PushConstants.render_matrix * vec4(vPosition, 1.f);
+    outColor = oct_decode(vOctNormal) * 0.5f + 0.5f;
+    outUV = vUV;
+}
@@ -0,0 +1,13 @@
+#version 450
+
+layout (location = 0) in vec3 inColor;
+layout (location = 1) in vec2 inUV;
+
+layout (location = 0) out vec4 outFragColor;
+
+// Each draw binds the set of its texture
+layout (set = 1, binding = 0) uniform sampler2D albedo;
+
+void main() {
+    outFragColor = vec4(inColor * texture(albedo, inUV).rgb, 1.f);
+}
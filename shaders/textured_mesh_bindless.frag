@@ -0,0 +1,22 @@
+#version 450
+// Runtime sized descriptor arrays
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout (location = 0) in vec3 inColor;
+layout (location = 1) in vec2 inUV;
+
+layout (location = 0) out vec4 outFragColor;
+
+// The bindless table's textures, bound once for every draw
+layout (set = 1, binding = 0) uniform sampler2D textures[];
+
+// After the vertex stage's MeshPushConstants
+layout (push_constant) uniform constants {
+    layout (offset = 64) uint texture_index;
+} PushConstants;
+
+void main() {
+    // The same for the whole draw, so it needs no nonuniformEXT
+    vec3 albedo = texture(textures[PushConstants.texture_index], inUV).rgb;
+    outFragColor = vec4(inColor * albedo, 1.f);
+}
@@ -1,14 +1,234 @@
 #include <vk_engine.h>
 
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// Frames rendered by a headless run when --frames isn't given
+constexpr uint32_t DEFAULT_HEADLESS_FRAMES = 1000;
+
+static void print_usage(char const* exe)
+{
+	std::cout << "Usage: " << exe << " [options]\n"
+		<< "  --headless       render offscreen without a window\n"
+		<< "  --frames N       render N frames, then exit and report timings\n"
+		<< "  --width W        render target width\n"
+		<< "  --height H       render target height\n"
+		<< "  --frames-in-flight N\n"
+		<< "                   frames the CPU may record ahead, 1 to " << MAX_FRAMES_IN_FLIGHT << "\n"
+		<< "  --csv FILE       write per-frame timings to FILE\n"
+		<< "  --trace FILE     write a Chrome trace of the run to FILE, the T key\n"
+		<< "                   also writes one while running\n"
+		<< "  --draws N        draw N copies of the mesh, one draw call each\n"
+		<< "  --record-threads N\n"
+		<< "                   jobs recording draws in parallel, 1 to " << MAX_RECORD_THREADS << "\n"
+		<< "  --gpu-culling    cull the copies on the GPU and draw the visible ones\n"
+		<< "                   with indirect draws\n"
+		<< "  --cluster-culling\n"
+		<< "                   like --gpu-culling, and also cull each copy's meshlets\n"
+		<< "                   by frustum and normal cone\n"
+		<< "  --check-culling  like --gpu-culling, and check every frame's draws and\n"
+		<< "                   triangles against a CPU reference, failing on a mismatch\n"
+		<< "  --batch-draws    sort the copies' draws by state and depth and draw each\n"
+		<< "                   run of the same mesh with one instanced draw call\n"
+		<< "  --lod-error PX   draw each copy at the coarsest level of detail whose\n"
+		<< "                   error stays within PX pixels, 1 by default, 0 always\n"
+		<< "                   draws full detail\n"
+		<< "  --camera-distance D\n"
+		<< "                   keep the camera D units from the grid instead of just\n"
+		<< "                   far enough to see all of it\n"
+		<< "  --textures MODE  how textures are loaded: bc (default) builds BC1/BC3\n"
+		<< "                   with mips once and caches them, bc7 does the same\n"
+		<< "                   with BC7, raw uploads the decoded RGBA8 without mips,\n"
+		<< "                   none skips them. Runs with a frame count skip them\n"
+		<< "                   unless MODE is given.\n"
+		<< "  --bindless       sample the copies' textures from one bindless table by\n"
+		<< "                   index instead of binding a descriptor set per texture,\n"
+		<< "                   where the device has descriptor indexing\n"
+		<< "  --present-mode MODE\n"
+		<< "                   fifo (default), fifo-relaxed, mailbox or immediate,\n"
+		<< "                   the closest supported mode if MODE isn't\n"
+		<< "  --target-fps N   pace frames to start N times a second, 0 (default)\n"
+		<< "                   leaves them to the present mode\n"
+		<< "  --hud            show the performance overlay from the first frame, the H\n"
+		<< "                   key toggles it\n"
+		<< "  --dump-graph     log the render graph's passes, barriers and transient\n"
+		<< "                   memory whenever it's compiled\n"
+		<< "  --bench-dispatch time recording a large command buffer through the\n"
+		<< "                   loader's entry points and the device's, then exit\n"
+		<< "  --job-threads N  job system threads besides the main thread,\n"
+		<< "                   one per hardware thread by default\n"
+		<< "  --log-level L    lowest level logged: debug, info (default), warn\n"
+		<< "                   or error\n"
+		<< "  --log-mute C     don't log category C: engine, input or validation,\n"
+		<< "                   may be repeated\n";
+}
+
+// Parses the value following argv[i] as a positive integer
+static bool parse_uint(int argc, char* argv[], int& i, uint32_t& out_value)
+{
+	if (i + 1 >= argc) {
+		std::cout << "Missing value for " << argv[i] << std::endl;
+		return false;
+	}
+
+	char* end = nullptr;
+	unsigned long const value = std::strtoul(argv[++i], &end, 10);
+	if (*end != '\0' || value == 0) {
+		std::cout << "Invalid value for " << argv[i - 1] << ": " << argv[i] << std::endl;
+		return false;
+	}
+
+	out_value = (uint32_t)value;
+	return true;
+}
+
+// Parses the value following argv[i] as a non-negative number
+static bool parse_float(int argc, char* argv[], int& i, float& out_value)
+{
+	if (i + 1 >= argc) {
+		std::cout << "Missing value for " << argv[i] << std::endl;
+		return false;
+	}
+
+	char* end = nullptr;
+	float const value = std::strtof(argv[++i], &end);
+	if (*end != '\0' || !(value >= 0.0f)) {
+		std::cout << "Invalid value for " << argv[i - 1] << ": " << argv[i] << std::endl;
+		return false;
+	}
+
+	out_value = value;
+	return true;
+}
+
 int main(int argc, char* argv[])
 {
+	// Logs from here on are written by a background thread
+	logging::init();
+
 	VulkanEngine engine;
+	bool bench_dispatch = false;
+	bool textures_given = false;
+
+	for (int i = 1; i < argc; i++) {
+		bool ok = true;
+		if (std::strcmp(argv[i], "--headless") == 0) {
+			engine.headless = true;
+		} else if (std::strcmp(argv[i], "--frames") == 0) {
+			ok = parse_uint(argc, argv, i, engine.max_frames);
+		} else if (std::strcmp(argv[i], "--width") == 0) {
+			ok = parse_uint(argc, argv, i, engine.window_extent.width);
+		} else if (std::strcmp(argv[i], "--height") == 0) {
+			ok = parse_uint(argc, argv, i, engine.window_extent.height);
+		} else if (std::strcmp(argv[i], "--frames-in-flight") == 0) {
+			ok = parse_uint(argc, argv, i, engine.frames_in_flight)
+				&& engine.frames_in_flight <= MAX_FRAMES_IN_FLIGHT;
+		} else if (std::strcmp(argv[i], "--draws") == 0) {
+			ok = parse_uint(argc, argv, i, engine.scene_draw_count);
+		} else if (std::strcmp(argv[i], "--record-threads") == 0) {
+			ok = parse_uint(argc, argv, i, engine.record_threads)
+				&& engine.record_threads <= MAX_RECORD_THREADS;
+		} else if (std::strcmp(argv[i], "--gpu-culling") == 0) {
+			engine.gpu_culling = true;
+		} else if (std::strcmp(argv[i], "--cluster-culling") == 0) {
+			engine.gpu_culling = true;
+			engine.cluster_culling = true;
+		} else if (std::strcmp(argv[i], "--check-culling") == 0) {
+			engine.gpu_culling = true;
+			engine.check_culling = true;
+		} else if (std::strcmp(argv[i], "--batch-draws") == 0) {
+			engine.batch_draws = true;
+		} else if (std::strcmp(argv[i], "--lod-error") == 0) {
+			ok = parse_float(argc, argv, i, engine.lod_error_pixels);
+		} else if (std::strcmp(argv[i], "--camera-distance") == 0) {
+			ok = parse_float(argc, argv, i, engine.fixed_camera_distance);
+		} else if (std::strcmp(argv[i], "--textures") == 0 && i + 1 < argc) {
+			textures_given = true;
+			char const* mode = argv[++i];
+			if (std::strcmp(mode, "bc") == 0) {
+				engine.texture_mode = TextureMode::Bc;
+			} else if (std::strcmp(mode, "bc7") == 0) {
+				engine.texture_mode = TextureMode::Bc7;
+			} else if (std::strcmp(mode, "raw") == 0) {
+				engine.texture_mode = TextureMode::Raw;
+			} else if (std::strcmp(mode, "none") == 0) {
+				engine.load_textures = false;
+			} else {
+				ok = false;
+			}
+		} else if (std::strcmp(argv[i], "--bindless") == 0) {
+			engine.bindless = true;
+		} else if (std::strcmp(argv[i], "--present-mode") == 0 && i + 1 < argc) {
+			char const* mode = argv[++i];
+			if (std::strcmp(mode, "fifo") == 0) {
+				engine.present_mode = VK_PRESENT_MODE_FIFO_KHR;
+			} else if (std::strcmp(mode, "fifo-relaxed") == 0) {
+				engine.present_mode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+			} else if (std::strcmp(mode, "mailbox") == 0) {
+				engine.present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+			} else if (std::strcmp(mode, "immediate") == 0) {
+				engine.present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+			} else {
+				ok = false;
+			}
+		} else if (std::strcmp(argv[i], "--target-fps") == 0) {
+			ok = parse_float(argc, argv, i, engine.target_fps);
+		} else if (std::strcmp(argv[i], "--hud") == 0) {
+			engine.hud = true;
+		} else if (std::strcmp(argv[i], "--dump-graph") == 0) {
+			engine.dump_render_graph = true;
+		} else if (std::strcmp(argv[i], "--bench-dispatch") == 0) {
+			bench_dispatch = true;
+		} else if (std::strcmp(argv[i], "--job-threads") == 0) {
+			ok = parse_uint(argc, argv, i, engine.job_threads);
+		} else if (std::strcmp(argv[i], "--log-level") == 0 && i + 1 < argc) {
+			logging::Level level;
+			ok = logging::parse_level(argv[++i], level);
+			if (ok) {
+				logging::set_min_level(level);
+			}
+		} else if (std::strcmp(argv[i], "--log-mute") == 0 && i + 1 < argc) {
+			logging::Category category;
+			ok = logging::parse_category(argv[++i], category);
+			if (ok) {
+				logging::set_category_enabled(category, false);
+			}
+		} else if (std::strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+			engine.stats_csv_path = argv[++i];
+		} else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			engine.trace_path = argv[++i];
+		} else {
+			ok = false;
+		}
+
+		if (!ok) {
+			print_usage(argv[0]);
+			logging::shutdown();
+			return 1;
+		}
+	}
+
+	// A headless run has no window to close, so it always stops on its own
+	if (engine.headless && engine.max_frames == 0) {
+		engine.max_frames = DEFAULT_HEADLESS_FRAMES;
+	}
+	// Building the texture cache takes seconds on a cold start, which
+	// benchmarks that don't measure textures shouldn't wait for
+	if (engine.max_frames > 0 && !textures_given) {
+		engine.load_textures = false;
+	}
 
 	engine.init();	
 	
-	engine.run();	
+	if (bench_dispatch) {
+		engine.run_dispatch_bench();
+	} else {
+		engine.run();
+	}
 
 	engine.cleanup();	
+	logging::shutdown();
 
-	return 0;
+	return engine.culling_check_passed() ? 0 : 1;
 }
@@ -0,0 +1,160 @@
+#define VMA_IMPLEMENTATION
+#include <vk_allocators.h>
+
+#include <vk_initializers.h>
+
+namespace {
+VkDeviceSize align_up(VkDeviceSize const value, VkDeviceSize const alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void VKAPI_PTR on_device_allocate(
+    VmaAllocator, uint32_t, VkDeviceMemory, VkDeviceSize size, void *user_data
+) {
+    MemoryCounters &counters = *(MemoryCounters *)user_data;
+    counters.device_allocations++;
+    counters.device_bytes += size;
+}
+
+void VKAPI_PTR on_device_free(
+    VmaAllocator, uint32_t, VkDeviceMemory, VkDeviceSize size, void *user_data
+) {
+    MemoryCounters &counters = *(MemoryCounters *)user_data;
+    counters.device_frees++;
+    counters.device_bytes -= size;
+}
+
+// Host visible buffer that stays mapped for its whole lifetime
+AllocatedBuffer create_mapped_buffer(
+    VmaAllocator const allocator, VkDeviceSize const size,
+    VkBufferUsageFlags const usage, MemoryCounters &counters, char *&out_mapped
+) {
+    VkBufferCreateInfo const buffer_info = vkinit::buffer_create_info(size, usage);
+
+    VmaAllocationCreateInfo alloc_info = {};
+    alloc_info.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+    alloc_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    AllocatedBuffer buffer;
+    VmaAllocationInfo allocation;
+    VK_CHECK(vmaCreateBuffer(
+        allocator, &buffer_info, &alloc_info, &buffer.buffer, &buffer.allocation,
+        &allocation));
+    counters.resource_allocations++;
+
+    out_mapped = (char *)allocation.pMappedData;
+    return buffer;
+}
+} // namespace
+
+VmaDeviceMemoryCallbacks MemoryCounters::device_memory_callbacks(MemoryCounters &counters) {
+    VmaDeviceMemoryCallbacks callbacks = {};
+    callbacks.pfnAllocate = on_device_allocate;
+    callbacks.pfnFree = on_device_free;
+    callbacks.pUserData = &counters;
+    return callbacks;
+}
+
+void LinearAllocator::init(
+    VmaAllocator const allocator, VkDeviceSize const capacity,
+    VkBufferUsageFlags const usage, MemoryCounters &counters
+) {
+    this->allocator = allocator;
+    this->capacity = capacity;
+    offset = 0;
+    buffer = create_mapped_buffer(allocator, capacity, usage, counters, mapped);
+}
+
+void LinearAllocator::cleanup() {
+    if (buffer.buffer != VK_NULL_HANDLE) {
+        vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
+        buffer = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+    }
+}
+
+bool LinearAllocator::allocate(
+    VkDeviceSize const size, VkDeviceSize const alignment, BufferSlice &out_slice
+) {
+    VkDeviceSize const start = align_up(offset, alignment);
+    if (start + size > capacity) {
+        return false;
+    }
+
+    offset = start + size;
+    out_slice.buffer = buffer.buffer;
+    out_slice.offset = start;
+    out_slice.size = size;
+    out_slice.data = mapped + start;
+    return true;
+}
+
+void LinearAllocator::flush() {
+    // A no-op on host coherent memory
+    if (offset > 0) {
+        VK_CHECK(vmaFlushAllocation(allocator, buffer.allocation, 0, offset));
+    }
+}
+
+void StagingRing::init(
+    VmaAllocator const allocator, VkDeviceSize const capacity,
+    MemoryCounters &counters
+) {
+    this->allocator = allocator;
+    this->capacity = capacity;
+    allocated_total = 0;
+    released_total = 0;
+    submissions.clear();
+    buffer = create_mapped_buffer(
+        allocator, capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, counters, mapped);
+}
+
+void StagingRing::cleanup() {
+    if (buffer.buffer != VK_NULL_HANDLE) {
+        vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
+        buffer = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+    }
+}
+
+bool StagingRing::allocate(
+    VkDeviceSize const size, VkDeviceSize const alignment, BufferSlice &out_slice
+) {
+    VkDeviceSize const head = allocated_total % capacity;
+    VkDeviceSize start = align_up(head, alignment);
+    if (start + size > capacity) {
+        // Doesn't fit before the end, skip the rest of the buffer and wrap
+        start = 0;
+        if (size > capacity) {
+            return false;
+        }
+    }
+
+    // The skipped bytes count as used until this allocation is released
+    VkDeviceSize const consumed = start >= head
+        ? start + size - head
+        : capacity - head + size;
+    if (used() + consumed > capacity) {
+        return false;
+    }
+
+    allocated_total += consumed;
+    out_slice.buffer = buffer.buffer;
+    out_slice.offset = start;
+    out_slice.size = size;
+    out_slice.data = mapped + start;
+    return true;
+}
+
+void StagingRing::flush(BufferSlice const &slice) {
+    VK_CHECK(vmaFlushAllocation(allocator, buffer.allocation, slice.offset, slice.size));
+}
+
+void StagingRing::mark_submission(uint64_t const tag) {
+    submissions.push_back({tag, allocated_total});
+}
+
+void StagingRing::release(uint64_t const completed_tag) {
+    while (!submissions.empty() && submissions.front().tag <= completed_tag) {
+        released_total = submissions.front().allocated_total;
+        submissions.pop_front();
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <vk_types.h>
+
+// Counts allocations so that steady-state frames can be checked to allocate
+// nothing. Updated from any thread.
+struct MemoryCounters {
+    // vkAllocateMemory calls made by VMA, and the bytes they currently hold
+    std::atomic<uint64_t> device_allocations{0};
+    std::atomic<uint64_t> device_frees{0};
+    std::atomic<uint64_t> device_bytes{0};
+    // Buffers and images created through VMA, most share a memory block
+    std::atomic<uint64_t> resource_allocations{0};
+
+    uint64_t total_allocations() const {
+        return device_allocations + resource_allocations;
+    }
+
+    // Callbacks that keep the device counters up to date, to be passed to
+    // vmaCreateAllocator along with this object as user data
+    static VmaDeviceMemoryCallbacks device_memory_callbacks(MemoryCounters &counters);
+};
+
+// Range of a persistently mapped buffer
+struct BufferSlice {
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    void *data; // mapped pointer to the start of the range
+};
+
+// Bump allocator over one persistently mapped buffer, for data that only lives
+// for a single frame (uniforms, dynamic vertices). Everything is freed at once
+// with reset() when the frame's fence has signaled.
+class LinearAllocator {
+  public:
+    void init(
+        VmaAllocator const allocator, VkDeviceSize const capacity,
+        VkBufferUsageFlags const usage, MemoryCounters &counters);
+    void cleanup();
+
+    // Returns false if the remaining space is too small
+    bool allocate(
+        VkDeviceSize const size, VkDeviceSize const alignment, BufferSlice &out_slice);
+    void reset() { offset = 0; }
+
+    // Makes everything written since the last reset visible to the device
+    void flush();
+
+    VkBuffer get_buffer() const { return buffer.buffer; }
+    VkDeviceSize used() const { return offset; }
+    VkDeviceSize get_capacity() const { return capacity; }
+
+  private:
+    VmaAllocator allocator{VK_NULL_HANDLE};
+    AllocatedBuffer buffer{VK_NULL_HANDLE, VK_NULL_HANDLE};
+    char *mapped{nullptr};
+    VkDeviceSize capacity{0};
+    VkDeviceSize offset{0};
+};
+
+// Ring buffer for staging uploads. Allocations are tagged with the submission
+// that reads them, and freed in order once that submission has completed.
+// Not thread safe.
+class StagingRing {
+  public:
+    void init(
+        VmaAllocator const allocator, VkDeviceSize const capacity,
+        MemoryCounters &counters);
+    void cleanup();
+
+    // Returns false if the ring doesn't have enough space until more
+    // submissions are released
+    bool allocate(
+        VkDeviceSize const size, VkDeviceSize const alignment, BufferSlice &out_slice);
+
+    // Makes the slice's contents visible to the device
+    void flush(BufferSlice const &slice);
+
+    // Everything allocated since the last call is used by the submission with
+    // this tag. Tags must increase, e.g. fence counts or timeline values.
+    void mark_submission(uint64_t const tag);
+    // Frees the allocations of all submissions with tags up to completed_tag
+    void release(uint64_t const completed_tag);
+
+    VkBuffer get_buffer() const { return buffer.buffer; }
+    VkDeviceSize used() const { return allocated_total - released_total; }
+    VkDeviceSize get_capacity() const { return capacity; }
+
+  private:
+    struct Submission {
+        uint64_t tag;
+        uint64_t allocated_total; // allocated_total when it was marked
+    };
+
+    VmaAllocator allocator{VK_NULL_HANDLE};
+    AllocatedBuffer buffer{VK_NULL_HANDLE, VK_NULL_HANDLE};
+    char *mapped{nullptr};
+    VkDeviceSize capacity{0};
+
+    // Running byte counts including padding, their difference is what's in
+    // use and allocated_total modulo capacity is the write position
+    uint64_t allocated_total{0};
+    uint64_t released_total{0};
+    std::deque<Submission> submissions;
+};
@@ -0,0 +1,348 @@
+#include <vk_culling.h>
+
+#include <vk_initializers.h>
+#include <vk_mesh.h>
+#include <vk_profiler.h>
+#include <vk_upload.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// How far from passing or failing a test, relative to the size of the values
+// it was computed from, rounding could move an object or meshlet
+constexpr float BORDERLINE_TOLERANCE = 1e-5f;
+} // namespace
+
+culling::ReferenceResult culling::cull_reference(
+    GPUCullData const &data, GPUObjectData const *objects,
+    assets::MeshletCullData const &meshlets
+) {
+    glm::vec3 const camera(data.camera_position);
+    ReferenceResult result = {};
+    for (uint32_t i = 0; i < data.object_count; i++) {
+        GPUObjectData const &object = objects[i];
+        glm::mat4 const transform = object.model * data.shared_transform;
+        glm::vec3 const center = glm::vec3(transform * glm::vec4(glm::vec3(object.bounding_sphere), 1.f));
+        float const scale = std::max(
+            std::max(glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1]))),
+            glm::length(glm::vec3(transform[2])));
+        float const radius = object.bounding_sphere.w * scale;
+        float const slack = BORDERLINE_TOLERANCE
+            * (glm::length(center) + glm::length(camera) + radius);
+
+        // Same whole object test as cull.comp, once each way
+        bool inside_tight = true;
+        bool inside_loose = true;
+        for (int p = 0; p < 6; p++) {
+            glm::vec4 const &plane = data.frustum_planes[p];
+            float const distance = glm::dot(glm::vec3(plane), center) + plane.w;
+            inside_tight = inside_tight && distance > -radius + slack;
+            inside_loose = inside_loose && distance > -radius - slack;
+        }
+        if (!inside_loose) {
+            continue;
+        }
+
+        // Same level of detail selection, from a little closer and a little
+        // further away
+        float const distance = std::max(glm::length(center - camera) - radius, 0.f);
+        uint32_t const lods[2] = {
+            select_lod(data.lods, data.lod_count, scale, distance - slack, data.lod_error_scale),
+            select_lod(data.lods, data.lod_count, scale, distance + slack, data.lod_error_scale)};
+
+        CullResults object_min = {~0u, ~0u};
+        CullResults object_max = {0, 0};
+        for (uint32_t const lod : lods) {
+            assets::MeshletCullStats loose = {};
+            assets::MeshletCullStats tight = {};
+            if (lod == 0) {
+                // The slack is in world units, the meshlets are in object units
+                glm::vec4 planes[6];
+                glm::vec3 object_camera;
+                assets::to_object_space(transform, data.frustum_planes, camera, planes, object_camera);
+                assets::cull_meshlets(meshlets, planes, object_camera, slack / scale, loose);
+                if (inside_tight) {
+                    assets::cull_meshlets(meshlets, planes, object_camera, -slack / scale, tight);
+                }
+            } else {
+                // Coarser levels are drawn whole
+                loose.visible_meshlets = 1;
+                loose.visible_triangles = data.lods[lod].index_count / 3;
+                if (inside_tight) {
+                    tight = loose;
+                }
+            }
+            object_min.draws = std::min(object_min.draws, tight.visible_meshlets);
+            object_min.triangles = std::min(object_min.triangles, tight.visible_triangles);
+            object_max.draws = std::max(object_max.draws, loose.visible_meshlets);
+            object_max.triangles = std::max(object_max.triangles, loose.visible_triangles);
+        }
+        result.min.draws += object_min.draws;
+        result.min.triangles += object_min.triangles;
+        result.max.draws += object_max.draws;
+        result.max.triangles += object_max.triangles;
+    }
+    return result;
+}
+
+void CullingPass::init(InitInfo const &info) {
+    device = info.device;
+    allocator = info.allocator;
+    counters = info.counters;
+    max_objects = std::max(1u, info.max_objects);
+    max_meshlets = std::max(1u, info.max_meshlets);
+
+    // A workgroup per CULL_WORKGROUP_SIZE meshlets of every object, in as
+    // many rows as the X limit needs
+    max_group_count_x = info.max_group_count_x;
+    uint64_t const max_groups =
+        ((uint64_t)max_objects * max_meshlets + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE;
+    if ((max_groups + max_group_count_x - 1) / max_group_count_x > info.max_group_count_y) {
+        LOG_ERROR(
+            "Too much to cull in one dispatch: " << max_objects << " objects of "
+            << max_meshlets << " meshlets.");
+        abort();
+    }
+
+    draw_indexed_indirect_count = nullptr;
+    if (info.draw_indirect_count) {
+        draw_indexed_indirect_count = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(
+            device, "vkCmdDrawIndexedIndirectCountKHR");
+    }
+    if (!draw_indexed_indirect_count) {
+        LOG_INFO("VK_KHR_draw_indirect_count is unavailable, culled draws are skipped with empty commands.");
+    }
+
+    // The vertex shaders only read the objects, the rest is culling's own
+    VkDescriptorSetLayoutBinding const bindings[5] = {
+        vkinit::descriptorset_layout_binding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT, 0),
+        vkinit::descriptorset_layout_binding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+        vkinit::descriptorset_layout_binding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+        vkinit::descriptorset_layout_binding(
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+        vkinit::descriptorset_layout_binding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+    };
+    VkDescriptorSetLayoutCreateInfo set_info = {};
+    set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_info.pNext = nullptr;
+    set_info.flags = 0;
+    set_info.bindingCount = 5;
+    set_info.pBindings = bindings;
+    set_layout = info.layout_cache->get(set_info);
+
+    VkPipelineLayoutCreateInfo layout_info = vkinit::pipeline_layout_create_info();
+    layout_info.setLayoutCount = 1;
+    layout_info.pSetLayouts = &set_layout;
+    VK_CHECK(vkCreatePipelineLayout(device, &layout_info, nullptr, &pipeline_layout));
+
+    // The objects and meshlets never change, every frame in flight reads the
+    // same ones
+    objects = create_buffer(
+        max_objects * sizeof(GPUObjectData),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+    meshlets = create_buffer(
+        max_meshlets * sizeof(assets::Meshlet),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+
+    // The draws are rewritten every frame, so each frame in flight has its own
+    frames.resize(info.frames_in_flight);
+    for (FrameBuffers &frame : frames) {
+        frame.draws = create_buffer(
+            (VkDeviceSize)max_objects * max_meshlets * sizeof(VkDrawIndexedIndirectCommand),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+                | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VMA_MEMORY_USAGE_GPU_ONLY);
+        frame.results = create_buffer(
+            sizeof(culling::CullResults),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+                | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VMA_MEMORY_USAGE_GPU_ONLY);
+        frame.readback = create_buffer(
+            sizeof(culling::CullResults), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VMA_MEMORY_USAGE_GPU_TO_CPU, (void **)&frame.readback_data);
+        frame.cull_data = create_buffer(
+            sizeof(GPUCullData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+            VMA_MEMORY_USAGE_CPU_TO_GPU, (void **)&frame.cull_data_mapped);
+
+        frame.descriptor = info.descriptors->allocate(set_layout);
+
+        VkDescriptorBufferInfo const buffer_infos[5] = {
+            {objects.buffer, 0, VK_WHOLE_SIZE},
+            {frame.draws.buffer, 0, VK_WHOLE_SIZE},
+            {frame.results.buffer, 0, VK_WHOLE_SIZE},
+            {frame.cull_data.buffer, 0, VK_WHOLE_SIZE},
+            {meshlets.buffer, 0, VK_WHOLE_SIZE},
+        };
+        VkWriteDescriptorSet writes[5];
+        for (uint32_t i = 0; i < 5; i++) {
+            VkDescriptorType const type =
+                i == 3 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i] = vkinit::write_descriptor_buffer(type, frame.descriptor, &buffer_infos[i], i);
+        }
+        vkUpdateDescriptorSets(device, 5, writes, 0, nullptr);
+    }
+}
+
+void CullingPass::cleanup() {
+    for (FrameBuffers const &frame : frames) {
+        vmaDestroyBuffer(allocator, frame.draws.buffer, frame.draws.allocation);
+        vmaDestroyBuffer(allocator, frame.results.buffer, frame.results.allocation);
+        vmaDestroyBuffer(allocator, frame.readback.buffer, frame.readback.allocation);
+        vmaDestroyBuffer(allocator, frame.cull_data.buffer, frame.cull_data.allocation);
+    }
+    frames.clear();
+    vmaDestroyBuffer(allocator, objects.buffer, objects.allocation);
+    vmaDestroyBuffer(allocator, meshlets.buffer, meshlets.allocation);
+
+    vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
+}
+
+bool CullingPass::build_pipeline(VkShaderModule const cull_shader, PipelineCache &cache) {
+    PROFILE_ZONE("build pipeline");
+    if (cull_shader == VK_NULL_HANDLE) {
+        LOG_ERROR("Missing shader module for culling.");
+        return false;
+    }
+
+    VkComputePipelineCreateInfo pipeline_info = {};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.pNext = nullptr;
+    pipeline_info.stage = vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_COMPUTE_BIT, cull_shader);
+    pipeline_info.layout = pipeline_layout;
+    pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+
+    // A compute pipeline is nothing but its shader and layout
+    PipelineKey state_key(VK_PIPELINE_BIND_POINT_COMPUTE);
+    state_key.add_shader_stage(pipeline_info.stage);
+    state_key.add(pipeline_layout);
+    pipeline = cache.find(state_key);
+    if (pipeline != VK_NULL_HANDLE) {
+        return true;
+    }
+
+    VkPipeline new_pipeline;
+    if (vkCreateComputePipelines(
+        device, cache.get_vk_cache(), 1, &pipeline_info, nullptr, &new_pipeline
+    ) != VK_SUCCESS) {
+        LOG_ERROR("Failed to create the culling pipeline.");
+        return false;
+    }
+
+    pipeline = cache.insert(state_key, new_pipeline);
+    return true;
+}
+
+uint64_t CullingPass::upload_scene(
+    UploadService &uploads, std::vector<GPUObjectData> const &objects_data,
+    std::vector<assets::Meshlet> const &meshlets_data
+) {
+    if (objects_data.size() > max_objects || meshlets_data.size() > max_meshlets) {
+        LOG_ERROR(
+            "Too much to cull: " << objects_data.size() << " objects of " << meshlets_data.size()
+            << " meshlets, at most " << max_objects << " of " << max_meshlets << ".");
+        abort();
+    }
+
+    // Both copies go into the same batch
+    uploads.upload_buffer(
+        objects.buffer, 0, objects_data.data(), objects_data.size() * sizeof(GPUObjectData),
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+        VK_ACCESS_SHADER_READ_BIT);
+    uint64_t const value = uploads.upload_buffer(
+        meshlets.buffer, 0, meshlets_data.data(), meshlets_data.size() * sizeof(assets::Meshlet),
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    uploads.flush();
+    return value;
+}
+
+void CullingPass::record_clear(
+    VkCommandBuffer const cmd, uint32_t const frame_index, GPUCullData const &data
+) {
+    FrameBuffers &frame = frames[frame_index];
+
+    // The frame's previous cull finished reading it when its fence signaled
+    *frame.cull_data_mapped = data;
+    vmaFlushAllocation(allocator, frame.cull_data.allocation, 0, VK_WHOLE_SIZE);
+
+    // Appending starts from zero. Without a draw count every slot is drawn,
+    // so the ones no meshlet is appended to must draw nothing.
+    vkCmdFillBuffer(cmd, frame.results.buffer, 0, VK_WHOLE_SIZE, 0);
+    if (clears_draws()) {
+        vkCmdFillBuffer(cmd, frame.draws.buffer, 0, VK_WHOLE_SIZE, 0);
+    }
+
+    // One invocation per meshlet of every object
+    frame.max_draws = data.object_count * data.meshlet_count;
+}
+
+void CullingPass::record_dispatch(VkCommandBuffer const cmd, uint32_t const frame_index) {
+    FrameBuffers const &frame = frames[frame_index];
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &frame.descriptor, 0, nullptr);
+    // cull.comp rebuilds the linear index from the rows, the last of which
+    // may have workgroups past the end
+    uint32_t const groups = (frame.max_draws + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE;
+    uint32_t const groups_x = std::max(std::min(groups, max_group_count_x), 1u);
+    vkCmdDispatch(cmd, groups_x, (groups + groups_x - 1) / groups_x, 1);
+}
+
+void CullingPass::record_readback(VkCommandBuffer const cmd, uint32_t const frame_index) {
+    FrameBuffers const &frame = frames[frame_index];
+    VkBufferCopy const copy = {0, 0, sizeof(culling::CullResults)};
+    vkCmdCopyBuffer(cmd, frame.results.buffer, frame.readback.buffer, 1, &copy);
+}
+
+void CullingPass::record_draws(VkCommandBuffer const cmd, uint32_t const frame_index) {
+    FrameBuffers const &frame = frames[frame_index];
+    if (frame.max_draws == 0) {
+        return;
+    }
+
+    if (draw_indexed_indirect_count) {
+        draw_indexed_indirect_count(
+            cmd, frame.draws.buffer, 0, frame.results.buffer, 0, frame.max_draws,
+            sizeof(VkDrawIndexedIndirectCommand));
+    } else {
+        vkCmdDrawIndexedIndirect(
+            cmd, frame.draws.buffer, 0, frame.max_draws, sizeof(VkDrawIndexedIndirectCommand));
+    }
+}
+
+culling::CullResults CullingPass::read_results(uint32_t const frame_index) const {
+    FrameBuffers const &frame = frames[frame_index];
+    vmaInvalidateAllocation(allocator, frame.readback.allocation, 0, VK_WHOLE_SIZE);
+    return *frame.readback_data;
+}
+
+AllocatedBuffer CullingPass::create_buffer(
+    VkDeviceSize const size, VkBufferUsageFlags const usage,
+    VmaMemoryUsage const memory_usage, void **out_mapped
+) {
+    VkBufferCreateInfo const buffer_info = vkinit::buffer_create_info(size, usage);
+
+    VmaAllocationCreateInfo alloc_info = {};
+    alloc_info.usage = memory_usage;
+    if (out_mapped) {
+        alloc_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    }
+
+    AllocatedBuffer buffer;
+    VmaAllocationInfo allocation;
+    VK_CHECK(vmaCreateBuffer(
+        allocator, &buffer_info, &alloc_info, &buffer.buffer, &buffer.allocation,
+        &allocation));
+    counters->resource_allocations++;
+
+    if (out_mapped) {
+        *out_mapped = allocation.pMappedData;
+    }
+    return buffer;
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <mesh_simplifier.h>
+#include <meshlet.h>
+#include <vector>
+#include <vk_allocators.h>
+#include <vk_descriptors.h>
+#include <vk_pipeline_cache.h>
+#include <vk_types.h>
+
+class UploadService;
+
+// Meshlets tested by each workgroup of cull.comp, must match its local_size_x
+constexpr uint32_t CULL_WORKGROUP_SIZE = 64;
+
+// Per-object data read by cull.comp and the indirect mesh shaders, std430
+struct GPUObjectData {
+    glm::mat4 model;
+    // Object space center in xyz, radius in w
+    glm::vec4 bounding_sphere;
+};
+
+// Per-frame parameters of cull.comp, std140. Too large for push constants.
+struct GPUCullData {
+    // Normals point into the frustum, see assets::extract_frustum_planes()
+    glm::vec4 frustum_planes[6];
+    // Applied before every object's model matrix, like the push constant of
+    // the indirect mesh shaders
+    glm::mat4 shared_transform;
+    glm::vec4 camera_position; // w unused
+    uint32_t object_count;
+    // Meshlets of the mesh every object draws, those of its full detail level
+    uint32_t meshlet_count;
+    // Levels of detail of the mesh, 1 always draws full detail. Coarser
+    // levels have no meshlets and are drawn whole.
+    uint32_t lod_count;
+    // See select_lod()
+    float lod_error_scale;
+    // 16 bytes each, the std140 array stride
+    assets::MeshLod lods[assets::MAX_MESH_LODS];
+};
+
+namespace culling {
+struct CullResults {
+    uint32_t draws;
+    uint32_t triangles;
+};
+
+// Range the GPU's results must fall in
+struct ReferenceResult {
+    CullResults min;
+    CullResults max;
+};
+
+// The tests and level of detail selection cull.comp does, run on the CPU
+// with assets::cull_meshlets() in each object's space. It culls twice, with
+// every test tightened and loosened by more than the GPU's rounding could
+// change, and takes both levels of detail where the distance is that close
+// to a switch, which brackets what the GPU may find.
+ReferenceResult cull_reference(
+    GPUCullData const &data, GPUObjectData const *objects,
+    assets::MeshletCullData const &meshlets);
+} // namespace culling
+
+// GPU-driven drawing of many copies of a mesh split into meshlets. Every frame
+// a compute shader tests each object's bounding sphere against the view
+// frustum and picks its level of detail. Objects at full detail then test
+// the bounding spheres and normal cones of their meshlets, and append a
+// VkDrawIndexedIndirectCommand for each visible meshlet, coarser ones append
+// one for the whole level. All of them are drawn with a single indirect
+// draw. Culling whole objects is the same with a single meshlet covering the
+// mesh. Once the objects and meshlets have been uploaded the CPU never
+// touches them again.
+class CullingPass {
+  public:
+    struct InitInfo {
+        VkDevice device;
+        VmaAllocator allocator;
+        MemoryCounters *counters;
+        // The set layout comes from the cache, the sets from the allocator,
+        // which must not be reset while they're in use
+        DescriptorLayoutCache *layout_cache;
+        DescriptorAllocator *descriptors;
+        uint32_t frames_in_flight;
+        uint32_t max_objects;
+        uint32_t max_meshlets;
+        // VK_KHR_draw_indirect_count was enabled on the device. Its entry
+        // point isn't looked up otherwise, a driver may return one anyway.
+        bool draw_indirect_count;
+        // VkPhysicalDeviceLimits::maxComputeWorkGroupCount in X and Y
+        uint32_t max_group_count_x;
+        uint32_t max_group_count_y;
+    };
+
+    void init(InitInfo const &info);
+    void cleanup();
+
+    // Builds the culling pipeline. Safe to call from workers.
+    bool build_pipeline(VkShaderModule const cull_shader, PipelineCache &cache);
+
+    // Objects are set 1 of the indirect mesh pipelines, binding 0
+    VkDescriptorSetLayout get_set_layout() const { return set_layout; }
+    VkDescriptorSet get_descriptor(uint32_t const frame_index) const {
+        return frames[frame_index].descriptor;
+    }
+
+    // Queues the objects and the mesh's meshlets for upload and returns the
+    // upload's timeline value. There may be at most max_objects and
+    // max_meshlets of them.
+    uint64_t upload_scene(
+        UploadService &uploads, std::vector<GPUObjectData> const &objects_data,
+        std::vector<assets::Meshlet> const &meshlets_data);
+
+    // The culling is recorded in three steps, each outside of a render pass
+    // and ordered by the caller's barriers. record_clear() writes the frame's
+    // parameters and clears the results, and the draws with clears_draws().
+    void record_clear(
+        VkCommandBuffer const cmd, uint32_t const frame_index, GPUCullData const &data);
+    // The dispatch, which reads and writes the results and draws. Its
+    // workgroups are laid out in rows of at most max_group_count_x.
+    void record_dispatch(VkCommandBuffer const cmd, uint32_t const frame_index);
+    // Copies the results into the readback buffer, for read_results() once
+    // they're visible to the host
+    void record_readback(VkCommandBuffer const cmd, uint32_t const frame_index);
+    // Without a draw count every slot is drawn, so all of them are cleared
+    bool clears_draws() const { return draw_indexed_indirect_count == nullptr; }
+
+    // Draws the visible objects, with the indirect mesh pipeline, its
+    // descriptor sets and the mesh's buffers already bound. Reads the draws
+    // and the results as indirect commands.
+    void record_draws(VkCommandBuffer const cmd, uint32_t const frame_index);
+
+    // Draws and triangles of the last cull recorded for the frame index.
+    // Must only be called once that frame's fence has signaled.
+    culling::CullResults read_results(uint32_t const frame_index) const;
+
+  private:
+    struct FrameBuffers {
+        // Indirect draws, compacted to the front
+        AllocatedBuffer draws;
+        // culling::CullResults, the draw count first
+        AllocatedBuffer results;
+        // Copy of results for the CPU
+        AllocatedBuffer readback;
+        culling::CullResults *readback_data;
+        // GPUCullData, written by the CPU every frame
+        AllocatedBuffer cull_data;
+        GPUCullData *cull_data_mapped;
+        VkDescriptorSet descriptor;
+        // Draws the last record_clear() made room for
+        uint32_t max_draws{0};
+    };
+
+    VkDevice device{VK_NULL_HANDLE};
+    VmaAllocator allocator{VK_NULL_HANDLE};
+    MemoryCounters *counters{nullptr};
+    uint32_t max_objects{0};
+    uint32_t max_meshlets{0};
+    uint32_t max_group_count_x{0};
+
+    AllocatedBuffer objects{VK_NULL_HANDLE, VK_NULL_HANDLE};
+    AllocatedBuffer meshlets{VK_NULL_HANDLE, VK_NULL_HANDLE};
+    std::vector<FrameBuffers> frames;
+
+    VkDescriptorSetLayout set_layout{VK_NULL_HANDLE}; // owned by the layout cache
+    VkPipelineLayout pipeline_layout{VK_NULL_HANDLE};
+    // Owned by the pipeline cache
+    VkPipeline pipeline{VK_NULL_HANDLE};
+
+    // From VK_KHR_draw_indirect_count, nullptr if it wasn't enabled.
+    // Without it every slot is drawn, the ones past the count with no
+    // instances.
+    PFN_vkCmdDrawIndexedIndirectCountKHR draw_indexed_indirect_count{nullptr};
+
+    AllocatedBuffer create_buffer(
+        VkDeviceSize const size, VkBufferUsageFlags const usage,
+        VmaMemoryUsage const memory_usage, void **out_mapped = nullptr);
+};
@@ -0,0 +1,368 @@
+#include <vk_descriptors.h>
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+
+namespace {
+template <typename T> void hash_combine(size_t &seed, T const &value) {
+    seed ^= std::hash<T>{}(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+// Descriptors of each type a DescriptorAllocator pool holds per set, enough
+// for the engine's largest sets, the culling pass' four storage buffers
+struct PoolRatio {
+    VkDescriptorType type;
+    uint32_t per_set;
+};
+constexpr PoolRatio POOL_RATIOS[] = {
+    {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
+    {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1},
+    {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4},
+    {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2},
+};
+
+constexpr VkDescriptorBindingFlagsEXT BINDLESS_BINDING_FLAGS =
+    VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT
+    | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT
+    | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+} // namespace
+
+bool DescriptorLayoutCache::Binding::operator==(Binding const &other) const {
+    return binding == other.binding && type == other.type && count == other.count
+        && stages == other.stages && flags == other.flags;
+}
+
+bool DescriptorLayoutCache::Key::operator==(Key const &other) const {
+    return flags == other.flags && bindings == other.bindings;
+}
+
+size_t DescriptorLayoutCache::KeyHash::operator()(Key const &key) const {
+    size_t seed = 0;
+    hash_combine(seed, key.flags);
+    for (Binding const &binding : key.bindings) {
+        hash_combine(seed, binding.binding);
+        hash_combine(seed, binding.type);
+        hash_combine(seed, binding.count);
+        hash_combine(seed, binding.stages);
+        hash_combine(seed, binding.flags);
+    }
+    return seed;
+}
+
+void DescriptorLayoutCache::init(VkDevice const device_) {
+    device = device_;
+}
+
+void DescriptorLayoutCache::cleanup() {
+    for (auto const &entry : layouts) {
+        vkDestroyDescriptorSetLayout(device, entry.second, nullptr);
+    }
+    layouts.clear();
+}
+
+VkDescriptorSetLayout DescriptorLayoutCache::get(VkDescriptorSetLayoutCreateInfo const &info) {
+    // The binding flags are the only extension looked at
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT const *binding_flags = nullptr;
+    for (VkBaseInStructure const *next = (VkBaseInStructure const *)info.pNext; next;
+         next = next->pNext) {
+        if (next->sType
+            == VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT) {
+            binding_flags = (VkDescriptorSetLayoutBindingFlagsCreateInfoEXT const *)next;
+        }
+    }
+
+    Key key;
+    key.flags = info.flags;
+    key.bindings.reserve(info.bindingCount);
+    for (uint32_t i = 0; i < info.bindingCount; i++) {
+        VkDescriptorSetLayoutBinding const &binding = info.pBindings[i];
+        if (binding.pImmutableSamplers) {
+            LOG_ERROR("Layouts with immutable samplers can't be cached.");
+            abort();
+        }
+        VkDescriptorBindingFlagsEXT const flags =
+            binding_flags && binding_flags->bindingCount > 0 ? binding_flags->pBindingFlags[i] : 0;
+        key.bindings.push_back(
+            {binding.binding, binding.descriptorType, binding.descriptorCount,
+             binding.stageFlags, flags});
+    }
+    std::sort(key.bindings.begin(), key.bindings.end(), [](Binding const &a, Binding const &b) {
+        return a.binding < b.binding;
+    });
+
+    auto const it = layouts.find(key);
+    if (it != layouts.end()) {
+        return it->second;
+    }
+
+    VkDescriptorSetLayout layout;
+    VK_CHECK(vkCreateDescriptorSetLayout(device, &info, nullptr, &layout));
+    layouts.emplace(std::move(key), layout);
+    return layout;
+}
+
+void DescriptorAllocator::init(InitInfo const &info) {
+    device = info.device;
+    next_pool_sets = std::clamp(info.initial_sets, 1u, MAX_DESCRIPTOR_POOL_SETS);
+    // Ready before the first frame, so that it doesn't create it
+    ready_pools.push_back(create_pool());
+}
+
+void DescriptorAllocator::cleanup() {
+    for (VkDescriptorPool const pool : ready_pools) {
+        vkDestroyDescriptorPool(device, pool, nullptr);
+    }
+    for (VkDescriptorPool const pool : full_pools) {
+        vkDestroyDescriptorPool(device, pool, nullptr);
+    }
+    ready_pools.clear();
+    full_pools.clear();
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout const layout) {
+    while (true) {
+        bool const created = ready_pools.empty();
+        if (created) {
+            ready_pools.push_back(create_pool());
+        }
+
+        VkDescriptorSetAllocateInfo alloc_info = {};
+        alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.pNext = nullptr;
+        alloc_info.descriptorPool = ready_pools.back();
+        alloc_info.descriptorSetCount = 1;
+        alloc_info.pSetLayouts = &layout;
+        VkDescriptorSet set;
+        VkResult const result = vkAllocateDescriptorSets(device, &alloc_info, &set);
+        if (result == VK_SUCCESS) {
+            allocated_sets++;
+            return set;
+        }
+
+        // A pool that can't hold the set while empty never will
+        bool const pool_full =
+            result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL;
+        if (!pool_full || created) {
+            LOG_ERROR("Failed to allocate a descriptor set: " << result);
+            abort();
+        }
+        full_pools.push_back(ready_pools.back());
+        ready_pools.pop_back();
+    }
+}
+
+void DescriptorAllocator::reset() {
+    for (VkDescriptorPool const pool : ready_pools) {
+        VK_CHECK(vkResetDescriptorPool(device, pool, 0));
+    }
+    for (VkDescriptorPool const pool : full_pools) {
+        VK_CHECK(vkResetDescriptorPool(device, pool, 0));
+        ready_pools.push_back(pool);
+    }
+    full_pools.clear();
+    allocated_sets = 0;
+}
+
+VkDescriptorPool DescriptorAllocator::create_pool() {
+    VkDescriptorPoolSize sizes[std::size(POOL_RATIOS)];
+    for (size_t i = 0; i < std::size(POOL_RATIOS); i++) {
+        sizes[i] = {POOL_RATIOS[i].type, POOL_RATIOS[i].per_set * next_pool_sets};
+    }
+
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.pNext = nullptr;
+    pool_info.flags = 0;
+    pool_info.maxSets = next_pool_sets;
+    pool_info.poolSizeCount = (uint32_t)std::size(sizes);
+    pool_info.pPoolSizes = sizes;
+    VkDescriptorPool pool;
+    VK_CHECK(vkCreateDescriptorPool(device, &pool_info, nullptr, &pool));
+
+    next_pool_sets = std::min(next_pool_sets * 2, MAX_DESCRIPTOR_POOL_SETS);
+    return pool;
+}
+
+uint32_t BindlessTable::Slots::take() {
+    uint32_t index = INVALID_BINDLESS_INDEX;
+    if (!free.empty()) {
+        index = free.back();
+        free.pop_back();
+    } else if (high_water < capacity) {
+        index = high_water++;
+    } else {
+        return INVALID_BINDLESS_INDEX;
+    }
+    live++;
+    return index;
+}
+
+void BindlessTable::Slots::retire(uint32_t const index, uint64_t const frame) {
+    retired.push_back({frame, index});
+    live--;
+}
+
+void BindlessTable::Slots::recycle(uint64_t const frame, uint32_t const frames_in_flight) {
+    // Retired in frame order
+    size_t count = 0;
+    while (count < retired.size() && retired[count].first + frames_in_flight <= frame) {
+        free.push_back(retired[count].second);
+        count++;
+    }
+    retired.erase(retired.begin(), retired.begin() + count);
+}
+
+void BindlessTable::init(InitInfo const &info) {
+    device = info.device;
+    frames_in_flight = info.frames_in_flight;
+    textures.capacity = info.max_textures;
+    buffers.capacity = info.max_buffers;
+
+    // Textures are sampled by fragment shaders, buffers are read anywhere
+    VkDescriptorSetLayoutBinding const bindings[2] = {
+        {0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, info.max_textures,
+         VK_SHADER_STAGE_FRAGMENT_BIT, nullptr},
+        {1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, info.max_buffers,
+         VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
+         nullptr},
+    };
+    VkDescriptorBindingFlagsEXT const binding_flags[2] = {
+        BINDLESS_BINDING_FLAGS, BINDLESS_BINDING_FLAGS};
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flags_info = {};
+    flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+    flags_info.pNext = nullptr;
+    flags_info.bindingCount = 2;
+    flags_info.pBindingFlags = binding_flags;
+
+    VkDescriptorSetLayoutCreateInfo set_info = {};
+    set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_info.pNext = &flags_info;
+    set_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+    set_info.bindingCount = 2;
+    set_info.pBindings = bindings;
+    set_layout = info.layout_cache->get(set_info);
+
+    // Pool sizes can't be empty, an empty array needs none
+    VkDescriptorPoolSize pool_sizes[2];
+    uint32_t pool_size_count = 0;
+    if (info.max_textures > 0) {
+        pool_sizes[pool_size_count++] = {
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, info.max_textures};
+    }
+    if (info.max_buffers > 0) {
+        pool_sizes[pool_size_count++] = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, info.max_buffers};
+    }
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.pNext = nullptr;
+    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+    pool_info.maxSets = 1;
+    pool_info.poolSizeCount = pool_size_count;
+    pool_info.pPoolSizes = pool_sizes;
+    VK_CHECK(vkCreateDescriptorPool(device, &pool_info, nullptr, &pool));
+
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.pNext = nullptr;
+    alloc_info.descriptorPool = pool;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &set_layout;
+    VK_CHECK(vkAllocateDescriptorSets(device, &alloc_info, &descriptor));
+}
+
+void BindlessTable::cleanup() {
+    vkDestroyDescriptorPool(device, pool, nullptr);
+    pool = VK_NULL_HANDLE;
+    descriptor = VK_NULL_HANDLE;
+}
+
+uint32_t BindlessTable::add_texture(VkImageView const view, VkSampler const sampler) {
+    uint32_t const index = textures.take();
+    if (index != INVALID_BINDLESS_INDEX) {
+        pending_textures.push_back(
+            {index, {sampler, view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}});
+    }
+    return index;
+}
+
+uint32_t BindlessTable::add_buffer(
+    VkBuffer const buffer, VkDeviceSize const offset, VkDeviceSize const range
+) {
+    uint32_t const index = buffers.take();
+    if (index != INVALID_BINDLESS_INDEX) {
+        pending_buffers.push_back({index, {buffer, offset, range}});
+    }
+    return index;
+}
+
+void BindlessTable::remove_texture(uint32_t const index, uint64_t const frame) {
+    textures.retire(index, frame);
+}
+
+void BindlessTable::remove_buffer(uint32_t const index, uint64_t const frame) {
+    buffers.retire(index, frame);
+}
+
+uint32_t BindlessTable::flush(uint64_t const frame) {
+    textures.recycle(frame, frames_in_flight);
+    buffers.recycle(frame, frames_in_flight);
+    if (pending_textures.empty() && pending_buffers.empty()) {
+        return 0;
+    }
+
+    auto const by_slot = [](auto const &a, auto const &b) { return a.first < b.first; };
+    std::sort(pending_textures.begin(), pending_textures.end(), by_slot);
+    std::sort(pending_buffers.begin(), pending_buffers.end(), by_slot);
+
+    // Infos first, the writes point into them
+    image_infos.clear();
+    for (auto const &pending : pending_textures) {
+        image_infos.push_back(pending.second);
+    }
+    buffer_infos.clear();
+    for (auto const &pending : pending_buffers) {
+        buffer_infos.push_back(pending.second);
+    }
+
+    // Each run of consecutive slots is one write
+    writes.clear();
+    for (size_t i = 0; i < pending_textures.size(); i++) {
+        if (i > 0 && pending_textures[i].first == pending_textures[i - 1].first + 1) {
+            writes.back().descriptorCount++;
+            continue;
+        }
+        VkWriteDescriptorSet write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.pNext = nullptr;
+        write.dstSet = descriptor;
+        write.dstBinding = 0;
+        write.dstArrayElement = pending_textures[i].first;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.pImageInfo = &image_infos[i];
+        writes.push_back(write);
+    }
+    for (size_t i = 0; i < pending_buffers.size(); i++) {
+        if (i > 0 && pending_buffers[i].first == pending_buffers[i - 1].first + 1) {
+            writes.back().descriptorCount++;
+            continue;
+        }
+        VkWriteDescriptorSet write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.pNext = nullptr;
+        write.dstSet = descriptor;
+        write.dstBinding = 1;
+        write.dstArrayElement = pending_buffers[i].first;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.pBufferInfo = &buffer_infos[i];
+        writes.push_back(write);
+    }
+    vkUpdateDescriptorSets(device, (uint32_t)writes.size(), writes.data(), 0, nullptr);
+
+    uint32_t const written = (uint32_t)(pending_textures.size() + pending_buffers.size());
+    pending_textures.clear();
+    pending_buffers.clear();
+    return written;
+}
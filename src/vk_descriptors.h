@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <vk_types.h>
+
+// Deduplicates descriptor set layouts. Layouts are looked up by a hash of
+// their bindings, so every system asking for the same bindings shares one
+// layout, which also makes their sets compatible. Binding flags chained with
+// VkDescriptorSetLayoutBindingFlagsCreateInfoEXT are part of the key,
+// immutable samplers aren't supported. Not thread safe.
+class DescriptorLayoutCache {
+  public:
+    void init(VkDevice const device);
+    // Destroys every layout handed out
+    void cleanup();
+
+    // Returns the layout for the create info, creating it the first time.
+    // The bindings may be listed in any order.
+    VkDescriptorSetLayout get(VkDescriptorSetLayoutCreateInfo const &info);
+
+    uint32_t size() const { return (uint32_t)layouts.size(); }
+
+  private:
+    struct Binding {
+        uint32_t binding;
+        VkDescriptorType type;
+        uint32_t count;
+        VkShaderStageFlags stages;
+        VkDescriptorBindingFlagsEXT flags;
+
+        bool operator==(Binding const &other) const;
+    };
+    struct Key {
+        VkDescriptorSetLayoutCreateFlags flags;
+        std::vector<Binding> bindings; // sorted by binding
+
+        bool operator==(Key const &other) const;
+    };
+    struct KeyHash {
+        size_t operator()(Key const &key) const;
+    };
+
+    VkDevice device{VK_NULL_HANDLE};
+    std::unordered_map<Key, VkDescriptorSetLayout, KeyHash> layouts;
+};
+
+// Allocates descriptor sets from a list of pools that grows when they run
+// out, rather than from one pool sized up front. reset() frees every set at
+// once and keeps the pools, so that per-frame sets cost an allocation from
+// a pool that was reset wholesale, with no vkFreeDescriptorSets and, once
+// warmed up, no new pools. Each pool holds twice the sets of the previous
+// one, up to MAX_DESCRIPTOR_POOL_SETS. Not thread safe, each recording
+// thread has its own.
+class DescriptorAllocator {
+  public:
+    struct InitInfo {
+        VkDevice device;
+        // Sets the first pool holds
+        uint32_t initial_sets;
+    };
+
+    void init(InitInfo const &info);
+    void cleanup();
+
+    // Aborts if the layout needs more descriptors than a whole pool holds
+    VkDescriptorSet allocate(VkDescriptorSetLayout const layout);
+    // Frees every set allocated. The GPU must be done with them.
+    void reset();
+
+    // Since the last reset
+    uint32_t sets_allocated() const { return allocated_sets; }
+    uint32_t pool_count() const { return (uint32_t)(ready_pools.size() + full_pools.size()); }
+
+  private:
+    VkDevice device{VK_NULL_HANDLE};
+    // Sets the next pool created holds
+    uint32_t next_pool_sets{0};
+    uint32_t allocated_sets{0};
+
+    // The last one is allocated from
+    std::vector<VkDescriptorPool> ready_pools;
+    std::vector<VkDescriptorPool> full_pools;
+
+    // Creates a pool for next_pool_sets sets and doubles that
+    VkDescriptorPool create_pool();
+};
+
+// Upper bound on the sets of one DescriptorAllocator pool
+constexpr uint32_t MAX_DESCRIPTOR_POOL_SETS = 4096;
+
+// Index of a resource that didn't fit in the bindless table
+constexpr uint32_t INVALID_BINDLESS_INDEX = UINT32_MAX;
+
+// One descriptor set, bound once, holding every texture and storage buffer
+// shaders may read, which they pick by index, e.g. from a push constant or
+// an object buffer, instead of each draw binding its own set. The set is
+// created with update-after-bind, so adding resources writes only their
+// slots, even while frames using the set are in flight. Needs
+// VK_EXT_descriptor_indexing.
+//
+// Binding 0 is an array of combined image samplers, binding 1 an array of
+// storage buffers. Slots no shader reads may stay unwritten.
+class BindlessTable {
+  public:
+    struct InitInfo {
+        VkDevice device;
+        DescriptorLayoutCache *layout_cache;
+        // Array sizes, within the device's update-after-bind limits
+        uint32_t max_textures;
+        uint32_t max_buffers;
+        // Frames a removed slot waits before it's reused
+        uint32_t frames_in_flight;
+    };
+
+    void init(InitInfo const &info);
+    void cleanup();
+
+    VkDescriptorSetLayout get_set_layout() const { return set_layout; }
+    VkDescriptorSet get_descriptor() const { return descriptor; }
+
+    // Return the index shaders find the resource at, INVALID_BINDLESS_INDEX
+    // once the array is full. Written by the next flush().
+    uint32_t add_texture(VkImageView const view, VkSampler const sampler);
+    uint32_t add_buffer(VkBuffer const buffer, VkDeviceSize const offset, VkDeviceSize const range);
+    // Frees the index once the frames in flight recorded up to the given
+    // frame are done with it. Nothing recorded later may read it.
+    void remove_texture(uint32_t const index, uint64_t const frame);
+    void remove_buffer(uint32_t const index, uint64_t const frame);
+
+    // Writes the slots added since the last call, runs of consecutive slots
+    // as one write, and frees the removed indices no frame in flight can
+    // read anymore. Called once per frame, after waiting for the frame's
+    // fence and before recording. Returns the descriptors written.
+    uint32_t flush(uint64_t const frame);
+
+    uint32_t texture_count() const { return textures.live; }
+    uint32_t buffer_count() const { return buffers.live; }
+
+  private:
+    // Indices of one array
+    struct Slots {
+        uint32_t capacity{0};
+        uint32_t high_water{0}; // never handed out at or past this
+        uint32_t live{0};
+        std::vector<uint32_t> free;
+        // Removed indices and the frame they were last read by
+        std::vector<std::pair<uint64_t, uint32_t>> retired;
+
+        uint32_t take();
+        void retire(uint32_t const index, uint64_t const frame);
+        void recycle(uint64_t const frame, uint32_t const frames_in_flight);
+    };
+
+    VkDevice device{VK_NULL_HANDLE};
+    uint32_t frames_in_flight{1};
+    VkDescriptorSetLayout set_layout{VK_NULL_HANDLE}; // owned by the layout cache
+    VkDescriptorPool pool{VK_NULL_HANDLE};
+    VkDescriptorSet descriptor{VK_NULL_HANDLE};
+
+    Slots textures;
+    Slots buffers;
+    // Waiting for flush(), by slot
+    std::vector<std::pair<uint32_t, VkDescriptorImageInfo>> pending_textures;
+    std::vector<std::pair<uint32_t, VkDescriptorBufferInfo>> pending_buffers;
+    // The pending infos in slot order, as the writes point at them
+    std::vector<VkDescriptorImageInfo> image_infos;
+    std::vector<VkDescriptorBufferInfo> buffer_infos;
+    std::vector<VkWriteDescriptorSet> writes;
+};
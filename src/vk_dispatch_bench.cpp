@@ -0,0 +1,112 @@
+#include <vk_dispatch_bench.h>
+
+#include <vk_initializers.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// Each iteration records a viewport, a scissor and a push constant update,
+// the kind of small state calls a frame's draws make
+constexpr uint32_t DISPATCH_BENCH_ITERATIONS = 100000;
+constexpr uint32_t DISPATCH_BENCH_CALLS = 3 * DISPATCH_BENCH_ITERATIONS;
+constexpr uint32_t DISPATCH_BENCH_RUNS = 5;
+
+struct DispatchTable {
+    PFN_vkCmdSetViewport set_viewport;
+    PFN_vkCmdSetScissor set_scissor;
+    PFN_vkCmdPushConstants push_constants;
+};
+
+// Milliseconds to record DISPATCH_BENCH_CALLS calls through the table
+double record_calls(
+    VkDevice device, VkCommandPool pool, VkCommandBuffer cmd, VkPipelineLayout layout,
+    DispatchTable const &table
+) {
+    VK_CHECK(vkResetCommandPool(device, pool, 0));
+
+    VkCommandBufferBeginInfo cmd_info = {};
+    cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmd_info.pNext = nullptr;
+    cmd_info.pInheritanceInfo = nullptr;
+    cmd_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VkViewport viewport = {0.f, 0.f, 256.f, 256.f, 0.f, 1.f};
+    VkRect2D const scissor = {{0, 0}, {256, 256}};
+    float constants[16] = {};
+
+    Clock::time_point const start = Clock::now();
+    VK_CHECK(vkBeginCommandBuffer(cmd, &cmd_info));
+    for (uint32_t i = 0; i < DISPATCH_BENCH_ITERATIONS; i++) {
+        viewport.x = (float)(i & 0xff);
+        constants[0] = (float)i;
+        table.set_viewport(cmd, 0, 1, &viewport);
+        table.set_scissor(cmd, 0, 1, &scissor);
+        table.push_constants(
+            cmd, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), constants);
+    }
+    VK_CHECK(vkEndCommandBuffer(cmd));
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+} // namespace
+
+void bench_dispatch(VkInstance instance, VkDevice device, uint32_t const queue_family) {
+    DispatchTable trampolines;
+    trampolines.set_viewport =
+        (PFN_vkCmdSetViewport)vkGetInstanceProcAddr(instance, "vkCmdSetViewport");
+    trampolines.set_scissor =
+        (PFN_vkCmdSetScissor)vkGetInstanceProcAddr(instance, "vkCmdSetScissor");
+    trampolines.push_constants =
+        (PFN_vkCmdPushConstants)vkGetInstanceProcAddr(instance, "vkCmdPushConstants");
+    DispatchTable const direct = {vkCmdSetViewport, vkCmdSetScissor, vkCmdPushConstants};
+    if (trampolines.set_viewport == nullptr || trampolines.set_scissor == nullptr
+        || trampolines.push_constants == nullptr) {
+        LOG_ERROR("Failed to get the loader's command buffer entry points.");
+        return;
+    }
+
+    VkCommandPoolCreateInfo const pool_info = vkinit::command_pool_create_info(
+        queue_family, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+    VkCommandPool pool;
+    VK_CHECK(vkCreateCommandPool(device, &pool_info, nullptr, &pool));
+    VkCommandBufferAllocateInfo const cmd_alloc_info =
+        vkinit::command_buffer_alloc_info(pool, 1, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+    VkCommandBuffer cmd;
+    VK_CHECK(vkAllocateCommandBuffers(device, &cmd_alloc_info, &cmd));
+
+    VkPushConstantRange push_constant = {};
+    push_constant.offset = 0;
+    push_constant.size = 16 * sizeof(float);
+    push_constant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    VkPipelineLayoutCreateInfo layout_info = vkinit::pipeline_layout_create_info();
+    layout_info.pushConstantRangeCount = 1;
+    layout_info.pPushConstantRanges = &push_constant;
+    VkPipelineLayout layout;
+    VK_CHECK(vkCreatePipelineLayout(device, &layout_info, nullptr, &layout));
+
+    // Alternated, so that neither gets the warm caches or the pool's grown
+    // memory to itself
+    double trampoline_ms = 1e30;
+    double direct_ms = 1e30;
+    for (uint32_t run = 0; run < DISPATCH_BENCH_RUNS; run++) {
+        trampoline_ms =
+            std::min(trampoline_ms, record_calls(device, pool, cmd, layout, trampolines));
+        direct_ms = std::min(direct_ms, record_calls(device, pool, cmd, layout, direct));
+    }
+
+    double const trampoline_ns = trampoline_ms * 1e6 / DISPATCH_BENCH_CALLS;
+    double const direct_ns = direct_ms * 1e6 / DISPATCH_BENCH_CALLS;
+    std::printf(
+        "Recording %u calls, best of %u runs:\n", DISPATCH_BENCH_CALLS, DISPATCH_BENCH_RUNS);
+    std::printf("  loader trampolines %9.3f ms %7.2f ns per call\n", trampoline_ms, trampoline_ns);
+    std::printf("  device entry points %8.3f ms %7.2f ns per call\n", direct_ms, direct_ns);
+    std::printf(
+        "  saved %.2f ns per call (%.1f%%)\n", trampoline_ns - direct_ns,
+        100.0 * (trampoline_ns - direct_ns) / trampoline_ns);
+
+    vkDestroyPipelineLayout(device, layout, nullptr);
+    vkDestroyCommandPool(device, pool, nullptr);
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <vk_types.h>
+
+// Records the same large command buffer through two sets of entry points and
+// prints the cost per call of each, the best of a few runs: the loader's
+// trampolines, which vkGetInstanceProcAddr returns for device functions and
+// which dispatch through the device's table, and the driver's own, which
+// volk loads with volkLoadDevice. Layers enabled on the device are in both.
+void bench_dispatch(VkInstance instance, VkDevice device, uint32_t const queue_family);
@@ -2,99 +2,408 @@
 
 #include <SDL.h>
 #include <SDL_vulkan.h>
+#include <mapped_file.h>
+#include <mesh_optimizer.h>
+#include <mesh_simplifier.h>
+#include <obj_importer.h>
+#include <vk_dispatch_bench.h>
 #include <vk_initializers.h>
+#include <vk_profiler.h>
 #include <vk_types.h>
 
-#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
+#include <limits>
 
 #include "VkBootstrap.h"
 
-#define VK_CHECK(x)                                                            \
-    do {                                                                       \
-        VkResult err = x;                                                      \
-        if (err) {                                                             \
-            std::cout << "Detected Vulkan error: " << err << std::endl;        \
-            abort();                                                           \
-        }                                                                      \
-    } while (0)
-
-#define LOG_INFO(msg)                                                          \
-    do {                                                                       \
-        std::cout << "[INFO] " << msg << std::endl;                            \
-    } while (0)
-
-#define LOG_ERROR(msg)                                                         \
-    do {                                                                       \
-        std::cout << "[ERROR] " << msg << std::endl;                           \
-    } while (0)
+// Both relative to the working directory
+constexpr char const *SHADER_DIR = "shaderbuild";
+constexpr char const *PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+constexpr char const *MONKEY_MESH_PATH = "assetbuild/monkey_smooth.mesh";
+constexpr char const *MONKEY_OBJ_PATH = "assets/monkey_smooth.obj";
+// Color textures of the scene and where their builds are cached
+constexpr TextureSource SCENE_TEXTURES[] = {
+    {"assets/lost_empire-RGB.png", "assetbuild/lost_empire-RGB.tex", true},
+    {"assets/lost_empire-RGBA.png", "assetbuild/lost_empire-RGBA.tex", true},
+};
+constexpr uint32_t SCENE_TEXTURE_COUNT =
+    (uint32_t)(sizeof(SCENE_TEXTURES) / sizeof(SCENE_TEXTURES[0]));
+// Where the T key writes the trace when no trace path was given
+constexpr char const *DEFAULT_TRACE_PATH = "trace.json";
+
+constexpr VkDeviceSize FRAME_ARENA_SIZE = 1024 * 1024;
+constexpr VkDeviceSize STAGING_RING_SIZE = 16 * 1024 * 1024;
+
+// Distance between neighbouring monkeys of the scene grid
+constexpr float SCENE_GRID_SPACING = 3.0f;
+// Mesh and material of the scene's nodes: the monkey and the mesh pipeline
+// matching its vertex format, the only ones so far
+constexpr uint32_t MONKEY_MESH_ID = 0;
+constexpr uint32_t MESH_MATERIAL_ID = 0;
+// Radians per frame of the camera's side to side pan across the grid
+constexpr float CAMERA_PAN_SPEED = 0.01f;
+// GPU zone of the culling dispatch, whose time goes into the frame stats
+constexpr char const *CULLING_ZONE_NAME = "culling";
+// Same for the HUD's pass
+constexpr char const *HUD_ZONE_NAME = "hud";
+// Draws each job builds keys or writes instances for when batching draws
+constexpr uint32_t DRAW_LIST_GRAIN = 4096;
+// Sets the first pool of each recording job's per-frame descriptor allocator
+// holds, more pools are added if a frame needs them
+constexpr uint32_t FRAME_DESCRIPTOR_SETS = 16;
+// Upper bounds on the bindless table's arrays, lowered to the device's limits
+constexpr uint32_t MAX_BINDLESS_TEXTURES = 4096;
+constexpr uint32_t MAX_BINDLESS_BUFFERS = 1024;
+// Frames the stats of a run without --frames keep, the last five minutes at
+// 60 fps
+constexpr uint32_t INTERACTIVE_STATS_FRAMES = 18000;
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+double elapsed_ms(Clock::time_point const start, Clock::time_point const end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// The requested present mode if the surface supports it, otherwise the
+// closest one that it does. Every surface supports FIFO.
+VkPresentModeKHR choose_present_mode(
+    VkPhysicalDevice const gpu, VkSurfaceKHR const surface, VkPresentModeKHR const requested
+) {
+    uint32_t count = 0;
+    VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(gpu, surface, &count, nullptr));
+    std::vector<VkPresentModeKHR> supported(count);
+    VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(gpu, surface, &count, supported.data()));
+
+    // The two modes that don't wait for vblank stand in for each other,
+    // trading tearing for a queued frame or the other way around
+    VkPresentModeKHR candidates[2] = {requested, requested};
+    if (requested == VK_PRESENT_MODE_MAILBOX_KHR) {
+        candidates[1] = VK_PRESENT_MODE_IMMEDIATE_KHR;
+    } else if (requested == VK_PRESENT_MODE_IMMEDIATE_KHR) {
+        candidates[1] = VK_PRESENT_MODE_MAILBOX_KHR;
+    }
+    for (VkPresentModeKHR const mode : candidates) {
+        if (std::find(supported.begin(), supported.end(), mode) != supported.end()) {
+            return mode;
+        }
+    }
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+bool has_device_extension(VkPhysicalDevice const gpu, char const *const name) {
+    uint32_t count = 0;
+    VK_CHECK(vkEnumerateDeviceExtensionProperties(gpu, nullptr, &count, nullptr));
+    std::vector<VkExtensionProperties> extensions(count);
+    VK_CHECK(vkEnumerateDeviceExtensionProperties(gpu, nullptr, &count, extensions.data()));
+    for (VkExtensionProperties const &extension : extensions) {
+        if (std::strcmp(extension.extensionName, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+char const *present_mode_name(VkPresentModeKHR const mode) {
+    switch (mode) {
+        case VK_PRESENT_MODE_IMMEDIATE_KHR:
+            return "immediate";
+        case VK_PRESENT_MODE_MAILBOX_KHR:
+            return "mailbox";
+        case VK_PRESENT_MODE_FIFO_KHR:
+            return "fifo";
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+            return "fifo relaxed";
+        default:
+            return "unknown";
+    }
+}
+
+// Routes validation layer messages into the logger rather than stdout, at a
+// level matching their severity
+VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
+    VkDebugUtilsMessageSeverityFlagBitsEXT const severity,
+    VkDebugUtilsMessageTypeFlagsEXT const type,
+    VkDebugUtilsMessengerCallbackDataEXT const *const data, void *const
+) {
+    logging::Level level = logging::Level::Debug;
+    if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+        level = logging::Level::Error;
+    } else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+        level = logging::Level::Warn;
+    } else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT) {
+        level = logging::Level::Info;
+    }
+    if (!logging::compiled_in(level) || !logging::enabled(level, logging::Category::Validation)) {
+        return VK_FALSE;
+    }
+
+    char const *kind = "general";
+    if (type & VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT) {
+        kind = "validation";
+    } else if (type & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT) {
+        kind = "performance";
+    }
+    logging::RecordWriter writer(level, logging::Category::Validation);
+    writer << kind << ' ' << (data->pMessageIdName ? data->pMessageIdName : "") << ": "
+           << data->pMessage;
+    // The call that triggered it isn't aborted
+    return VK_FALSE;
+}
+} // namespace
 
 void VulkanEngine::init() {
-    // We initialize SDL and create a window with it.
-    SDL_Init(SDL_INIT_VIDEO);
+    init_start_time = Clock::now();
+    profiler::set_thread_name("main");
+    PROFILE_ZONE("init");
 
-    SDL_WindowFlags window_flags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN);
+    job_system.init(job_threads, [](uint32_t) { profiler::set_thread_name("job worker"); });
 
-    // clang-format off
-    window = SDL_CreateWindow(
-        "Vulkan Engine",
-        SDL_WINDOWPOS_UNDEFINED,
-        SDL_WINDOWPOS_UNDEFINED,
-        window_extent.width,
-        window_extent.height,
-        window_flags);
+    // GPU culling builds its draws on the GPU, there is nothing to batch
+    if (gpu_culling) {
+        batch_draws = false;
+    }
+
+    if (!headless) {
+        // SDL and the window live on the event thread
+        window = event_thread.init({"Vulkan Engine", window_extent});
+        if (!window) {
+            LOG_ERROR("Failed to create the window.");
+            abort();
+        }
+        seen_resize_count = event_thread.get_resize_count();
+    }
 
     // load the core vulkan structures
     init_vulkan();
 
-    init_swapchain();
+    if (headless) {
+        init_offscreen_targets();
+    } else {
+        init_swapchain();
+    }
 
     init_commands();
 
-    init_default_renderpass();
-
-    init_framebuffers();
+    init_render_graph();
 
     init_sync_structures();
 
+    init_frame_allocators();
+
+    init_uploads();
+
+    init_descriptors();
+
+    load_meshes();
+
+    init_textures();
+
+    init_scene();
+
+    if (gpu_culling) {
+        init_culling();
+    }
+    if (batch_draws) {
+        init_instances();
+    }
+
+    init_hud();
+
+    Clock::time_point const pipelines_start = Clock::now();
     init_pipelines();
+    Clock::time_point const pipelines_end = Clock::now();
+
+    init_profiler();
+
+    // Compare a run without pipeline_cache.bin (cold) against one with it (warm)
+    LOG_INFO(
+        "Startup took " << elapsed_ms(init_start_time, Clock::now()) << " ms, "
+        << elapsed_ms(pipelines_start, pipelines_end) << " ms of it in init_pipelines ("
+        << (pipeline_cache.was_loaded_from_disk() ? "warm" : "cold") << " pipeline cache).");
 
     // everything went fine
     initialized = true;
 }
 void VulkanEngine::cleanup() {
     if (initialized) {
-        vkDestroyRenderPass(device, renderpass, nullptr);
+        // Make sure the GPU is done with everything before destroying it
+        VK_CHECK(vkDeviceWaitIdle(device));
+
+        gpu_profiler.cleanup();
 
-        for (int i = 0; i < framebuffers.size(); i++) {
-            vkDestroyFramebuffer(device, framebuffers[i], nullptr);
-            vkDestroyImageView(device, swapchain_img_views[i], nullptr);
+        for (uint32_t i = 0; i < frames_in_flight; i++) {
+            vkDestroyFence(device, frames[i].render_fence, nullptr);
+            vkDestroySemaphore(device, frames[i].present_semaphore, nullptr);
+            vkDestroyCommandPool(device, frames[i].command_pool, nullptr);
+            for (VkCommandPool const pool : frames[i].worker_pools) {
+                vkDestroyCommandPool(device, pool, nullptr);
+            }
+            for (DescriptorAllocator &worker : frames[i].worker_descriptors) {
+                worker.cleanup();
+            }
+            frames[i].arena.cleanup();
         }
 
-        vkDestroySwapchainKHR(device, swapchain, nullptr);
-        
-        vkDestroyCommandPool(device, command_pool, nullptr);
-        
+        for (VkSemaphore const semaphore : render_semaphores) {
+            vkDestroySemaphore(device, semaphore, nullptr);
+        }
+        destroy_retired_swapchains(true);
+
+        if (gpu_culling) {
+            culling_pass.cleanup();
+        }
+        if (batch_draws) {
+            instance_buffers.cleanup();
+        }
+        upload_service.cleanup();
+        destroy_buffer(monkey_mesh.vertex_buffer);
+        destroy_buffer(monkey_mesh.index_buffer);
+        texture_loader.cleanup();
+        perf_hud.cleanup();
+
+        if (bindless) {
+            bindless_table.cleanup();
+        }
+        vkDestroySampler(device, texture_sampler, nullptr);
+        descriptor_allocator.cleanup();
+        layout_cache.cleanup();
+
+        // Let background compiles finish before tearing down what they use
+        job_system.cleanup();
+
+        pipeline_cache.cleanup();
+        shader_library.cleanup();
+        vkDestroyPipelineLayout(device, triangle_pipeline_layout, nullptr);
+        vkDestroyPipelineLayout(device, mesh_pipeline_layout, nullptr);
+        vkDestroyPipelineLayout(device, indirect_pipeline_layout, nullptr);
+        vkDestroyPipelineLayout(device, instanced_pipeline_layout, nullptr);
+
+        // Before the views its framebuffers use
+        render_graph.cleanup();
+
+        for (VkImageView const view : swapchain_img_views) {
+            vkDestroyImageView(device, view, nullptr);
+        }
+
+        if (headless) {
+            for (AllocatedImage const &img : offscreen_imgs) {
+                destroy_image(img);
+            }
+        } else {
+            vkDestroySwapchainKHR(device, swapchain, nullptr);
+        }
+
+        vmaDestroyAllocator(allocator);
         vkDestroyDevice(device, nullptr);
-        vkDestroySurfaceKHR(instance, surface, nullptr);
+        if (!headless) {
+            vkDestroySurfaceKHR(instance, surface, nullptr);
+        }
         vkb::destroy_debug_utils_messenger(instance, debug_messenger);
         vkDestroyInstance(instance, nullptr);
         
-        SDL_DestroyWindow(window);
+        if (window) {
+            uint64_t const dropped = event_thread.get_dropped_inputs();
+            if (dropped > 0) {
+                LOG_INFO(dropped << " input events were dropped, the queue was full.");
+            }
+            event_thread.cleanup();
+        }
     }
 }
 
 void VulkanEngine::draw() {
-    // Wait until the GPU has finished rendering the last frame. Timeout of 1 second
-    VK_CHECK(vkWaitForFences(device, 1, &render_fence, true, 1000000000));
-    VK_CHECK(vkResetFences(device, 1, &render_fence));
+    PROFILE_ZONE("draw");
+    Clock::time_point const frame_start = Clock::now();
+    uint64_t const allocations_start = memory_counters.total_allocations();
+    FrameData &frame = get_current_frame();
+
+    {
+        PROFILE_ZONE("wait for frame");
+        // Wait until the GPU has finished rendering the last frame that used this
+        // frame data, frames_in_flight frames ago. Timeout of 1 second
+        VK_CHECK(vkWaitForFences(device, 1, &frame.render_fence, true, 1000000000));
+    }
+    destroy_retired_swapchains(false);
+    // VMA refreshes the memory budget once per frame index
+    vmaSetCurrentFrameIndex(allocator, (uint32_t)frame_number);
 
-    // Request an image from the swapchain. Timeout of 1 second
-    uint32_t swapchain_img_idx;
-    VK_CHECK(vkAcquireNextImageKHR(device, swapchain, 1000000000, present_semaphore, nullptr, &swapchain_img_idx));
+    Clock::time_point const acquire_start = Clock::now();
+    double wait_ms = elapsed_ms(frame_start, acquire_start);
 
-    VkCommandBuffer cmd = main_command_buffer;
+    uint32_t swapchain_img_idx;
+    if (headless) {
+        // Each frame in flight has its own offscreen image
+        swapchain_img_idx = get_frame_index();
+    } else {
+        PROFILE_ZONE("acquire image");
+        // Twice at most, the window may have changed since it was last checked
+        VkResult result = VK_ERROR_OUT_OF_DATE_KHR;
+        for (uint32_t attempt = 0; attempt < 2 && result == VK_ERROR_OUT_OF_DATE_KHR; attempt++) {
+            if (swapchain_dirty) {
+                recreate_swapchain();
+            }
+            if (swapchain_dirty) {
+                break;
+            }
+            // Request an image from the swapchain. Timeout of 1 second
+            result = vkAcquireNextImageKHR(
+                device, swapchain, 1000000000, frame.present_semaphore, nullptr,
+                &swapchain_img_idx);
+            swapchain_dirty = result == VK_ERROR_OUT_OF_DATE_KHR;
+        }
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            // Nothing to render into until the window has a size again. The
+            // frame is skipped, its fence stays signaled.
+            return;
+        }
+        if (result == VK_SUBOPTIMAL_KHR) {
+            // Still presentable, recreated before the next acquire
+            swapchain_dirty = true;
+        } else if (result != VK_SUCCESS) {
+            LOG_ERROR("Failed to acquire a swapchain image: " << result);
+            abort();
+        }
+        wait_ms += elapsed_ms(acquire_start, Clock::now());
+    }
+    VK_CHECK(vkResetFences(device, 1, &frame.render_fence));
+
+    // The frame that last used this frame data has finished, so its
+    // timestamps can be read without stalling and its per-frame data can be
+    // overwritten
+    collect_gpu_time(frame);
+    collect_culling_results(frame);
+    frame.arena.reset();
+    for (VkCommandPool const pool : frame.worker_pools) {
+        VK_CHECK(vkResetCommandPool(device, pool, 0));
+    }
+    for (DescriptorAllocator &worker : frame.worker_descriptors) {
+        worker.reset();
+    }
+    // New slots are written before anything recorded reads them, the
+    // table stays bound by frames still in flight
+    uint32_t const bindless_writes = bindless ? bindless_table.flush(frame_number) : 0;
+
+    VkCommandBuffer cmd = frame.main_command_buffer;
+    double record_ms = 0.0;
+    // Recorded on the CPU, and the triangles of the same draws at full detail
+    DrawCounters draw_counters;
+    uint32_t full_detail_triangles = 0;
+    // From the input the frame saw to its present, < 0 if it saw none
+    double input_latency_ms = -1.0;
+    // Building and recording the HUD, < 0 if it isn't shown
+    double hud_ms = -1.0;
+    RenderGraphStats graph_stats = {};
+    // Set while recording, waited on by the submission
+    VkPipelineStageFlags upload_wait_stage = 0;
+    uint64_t upload_wait_value = 0;
     { // Command buffer recording
+        PROFILE_ZONE("record");
         // Reset the command buffer before beginning recording
         VK_CHECK(vkResetCommandBuffer(cmd, 0));
 
@@ -106,55 +415,288 @@ void VulkanEngine::draw() {
         cmd_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
         VK_CHECK(vkBeginCommandBuffer(cmd, &cmd_info));
 
+        // GPU zones are read back frames_in_flight frames later
+        gpu_profiler.begin_frame(cmd, get_frame_index(), frame_number);
+
+        // Take over buffers from uploads that have finished since last frame
+        uint32_t const acquire_zone = gpu_profiler.begin_zone(cmd, get_frame_index(), "upload acquires");
+        upload_wait_value = upload_service.record_acquires(cmd, upload_wait_stage);
+        gpu_profiler.end_zone(cmd, get_frame_index(), acquire_zone);
+
+        // Fall back to the required pipeline until the selected one is ready
+        poll_pending_pipelines();
+
+        DrawRecordContext context;
+        context.inheritance = {}; // set once the main pass is recorded
+        context.extent = window_extent;
+        context.backdrop_pipeline = triangle_pipeline;
+        if (selected_shader == 1 && colored_triangle_pipeline != VK_NULL_HANDLE) {
+            context.backdrop_pipeline = colored_triangle_pipeline;
+        }
+        context.mesh_pipeline = VK_NULL_HANDLE;
+        context.global_descriptor = frame.global_descriptor;
+        context.camera_offset = 0;
+        context.texture_count = textured_meshes ? (uint32_t)texture_loader.get_textures().size() : 0;
+        context.camera_position = glm::vec3(0.f);
+        context.lod_count = 1;
+        context.lod_error_scale = 0.f;
+
+        // The monkeys are skipped until their mesh's upload has finished, with
+        // GPU culling until the objects' upload has too, and textured until
+        // the textures' has
+        uint32_t draw_count = 0;
+        bool const scene_uploaded = monkey_mesh.upload_value <= upload_service.acquired_value()
+            && (!gpu_culling || scene_objects_upload_value <= upload_service.acquired_value())
+            && (!textured_meshes || textures_upload_value <= upload_service.acquired_value());
+        glm::mat4 viewproj(1.f);
+        glm::vec3 camera_position(0.f);
+        if (scene_uploaded) {
+            // Camera data lives in the frame arena for as long as the frame is in flight
+            BufferSlice camera_slice;
+            if (!frame.arena.allocate(sizeof(GPUCameraData), gpu_props.limits.minUniformBufferOffsetAlignment, camera_slice)) {
+                LOG_ERROR("Frame arena is out of space.");
+                abort();
+            }
+
+            // Pan across the grid, so that parts of it leave the view
+            float const camera_x = scene_half_extent * std::sin(frame_number * CAMERA_PAN_SPEED);
+            camera_position = glm::vec3(camera_x, 0.f, camera_distance);
+
+            glm::mat4 const view = glm::translate(glm::mat4(1.f), -camera_position);
+            glm::mat4 proj = glm::perspective(
+                glm::radians(70.f), (float)window_extent.width / window_extent.height, 0.1f,
+                camera_distance + 200.0f);
+            proj[1][1] *= -1; // Vulkan's clip space y points down
+            viewproj = proj * view;
+
+            // Only written, the arena may be write-combined memory
+            GPUCameraData &camera = *(GPUCameraData *)camera_slice.data;
+            camera.view = view;
+            camera.proj = proj;
+            camera.viewproj = viewproj;
+
+            uint32_t const format = (uint32_t)monkey_mesh.vertex_format;
+            context.mesh_pipeline = mesh_pipelines[format];
+            if (gpu_culling) {
+                context.mesh_pipeline = indirect_mesh_pipelines[format];
+            } else if (batch_draws) {
+                context.mesh_pipeline = instanced_mesh_pipelines[format];
+            }
+            context.camera_offset = (uint32_t)camera_slice.offset;
+            context.spin = glm::rotate(
+                glm::mat4(1.f), glm::radians(frame_number * 0.4f), glm::vec3(0.f, 1.f, 0.f));
+            draw_count = (uint32_t)scene_draws.size();
+
+            // A unit at distance 1 is |proj[1][1]| half heights of the target
+            context.camera_position = camera_position;
+            if (lod_error_pixels > 0.f) {
+                context.lod_count = (uint32_t)monkey_mesh.lods.size();
+                context.lod_error_scale =
+                    std::abs(proj[1][1]) * window_extent.height * 0.5f / lod_error_pixels;
+            }
+        }
+
+        // The frame's passes, most frames find them already compiled
+        uint32_t const frame_index = get_frame_index();
+        render_graph.begin(frame_number);
+
+        // Presenting waits for nothing, but the acquire's semaphore is
+        // waited for at the color attachment output stage
+        VkImage const target_img = headless
+            ? offscreen_imgs[swapchain_img_idx].image
+            : swapchain_imgs[swapchain_img_idx];
+        GraphResource const target = render_graph.import_image(
+            "render target", {swapchain_img_fmt, window_extent}, target_img,
+            swapchain_img_views[swapchain_img_idx], GraphAccess::ColorAttachment,
+            headless ? GraphAccess::TransferRead : GraphAccess::Present, false);
+        GraphResource const depth =
+            render_graph.create_image("depth", {depth_img_fmt, window_extent});
+
+        bool const culled = gpu_culling && draw_count > 0;
+        GPUCullData cull_data = {};
+        GraphResource cull_results = 0;
+        GraphResource cull_draws = 0;
+        if (culled) {
+            assets::extract_frustum_planes(viewproj, cull_data.frustum_planes);
+            cull_data.shared_transform = context.spin;
+            cull_data.camera_position = glm::vec4(camera_position, 1.f);
+            cull_data.object_count = draw_count;
+            cull_data.meshlet_count = (uint32_t)scene_meshlets.size();
+            cull_data.lod_count = std::min(context.lod_count, assets::MAX_MESH_LODS);
+            cull_data.lod_error_scale = context.lod_error_scale;
+            std::copy_n(monkey_mesh.lods.data(), cull_data.lod_count, cull_data.lods);
+
+            // Each frame in flight has its own, and the last frame that used
+            // them has finished
+            cull_results =
+                render_graph.import_buffer("cull results", GraphAccess::None, GraphAccess::None);
+            cull_draws =
+                render_graph.import_buffer("cull draws", GraphAccess::None, GraphAccess::None);
+            GraphResource const cull_readback = render_graph.import_buffer(
+                "cull readback", GraphAccess::None, GraphAccess::HostRead);
+
+            uint32_t const clear_pass = render_graph.add_pass(
+                "cull clear", GraphPassType::Compute,
+                [this, frame_index, &cull_data](
+                    VkCommandBuffer cmd, VkCommandBufferInheritanceInfo const &) {
+                    culling_pass.record_clear(cmd, frame_index, cull_data);
+                });
+            render_graph.write(clear_pass, cull_results, GraphAccess::TransferWrite);
+            if (culling_pass.clears_draws()) {
+                render_graph.write(clear_pass, cull_draws, GraphAccess::TransferWrite);
+            }
+
+            uint32_t const cull_pass = render_graph.add_pass(
+                CULLING_ZONE_NAME, GraphPassType::Compute,
+                [this, frame_index](VkCommandBuffer cmd, VkCommandBufferInheritanceInfo const &) {
+                    culling_pass.record_dispatch(cmd, frame_index);
+                });
+            render_graph.write(cull_pass, cull_results, GraphAccess::ComputeWrite);
+            render_graph.write(cull_pass, cull_draws, GraphAccess::ComputeWrite);
+
+            uint32_t const readback_pass = render_graph.add_pass(
+                "cull readback", GraphPassType::Compute,
+                [this, frame_index](VkCommandBuffer cmd, VkCommandBufferInheritanceInfo const &) {
+                    culling_pass.record_readback(cmd, frame_index);
+                });
+            render_graph.read(readback_pass, cull_results, GraphAccess::TransferRead);
+            render_graph.write(readback_pass, cull_readback, GraphAccess::TransferWrite);
+
+            frame.culling_frame = frame_number;
+            frame.culling_triangles = draw_count * (monkey_mesh.lods[0].index_count / 3);
+            if (check_culling) {
+                frame.culling_reference = culling::cull_reference(
+                    cull_data, scene_objects.data(), scene_meshlet_cull_data);
+            }
+        }
+
         // Make a clear-color from the frame number. This will flash with a 120*pi frame period.
-        VkClearValue clear_value;
+        VkClearValue clear_values[2];
         float flash = abs(sin(frame_number / 120.f));
-        clear_value.color = { {0.0f, 0.0f, flash, 1.0f } };
-
-        // Start the main renderpass
-        VkRenderPassBeginInfo rp_info = {};
-        rp_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        rp_info.pNext = nullptr;
-        rp_info.renderPass = renderpass;
-        rp_info.renderArea.offset.x = 0;
-        rp_info.renderArea.offset.y = 0;
-        rp_info.renderArea.extent = window_extent;
-        rp_info.framebuffer = framebuffers[swapchain_img_idx];
-        rp_info.clearValueCount = 1;
-        rp_info.pClearValues = &clear_value;
-        vkCmdBeginRenderPass(cmd, &rp_info, VK_SUBPASS_CONTENTS_INLINE);
-
-        // Stop the main renderpass
-        vkCmdEndRenderPass(cmd);
+        clear_values[0].color = { {0.0f, 0.0f, flash, 1.0f } };
+        clear_values[1].depthStencil.depth = 1.0f;
+
+        // GPU culling and batching record a handful of commands no matter
+        // how many objects, right into the frame's command buffer
+        uint32_t const main_pass = render_graph.add_pass(
+            "main pass",
+            gpu_culling || batch_draws ? GraphPassType::Graphics : GraphPassType::GraphicsSecondary,
+            [this, &frame, &context, draw_count, &draw_counters](
+                VkCommandBuffer cmd, VkCommandBufferInheritanceInfo const &inheritance) {
+                context.inheritance = inheritance;
+                if (gpu_culling) {
+                    draw_counters = record_culled_draws(cmd, context);
+                } else if (batch_draws) {
+                    draw_counters = record_batched_draws(cmd, context, draw_count);
+                } else {
+                    draw_counters = record_draw_ranges(cmd, frame, context, draw_count);
+                }
+            });
+        render_graph.color_attachment(main_pass, target, &clear_values[0]);
+        render_graph.depth_attachment(main_pass, depth, &clear_values[1]);
+        if (culled) {
+            render_graph.read(main_pass, cull_draws, GraphAccess::IndirectRead);
+            render_graph.read(main_pass, cull_results, GraphAccess::IndirectRead);
+        }
+        if (!gpu_culling && draw_count > 0) {
+            full_detail_triangles = draw_count * (monkey_mesh.lods[0].index_count / 3);
+        }
+
+        // Over the finished scene, once its font has been uploaded. It's
+        // laid out now, with the last frame's counters, and only copied
+        // into the arena and drawn while the graph executes.
+        if (hud && perf_hud.get_upload_value() <= upload_service.acquired_value()) {
+            Clock::time_point const hud_start = Clock::now();
+            float const delta_s =
+                perf_counters.frame_ms > 0.0 ? (float)perf_counters.frame_ms / 1000.f : 0.f;
+            perf_hud.build(perf_counters, frame_history, window_extent, delta_s);
+            hud_ms = elapsed_ms(hud_start, Clock::now());
+
+            uint32_t const hud_pass = render_graph.add_pass(
+                HUD_ZONE_NAME, GraphPassType::Graphics,
+                [this, &frame, &hud_ms](VkCommandBuffer cmd, VkCommandBufferInheritanceInfo const &) {
+                    Clock::time_point const record_start = Clock::now();
+                    if (!perf_hud.record(cmd, hud_pipeline, frame.arena, window_extent)) {
+                        LOG_ERROR("Frame arena is out of space.");
+                        abort();
+                    }
+                    hud_ms += elapsed_ms(record_start, Clock::now());
+                });
+            render_graph.color_attachment(hud_pass, target, nullptr);
+        }
+
+        if (render_graph.compile() && dump_render_graph) {
+            render_graph.dump();
+        }
+        graph_stats = render_graph.get_stats();
+
+        Clock::time_point const record_start = Clock::now();
+        render_graph.execute(cmd, frame_index);
+        record_ms = elapsed_ms(record_start, Clock::now());
+
+        gpu_profiler.end_frame(cmd, get_frame_index());
+
         // Stop recording the command buffer
         VK_CHECK(vkEndCommandBuffer(cmd));
+
+        frame.arena.flush();
     }
 
     { // Submitting command buffer to graphics queue
+        PROFILE_ZONE("submit");
         // Prepare the submission to the queue
+        VkSemaphore wait_semaphores[2];
+        VkPipelineStageFlags wait_stages[2];
+        uint64_t wait_values[2];
+        uint32_t wait_count = 0;
+
         VkSubmitInfo submit = {};
         submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
         submit.pNext = nullptr;
-        VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        submit.pWaitDstStageMask = &wait_stage;
 
-        // Wait for the present semaphore to signal, indicating the swapchain is ready
-        submit.waitSemaphoreCount = 1;
-        submit.pWaitSemaphores = &present_semaphore;
+        // Headless frames have no swapchain image to wait for or present
+        if (!headless) {
+            // Wait for the present semaphore to signal, indicating the swapchain is ready
+            wait_semaphores[wait_count] = frame.present_semaphore;
+            wait_stages[wait_count] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            wait_values[wait_count] = 0; // Ignored for binary semaphores
+            wait_count++;
+
+            // Signal the render semaphore to indicate that rendering has finished
+            submit.signalSemaphoreCount = 1;
+            submit.pSignalSemaphores = &render_semaphores[swapchain_img_idx];
+        }
+
+        // Only wait for the uploads acquired in this frame, if any
+        VkTimelineSemaphoreSubmitInfoKHR timeline_info = {};
+        if (upload_wait_value > 0) {
+            wait_semaphores[wait_count] = upload_service.get_timeline();
+            wait_stages[wait_count] = upload_wait_stage;
+            wait_values[wait_count] = upload_wait_value;
+            wait_count++;
+
+            timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+            timeline_info.pNext = nullptr;
+            timeline_info.waitSemaphoreValueCount = wait_count;
+            timeline_info.pWaitSemaphoreValues = wait_values;
+            submit.pNext = &timeline_info;
+        }
 
-        // Signal the render semaphore to indicate that rendering has finished
-        submit.signalSemaphoreCount = 1;
-        submit.pSignalSemaphores = &render_semaphore;
+        submit.waitSemaphoreCount = wait_count;
+        submit.pWaitSemaphores = wait_semaphores;
+        submit.pWaitDstStageMask = wait_stages;
 
         submit.commandBufferCount = 1;
         submit.pCommandBuffers = &cmd;
 
         // Submit the command buffer to the queue to execute it
         // render_fence will now block until the commands finish execution
-        VK_CHECK(vkQueueSubmit(graphics_queue, 1, &submit, render_fence));
+        VK_CHECK(vkQueueSubmit(graphics_queue, 1, &submit, frame.render_fence));
+        graphics_submits++;
     }
 
-    { // Present resulting image to the screen
+    if (!headless) { // Present resulting image to the screen
+        PROFILE_ZONE("present");
         VkPresentInfoKHR present_info = {};
         present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
         present_info.pNext = nullptr;
@@ -162,251 +704,1820 @@ void VulkanEngine::draw() {
         present_info.swapchainCount = 1;
 
         // Wait for the render semaphore to signal
-        present_info.pWaitSemaphores = &render_semaphore;
+        present_info.pWaitSemaphores = &render_semaphores[swapchain_img_idx];
         present_info.waitSemaphoreCount = 1;
 
         // Present the image from the renderpass to the screen
         present_info.pImageIndices = &swapchain_img_idx;
-        VK_CHECK(vkQueuePresentKHR(graphics_queue, &present_info));
+        VkResult const result = vkQueuePresentKHR(graphics_queue, &present_info);
+        presents++;
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+            // Recreated before the next acquire
+            swapchain_dirty = true;
+        } else if (result != VK_SUCCESS) {
+            LOG_ERROR("Failed to present: " << result);
+            abort();
+        }
+
+        if (input_pending) {
+            input_latency_ms = elapsed_ms(input_time, Clock::now());
+            input_pending = false;
+        }
+    }
+
+    Clock::time_point const frame_end = Clock::now();
+    double const frame_ms = elapsed_ms(frame_start, frame_end);
+    uint64_t const frame_allocations = memory_counters.total_allocations() - allocations_start;
+    frame_stats.add_frame(
+        frame_ms, frame_ms - wait_ms, record_ms, frame_allocations, frame.arena.used());
+    frame_stats.set_render_graph(
+        frame_number, graph_stats.barriers, graph_stats.barrier_batches,
+        graph_stats.aliased_bytes);
+    frame_stats.set_draws(
+        frame_number, draw_counters.draws, draw_counters.binds, draw_counters.instances);
+    frame_stats.set_descriptors(
+        frame_number, draw_counters.descriptor_writes + bindless_writes,
+        draw_counters.descriptor_sets);
+    if (input_latency_ms >= 0.0) {
+        frame_stats.set_input_latency(frame_number, input_latency_ms);
+    }
+    if (event_latency_ms >= 0.0) {
+        frame_stats.set_event_latency(frame_number, event_latency_ms);
+        event_latency_ms = -1.0;
+    }
+    if (hud_ms >= 0.0) {
+        frame_stats.set_hud_time(frame_number, hud_ms);
+    }
+    // Known right away, unlike the GPU culling's
+    if (full_detail_triangles > 0) {
+        frame_stats.set_triangles(
+            frame_number, draw_counters.triangles,
+            full_detail_triangles - draw_counters.triangles);
+    }
+
+    update_perf_counters(
+        frame_ms, frame_ms - wait_ms, hud_ms, draw_counters,
+        draw_counters.descriptor_writes + bindless_writes, frame_allocations);
 
-        // Increment the frame counter
-        frame_number++;
+    if (frame_number == 0) {
+        LOG_INFO("First frame submitted " << elapsed_ms(init_start_time, frame_end) << " ms after init() started.");
     }
+
+    // Increment the frame counter
+    frame_number++;
 }
 
 void VulkanEngine::run() {
-    SDL_Event e;
-    bool bQuit = false;
-
-    // main loop
-    while (!bQuit) {
-        // Handle events on queue
-        while (SDL_PollEvent(&e) != 0) {
-            // close the window when user alt-f4s or clicks the X button
-            if (e.type == SDL_QUIT) {
-                bQuit = true;
-            }
+    frame_stats.init(max_frames > 0 ? max_frames : INTERACTIVE_STATS_FRAMES);
+    frame_pacer.set_target_fps(target_fps);
 
-            switch (e.type) {
-                case SDL_KEYDOWN:
-                    LOG_INFO("Keydown event detected");
-                    break;
-                case SDL_KEYUP:
-                    LOG_INFO("Keyup event detected");
-                    break;
-                default:
-                    break;
-            }
+    // main loop, the event thread polls the window meanwhile
+    while (true) {
+        if (max_frames > 0 && (uint32_t)frame_number >= max_frames) {
+            break;
+        }
+
+        // Before taking input, so that the frame starts with the freshest
+        frame_pacer.wait();
+
+        if (headless) {
+            draw();
+            continue;
+        }
+
+        // close the window when user alt-f4s or clicks the X button
+        if (event_thread.quit_requested()) {
+            break;
+        }
+        process_input();
+
+        uint32_t const resize_count = event_thread.get_resize_count();
+        if (resize_count != seen_resize_count) {
+            seen_resize_count = resize_count;
+            swapchain_dirty = true;
+        }
+
+        // A minimized window has nothing to present to, wait for it to be
+        // restored. Input queues up meanwhile.
+        event_thread.wait_while_minimized();
+        if (event_thread.quit_requested()) {
+            break;
         }
 
         draw();
     }
+
+    // Wait for the frames still in flight so that their GPU times are included
+    VK_CHECK(vkDeviceWaitIdle(device));
+    for (uint32_t i = 0; i < frames_in_flight; i++) {
+        collect_gpu_time(frames[i]);
+        collect_culling_results(frames[i]);
+    }
+
+    if (check_culling) {
+        if (culling_mismatches == 0) {
+            LOG_INFO("GPU culling matched the CPU reference in all " << culling_checks << " frames checked.");
+        } else {
+            LOG_ERROR("GPU culling differed from the CPU reference in " << culling_mismatches << " of " << culling_checks << " frames checked.");
+        }
+    }
+
+    // The report is printed right away, after whatever is still queued
+    logging::flush();
+    frame_stats.report();
+    report_perf_counters(perf_counters);
+    if (stats_csv_path) {
+        if (frame_stats.write_csv(stats_csv_path)) {
+            LOG_INFO("Frame timings written to \"" << stats_csv_path << "\".");
+        } else {
+            LOG_ERROR("Failed to write frame timings to \"" << stats_csv_path << "\".");
+        }
+    }
+    if (trace_path) {
+        write_trace(trace_path);
+    }
+}
+
+void VulkanEngine::write_trace(char const *const filepath) {
+    if (profiler::write_chrome_trace(filepath)) {
+        LOG_INFO("Trace written to \"" << filepath << "\".");
+    } else {
+        LOG_ERROR("Failed to write trace to \"" << filepath << "\".");
+    }
+}
+
+void VulkanEngine::process_input() {
+    PROFILE_ZONE("process input");
+    InputEvent event;
+    while (event_thread.pop_input(event)) {
+        event_latency_ms = std::max(event_latency_ms, elapsed_ms(event.time, Clock::now()));
+
+        // The first input the next frame presents, for its latency
+        if (event.type != InputEvent::Type::MouseMotion && !input_pending) {
+            input_pending = true;
+            input_time = event.time;
+        }
+
+        switch (event.type) {
+            case InputEvent::Type::KeyDown:
+                LOG_AT(logging::Level::Debug, logging::Category::Input, "Keydown event detected");
+                if (event.key == SDLK_SPACE) {
+                    selected_shader = (selected_shader + 1) % 2;
+                } else if (event.key == SDLK_t) {
+                    write_trace(trace_path ? trace_path : DEFAULT_TRACE_PATH);
+                } else if (event.key == SDLK_h) {
+                    hud = !hud;
+                }
+                break;
+            case InputEvent::Type::KeyUp:
+                LOG_AT(logging::Level::Debug, logging::Category::Input, "Keyup event detected");
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void VulkanEngine::run_dispatch_bench() {
+    bench_dispatch(instance, device, graphics_queue_family);
 }
 
 void VulkanEngine::init_vulkan() {
+    PROFILE_ZONE("init_vulkan");
+    // Every Vulkan call goes through the function pointers volk loads, and
+    // vk-bootstrap gets its own from the same vkGetInstanceProcAddr
+    Clock::time_point const volk_start = Clock::now();
+    if (volkInitialize() != VK_SUCCESS) {
+        LOG_ERROR("Failed to load the Vulkan loader.");
+        abort();
+    }
+    double load_ms = elapsed_ms(volk_start, Clock::now());
+
     // make the vulkan instance with basic debug features
-    vkb::InstanceBuilder builder;
+    vkb::InstanceBuilder builder(vkGetInstanceProcAddr);
     auto inst_result = builder.set_app_name("Example Vulkan Application")
         .request_validation_layers(true)
         .require_api_version(1, 1, 0)
-        .use_default_debug_messenger()
+        .set_debug_callback(debug_callback)
+        .set_headless(headless)
         .build();
 
     // store the instance and debug messenger
     vkb::Instance vkb_inst = inst_result.value();
     instance = vkb_inst.instance;
     debug_messenger = vkb_inst.debug_messenger;
-
-    // get the surface of the window opened with sdl
-    SDL_Vulkan_CreateSurface(window, instance, &surface);
+    // Device-level functions are loaded from the device below
+    Clock::time_point const instance_load_start = Clock::now();
+    volkLoadInstanceOnly(instance);
+    load_ms += elapsed_ms(instance_load_start, Clock::now());
 
     // select a gpu
     vkb::PhysicalDeviceSelector selector {vkb_inst};
-    vkb::PhysicalDevice vkb_phys_dev = selector
-        .set_minimum_version(1, 1)
-        .set_surface(surface)
-        .select()
-        .value();
+    selector.set_minimum_version(1, 1);
+    // Uploads signal a timeline semaphore
+    selector.add_required_extension(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+
+    if (gpu_culling) {
+        // Culling writes a draw per visible object, each of which finds its
+        // object through firstInstance. Without the draw count extension the
+        // slots of culled objects are drawn empty.
+        VkPhysicalDeviceFeatures features = {};
+        features.multiDrawIndirect = VK_TRUE;
+        features.drawIndirectFirstInstance = VK_TRUE;
+        selector.set_required_features(features);
+        selector.add_desired_extension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    }
+    if (bindless) {
+        // Its maintenance3 dependency is core in 1.1
+        selector.add_desired_extension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+    }
+    // Heap usage and budget for the HUD, its dependency on
+    // VK_KHR_get_physical_device_properties2 is core in 1.1 too
+    selector.add_desired_extension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+    if (headless) {
+        // A headless instance doesn't require presentation support, which
+        // also allows software implementations like lavapipe
+        surface = VK_NULL_HANDLE;
+    } else {
+        // get the surface of the window opened with sdl
+        SDL_Vulkan_CreateSurface(window, instance, &surface);
+        selector.set_surface(surface);
+    }
+
+    vkb::PhysicalDevice vkb_phys_dev = selector.select().value();
+    memory_budget_supported =
+        has_device_extension(vkb_phys_dev.physical_device, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    draw_indirect_count_supported = gpu_culling
+        && has_device_extension(
+            vkb_phys_dev.physical_device, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+
+    // Textures are block compressed where the device can sample that
+    VkPhysicalDeviceFeatures supported_features;
+    vkGetPhysicalDeviceFeatures(vkb_phys_dev.physical_device, &supported_features);
+    bc_textures_supported = supported_features.textureCompressionBC == VK_TRUE;
+    vkb_phys_dev.features.textureCompressionBC = supported_features.textureCompressionBC;
+
+    // The bindless table needs update-after-bind arrays that may be partly
+    // written. Only what it uses is enabled.
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing_features = {};
+    indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    indexing_features.pNext = nullptr;
+    if (bindless) {
+        bindless = init_bindless_limits(vkb_phys_dev.physical_device);
+        if (bindless) {
+            indexing_features.runtimeDescriptorArray = VK_TRUE;
+            indexing_features.descriptorBindingPartiallyBound = VK_TRUE;
+            indexing_features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+            indexing_features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+            indexing_features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+        } else {
+            LOG_INFO("Descriptor indexing is unavailable, textures are bound per draw instead of bindless.");
+        }
+    }
 
     // create the final vulkan device
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_features = {};
+    timeline_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+    timeline_features.pNext = nullptr;
+    timeline_features.timelineSemaphore = VK_TRUE;
+
     vkb::DeviceBuilder dev_builder {vkb_phys_dev};
+    dev_builder.add_pNext(&timeline_features);
+    if (bindless) {
+        dev_builder.add_pNext(&indexing_features);
+    }
     vkb::Device vkb_dev = dev_builder.build().value();
 
     // store the device and physical device handles
     device = vkb_dev.device;
     chosen_gpu = vkb_phys_dev.physical_device;
+    gpu_props = vkb_phys_dev.properties;
+
+    // Straight from the driver, skipping the loader's trampolines and the
+    // dispatch through each layer's table
+    Clock::time_point const device_load_start = Clock::now();
+    volkLoadDevice(device);
+    load_ms += elapsed_ms(device_load_start, Clock::now());
+    LOG_INFO("Loaded the Vulkan entry points in " << load_ms << " ms.");
+
+    // initialize the memory allocator, counting every device allocation
+    VmaDeviceMemoryCallbacks const memory_callbacks =
+        MemoryCounters::device_memory_callbacks(memory_counters);
+    VmaAllocatorCreateInfo allocator_info = {};
+    allocator_info.physicalDevice = chosen_gpu;
+    allocator_info.device = device;
+    allocator_info.instance = instance;
+    allocator_info.vulkanApiVersion = VK_API_VERSION_1_1;
+    allocator_info.pDeviceMemoryCallbacks = &memory_callbacks;
+    if (memory_budget_supported) {
+        allocator_info.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+    }
+    VK_CHECK(vmaCreateAllocator(&allocator_info, &allocator));
 
     // store graphics queue and family
     graphics_queue = vkb_dev.get_queue(vkb::QueueType::graphics).value();
     graphics_queue_family = vkb_dev.get_queue_index(vkb::QueueType::graphics).value();
+
+    // Prefer a transfer-only family (usually a DMA engine), then any family
+    // without graphics, and share the graphics queue as the last resort
+    auto dedicated_transfer = vkb_dev.get_dedicated_queue_index(vkb::QueueType::transfer);
+    auto separate_transfer = vkb_dev.get_queue_index(vkb::QueueType::transfer);
+    if (dedicated_transfer.has_value()) {
+        transfer_queue_family = dedicated_transfer.value();
+    } else if (separate_transfer.has_value()) {
+        transfer_queue_family = separate_transfer.value();
+    } else {
+        transfer_queue_family = graphics_queue_family;
+    }
+    vkGetDeviceQueue(device, transfer_queue_family, 0, &transfer_queue);
+    LOG_INFO(
+        "Uploading on queue family " << transfer_queue_family
+        << (transfer_queue_family == graphics_queue_family ? " (shared with graphics)." : "."));
+
+    // store what is needed to turn timestamps into milliseconds
+    timestamp_period = vkb_phys_dev.properties.limits.timestampPeriod;
+    uint32_t const valid_bits =
+        vkb_phys_dev.get_queue_families()[graphics_queue_family].timestampValidBits;
+    timestamp_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
 }
 
 void VulkanEngine::init_swapchain() {
+    PROFILE_ZONE("init_swapchain");
+    create_swapchain(VK_NULL_HANDLE);
+}
+
+void VulkanEngine::create_swapchain(VkSwapchainKHR const old_swapchain) {
+    VkExtent2D const extent = event_thread.get_drawable_extent();
+    VkPresentModeKHR const mode = choose_present_mode(chosen_gpu, surface, present_mode);
+
     vkb::SwapchainBuilder swapchain_builder{chosen_gpu, device, surface};
     vkb::Swapchain vkb_swapchain = swapchain_builder
         .use_default_format_selection()
-        .set_desired_present_mode(VK_PRESENT_MODE_FIFO_KHR)
-        .set_desired_extent(window_extent.width, window_extent.height)
+        .set_desired_present_mode(mode)
+        .set_desired_extent(extent.width, extent.height)
+        .set_old_swapchain(old_swapchain)
         .build()
         .value();
 
+    // Render passes and pipelines are built for the first swapchain's format
+    if (old_swapchain != VK_NULL_HANDLE && vkb_swapchain.image_format != swapchain_img_fmt) {
+        LOG_ERROR("The recreated swapchain changed its image format.");
+        abort();
+    }
+
     // store swapchain and images
     swapchain = vkb_swapchain.swapchain;
     swapchain_imgs = vkb_swapchain.get_images().value();
     swapchain_img_views = vkb_swapchain.get_image_views().value();
     swapchain_img_fmt = vkb_swapchain.image_format;
+    window_extent = vkb_swapchain.extent;
+
+    VkSemaphoreCreateInfo semaphore_info = {};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_info.pNext = nullptr;
+    semaphore_info.flags = 0;
+    render_semaphores = std::vector<VkSemaphore>(swapchain_imgs.size());
+    for (VkSemaphore &semaphore : render_semaphores) {
+        VK_CHECK(vkCreateSemaphore(device, &semaphore_info, nullptr, &semaphore));
+    }
+
+    if (old_swapchain == VK_NULL_HANDLE) {
+        LOG_INFO(
+            "Presenting " << swapchain_imgs.size() << " images with the "
+            << present_mode_name(mode) << " present mode (" << present_mode_name(present_mode)
+            << " requested).");
+    }
+}
+
+void VulkanEngine::recreate_swapchain() {
+    PROFILE_ZONE("recreate swapchain");
+    // Stays dirty while minimized, until the window has a size again
+    VkExtent2D const extent = event_thread.get_drawable_extent();
+    if (extent.width == 0 || extent.height == 0) {
+        return;
+    }
+
+    // Only called before the current frame's acquire, so the frames that
+    // may still render into or present the old images end with the last one
+    RetiredSwapchain retired;
+    retired.swapchain = swapchain;
+    retired.views = std::move(swapchain_img_views);
+    retired.render_semaphores = std::move(render_semaphores);
+    retired.last_frame = frame_number - 1;
+    retired_swapchains.push_back(std::move(retired));
+
+    create_swapchain(retired_swapchains.back().swapchain);
+    swapchain_dirty = false;
+}
+
+void VulkanEngine::destroy_retired_swapchains(bool const all) {
+    // The frame whose fence was waited for last has finished, and every
+    // frame before it
+    int const finished_frame = frame_number - (int)frames_in_flight;
+    for (size_t i = 0; i < retired_swapchains.size();) {
+        RetiredSwapchain const &retired = retired_swapchains[i];
+        if (!all && retired.last_frame > finished_frame) {
+            i++;
+            continue;
+        }
+
+        // Their framebuffers go first, the ones over the new views stay
+        render_graph.flush_framebuffers(retired.views.data(), (uint32_t)retired.views.size());
+        for (VkImageView const view : retired.views) {
+            vkDestroyImageView(device, view, nullptr);
+        }
+        for (VkSemaphore const semaphore : retired.render_semaphores) {
+            vkDestroySemaphore(device, semaphore, nullptr);
+        }
+        vkDestroySwapchainKHR(device, retired.swapchain, nullptr);
+        retired_swapchains.erase(retired_swapchains.begin() + i);
+    }
+}
+
+void VulkanEngine::init_offscreen_targets() {
+    PROFILE_ZONE("init_offscreen_targets");
+    // Same format the swapchain would most likely pick
+    swapchain_img_fmt = VK_FORMAT_B8G8R8A8_SRGB;
+
+    VkExtent3D const extent = {window_extent.width, window_extent.height, 1};
+    VkImageCreateInfo const img_info = vkinit::image_create_info(
+        swapchain_img_fmt,
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        extent);
+
+    // One image per frame in flight, so an image is free again once the fence
+    // of the frame that rendered into it has signaled
+    for (uint32_t i = 0; i < frames_in_flight; i++) {
+        AllocatedImage const img = create_image(img_info, VMA_MEMORY_USAGE_GPU_ONLY);
+
+        VkImageViewCreateInfo const view_info = vkinit::imageview_create_info(
+            swapchain_img_fmt, img.image, VK_IMAGE_ASPECT_COLOR_BIT);
+        VkImageView view;
+        VK_CHECK(vkCreateImageView(device, &view_info, nullptr, &view));
+
+        offscreen_imgs.push_back(img);
+        swapchain_img_views.push_back(view);
+    }
 }
 
 void VulkanEngine::init_commands() {
+    PROFILE_ZONE("init_commands");
     // Create command pool for submitting graphics commands
     // Also allow resetting of individual command buffers inside the pool
     VkCommandPoolCreateInfo command_pool_info = vkinit::command_pool_create_info(
         graphics_queue_family, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
-    VK_CHECK(vkCreateCommandPool(
-        device, &command_pool_info, nullptr, &command_pool));
-
-    // allocate default command buffer for rendering
-    VkCommandBufferAllocateInfo cmd_alloc_info = vkinit::command_buffer_alloc_info(
-        command_pool, 1, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
-    VK_CHECK(vkAllocateCommandBuffers(
-        device, &cmd_alloc_info, &main_command_buffer));
-}
-
-void VulkanEngine::init_default_renderpass() {
-    VkAttachmentDescription color_attachment = {}; // Description of the image to write into
-    color_attachment.format = swapchain_img_fmt;
-    color_attachment.samples = VK_SAMPLE_COUNT_1_BIT; // No MSAA so 1 sample
-    color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR; // Clear when renderpass loads
-    color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE; // Store when renderpass ends
-    color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; // Ready for display
-
-    VkAttachmentReference color_attachment_ref = {};
-    color_attachment_ref.attachment = 0; // Index into pAttachments array in parent renderpass
-    color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    VkSubpassDescription subpass = {};
-    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.colorAttachmentCount = 1;
-    subpass.pColorAttachments = &color_attachment_ref;
-
-    VkRenderPassCreateInfo render_pass_info = {};
-    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    render_pass_info.attachmentCount = 1;
-    render_pass_info.pAttachments = &color_attachment;
-    render_pass_info.subpassCount = 1;
-    render_pass_info.pSubpasses = &subpass;
-
-    VK_CHECK(vkCreateRenderPass(device, &render_pass_info, nullptr, &renderpass));
-}
-
-void VulkanEngine::init_framebuffers() {
-    // Framebuffers connect renderpass to images for rendering
-    VkFramebufferCreateInfo fb_info = {};
-    fb_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-    fb_info.pNext = nullptr;
-    fb_info.renderPass = renderpass;
-    fb_info.attachmentCount = 1;
-    fb_info.width = window_extent.width;
-    fb_info.height = window_extent.height;
-    fb_info.layers = 1;
-
-    // Grab number of images in the swapchain
-    const uint32_t swapchain_imgcount = swapchain_imgs.size();
-    framebuffers = std::vector<VkFramebuffer>(swapchain_imgcount);
-
-    // Create one framebuffer for each swapchain image view
-    for (int i = 0; i < swapchain_imgcount; i++) {
-        fb_info.pAttachments = &swapchain_img_views[i];
-        VK_CHECK(vkCreateFramebuffer(device, &fb_info, nullptr, &framebuffers[i]));
+
+    // Each frame in flight records into its own pool and command buffer
+    for (uint32_t i = 0; i < frames_in_flight; i++) {
+        VK_CHECK(vkCreateCommandPool(
+            device, &command_pool_info, nullptr, &frames[i].command_pool));
+
+        // allocate default command buffer for rendering
+        VkCommandBufferAllocateInfo cmd_alloc_info = vkinit::command_buffer_alloc_info(
+            frames[i].command_pool, 1, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+        VK_CHECK(vkAllocateCommandBuffers(
+            device, &cmd_alloc_info, &frames[i].main_command_buffer));
+
+        // The recording jobs' pools are only ever reset as a whole, and their
+        // buffers are rerecorded every frame
+        VkCommandPoolCreateInfo const worker_pool_info = vkinit::command_pool_create_info(
+            graphics_queue_family, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+        frames[i].worker_pools.resize(record_threads);
+        frames[i].secondary_buffers.resize(record_threads);
+        frames[i].range_counters.resize(record_threads);
+        for (uint32_t t = 0; t < record_threads; t++) {
+            VK_CHECK(vkCreateCommandPool(
+                device, &worker_pool_info, nullptr, &frames[i].worker_pools[t]));
+
+            VkCommandBufferAllocateInfo const secondary_alloc_info = vkinit::command_buffer_alloc_info(
+                frames[i].worker_pools[t], 1, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+            VK_CHECK(vkAllocateCommandBuffers(
+                device, &secondary_alloc_info, &frames[i].secondary_buffers[t]));
+        }
     }
 }
 
+void VulkanEngine::init_render_graph() {
+    PROFILE_ZONE("init_render_graph");
+    depth_img_fmt = VK_FORMAT_D32_SFLOAT;
+
+    RenderGraph::InitInfo info;
+    info.device = device;
+    info.allocator = allocator;
+    info.counters = &memory_counters;
+    info.profiler = &gpu_profiler;
+    render_graph.init(info);
+
+    // The main pass draws into the render target and a depth image
+    renderpass = render_graph.get_compatible_render_pass(&swapchain_img_fmt, 1, depth_img_fmt);
+}
+
 void VulkanEngine::init_sync_structures() {
+    PROFILE_ZONE("init_sync_structures");
     VkFenceCreateInfo fence_info = {};
     fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
     fence_info.pNext = nullptr;
     fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-    VK_CHECK(vkCreateFence(device, &fence_info, nullptr, &render_fence));
 
     VkSemaphoreCreateInfo semaphore_info = {};
     semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
     semaphore_info.pNext = nullptr;
     semaphore_info.flags = 0;
-    VK_CHECK(vkCreateSemaphore(device, &semaphore_info, nullptr, &present_semaphore));
-    VK_CHECK(vkCreateSemaphore(device, &semaphore_info, nullptr, &render_semaphore));
+
+    for (uint32_t i = 0; i < frames_in_flight; i++) {
+        VK_CHECK(vkCreateFence(device, &fence_info, nullptr, &frames[i].render_fence));
+        VK_CHECK(vkCreateSemaphore(device, &semaphore_info, nullptr, &frames[i].present_semaphore));
+    }
+    // The render semaphores come with the swapchain, headless frames are
+    // never presented and need none
 }
 
-void VulkanEngine::init_pipelines() {
-    VkShaderModule triangle_frag_shader;
-    if (!load_shader_module(
-        "shaderbuild/triangle.frag.spv", triangle_frag_shader
-    )) {
-        LOG_ERROR("Failed to build fragment shader module.");
-    } else {
-        LOG_INFO("Triangle fragment shader successfully loaded.");
+void VulkanEngine::init_frame_allocators() {
+    PROFILE_ZONE("init_frame_allocators");
+    // Frame data is read as uniforms, vertices or indices
+    VkBufferUsageFlags const arena_usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT
+        | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+        | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    for (uint32_t i = 0; i < frames_in_flight; i++) {
+        frames[i].arena.init(allocator, FRAME_ARENA_SIZE, arena_usage, memory_counters);
     }
+}
 
-    VkShaderModule triangle_vert_shader;
-    if (!load_shader_module(
-        "shaderbuild/triangle.vert.spv", triangle_vert_shader
-    )) {
-        LOG_ERROR("Failed to build vertex shader module.");
+void VulkanEngine::init_uploads() {
+    PROFILE_ZONE("init_uploads");
+    UploadService::InitInfo info;
+    info.device = device;
+    info.allocator = allocator;
+    info.counters = &memory_counters;
+    info.transfer_queue = transfer_queue;
+    info.transfer_queue_family = transfer_queue_family;
+    info.graphics_queue_family = graphics_queue_family;
+    info.staging_size = STAGING_RING_SIZE;
+    upload_service.init(info);
+}
+
+bool VulkanEngine::init_bindless_limits(VkPhysicalDevice const gpu) {
+    if (!has_device_extension(gpu, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)) {
+        return false;
+    }
+
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT features = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    features.pNext = nullptr;
+    VkPhysicalDeviceFeatures2 features2 = {};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &features;
+    vkGetPhysicalDeviceFeatures2(gpu, &features2);
+    if (!features.runtimeDescriptorArray || !features.descriptorBindingPartiallyBound
+        || !features.descriptorBindingSampledImageUpdateAfterBind
+        || !features.descriptorBindingStorageBufferUpdateAfterBind
+        || !features.descriptorBindingUpdateUnusedWhilePending) {
+        return false;
+    }
+
+    VkPhysicalDeviceDescriptorIndexingPropertiesEXT limits = {};
+    limits.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+    limits.pNext = nullptr;
+    VkPhysicalDeviceProperties2 properties2 = {};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &limits;
+    vkGetPhysicalDeviceProperties2(gpu, &properties2);
+
+    // Combined image samplers count as both samplers and sampled images
+    bindless_max_textures = std::min({
+        MAX_BINDLESS_TEXTURES, limits.maxPerStageDescriptorUpdateAfterBindSamplers,
+        limits.maxPerStageDescriptorUpdateAfterBindSampledImages,
+        limits.maxDescriptorSetUpdateAfterBindSamplers,
+        limits.maxDescriptorSetUpdateAfterBindSampledImages});
+    bindless_max_buffers = std::min({
+        MAX_BINDLESS_BUFFERS, limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+        limits.maxDescriptorSetUpdateAfterBindStorageBuffers});
+    // The fragment stage sees both arrays, and the few descriptors of the
+    // other sets
+    uint32_t const resources = limits.maxPerStageUpdateAfterBindResources > 16
+        ? limits.maxPerStageUpdateAfterBindResources - 16
+        : 0;
+    bindless_max_buffers = std::min(bindless_max_buffers, resources / 4);
+    bindless_max_textures = std::min(bindless_max_textures, resources - bindless_max_buffers);
+    return bindless_max_textures >= SCENE_TEXTURE_COUNT;
+}
+
+void VulkanEngine::init_descriptors() {
+    PROFILE_ZONE("init_descriptors");
+    layout_cache.init(device);
+
+    // The sets that live until cleanup: each frame's camera set, and the
+    // culling pass' or the instance buffers' sets
+    DescriptorAllocator::InitInfo allocator_info;
+    allocator_info.device = device;
+    allocator_info.initial_sets = 2 * frames_in_flight;
+    descriptor_allocator.init(allocator_info);
+
+    // Camera data, at a different arena offset every frame
+    VkDescriptorSetLayoutBinding const camera_binding = vkinit::descriptorset_layout_binding(
+        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT, 0);
+
+    VkDescriptorSetLayoutCreateInfo set_info = {};
+    set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_info.pNext = nullptr;
+    set_info.flags = 0;
+    set_info.bindingCount = 1;
+    set_info.pBindings = &camera_binding;
+    global_set_layout = layout_cache.get(set_info);
+
+    for (uint32_t i = 0; i < frames_in_flight; i++) {
+        frames[i].global_descriptor = descriptor_allocator.allocate(global_set_layout);
+
+        VkDescriptorBufferInfo buffer_info = {};
+        buffer_info.buffer = frames[i].arena.get_buffer();
+        buffer_info.offset = 0;
+        buffer_info.range = sizeof(GPUCameraData);
+
+        VkWriteDescriptorSet const write = vkinit::write_descriptor_buffer(
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, frames[i].global_descriptor, &buffer_info, 0);
+        vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+        // Sets only needed while the frame is in flight come from these
+        DescriptorAllocator::InitInfo worker_info;
+        worker_info.device = device;
+        worker_info.initial_sets = FRAME_DESCRIPTOR_SETS;
+        frames[i].worker_descriptors.resize(record_threads);
+        for (DescriptorAllocator &worker : frames[i].worker_descriptors) {
+            worker.init(worker_info);
+        }
+    }
+
+    // Trilinear, the textures are built with their mips
+    VkSamplerCreateInfo const sampler_info =
+        vkinit::sampler_create_info(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT);
+    VK_CHECK(vkCreateSampler(device, &sampler_info, nullptr, &texture_sampler));
+
+    if (bindless) {
+        BindlessTable::InitInfo info;
+        info.device = device;
+        info.layout_cache = &layout_cache;
+        info.max_textures = bindless_max_textures;
+        info.max_buffers = bindless_max_buffers;
+        info.frames_in_flight = frames_in_flight;
+        bindless_table.init(info);
+        LOG_INFO(
+            "Bindless table holds " << bindless_max_textures << " textures and "
+            << bindless_max_buffers << " storage buffers.");
     } else {
-        LOG_INFO("Triangle vertex shader successfully loaded.");
+        VkDescriptorSetLayoutBinding const texture_binding = vkinit::descriptorset_layout_binding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0);
+        set_info.pBindings = &texture_binding;
+        material_set_layout = layout_cache.get(set_info);
     }
 }
 
-bool VulkanEngine::load_shader_module(
-    char const *const filepath, VkShaderModule &out_shader_module
-) const {
-    std::vector<uint32_t> buffer;
-    { // Read file into buffer
-        // Open the file in binary mode with the cursor at the end
-        std::ifstream file(filepath, std::ios::ate | std::ios::binary);
+void VulkanEngine::init_scene() {
+    PROFILE_ZONE("init_scene");
+    // Square grid centered on the origin, filled row by row
+    uint32_t const side = (uint32_t)std::ceil(std::sqrt((double)scene_draw_count));
+    float const half_extent = (side - 1) * SCENE_GRID_SPACING * 0.5f;
+    scene_half_extent = half_extent;
+
+    // Centered on the mesh origin, which the spin rotates around, so that the
+    // sphere holds the mesh at any angle
+    glm::vec3 const extent = glm::max(glm::abs(monkey_mesh.bounds_min), glm::abs(monkey_mesh.bounds_max));
+    glm::vec4 const bounding_sphere(0.f, 0.f, 0.f, glm::length(extent));
+
+    // Rows before the copies, so the store is already in depth order
+    uint32_t const row_count = side > 0 ? (scene_draw_count + side - 1) / side : 0;
+    scene_store.clear();
+    scene_store.reserve(row_count + scene_draw_count);
+    std::vector<scene::NodeId> rows;
+    for (uint32_t row = 0; row < row_count; row++) {
+        scene::NodeDesc desc;
+        desc.position = glm::vec3(-half_extent, row * SCENE_GRID_SPACING - half_extent, 0.f);
+        rows.push_back(scene_store.add_node(desc));
+    }
+    for (uint32_t i = 0; i < scene_draw_count; i++) {
+        scene::NodeDesc desc;
+        desc.parent = rows[i / side];
+        desc.position = glm::vec3((i % side) * SCENE_GRID_SPACING, 0.f, 0.f);
+        desc.local_bounds = bounding_sphere;
+        desc.mesh = MONKEY_MESH_ID;
+        desc.material = MESH_MATERIAL_ID;
+        scene_store.add_node(desc);
+    }
+    scene_store.update_transforms(&job_system);
 
-        // Failed to open file
-        if (!file.is_open()) {
-            LOG_ERROR("Failed to open file: \"" << filepath << "\".");
-            return false;
+    uint32_t const *const meshes = scene_store.get_meshes();
+    scene_draws.clear();
+    for (uint32_t i = 0; i < scene_store.size(); i++) {
+        if (meshes[i] != scene::NO_MESH) {
+            scene_draws.push_back(i);
         }
+    }
 
-        // File size in bytes is the location of the cursor
-        size_t const file_size = (size_t)file.tellg();
+    // Back far enough for the whole grid, plus a monkey's radius, to fit in
+    // the 70 degree field of view
+    camera_distance = std::max(3.0f, (half_extent + 1.0f) / std::tan(glm::radians(35.f)) + 1.0f);
+    if (fixed_camera_distance > 0.0f) {
+        camera_distance = fixed_camera_distance;
+    }
+
+    if (gpu_culling) {
+        glm::mat4 const *const world_matrices = scene_store.get_world_matrices();
+        glm::vec4 const *const local_bounds = scene_store.get_local_bounds();
+        scene_objects.clear();
+        scene_objects.reserve(scene_draws.size());
+        for (uint32_t const node : scene_draws) {
+            GPUObjectData object;
+            object.model = world_matrices[node];
+            object.bounding_sphere = local_bounds[node];
+            scene_objects.push_back(object);
+        }
 
-        // Vulkan requires shader code size to be a multiple of 4 (uint32_t is 4 bytes)
-        if (file_size % 4 != 0) {
-            LOG_ERROR("File size of file \"" << filepath << "\" is not a multiple of 4.");
+        if (cluster_culling) {
+            scene_meshlets = monkey_mesh.meshlets;
+        } else {
+            // The whole mesh, with the object's sphere and no normal cone
+            assets::Meshlet whole_mesh = {};
+            whole_mesh.radius = bounding_sphere.w;
+            whole_mesh.cone_cutoff = 2.f;
+            whole_mesh.first_index = 0;
+            whole_mesh.triangle_count = monkey_mesh.lods[0].index_count / 3;
+            whole_mesh.vertex_count = monkey_mesh.vertex_count;
+            scene_meshlets.assign(1, whole_mesh);
         }
+        if (check_culling) {
+            assets::build_meshlet_cull_data(
+                scene_meshlets.data(), scene_meshlets.size(), scene_meshlet_cull_data);
+        }
+    }
+}
+
+void VulkanEngine::init_culling() {
+    PROFILE_ZONE("init_culling");
+    CullingPass::InitInfo info;
+    info.device = device;
+    info.allocator = allocator;
+    info.counters = &memory_counters;
+    info.layout_cache = &layout_cache;
+    info.descriptors = &descriptor_allocator;
+    info.frames_in_flight = frames_in_flight;
+    info.max_objects = (uint32_t)scene_objects.size();
+    info.max_meshlets = (uint32_t)scene_meshlets.size();
+    info.draw_indirect_count = draw_indirect_count_supported;
+    info.max_group_count_x = gpu_props.limits.maxComputeWorkGroupCount[0];
+    info.max_group_count_y = gpu_props.limits.maxComputeWorkGroupCount[1];
+    culling_pass.init(info);
+
+    scene_objects_upload_value = culling_pass.upload_scene(upload_service, scene_objects, scene_meshlets);
+}
+
+void VulkanEngine::init_instances() {
+    PROFILE_ZONE("init_instances");
+    InstanceBuffers::InitInfo info;
+    info.device = device;
+    info.allocator = allocator;
+    info.counters = &memory_counters;
+    info.layout_cache = &layout_cache;
+    info.descriptors = &descriptor_allocator;
+    info.frames_in_flight = frames_in_flight;
+    info.max_instances = (uint32_t)scene_draws.size();
+    instance_buffers.init(info);
+
+    // Sized for every draw, so steady-state frames don't allocate
+    draw_list.reserve(info.max_instances);
+}
+
+void VulkanEngine::init_hud() {
+    PROFILE_ZONE("init_hud");
+    // Always, so that H can show it at any time
+    PerfHud::InitInfo info;
+    info.device = device;
+    info.allocator = allocator;
+    info.counters = &memory_counters;
+    info.uploads = &upload_service;
+    info.layout_cache = &layout_cache;
+    info.descriptors = &descriptor_allocator;
+    info.sampler = texture_sampler;
+    perf_hud.init(info);
+}
+
+void VulkanEngine::init_pipelines() {
+    PROFILE_ZONE("init_pipelines");
+    pipeline_cache.init(device, gpu_props, PIPELINE_CACHE_PATH);
+
+    // Every SPIR-V file is mapped and turned into a module in parallel
+    shader_library.load_all(device, SHADER_DIR, job_system);
+
+    VkPipelineLayoutCreateInfo layout_info = vkinit::pipeline_layout_create_info();
+    VK_CHECK(vkCreatePipelineLayout(device, &layout_info, nullptr, &triangle_pipeline_layout));
+
+    // Meshes get the camera from the global set and their transform through
+    // push constants. Textured ones get their texture from set 1, either a
+    // set of its own or the bindless table, with the texture's index pushed
+    // to the fragment stage.
+    VkPushConstantRange push_constants[2] = {};
+    push_constants[0].offset = 0;
+    push_constants[0].size = sizeof(MeshPushConstants);
+    push_constants[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    push_constants[1].offset = sizeof(MeshPushConstants);
+    push_constants[1].size = sizeof(MaterialPushConstants);
+    push_constants[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    VkDescriptorSetLayout const mesh_set_layouts[2] = {
+        global_set_layout, bindless ? bindless_table.get_set_layout() : material_set_layout};
+    layout_info.setLayoutCount = textured_meshes ? 2 : 1;
+    layout_info.pSetLayouts = mesh_set_layouts;
+    layout_info.pushConstantRangeCount = textured_meshes && bindless ? 2 : 1;
+    layout_info.pPushConstantRanges = push_constants;
+    VK_CHECK(vkCreatePipelineLayout(device, &layout_info, nullptr, &mesh_pipeline_layout));
+    // The vertex range only from here on
+    layout_info.pushConstantRangeCount = 1;
+
+    // Indirect draws get their transform from the culling pass' objects, the
+    // push constant only holds the spin they share
+    if (gpu_culling) {
+        VkDescriptorSetLayout const indirect_set_layouts[2] = {
+            global_set_layout, culling_pass.get_set_layout()};
+        layout_info.setLayoutCount = 2;
+        layout_info.pSetLayouts = indirect_set_layouts;
+        VK_CHECK(vkCreatePipelineLayout(device, &layout_info, nullptr, &indirect_pipeline_layout));
+    }
+    // Instanced draws get theirs from the instance buffers, the same way
+    if (batch_draws) {
+        VkDescriptorSetLayout const instanced_set_layouts[2] = {
+            global_set_layout, instance_buffers.get_set_layout()};
+        layout_info.setLayoutCount = 2;
+        layout_info.pSetLayouts = instanced_set_layouts;
+        VK_CHECK(vkCreatePipelineLayout(
+            device, &layout_info, nullptr, &instanced_pipeline_layout));
+    }
+
+    // Pipelines compile in parallel jobs, the pipeline cache is shared by all
+    jobs::Counter required;
+    job_system.run(required, [this]() {
+        triangle_pipeline = build_triangle_pipeline("triangle");
+    });
+    job_system.run(required, [this]() {
+        mesh_pipelines[(uint32_t)assets::VertexFormat::Full] =
+            build_mesh_pipeline(assets::VertexFormat::Full, false, mesh_pipeline_layout);
+    });
+    job_system.run(required, [this]() {
+        mesh_pipelines[(uint32_t)assets::VertexFormat::Quantized] = build_mesh_pipeline(
+            assets::VertexFormat::Quantized, false, mesh_pipeline_layout);
+    });
+    bool culling_pipeline_built = true;
+    if (gpu_culling) {
+        job_system.run(required, [this, &culling_pipeline_built]() {
+            culling_pipeline_built = culling_pass.build_pipeline(
+                shader_library.find("cull.comp.spv"), pipeline_cache);
+        });
+        job_system.run(required, [this]() {
+            indirect_mesh_pipelines[(uint32_t)assets::VertexFormat::Full] =
+                build_mesh_pipeline(assets::VertexFormat::Full, true, indirect_pipeline_layout);
+        });
+        job_system.run(required, [this]() {
+            indirect_mesh_pipelines[(uint32_t)assets::VertexFormat::Quantized] =
+                build_mesh_pipeline(
+                    assets::VertexFormat::Quantized, true, indirect_pipeline_layout);
+        });
+    }
+    if (batch_draws) {
+        job_system.run(required, [this]() {
+            instanced_mesh_pipelines[(uint32_t)assets::VertexFormat::Full] =
+                build_mesh_pipeline(assets::VertexFormat::Full, true, instanced_pipeline_layout);
+        });
+        job_system.run(required, [this]() {
+            instanced_mesh_pipelines[(uint32_t)assets::VertexFormat::Quantized] =
+                build_mesh_pipeline(
+                    assets::VertexFormat::Quantized, true, instanced_pipeline_layout);
+        });
+    }
+    job_system.run(required, [this]() {
+        hud_pipeline = build_hud_pipeline();
+    });
+    job_system.run(colored_triangle_pipeline_counter, [this]() {
+        colored_triangle_pipeline_result = build_triangle_pipeline("colored_triangle");
+    }, jobs::Priority::Background);
+
+    // Only the required pipelines have to be ready before rendering can start
+    job_system.wait(required);
+    if (triangle_pipeline == VK_NULL_HANDLE) {
+        LOG_ERROR("Failed to build the triangle pipeline.");
+        abort();
+    }
+    for (VkPipeline const pipeline : mesh_pipelines) {
+        if (pipeline == VK_NULL_HANDLE) {
+            LOG_ERROR("Failed to build the mesh pipelines.");
+            abort();
+        }
+    }
+    if (gpu_culling) {
+        if (!culling_pipeline_built) {
+            LOG_ERROR("Failed to build the culling pipeline.");
+            abort();
+        }
+        for (VkPipeline const pipeline : indirect_mesh_pipelines) {
+            if (pipeline == VK_NULL_HANDLE) {
+                LOG_ERROR("Failed to build the indirect mesh pipelines.");
+                abort();
+            }
+        }
+    }
+    if (batch_draws) {
+        for (VkPipeline const pipeline : instanced_mesh_pipelines) {
+            if (pipeline == VK_NULL_HANDLE) {
+                LOG_ERROR("Failed to build the instanced mesh pipelines.");
+                abort();
+            }
+        }
+    }
+    if (hud_pipeline == VK_NULL_HANDLE) {
+        LOG_ERROR("Failed to build the HUD pipeline.");
+        abort();
+    }
+}
+
+PipelineBuilder VulkanEngine::default_pipeline_builder() const {
+    PipelineBuilder builder;
+
+    // No vertex input, pipelines drawing meshes set their own
+    builder.vertex_input_info = vkinit::vertex_input_state_create_info();
+    builder.input_assembly = vkinit::input_assembly_create_info(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+
+    builder.rasterizer = vkinit::rasterization_state_create_info(VK_POLYGON_MODE_FILL);
+    builder.multisampling = vkinit::multisampling_state_create_info();
+    builder.color_blend_attachment = vkinit::color_blend_attachment_state();
+    builder.depth_stencil = vkinit::depth_stencil_create_info(true, true, VK_COMPARE_OP_LESS_OR_EQUAL);
 
-        // Reserve a buffer big enough for the entire file
-        buffer.resize(file_size / sizeof(uint32_t));
+    return builder;
+}
+
+VkPipeline VulkanEngine::build_triangle_pipeline(char const *const shader_name) {
+    std::string const name = shader_name;
+    VkShaderModule const vert_shader = shader_library.find(name + ".vert.spv");
+    VkShaderModule const frag_shader = shader_library.find(name + ".frag.spv");
+    if (vert_shader == VK_NULL_HANDLE || frag_shader == VK_NULL_HANDLE) {
+        LOG_ERROR("Missing shader modules for \"" << name << "\".");
+        return VK_NULL_HANDLE;
+    }
 
-        // Load the entire file into the buffer
-        file.seekg(0);
-        file.read((char *)buffer.data(), file_size);
-        file.close();
+    // The triangle's vertices are hard-coded in the shader, no vertex input
+    PipelineBuilder builder = default_pipeline_builder();
+    builder.shader_stages.push_back(vkinit::pipeline_shader_stage_create_info(
+        VK_SHADER_STAGE_VERTEX_BIT, vert_shader));
+    builder.shader_stages.push_back(vkinit::pipeline_shader_stage_create_info(
+        VK_SHADER_STAGE_FRAGMENT_BIT, frag_shader));
+
+    // Drawn behind everything else
+    builder.depth_stencil = vkinit::depth_stencil_create_info(false, false, VK_COMPARE_OP_ALWAYS);
+    builder.pipeline_layout = triangle_pipeline_layout;
+
+    return builder.build_pipeline(device, renderpass, pipeline_cache);
+}
+
+VkPipeline VulkanEngine::build_mesh_pipeline(
+    assets::VertexFormat const format, bool const object_buffer, VkPipelineLayout const layout
+) {
+    // Quantized normals are decoded in the vertex shader
+    bool const quantized = format == assets::VertexFormat::Quantized;
+    char const *vert_name = quantized ? "mesh_quantized.vert.spv" : "mesh.vert.spv";
+    if (object_buffer) {
+        vert_name = quantized ? "mesh_indirect_quantized.vert.spv" : "mesh_indirect.vert.spv";
+    }
+    // Only copies drawn one call each are textured
+    char const *frag_name = "colored_triangle.frag.spv";
+    if (!object_buffer && textured_meshes) {
+        frag_name = bindless ? "textured_mesh_bindless.frag.spv" : "textured_mesh.frag.spv";
+    }
+    VkShaderModule const vert_shader = shader_library.find(vert_name);
+    VkShaderModule const frag_shader = shader_library.find(frag_name);
+    if (vert_shader == VK_NULL_HANDLE || frag_shader == VK_NULL_HANDLE) {
+        LOG_ERROR("Missing shader modules for \"" << vert_name << "\" or \"" << frag_name << "\".");
+        return VK_NULL_HANDLE;
     }
 
-    VkShaderModule shader_module;
-    { // Create shader module for the buffer
-        VkShaderModuleCreateInfo info = {};
-        info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        info.pNext = nullptr;
+    PipelineBuilder builder = default_pipeline_builder();
+    builder.shader_stages.push_back(vkinit::pipeline_shader_stage_create_info(
+        VK_SHADER_STAGE_VERTEX_BIT, vert_shader));
+    builder.shader_stages.push_back(vkinit::pipeline_shader_stage_create_info(
+        VK_SHADER_STAGE_FRAGMENT_BIT, frag_shader));
 
-        // codeSize has to be in bytes, so multiple the ints in the buffer by the size of an int
-        info.codeSize = buffer.size() * sizeof(uint32_t);
-        info.pCode = buffer.data();
+    // Must stay alive until the pipeline has been built
+    VertexInputDescription const vertex_description = get_vertex_description(format);
+    builder.vertex_input_info.vertexBindingDescriptionCount = vertex_description.bindings.size();
+    builder.vertex_input_info.pVertexBindingDescriptions = vertex_description.bindings.data();
+    builder.vertex_input_info.vertexAttributeDescriptionCount = vertex_description.attributes.size();
+    builder.vertex_input_info.pVertexAttributeDescriptions = vertex_description.attributes.data();
+
+    builder.pipeline_layout = layout;
+
+    return builder.build_pipeline(device, renderpass, pipeline_cache);
+}
+
+VkPipeline VulkanEngine::build_hud_pipeline() {
+    VkShaderModule const vert_shader = shader_library.find("hud.vert.spv");
+    VkShaderModule const frag_shader = shader_library.find("hud.frag.spv");
+    if (vert_shader == VK_NULL_HANDLE || frag_shader == VK_NULL_HANDLE) {
+        LOG_ERROR("Missing shader modules for \"hud\".");
+        return VK_NULL_HANDLE;
+    }
+
+    PipelineBuilder builder = default_pipeline_builder();
+    builder.shader_stages.push_back(vkinit::pipeline_shader_stage_create_info(
+        VK_SHADER_STAGE_VERTEX_BIT, vert_shader));
+    builder.shader_stages.push_back(vkinit::pipeline_shader_stage_create_info(
+        VK_SHADER_STAGE_FRAGMENT_BIT, frag_shader));
+
+    // Must stay alive until the pipeline has been built
+    VertexInputDescription const vertex_description = PerfHud::get_vertex_description();
+    builder.vertex_input_info.vertexBindingDescriptionCount = vertex_description.bindings.size();
+    builder.vertex_input_info.pVertexBindingDescriptions = vertex_description.bindings.data();
+    builder.vertex_input_info.vertexAttributeDescriptionCount = vertex_description.attributes.size();
+    builder.vertex_input_info.pVertexAttributeDescriptions = vertex_description.attributes.data();
+
+    // Alpha blended over the scene, in the order imgui draws
+    builder.color_blend_attachment.blendEnable = VK_TRUE;
+    builder.color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    builder.color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    builder.color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+    builder.color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    builder.color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    builder.color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+    builder.depth_stencil = vkinit::depth_stencil_create_info(false, false, VK_COMPARE_OP_ALWAYS);
+    builder.pipeline_layout = perf_hud.get_pipeline_layout();
+
+    // The HUD's pass has the target alone, without the depth attachment
+    VkRenderPass const hud_pass =
+        render_graph.get_compatible_render_pass(&swapchain_img_fmt, 1, VK_FORMAT_UNDEFINED);
+    return builder.build_pipeline(device, hud_pass, pipeline_cache);
+}
+
+void VulkanEngine::poll_pending_pipelines() {
+    if (colored_triangle_pipeline != VK_NULL_HANDLE || !colored_triangle_pipeline_counter.done()) {
+        return;
+    }
+
+    colored_triangle_pipeline = colored_triangle_pipeline_result;
+    if (colored_triangle_pipeline != VK_NULL_HANDLE) {
+        LOG_INFO("Colored triangle pipeline is ready.");
+    }
+}
 
-        if (vkCreateShaderModule(
-            device, &info, nullptr, &shader_module
-        ) != VK_SUCCESS) {
-            return false;
+DrawCounters VulkanEngine::record_draw_range(
+    FrameData &frame, uint32_t const range_index,
+    DrawRecordContext const &context, uint32_t const first,
+    uint32_t const count
+) {
+    PROFILE_ZONE("record draw range");
+    VkCommandBuffer const cmd = frame.secondary_buffers[range_index];
+    DrawCounters counters;
+
+    VkCommandBufferBeginInfo cmd_info = {};
+    cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmd_info.pNext = nullptr;
+    cmd_info.pInheritanceInfo = &context.inheritance;
+    cmd_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+        | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    VK_CHECK(vkBeginCommandBuffer(cmd, &cmd_info));
+
+    // Dynamic state isn't inherited either, it follows the window's size
+    VkViewport const viewport = {
+        0.f, 0.f, (float)context.extent.width, (float)context.extent.height, 0.f, 1.f};
+    VkRect2D const scissor = {{0, 0}, context.extent};
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+    if (range_index == 0) {
+        // The triangle doesn't test or write depth, it's drawn as a backdrop
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, context.backdrop_pipeline);
+        vkCmdDraw(cmd, 3, 1, 0, 0);
+        counters.binds++;
+        counters.draws++;
+    }
+
+    if (count > 0) {
+        // Secondary command buffers inherit no state, each binds its own
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, context.mesh_pipeline);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh_pipeline_layout, 0, 1, &context.global_descriptor, 1, &context.camera_offset);
+        if (context.texture_count > 0 && bindless) {
+            // Bound once, each copy only pushes its texture's index
+            VkDescriptorSet const table = bindless_table.get_descriptor();
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh_pipeline_layout, 1, 1, &table, 0, nullptr);
+            counters.binds++;
+        }
+
+        VkDeviceSize const offset = 0;
+        vkCmdBindVertexBuffers(cmd, 0, 1, &monkey_mesh.vertex_buffer.buffer, &offset);
+        vkCmdBindIndexBuffer(cmd, monkey_mesh.index_buffer.buffer, 0, monkey_mesh.index_type);
+        counters.binds += 4;
+
+        // Without bindless, each texture gets a set from the range's
+        // per-frame allocator the first time one of its copies uses it
+        DescriptorAllocator &descriptors = frame.worker_descriptors[range_index];
+        VkDescriptorSet material_sets[SCENE_TEXTURE_COUNT] = {};
+
+        glm::mat4 const *const world_matrices = scene_store.get_world_matrices();
+        glm::vec4 const *const world_bounds = scene_store.get_world_bounds();
+        for (uint32_t i = first; i < first + count; i++) {
+            uint32_t const node = scene_draws[i];
+            MeshPushConstants constants;
+            constants.render_matrix = world_matrices[node] * context.spin;
+            vkCmdPushConstants(cmd, mesh_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants), &constants);
+            counters.binds++;
+            counters.instances++;
+
+            if (context.texture_count > 0) {
+                uint32_t const texture = i % context.texture_count;
+                if (bindless) {
+                    MaterialPushConstants material;
+                    material.texture_index = texture_indices[texture];
+                    vkCmdPushConstants(
+                        cmd, mesh_pipeline_layout, VK_SHADER_STAGE_FRAGMENT_BIT,
+                        sizeof(MeshPushConstants), sizeof(MaterialPushConstants), &material);
+                } else {
+                    if (material_sets[texture] == VK_NULL_HANDLE) {
+                        material_sets[texture] = descriptors.allocate(material_set_layout);
+                        VkDescriptorImageInfo const image_info = {
+                            texture_sampler, texture_loader.get_textures()[texture].view,
+                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+                        VkWriteDescriptorSet const write = vkinit::write_descriptor_image(
+                            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, material_sets[texture],
+                            &image_info, 0);
+                        vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+                        counters.descriptor_writes++;
+                    }
+                    vkCmdBindDescriptorSets(
+                        cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh_pipeline_layout, 1, 1,
+                        &material_sets[texture], 0, nullptr);
+                }
+                counters.binds++;
+            }
+
+            glm::vec4 const &bounds = world_bounds[node];
+            float const distance = std::max(
+                glm::length(glm::vec3(bounds) - context.camera_position) - bounds.w, 0.f);
+            uint32_t const lod = select_lod(
+                monkey_mesh.lods.data(), context.lod_count, 1.f, distance, context.lod_error_scale);
+            if (lod > 0) {
+                // Coarser levels are simplified across submeshes
+                assets::MeshLod const &level = monkey_mesh.lods[lod];
+                vkCmdDrawIndexed(cmd, level.index_count, 1, level.first_index, 0, 0);
+                counters.draws++;
+                counters.triangles += level.index_count / 3;
+                continue;
+            }
+            for (assets::Submesh const &submesh : monkey_mesh.submeshes) {
+                vkCmdDrawIndexed(cmd, submesh.index_count, 1, submesh.first_index, 0, 0);
+                counters.draws++;
+                counters.triangles += submesh.index_count / 3;
+            }
+        }
+    }
+
+    VK_CHECK(vkEndCommandBuffer(cmd));
+    return counters;
+}
+
+DrawCounters VulkanEngine::record_draw_ranges(
+    VkCommandBuffer const cmd, FrameData &frame, DrawRecordContext const &context,
+    uint32_t const draw_count
+) {
+    // Split the draws into contiguous ranges, each recorded by one job.
+    // The main thread records ranges too while it waits for the others.
+    uint32_t const range_count = std::max(1u, std::min(record_threads, draw_count));
+    job_system.parallel_for(range_count, 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            uint32_t const first = (uint32_t)((uint64_t)draw_count * i / range_count);
+            uint32_t const last = (uint32_t)((uint64_t)draw_count * (i + 1) / range_count);
+            frame.range_counters[i] = record_draw_range(frame, i, context, first, last - first);
         }
+    });
+    DrawCounters counters;
+    for (uint32_t i = 0; i < range_count; i++) {
+        counters.draws += frame.range_counters[i].draws;
+        counters.binds += frame.range_counters[i].binds;
+        counters.instances += frame.range_counters[i].instances;
+        counters.triangles += frame.range_counters[i].triangles;
+        counters.descriptor_sets += frame.worker_descriptors[i].sets_allocated();
+        counters.descriptor_writes += frame.range_counters[i].descriptor_writes;
+    }
+
+    // Executed in range order, no matter which job finished first
+    vkCmdExecuteCommands(cmd, range_count, frame.secondary_buffers.data());
+    return counters;
+}
+
+DrawCounters VulkanEngine::record_batched_draws(
+    VkCommandBuffer const cmd, DrawRecordContext const &context, uint32_t const draw_count
+) {
+    PROFILE_ZONE("record batched draws");
+    DrawCounters counters;
+    // The triangle doesn't test or write depth, it's drawn as a backdrop
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, context.backdrop_pipeline);
+    vkCmdDraw(cmd, 3, 1, 0, 0);
+    counters.binds++;
+    counters.draws++;
+
+    if (draw_count == 0) {
+        return counters;
+    }
+
+    uint32_t const frame_index = get_frame_index();
+    uint32_t const *const meshes = scene_store.get_meshes();
+    uint32_t const *const materials = scene_store.get_materials();
+    glm::mat4 const *const world_matrices = scene_store.get_world_matrices();
+    glm::vec4 const *const world_bounds = scene_store.get_world_bounds();
+    glm::vec4 const *const local_bounds = scene_store.get_local_bounds();
+    // Every node draws the monkey, with the pipeline matching its format
+    uint32_t const pipeline = (uint32_t)monkey_mesh.vertex_format;
+
+    {
+        PROFILE_ZONE("build sort keys");
+        draw_list.resize(draw_count);
+        job_system.parallel_for(draw_count, DRAW_LIST_GRAIN, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                uint32_t const node = scene_draws[i];
+                glm::vec4 const &bounds = world_bounds[node];
+                float const distance = std::max(
+                    glm::length(glm::vec3(bounds) - context.camera_position) - bounds.w, 0.f);
+                uint32_t const lod = select_lod(
+                    monkey_mesh.lods.data(), context.lod_count, 1.f, distance,
+                    context.lod_error_scale);
+                // Levels of detail draw different indices, each is a mesh of
+                // its own as far as batching goes
+                uint32_t const mesh = meshes[node] * assets::MAX_MESH_LODS + lod;
+                draw_list.set(
+                    i, scene::make_sort_key(pipeline, materials[node], mesh, distance), node);
+            }
+        });
+    }
+    {
+        PROFILE_ZONE("sort draws");
+        draw_list.sort();
+    }
+    {
+        PROFILE_ZONE("write instances");
+        // In sorted order, so each batch's instances are contiguous
+        GPUObjectData *const instances = instance_buffers.get_instances(frame_index);
+        uint32_t const *const objects = draw_list.get_objects();
+        job_system.parallel_for(draw_count, DRAW_LIST_GRAIN, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                instances[i].model = world_matrices[objects[i]];
+                instances[i].bounding_sphere = local_bounds[objects[i]];
+            }
+        });
+        instance_buffers.flush(frame_index, draw_count);
     }
 
-    out_shader_module = shader_module;
+    // All instanced pipelines share a layout, so the sets and the spin
+    // stay bound across pipeline changes. Materials have no state of their
+    // own yet, batches only split on them.
+    VkDescriptorSet const sets[2] = {
+        context.global_descriptor, instance_buffers.get_descriptor(frame_index)};
+    uint32_t bound_pipeline = UINT32_MAX;
+    uint32_t bound_mesh = UINT32_MAX;
+    for (scene::DrawBatch const &batch : draw_list.get_batches()) {
+        uint32_t const batch_pipeline = scene::sort_key_pipeline(batch.key);
+        if (batch_pipeline != bound_pipeline) {
+            vkCmdBindPipeline(
+                cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, instanced_mesh_pipelines[batch_pipeline]);
+            counters.binds++;
+            if (bound_pipeline == UINT32_MAX) {
+                vkCmdBindDescriptorSets(
+                    cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, instanced_pipeline_layout, 0, 2, sets,
+                    1, &context.camera_offset);
+                MeshPushConstants constants;
+                constants.render_matrix = context.spin;
+                vkCmdPushConstants(
+                    cmd, instanced_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                    sizeof(MeshPushConstants), &constants);
+                counters.binds += 2;
+            }
+            bound_pipeline = batch_pipeline;
+        }
+
+        uint32_t const mesh = scene::sort_key_mesh(batch.key) / assets::MAX_MESH_LODS;
+        uint32_t const lod = scene::sort_key_mesh(batch.key) % assets::MAX_MESH_LODS;
+        if (mesh != bound_mesh) {
+            VkDeviceSize const offset = 0;
+            vkCmdBindVertexBuffers(cmd, 0, 1, &monkey_mesh.vertex_buffer.buffer, &offset);
+            vkCmdBindIndexBuffer(
+                cmd, monkey_mesh.index_buffer.buffer, 0, monkey_mesh.index_type);
+            counters.binds += 2;
+            bound_mesh = mesh;
+        }
+
+        // The instances are read at gl_InstanceIndex, which starts at the
+        // batch's first
+        counters.instances += batch.count;
+        if (lod > 0) {
+            // Coarser levels are simplified across submeshes
+            assets::MeshLod const &level = monkey_mesh.lods[lod];
+            vkCmdDrawIndexed(
+                cmd, level.index_count, batch.count, level.first_index, 0, batch.first);
+            counters.draws++;
+            counters.triangles += level.index_count / 3 * batch.count;
+            continue;
+        }
+        for (assets::Submesh const &submesh : monkey_mesh.submeshes) {
+            vkCmdDrawIndexed(
+                cmd, submesh.index_count, batch.count, submesh.first_index, 0, batch.first);
+            counters.draws++;
+            counters.triangles += submesh.index_count / 3 * batch.count;
+        }
+    }
+    return counters;
+}
+
+DrawCounters VulkanEngine::record_culled_draws(
+    VkCommandBuffer const cmd, DrawRecordContext const &context
+) {
+    PROFILE_ZONE("record culled draws");
+    DrawCounters counters;
+    // The triangle doesn't test or write depth, it's drawn as a backdrop
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, context.backdrop_pipeline);
+    vkCmdDraw(cmd, 3, 1, 0, 0);
+    counters.binds++;
+    counters.draws++;
+
+    if (context.mesh_pipeline == VK_NULL_HANDLE) {
+        return counters;
+    }
+
+    VkDescriptorSet const sets[2] = {
+        context.global_descriptor, culling_pass.get_descriptor(get_frame_index())};
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, context.mesh_pipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, indirect_pipeline_layout, 0, 2, sets, 1, &context.camera_offset);
+
+    MeshPushConstants constants;
+    constants.render_matrix = context.spin;
+    vkCmdPushConstants(cmd, indirect_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants), &constants);
+
+    VkDeviceSize const offset = 0;
+    vkCmdBindVertexBuffers(cmd, 0, 1, &monkey_mesh.vertex_buffer.buffer, &offset);
+    vkCmdBindIndexBuffer(cmd, monkey_mesh.index_buffer.buffer, 0, monkey_mesh.index_type);
+
+    culling_pass.record_draws(cmd, get_frame_index());
+    counters.binds += 5;
+    counters.draws++;
+    counters.instances += (uint32_t)scene_objects.size();
+    return counters;
+}
+
+void VulkanEngine::collect_culling_results(FrameData &frame) {
+    if (frame.culling_frame < 0) {
+        return;
+    }
+
+    culling::CullResults const results = culling_pass.read_results((uint32_t)(&frame - frames));
+    frame_stats.set_triangles(
+        frame.culling_frame, results.triangles, frame.culling_triangles - results.triangles);
+
+    if (check_culling) {
+        culling::ReferenceResult const &expected = frame.culling_reference;
+        culling_checks++;
+        // Meshlets too close to a test's threshold may go either way
+        if (results.draws < expected.min.draws || results.draws > expected.max.draws
+            || results.triangles < expected.min.triangles
+            || results.triangles > expected.max.triangles) {
+            culling_mismatches++;
+            LOG_ERROR(
+                "Frame " << frame.culling_frame << ": GPU culling drew " << results.draws
+                << " meshlets of " << results.triangles << " triangles, the CPU reference "
+                << expected.min.draws << " to " << expected.max.draws << " meshlets of "
+                << expected.min.triangles << " to " << expected.max.triangles << " triangles.");
+        }
+    }
+    frame.culling_frame = -1;
+}
+
+void VulkanEngine::load_meshes() {
+    PROFILE_ZONE("load_meshes");
+    Clock::time_point const load_start = Clock::now();
+
+    // Prefer the baked asset, the OBJ is only parsed if it hasn't been built
+    bool const baked = load_mesh_asset(MONKEY_MESH_PATH, monkey_mesh);
+    if (!baked && !load_mesh_obj(MONKEY_OBJ_PATH, monkey_mesh)) {
+        LOG_ERROR("Failed to load the monkey mesh.");
+        abort();
+    }
+
+    LOG_INFO(
+        "Loaded " << (baked ? MONKEY_MESH_PATH : MONKEY_OBJ_PATH) << " in "
+        << elapsed_ms(load_start, Clock::now()) << " ms (" << monkey_mesh.vertex_count
+        << " vertices, " << monkey_mesh.lods[0].index_count / 3 << " triangles).");
+    for (size_t i = 1; i < monkey_mesh.lods.size(); i++) {
+        LOG_INFO(
+            "LOD " << i << ": " << monkey_mesh.lods[i].index_count / 3
+            << " triangles, error " << monkey_mesh.lods[i].error << ".");
+    }
+}
+
+void VulkanEngine::init_textures() {
+    PROFILE_ZONE("init_textures");
+    TextureLoader::InitInfo info;
+    info.device = device;
+    info.allocator = allocator;
+    info.counters = &memory_counters;
+    info.uploads = &upload_service;
+    info.jobs = &job_system;
+    info.mode = texture_mode;
+    info.bc_supported = bc_textures_supported;
+    texture_loader.init(info);
+
+    if (!load_textures) {
+        return;
+    }
+    if (texture_mode != TextureMode::Raw && !bc_textures_supported) {
+        LOG_INFO("The device can't sample BC textures, they stay RGBA8.");
+    }
+
+    // Compare --textures raw (before) against bc or bc7, cold then warm
+    // cache (after). The time includes streaming the texels to the GPU.
+    Clock::time_point const load_start = Clock::now();
+    texture_loader.load(SCENE_TEXTURES, SCENE_TEXTURE_COUNT);
+
+    uint32_t from_cache = 0;
+    for (Texture const &texture : texture_loader.get_textures()) {
+        from_cache += texture.from_cache ? 1 : 0;
+    }
+    LOG_INFO(
+        "Loaded " << texture_loader.get_textures().size() << " textures in "
+        << elapsed_ms(load_start, Clock::now()) << " ms (" << from_cache
+        << " from cache), " << texture_loader.memory_size() / (1024.0 * 1024.0)
+        << " MiB of device memory.");
+
+    // Only the copies drawn one call each sample them so far
+    std::vector<Texture> const &textures = texture_loader.get_textures();
+    textured_meshes = !textures.empty() && !gpu_culling && !batch_draws;
+    if (!textured_meshes) {
+        return;
+    }
+    for (Texture const &texture : textures) {
+        textures_upload_value = std::max(textures_upload_value, texture.upload_value);
+        if (bindless) {
+            // Written by the first frame's flush
+            uint32_t const index = bindless_table.add_texture(texture.view, texture_sampler);
+            if (index == INVALID_BINDLESS_INDEX) {
+                LOG_ERROR("The bindless table is out of texture slots.");
+                abort();
+            }
+            texture_indices.push_back(index);
+        }
+    }
+}
+
+bool VulkanEngine::load_mesh_asset(char const *const filepath, Mesh &out_mesh) {
+    MappedFile file;
+    if (!file.open(filepath)) {
+        return false;
+    }
+
+    assets::MeshAssetView view;
+    if (!assets::read_mesh_asset(file.data(), file.size(), view)) {
+        LOG_ERROR("\"" << filepath << "\" is not a valid mesh asset.");
+        return false;
+    }
+
+    assets::MeshAssetHeader const &header = *view.header;
+    out_mesh.vertex_format = view.vertex_format();
+    out_mesh.index_type = header.index_size == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    out_mesh.vertex_count = header.vertex_count;
+    out_mesh.index_count = header.index_count;
+    out_mesh.submeshes.assign(view.submeshes, view.submeshes + header.submesh_count);
+    out_mesh.meshlets.assign(view.meshlets, view.meshlets + header.meshlet_count);
+    out_mesh.lods.assign(view.lods, view.lods + header.lod_count);
+    if (out_mesh.lods.empty()) {
+        out_mesh.lods.push_back({0, header.index_count, 0.f, 0});
+    }
+    out_mesh.bounds_min = glm::vec3(header.bounds_min[0], header.bounds_min[1], header.bounds_min[2]);
+    out_mesh.bounds_max = glm::vec3(header.bounds_max[0], header.bounds_max[1], header.bounds_max[2]);
+
+    upload_mesh(view.vertices, view.vertices_size, view.indices, view.indices_size, out_mesh);
     return true;
 }
+
+bool VulkanEngine::load_mesh_obj(char const *const filepath, Mesh &out_mesh) {
+    assets::MeshData mesh;
+    std::string error;
+    if (!assets::load_obj(filepath, mesh, error)) {
+        LOG_ERROR("Failed to load \"" << filepath << "\": " << error);
+        return false;
+    }
+
+    // Baked meshes already went through this in the asset baker
+    assets::optimize_mesh(mesh);
+    assets::build_lod_chain(mesh);
+
+    out_mesh.vertex_format = assets::VertexFormat::Full;
+    out_mesh.index_type = VK_INDEX_TYPE_UINT32;
+    out_mesh.vertex_count = (uint32_t)mesh.vertices.size();
+    out_mesh.index_count = (uint32_t)mesh.indices.size();
+    out_mesh.submeshes = mesh.submeshes;
+    out_mesh.meshlets = mesh.meshlets;
+    out_mesh.lods = mesh.lods;
+
+    out_mesh.bounds_min = glm::vec3(std::numeric_limits<float>::max());
+    out_mesh.bounds_max = glm::vec3(std::numeric_limits<float>::lowest());
+    for (assets::VertexFull const &vertex : mesh.vertices) {
+        glm::vec3 const position(vertex.position[0], vertex.position[1], vertex.position[2]);
+        out_mesh.bounds_min = glm::min(out_mesh.bounds_min, position);
+        out_mesh.bounds_max = glm::max(out_mesh.bounds_max, position);
+    }
+
+    upload_mesh(
+        mesh.vertices.data(), mesh.vertices.size() * sizeof(assets::VertexFull),
+        mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t), out_mesh);
+    return true;
+}
+
+void VulkanEngine::upload_mesh(
+    void const *vertices, size_t const vertices_size, void const *indices,
+    size_t const indices_size, Mesh &mesh
+) {
+    mesh.vertex_buffer = create_buffer(
+        vertices_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+    mesh.index_buffer = create_buffer(
+        indices_size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+
+    // Both copies go into the same batch
+    upload_service.upload_buffer(
+        mesh.vertex_buffer.buffer, 0, vertices, vertices_size,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+    mesh.upload_value = upload_service.upload_buffer(
+        mesh.index_buffer.buffer, 0, indices, indices_size,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+    upload_service.flush();
+}
+
+void VulkanEngine::init_profiler() {
+    PROFILE_ZONE("init_profiler");
+
+    GpuProfiler::InitInfo info;
+    info.device = device;
+    info.frames_in_flight = frames_in_flight;
+    info.timestamp_period = timestamp_period;
+    info.timestamp_mask = timestamp_mask;
+    info.queue = graphics_queue;
+    info.queue_family = graphics_queue_family;
+    gpu_profiler.init(info);
+}
+
+void VulkanEngine::update_perf_counters(
+    double const frame_ms, double const cpu_ms, double const hud_ms,
+    DrawCounters const &draw_counters, uint32_t const descriptor_writes,
+    uint64_t const frame_allocations
+) {
+    frame_history.add((float)frame_ms);
+
+    PerfCounters &counters = perf_counters;
+    counters.frame = (uint64_t)frame_number;
+    counters.frame_ms = frame_ms;
+    counters.cpu_ms = cpu_ms;
+    counters.hud_ms = hud_ms;
+    counters.frame_times = frame_history.summarize();
+
+    counters.draws = draw_counters.draws;
+    counters.binds = draw_counters.binds;
+    counters.instances = draw_counters.instances;
+    counters.triangles = draw_counters.triangles;
+    counters.descriptor_writes = descriptor_writes;
+    counters.descriptor_sets = draw_counters.descriptor_sets;
+    counters.pipelines = pipeline_cache.size();
+    counters.graph_compiles = render_graph.get_compile_count();
+
+    counters.graphics_submits = graphics_submits;
+    counters.upload_submits = upload_service.submit_count();
+    counters.presents = presents;
+
+    counters.device_allocations =
+        memory_counters.device_allocations - memory_counters.device_frees;
+    counters.device_bytes = memory_counters.device_bytes;
+    counters.resource_allocations = memory_counters.resource_allocations;
+    counters.frame_allocations = frame_allocations;
+    counters.hud_allocations = perf_hud.take_allocations();
+
+    // VMA asked the driver for the budget when the frame index was set,
+    // this only reads it back
+    VkPhysicalDeviceMemoryProperties const *memory_props = nullptr;
+    vmaGetMemoryProperties(allocator, &memory_props);
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+    vmaGetBudget(allocator, budgets);
+    counters.memory_budget_ext = memory_budget_supported;
+    counters.heap_count = memory_props->memoryHeapCount;
+    for (uint32_t i = 0; i < counters.heap_count; i++) {
+        HeapBudget &heap = counters.heaps[i];
+        heap.usage = budgets[i].usage;
+        heap.budget = budgets[i].budget;
+        heap.block_bytes = budgets[i].blockBytes;
+        heap.allocation_bytes = budgets[i].allocationBytes;
+        heap.device_local =
+            (memory_props->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+    }
+}
+
+void VulkanEngine::collect_gpu_time(FrameData &frame) {
+    int frame_idx;
+    double gpu_ms;
+    if (gpu_profiler.collect((uint32_t)(&frame - frames), frame_idx, gpu_ms)) {
+        frame_stats.set_gpu_time(frame_idx, gpu_ms);
+
+        perf_counters.gpu_ms = gpu_ms;
+
+        double cull_ms;
+        if (gpu_profiler.collected_zone_ms(CULLING_ZONE_NAME, cull_ms)) {
+            frame_stats.set_cull_time(frame_idx, cull_ms);
+        }
+        double hud_gpu_ms = -1.0;
+        if (gpu_profiler.collected_zone_ms(HUD_ZONE_NAME, hud_gpu_ms)) {
+            frame_stats.set_hud_gpu_time(frame_idx, hud_gpu_ms);
+        }
+        perf_counters.hud_gpu_ms = hud_gpu_ms;
+    }
+}
+
+AllocatedImage VulkanEngine::create_image(
+    VkImageCreateInfo const &info, VmaMemoryUsage const memory_usage
+) {
+    VmaAllocationCreateInfo alloc_info = {};
+    alloc_info.usage = memory_usage;
+
+    AllocatedImage img;
+    VK_CHECK(vmaCreateImage(allocator, &info, &alloc_info, &img.image, &img.allocation, nullptr));
+    memory_counters.resource_allocations++;
+    return img;
+}
+
+void VulkanEngine::destroy_image(AllocatedImage const &img) {
+    vmaDestroyImage(allocator, img.image, img.allocation);
+}
+
+AllocatedBuffer VulkanEngine::create_buffer(
+    size_t const size, VkBufferUsageFlags const usage,
+    VmaMemoryUsage const memory_usage
+) {
+    VkBufferCreateInfo const buffer_info = vkinit::buffer_create_info(size, usage);
+
+    VmaAllocationCreateInfo alloc_info = {};
+    alloc_info.usage = memory_usage;
+
+    AllocatedBuffer buffer;
+    VK_CHECK(vmaCreateBuffer(allocator, &buffer_info, &alloc_info, &buffer.buffer, &buffer.allocation, nullptr));
+    memory_counters.resource_allocations++;
+    return buffer;
+}
+
+void VulkanEngine::destroy_buffer(AllocatedBuffer const &buffer) {
+    vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
+}
+
+VkPipeline PipelineBuilder::build_pipeline(
+    VkDevice device, VkRenderPass pass, PipelineCache &cache
+) const {
+    PROFILE_ZONE("build pipeline");
+    PipelineKey const state_key = key(pass);
+    VkPipeline const existing = cache.find(state_key);
+    if (existing != VK_NULL_HANDLE) {
+        return existing;
+    }
+
+    // A single viewport and scissor, set while recording so that pipelines
+    // outlive swapchain resizes
+    VkPipelineViewportStateCreateInfo viewport_state = {};
+    viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state.pNext = nullptr;
+    viewport_state.viewportCount = 1;
+    viewport_state.pViewports = nullptr;
+    viewport_state.scissorCount = 1;
+    viewport_state.pScissors = nullptr;
+
+    VkDynamicState const dynamic_states[2] = {
+        VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamic_state = {};
+    dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state.pNext = nullptr;
+    dynamic_state.dynamicStateCount = 2;
+    dynamic_state.pDynamicStates = dynamic_states;
+
+    // No blending, but the single color attachment still needs its state
+    VkPipelineColorBlendStateCreateInfo color_blending = {};
+    color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blending.pNext = nullptr;
+    color_blending.logicOpEnable = VK_FALSE;
+    color_blending.logicOp = VK_LOGIC_OP_COPY;
+    color_blending.attachmentCount = 1;
+    color_blending.pAttachments = &color_blend_attachment;
+
+    VkGraphicsPipelineCreateInfo pipeline_info = {};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_info.pNext = nullptr;
+    pipeline_info.stageCount = shader_stages.size();
+    pipeline_info.pStages = shader_stages.data();
+    pipeline_info.pVertexInputState = &vertex_input_info;
+    pipeline_info.pInputAssemblyState = &input_assembly;
+    pipeline_info.pViewportState = &viewport_state;
+    pipeline_info.pRasterizationState = &rasterizer;
+    pipeline_info.pMultisampleState = &multisampling;
+    pipeline_info.pDepthStencilState = &depth_stencil;
+    pipeline_info.pColorBlendState = &color_blending;
+    pipeline_info.pDynamicState = &dynamic_state;
+    pipeline_info.layout = pipeline_layout;
+    pipeline_info.renderPass = pass;
+    pipeline_info.subpass = 0;
+    pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+
+    VkPipeline pipeline;
+    if (vkCreateGraphicsPipelines(
+        device, cache.get_vk_cache(), 1, &pipeline_info, nullptr, &pipeline
+    ) != VK_SUCCESS) {
+        LOG_ERROR("Failed to create pipeline.");
+        return VK_NULL_HANDLE;
+    }
+
+    return cache.insert(state_key, pipeline);
+}
+
+PipelineKey PipelineBuilder::key(VkRenderPass pass) const {
+    PipelineKey key(VK_PIPELINE_BIND_POINT_GRAPHICS);
+    key.add(pass);
+    key.add(pipeline_layout);
+
+    key.add(shader_stages.size());
+    for (VkPipelineShaderStageCreateInfo const &stage : shader_stages) {
+        key.add_shader_stage(stage);
+    }
+
+    key.add(vertex_input_info.vertexBindingDescriptionCount);
+    for (uint32_t i = 0; i < vertex_input_info.vertexBindingDescriptionCount; i++) {
+        VkVertexInputBindingDescription const &binding =
+            vertex_input_info.pVertexBindingDescriptions[i];
+        key.add(binding.binding);
+        key.add(binding.stride);
+        key.add(binding.inputRate);
+    }
+    key.add(vertex_input_info.vertexAttributeDescriptionCount);
+    for (uint32_t i = 0; i < vertex_input_info.vertexAttributeDescriptionCount; i++) {
+        VkVertexInputAttributeDescription const &attribute =
+            vertex_input_info.pVertexAttributeDescriptions[i];
+        key.add(attribute.location);
+        key.add(attribute.binding);
+        key.add(attribute.format);
+        key.add(attribute.offset);
+    }
+
+    key.add(input_assembly.topology);
+    key.add(input_assembly.primitiveRestartEnable);
+
+    key.add(rasterizer.depthClampEnable);
+    key.add(rasterizer.rasterizerDiscardEnable);
+    key.add(rasterizer.polygonMode);
+    key.add(rasterizer.cullMode);
+    key.add(rasterizer.frontFace);
+    key.add(rasterizer.depthBiasEnable);
+    key.add(rasterizer.depthBiasConstantFactor);
+    key.add(rasterizer.depthBiasClamp);
+    key.add(rasterizer.depthBiasSlopeFactor);
+    key.add(rasterizer.lineWidth);
+
+    key.add(color_blend_attachment.blendEnable);
+    key.add(color_blend_attachment.srcColorBlendFactor);
+    key.add(color_blend_attachment.dstColorBlendFactor);
+    key.add(color_blend_attachment.colorBlendOp);
+    key.add(color_blend_attachment.srcAlphaBlendFactor);
+    key.add(color_blend_attachment.dstAlphaBlendFactor);
+    key.add(color_blend_attachment.alphaBlendOp);
+    key.add(color_blend_attachment.colorWriteMask);
+
+    key.add(multisampling.rasterizationSamples);
+    key.add(multisampling.sampleShadingEnable);
+    key.add(multisampling.minSampleShading);
+    key.add(multisampling.alphaToCoverageEnable);
+    key.add(multisampling.alphaToOneEnable);
+    // One mask word per 32 samples
+    key.add(multisampling.pSampleMask != nullptr);
+    if (multisampling.pSampleMask) {
+        uint32_t const mask_words = ((uint32_t)multisampling.rasterizationSamples + 31) / 32;
+        for (uint32_t i = 0; i < mask_words; i++) {
+            key.add(multisampling.pSampleMask[i]);
+        }
+    }
+
+    key.add(depth_stencil.depthTestEnable);
+    key.add(depth_stencil.depthWriteEnable);
+    key.add(depth_stencil.depthCompareOp);
+    key.add(depth_stencil.depthBoundsTestEnable);
+    key.add(depth_stencil.stencilTestEnable);
+    for (VkStencilOpState const *const op : {&depth_stencil.front, &depth_stencil.back}) {
+        key.add(op->failOp);
+        key.add(op->passOp);
+        key.add(op->depthFailOp);
+        key.add(op->compareOp);
+        key.add(op->compareMask);
+        key.add(op->writeMask);
+        key.add(op->reference);
+    }
+    key.add(depth_stencil.minDepthBounds);
+    key.add(depth_stencil.maxDepthBounds);
+
+    return key;
+}
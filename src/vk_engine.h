@@ -3,8 +3,140 @@
 
 #pragma once
 
+#include <chrono>
+#include <draw_list.h>
+#include <glm/glm.hpp>
+#include <job_system.h>
+#include <scene.h>
 #include <vector>
+#include <vk_allocators.h>
+#include <vk_culling.h>
+#include <vk_descriptors.h>
+#include <vk_event_thread.h>
+#include <vk_frame_pacer.h>
+#include <vk_frame_stats.h>
+#include <vk_hud.h>
+#include <vk_instances.h>
+#include <vk_mesh.h>
+#include <vk_pipeline_cache.h>
+#include <vk_profiler.h>
+#include <vk_render_graph.h>
+#include <vk_shader_library.h>
+#include <vk_textures.h>
 #include <vk_types.h>
+#include <vk_upload.h>
+
+// Upper bound on how many frames the CPU may record ahead of the GPU
+constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+// Upper bound on the jobs recording a frame's draws
+constexpr uint32_t MAX_RECORD_THREADS = 32;
+
+// What recording a frame's draws submitted. Binds count every pipeline,
+// descriptor set, vertex buffer and index buffer bind and push constant
+// update.
+struct DrawCounters {
+    uint32_t draws{0};
+    uint32_t binds{0};
+    uint32_t instances{0};
+    uint32_t triangles{0};
+    // Sets allocated and descriptors written while recording
+    uint32_t descriptor_sets{0};
+    uint32_t descriptor_writes{0};
+};
+
+// Everything one frame in flight needs to be recorded while older frames are
+// still executing on the GPU
+struct FrameData {
+    VkCommandPool command_pool;
+    VkCommandBuffer main_command_buffer;
+
+    // One pool and secondary command buffer per recording job, so no two
+    // threads ever share a pool. The pools are reset as a whole every frame.
+    std::vector<VkCommandPool> worker_pools;
+    std::vector<VkCommandBuffer> secondary_buffers;
+    // What each secondary command buffer drew
+    std::vector<DrawCounters> range_counters;
+    // Sets allocated while recording, one allocator per recording job like
+    // the pools, reset once render_fence signals
+    std::vector<DescriptorAllocator> worker_descriptors;
+
+    // Signaled when the acquired swapchain image is ready to be rendered into.
+    // Indexed by frame rather than by swapchain image since the image index
+    // isn't known until after the acquire.
+    VkSemaphore present_semaphore;
+    // Signaled when the GPU has finished executing the frame
+    VkFence render_fence;
+
+    // Uniforms and other per-frame data, reset once render_fence signals
+    LinearAllocator arena;
+    // Points at the arena, the data is selected with a dynamic offset
+    VkDescriptorSet global_descriptor;
+
+    // Frame whose GPU culling results are read back once render_fence
+    // signals, -1 if it wasn't culled. With check_culling they're checked
+    // against the CPU reference.
+    int culling_frame{-1};
+    // Full detail triangles of all the objects culled, visible or not
+    uint32_t culling_triangles{0};
+    culling::ReferenceResult culling_reference;
+};
+
+class PipelineBuilder {
+  public:
+    // Returns the pipeline for the current state, building it only if the
+    // cache doesn't already hold one built from identical state
+    VkPipeline build_pipeline(
+        VkDevice device, VkRenderPass pass, PipelineCache &cache) const;
+
+    // All state that goes into the pipeline
+    PipelineKey key(VkRenderPass pass) const;
+
+    std::vector<VkPipelineShaderStageCreateInfo> shader_stages;
+    VkPipelineVertexInputStateCreateInfo vertex_input_info;
+    VkPipelineInputAssemblyStateCreateInfo input_assembly;
+    VkPipelineRasterizationStateCreateInfo rasterizer;
+    VkPipelineColorBlendAttachmentState color_blend_attachment;
+    VkPipelineMultisampleStateCreateInfo multisampling;
+    VkPipelineDepthStencilStateCreateInfo depth_stencil;
+    VkPipelineLayout pipeline_layout;
+};
+
+struct MeshPushConstants {
+    glm::mat4 render_matrix;
+};
+
+// Fragment stage push constants of the bindless mesh pipelines, right after
+// MeshPushConstants
+struct MaterialPushConstants {
+    uint32_t texture_index; // into the bindless table's textures
+};
+
+struct GPUCameraData {
+    glm::mat4 view;
+    glm::mat4 proj;
+    glm::mat4 viewproj;
+};
+
+// Everything the threads recording a frame's draws share, filled in before
+// they start and only read while they run
+struct DrawRecordContext {
+    // The render graph's main pass and framebuffer, and the extent of its
+    // attachments
+    VkCommandBufferInheritanceInfo inheritance;
+    VkExtent2D extent;
+    VkPipeline backdrop_pipeline;
+    // VK_NULL_HANDLE while the mesh hasn't been uploaded
+    VkPipeline mesh_pipeline;
+    VkDescriptorSet global_descriptor;
+    uint32_t camera_offset;
+    // Textures the copies cycle through, 0 with the meshes untextured
+    uint32_t texture_count;
+    glm::mat4 spin; // rotation shared by every copy of the mesh
+    glm::vec3 camera_position;
+    // Levels of detail to pick from and their error scale, see select_lod()
+    uint32_t lod_count;
+    float lod_error_scale;
+};
 
 class VulkanEngine {
   public:
@@ -13,6 +145,65 @@ class VulkanEngine {
 
     VkExtent2D window_extent{1700, 900};
 
+    // Render into offscreen images without creating a window or swapchain
+    bool headless{false};
+    // Present mode asked for. When the surface doesn't support it MAILBOX
+    // and IMMEDIATE fall back to each other, then everything to FIFO.
+    VkPresentModeKHR present_mode{VK_PRESENT_MODE_FIFO_KHR};
+    // Frame rate the main loop is held to, 0 runs as fast as presenting
+    // allows
+    float target_fps{0.0f};
+    // Number of frames the CPU may record ahead, 1 to MAX_FRAMES_IN_FLIGHT
+    uint32_t frames_in_flight{2};
+    // Number of frames run() renders before returning, 0 runs until quit
+    uint32_t max_frames{0};
+    // Per-frame timings are written here at exit if set
+    char const *stats_csv_path{nullptr};
+    // Chrome trace of every CPU and GPU zone is written here at exit if set
+    char const *trace_path{nullptr};
+    // Jobs recording draws into secondary command buffers in parallel, 1 to
+    // MAX_RECORD_THREADS
+    uint32_t record_threads{1};
+    // Job system threads besides the main thread, 0 for one per hardware
+    // thread
+    uint32_t job_threads{0};
+    // Copies of the monkey drawn each frame, one draw call each
+    uint32_t scene_draw_count{1};
+    // Cull the copies in a compute shader and draw the visible ones with
+    // indirect draws, instead of recording a draw call for each
+    bool gpu_culling{false};
+    // Cull each copy's meshlets by their bounding spheres and normal cones,
+    // after the whole copy, instead of drawing all of a visible copy. Only
+    // with gpu_culling.
+    bool cluster_culling{false};
+    // Check each frame's GPU culling result against the CPU reference, only
+    // with gpu_culling
+    bool check_culling{false};
+    // Sort the copies' draws by pipeline, material, mesh and depth, and draw
+    // each run sharing a mesh and material with one instanced draw call,
+    // binding only the state that changes. Ignored with gpu_culling.
+    bool batch_draws{false};
+    // Each copy is drawn with the coarsest level of detail whose error
+    // projects to at most this many pixels, 0 always draws full detail
+    float lod_error_pixels{1.0f};
+    // How far back the camera sits from the grid, 0 for just far enough to
+    // see all of it
+    float fixed_camera_distance{0.0f};
+    // Load the scene's textures at startup, and how they're stored. Runs with
+    // a frame count leave them out unless --textures is given.
+    bool load_textures{true};
+    TextureMode texture_mode{TextureMode::Bc};
+    // Copies drawn one call each sample their texture from a bindless table,
+    // picked by push constant, instead of binding a set per texture. Cleared
+    // when the device lacks descriptor indexing.
+    bool bindless{false};
+    // Log the render graph's passes, barriers and transient memory whenever
+    // it's compiled
+    bool dump_render_graph{false};
+    // Draw the performance HUD over the scene from the first frame, H
+    // toggles it either way
+    bool hud{false};
+
     struct SDL_Window *window{nullptr};
 
     // initializes everything in the engine
@@ -27,6 +218,18 @@ class VulkanEngine {
     // run main loop
     void run();
 
+    // Times command recording through the loader's trampolines against the
+    // device entry points volk loaded, instead of rendering
+    void run_dispatch_bench();
+
+    // False if check_culling found a frame where the GPU culled differently
+    // from the CPU reference
+    bool culling_check_passed() const { return culling_mismatches == 0; }
+
+    // What the last frame did, the HUD's counters. Kept up to date whether
+    // the HUD is shown or not.
+    PerfCounters const &get_perf_counters() const { return perf_counters; }
+
   private:
     VkInstance instance;
     VkDebugUtilsMessengerEXT debug_messenger;
@@ -38,48 +241,315 @@ class VulkanEngine {
     VkFormat swapchain_img_fmt;
     std::vector<VkImage> swapchain_imgs;
     std::vector<VkImageView> swapchain_img_views;
+    // Set when the swapchain no longer matches the window, it's recreated
+    // before the next acquire
+    bool swapchain_dirty{false};
+
+    // A replaced swapchain with its views and render semaphores, kept until
+    // the last frame that may have used them has finished
+    struct RetiredSwapchain {
+        VkSwapchainKHR swapchain;
+        std::vector<VkImageView> views;
+        std::vector<VkSemaphore> render_semaphores;
+        int last_frame;
+    };
+    std::vector<RetiredSwapchain> retired_swapchains;
+
+    // Waits at the start of each frame for target_fps
+    FramePacer frame_pacer;
+    // Owns the window and polls its events, this thread renders
+    EventThread event_thread;
+    // The event thread's resize count the swapchain was last checked against
+    uint32_t seen_resize_count{0};
+
+    // When the oldest input event that no presented frame has seen yet was
+    // polled, for the input latency stats
+    bool input_pending{false};
+    std::chrono::steady_clock::time_point input_time;
+    // Longest an input event the next frame took waited in the queue, < 0 if
+    // it took none
+    double event_latency_ms{-1.0};
+
+    // Headless render targets, their views stand in for swapchain_img_views
+    std::vector<AllocatedImage> offscreen_imgs;
+
+    // Of the render graph's transient depth image
+    VkFormat depth_img_fmt;
 
     VkQueue graphics_queue;
     uint32_t graphics_queue_family;
+    // Since startup, for the perf counters
+    uint64_t graphics_submits{0};
+    uint64_t presents{0};
 
-    VkCommandPool command_pool;
-    VkCommandBuffer main_command_buffer;
+    // Dedicated transfer queue if the device has one, otherwise another queue
+    // without graphics, otherwise the graphics queue itself
+    VkQueue transfer_queue;
+    uint32_t transfer_queue_family;
+
+    // VK_KHR_draw_indirect_count was enabled, which is only asked for with
+    // GPU culling
+    bool draw_indirect_count_supported{false};
+
+    FrameData frames[MAX_FRAMES_IN_FLIGHT];
 
-    // Default renderpass
+    // Every buffer and image is allocated through VMA
+    VmaAllocator allocator;
+    MemoryCounters memory_counters;
+    // VMA takes the heaps' usage and budget from VK_EXT_memory_budget,
+    // rather than estimating them
+    bool memory_budget_supported{false};
+
+    // Streams buffer and image data in on the transfer queue
+    UploadService upload_service;
+
+    // Every set layout, those of the culling pass and instance buffers too
+    DescriptorLayoutCache layout_cache;
+    // Sets that stay until cleanup, never reset
+    DescriptorAllocator descriptor_allocator;
+    VkDescriptorSetLayout global_set_layout;
+
+    // Declares each frame's passes, places their barriers and owns the
+    // transient images, render passes and framebuffers
+    RenderGraph render_graph;
+    // Compatible with the render graph's main pass, pipelines and secondary
+    // command buffers are built against it. Owned by the render graph.
     VkRenderPass renderpass;
 
-    // Framebuffers
-    std::vector<VkFramebuffer> framebuffers;
+    // Signaled when rendering to a swapchain image has finished. Indexed by
+    // swapchain image since presenting is what waits on them, and a present
+    // has no fence to tell when it is safe to reuse the semaphore.
+    std::vector<VkSemaphore> render_semaphores;
 
-    // Sync structures
-    VkSemaphore present_semaphore;
-    VkSemaphore render_semaphore;
-    VkFence render_fence;
+    // GPU zones of each frame in flight, for the trace and frame stats
+    GpuProfiler gpu_profiler;
+    float timestamp_period{0.0f}; // nanoseconds per timestamp tick
+    uint64_t timestamp_mask{0};   // valid bits of a timestamp value
+
+    FrameStats frame_stats;
+
+    // Drawn in a pass of its own after the main pass, with the previous
+    // frame's counters
+    PerfHud perf_hud;
+    PerfCounters perf_counters;
+    FrameTimeHistory frame_history;
+    VkPipeline hud_pipeline{VK_NULL_HANDLE};
+
+    VkPhysicalDeviceProperties gpu_props;
+
+    // Persistent driver cache, also owns every pipeline
+    PipelineCache pipeline_cache;
+
+    // Runs all parallel work: shader modules, pipelines, draw recording
+    jobs::JobSystem job_system;
+    ShaderLibrary shader_library;
+
+    // When init() started, to measure time to first frame
+    std::chrono::steady_clock::time_point init_start_time;
+
+    VkPipelineLayout triangle_pipeline_layout;
+    // Required to start rendering, init() waits for it
+    VkPipeline triangle_pipeline;
+    // Optional, keeps compiling in a background job while frames are rendered.
+    // The result is only read once the counter is done.
+    jobs::Counter colored_triangle_pipeline_counter;
+    VkPipeline colored_triangle_pipeline_result{VK_NULL_HANDLE};
+    VkPipeline colored_triangle_pipeline{VK_NULL_HANDLE};
+
+    // Toggled with the spacebar, 1 draws the colored triangle once it's ready
+    int selected_shader{0};
+
+    VkPipelineLayout mesh_pipeline_layout;
+    // One per assets::VertexFormat, a mesh is drawn with the one matching its
+    // vertex layout
+    VkPipeline mesh_pipelines[2];
+
+    Mesh monkey_mesh;
+
+    // Whether the device can sample BC compressed images, RGBA8 is used
+    // instead without it
+    bool bc_textures_supported{false};
+    TextureLoader texture_loader;
+    // The copies drawn one call each sample the textures loaded, cycling
+    // through them. They're skipped until textures_upload_value, the last
+    // texture's, is acquired.
+    bool textured_meshes{false};
+    uint64_t textures_upload_value{0};
+    // Shared by every texture
+    VkSampler texture_sampler{VK_NULL_HANDLE};
+
+    // Set 1 of the mesh pipelines when textured, a combined image sampler
+    // the copies each bind. Only without bindless.
+    VkDescriptorSetLayout material_set_layout{VK_NULL_HANDLE};
+    // With bindless, the loaded textures' indices in the table instead, set
+    // 1 of the mesh pipelines
+    BindlessTable bindless_table;
+    std::vector<uint32_t> texture_indices;
+    // Update-after-bind limits the table is sized within
+    uint32_t bindless_max_textures{0};
+    uint32_t bindless_max_buffers{0};
+
+    // Grid of monkey copies, a node per row with the row's copies under it,
+    // and how far back the camera sits to see them all
+    scene::SceneStore scene_store;
+    // Store indices of the nodes drawn, the copies, in draw order
+    std::vector<uint32_t> scene_draws;
+    float scene_half_extent{0.0f};
+    float camera_distance{3.0f};
+
+    // GPU-driven path, see gpu_culling. The objects are the scene positions
+    // with the monkey's bounds, each drawn as the monkey's meshlets or as one
+    // meshlet covering all of it.
+    CullingPass culling_pass;
+    std::vector<GPUObjectData> scene_objects;
+    std::vector<assets::Meshlet> scene_meshlets;
+    // The meshlets in the CPU reference's layout, only with check_culling
+    assets::MeshletCullData scene_meshlet_cull_data;
+    uint64_t scene_objects_upload_value{0};
+    // Mesh pipelines that find their object through the culling pass' set
+    VkPipelineLayout indirect_pipeline_layout{VK_NULL_HANDLE};
+    VkPipeline indirect_mesh_pipelines[2];
+    uint32_t culling_checks{0};
+    uint32_t culling_mismatches{0};
+
+    // Batched path, see batch_draws. Each frame's draws are sorted into the
+    // draw list, and each batch's instances written to the instance buffers
+    // in sorted order.
+    scene::DrawList draw_list;
+    InstanceBuffers instance_buffers;
+    // Mesh pipelines that find their instance through the instance buffers'
+    // set, built from the indirect mesh shaders
+    VkPipelineLayout instanced_pipeline_layout{VK_NULL_HANDLE};
+    VkPipeline instanced_mesh_pipelines[2];
 
     void init_vulkan();
     void init_swapchain();
+    // Creates the swapchain for the window's current size, with its views
+    // and render semaphores, replacing old_swapchain if set
+    void create_swapchain(VkSwapchainKHR const old_swapchain);
+    // Replaces the swapchain without waiting for the device, the old one is
+    // retired until the frames in flight are done with it
+    void recreate_swapchain();
+    // Destroys the retired swapchains no frame in flight uses anymore, or
+    // all of them once the device is idle
+    void destroy_retired_swapchains(bool const all);
+    void init_offscreen_targets();
     void init_commands();
-    void init_default_renderpass();
-    void init_framebuffers();
+    void init_render_graph();
     void init_sync_structures();
     void init_pipelines();
+    void init_profiler();
+    void init_frame_allocators();
+    void init_uploads();
+    // Returns whether the device has what the bindless table needs, and
+    // sizes the table within its limits
+    bool init_bindless_limits(VkPhysicalDevice const gpu);
+    void init_descriptors();
+    void init_scene();
+    void init_culling();
+    void init_instances();
+    void init_hud();
 
-    bool load_shader_module(
-        char const *const filepath, VkShaderModule &out_shader_module) const;
-};
+    void load_meshes();
+    void init_textures();
 
-class PipelineBuilder {
-  public:
-    VkPipeline build_pipeline(VkDevice device, VkRenderPass pass);
+    uint32_t get_frame_index() const { return frame_number % frames_in_flight; }
+    FrameData &get_current_frame() { return frames[get_frame_index()]; }
 
-  private:
-    std::vector<VkPipelineShaderStageCreateInfo> shader_stages;
-    VkPipelineVertexInputStateCreateInfo vertex_input_info;
-    VkPipelineInputAssemblyStateCreateInfo input_assembly;
-    VkViewport viewport;
-    VkRect2D scissor;
-    VkPipelineRasterizationStateCreateInfo rasterizer;
-    VkPipelineColorBlendAttachmentState color_blend_attachment;
-    VkPipelineMultisampleStateCreateInfo multisampling;
-    VkPipelineLayout pipeline_layout;
+    // Reads the GPU zones of the frame last recorded into the given frame data
+    // into the trace, and its GPU time into the frame stats. Must only be
+    // called once that frame's fence has signaled.
+    void collect_gpu_time(FrameData &frame);
+
+    AllocatedImage create_image(
+        VkImageCreateInfo const &info, VmaMemoryUsage const memory_usage);
+    void destroy_image(AllocatedImage const &img);
+
+    AllocatedBuffer create_buffer(
+        size_t const size, VkBufferUsageFlags const usage,
+        VmaMemoryUsage const memory_usage);
+    void destroy_buffer(AllocatedBuffer const &buffer);
+
+    // Loads a baked mesh asset. The file is mapped and its vertex and index
+    // sections are copied into the staging buffer as they are, without
+    // touching individual vertices.
+    bool load_mesh_asset(char const *const filepath, Mesh &out_mesh);
+    // Fallback for meshes that haven't been baked, parses the OBJ file
+    bool load_mesh_obj(char const *const filepath, Mesh &out_mesh);
+
+    // Queues the vertex and index data for upload to device local buffers.
+    // The mesh can be drawn once its upload_value has been acquired. The rest
+    // of the mesh must already be filled in.
+    void upload_mesh(
+        void const *vertices, size_t const vertices_size, void const *indices,
+        size_t const indices_size, Mesh &mesh);
+
+    // State shared by all pipelines drawing into the default renderpass
+    PipelineBuilder default_pipeline_builder() const;
+
+    // Builds a pipeline drawing the hard-coded triangle with the shaders
+    // "<name>.vert.spv" and "<name>.frag.spv". Safe to call from workers.
+    VkPipeline build_triangle_pipeline(char const *const shader_name);
+    // Builds the pipeline drawing meshes with the given vertex format, either
+    // with their transform in push constants or with it read from an object
+    // buffer at gl_InstanceIndex, as the indirect and instanced draws do.
+    // Safe to call from workers.
+    VkPipeline build_mesh_pipeline(
+        assets::VertexFormat const format, bool const object_buffer,
+        VkPipelineLayout const layout);
+    // Builds the HUD's pipeline, blended over the render target without
+    // depth. Safe to call from workers.
+    VkPipeline build_hud_pipeline();
+
+    // Writes every profiler zone recorded so far as a Chrome trace
+    void write_trace(char const *const filepath);
+
+    // Takes the input events queued by the event thread
+    void process_input();
+
+    // Picks up optional pipelines whose background compile has finished
+    void poll_pending_pipelines();
+
+    // Fills perf_counters in with what the frame just submitted did, and
+    // the memory budget
+    void update_perf_counters(
+        double const frame_ms, double const cpu_ms, double const hud_ms,
+        DrawCounters const &draw_counters, uint32_t const descriptor_writes,
+        uint64_t const frame_allocations);
+
+    // Records the draws [first, first + count) of scene_draws into the secondary
+    // command buffer of the given range, each at its level of detail, and
+    // returns what it drew. The first range also draws the backdrop,
+    // so that executing the buffers in range order keeps the draw order of a
+    // single threaded frame. Safe to call from jobs.
+    DrawCounters record_draw_range(
+        FrameData &frame, uint32_t const range_index,
+        DrawRecordContext const &context, uint32_t const first,
+        uint32_t const count);
+
+    // Records the draws of the main pass for draw_count scene objects into
+    // secondary command buffers, one per recording job, and executes them.
+    // Returns what they drew.
+    DrawCounters record_draw_ranges(
+        VkCommandBuffer const cmd, FrameData &frame, DrawRecordContext const &context,
+        uint32_t const draw_count);
+
+    // Sorts the draws of draw_count scene objects into batches, writes their
+    // instances and records the backdrop and an instanced draw per batch
+    // straight into the frame's command buffer. Returns what it drew.
+    DrawCounters record_batched_draws(
+        VkCommandBuffer const cmd, DrawRecordContext const &context, uint32_t const draw_count);
+
+    // Records the backdrop and the objects the culling pass found visible
+    // straight into the frame's command buffer. Returns what it recorded, the
+    // indirect draw counted as a single draw of every object culled.
+    DrawCounters record_culled_draws(
+        VkCommandBuffer const cmd, DrawRecordContext const &context);
+
+    // Adds the triangles drawn and skipped by the frame last culled with the
+    // given frame data to the frame stats, and with check_culling compares
+    // the results against the CPU reference. Must only be called once that
+    // frame's fence has signaled.
+    void collect_culling_results(FrameData &frame);
 };
+
@@ -0,0 +1,143 @@
+#include <vk_event_thread.h>
+
+#include <SDL.h>
+#include <SDL_vulkan.h>
+#include <vk_profiler.h>
+
+SDL_Window *EventThread::init(InitInfo const &info) {
+    thread = std::thread(&EventThread::thread_main, this, info);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this]() { return started; });
+    return window;
+}
+
+void EventThread::cleanup() {
+    if (!thread.joinable()) {
+        return;
+    }
+
+    // SDL_PushEvent may be called from any thread, it wakes SDL_WaitEvent
+    stopping.store(true, std::memory_order_release);
+    SDL_Event wake = {};
+    wake.type = SDL_USEREVENT;
+    SDL_PushEvent(&wake);
+    thread.join();
+}
+
+VkExtent2D EventThread::get_drawable_extent() const {
+    uint64_t const extent = drawable_extent.load(std::memory_order_acquire);
+    return {(uint32_t)(extent >> 32), (uint32_t)extent};
+}
+
+void EventThread::wait_while_minimized() {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this]() { return !minimized || quit_requested(); });
+}
+
+void EventThread::thread_main(InitInfo const info) {
+    profiler::set_thread_name("events");
+
+    SDL_Init(SDL_INIT_VIDEO);
+    SDL_WindowFlags const window_flags =
+        (SDL_WindowFlags)(SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
+    SDL_Window *const created = SDL_CreateWindow(
+        info.title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, (int)info.extent.width,
+        (int)info.extent.height, window_flags);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        window = created;
+        started = true;
+    }
+    if (created) {
+        update_drawable_extent();
+    } else {
+        // SDL's errors are per thread, the render thread can't read it
+        LOG_ERROR("SDL_CreateWindow failed: " << SDL_GetError());
+    }
+    changed.notify_all();
+
+    SDL_Event e;
+    while (created && !stopping.load(std::memory_order_acquire)) {
+        // Sleeps until the next event rather than polling
+        if (SDL_WaitEvent(&e) == 0) {
+            continue;
+        }
+
+        InputEvent input = {};
+        input.time = std::chrono::steady_clock::now();
+        bool is_input = true;
+        switch (e.type) {
+            case SDL_KEYDOWN:
+                input.type = InputEvent::Type::KeyDown;
+                input.key = e.key.keysym.sym;
+                break;
+            case SDL_KEYUP:
+                input.type = InputEvent::Type::KeyUp;
+                input.key = e.key.keysym.sym;
+                break;
+            case SDL_MOUSEBUTTONDOWN:
+                input.type = InputEvent::Type::MouseButtonDown;
+                break;
+            case SDL_MOUSEBUTTONUP:
+                input.type = InputEvent::Type::MouseButtonUp;
+                break;
+            case SDL_MOUSEMOTION:
+                input.type = InputEvent::Type::MouseMotion;
+                break;
+            default:
+                is_input = false;
+                break;
+        }
+        if (is_input) {
+            if (!input_queue.push(input)) {
+                dropped_inputs.fetch_add(1, std::memory_order_relaxed);
+            }
+            continue;
+        }
+
+        if (e.type == SDL_QUIT) {
+            // Under the lock, so that a render thread about to wait while
+            // minimized can't miss it
+            std::lock_guard<std::mutex> lock(mutex);
+            quit.store(true, std::memory_order_release);
+            changed.notify_all();
+        } else if (e.type == SDL_WINDOWEVENT) {
+            switch (e.window.event) {
+                case SDL_WINDOWEVENT_SIZE_CHANGED:
+                    update_drawable_extent();
+                    break;
+                case SDL_WINDOWEVENT_MINIMIZED:
+                    set_minimized(true);
+                    break;
+                case SDL_WINDOWEVENT_RESTORED:
+                case SDL_WINDOWEVENT_MAXIMIZED:
+                    set_minimized(false);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    if (created) {
+        SDL_DestroyWindow(created);
+    }
+    SDL_Quit();
+}
+
+void EventThread::update_drawable_extent() {
+    int width = 0;
+    int height = 0;
+    SDL_Vulkan_GetDrawableSize(window, &width, &height);
+    drawable_extent.store((uint64_t)width << 32 | (uint32_t)height, std::memory_order_release);
+    resize_count.fetch_add(1, std::memory_order_acq_rel);
+}
+
+void EventThread::set_minimized(bool const value) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        minimized = value;
+    }
+    changed.notify_all();
+}
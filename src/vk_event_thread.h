@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <spsc_queue.h>
+#include <thread>
+#include <vk_types.h>
+
+// Input the event thread hands to the render thread
+struct InputEvent {
+    enum class Type : uint8_t {
+        KeyDown,
+        KeyUp,
+        MouseButtonDown,
+        MouseButtonUp,
+        MouseMotion,
+    };
+
+    Type type;
+    int32_t key; // SDL keycode of key events
+    // When the event thread polled it
+    std::chrono::steady_clock::time_point time;
+};
+
+// Input events that can wait for the render thread, more are dropped
+constexpr uint32_t INPUT_QUEUE_CAPACITY = 1024;
+
+// Owns the window and handles its events on a thread of its own, so that
+// events are taken as they arrive instead of once per frame, and never wait
+// behind the render thread's fence and acquire waits. Input reaches the
+// render thread through a lock-free queue. The window's state (size,
+// minimized, closed) is published separately, so that it can't be lost to a
+// full queue.
+//
+// SDL's video subsystem and the window are created, pumped and destroyed on
+// the event thread, as SDL wants them on the thread that handles their
+// events. Windows and Linux allow that to be any thread, macOS only allows
+// the main one.
+class EventThread {
+  public:
+    struct InitInfo {
+        char const *title;
+        VkExtent2D extent;
+    };
+
+    // Starts the thread, returns once it has created the window
+    struct SDL_Window *init(InitInfo const &info);
+    // Destroys the window and joins the thread. What was made from the
+    // window, e.g. its Vulkan surface, must be destroyed before.
+    void cleanup();
+
+    // The rest is for the render thread
+
+    // Returns false once the queue is empty
+    bool pop_input(InputEvent &out_event) { return input_queue.pop(out_event); }
+    bool quit_requested() const { return quit.load(std::memory_order_acquire); }
+    // In pixels, which may be more than the window's size on high DPI displays
+    VkExtent2D get_drawable_extent() const;
+    // Goes up every time the drawable extent changes
+    uint32_t get_resize_count() const { return resize_count.load(std::memory_order_acquire); }
+    // Blocks while the window is minimized, unless a quit is requested
+    void wait_while_minimized();
+    // Input events lost to a full queue
+    uint64_t get_dropped_inputs() const { return dropped_inputs.load(std::memory_order_relaxed); }
+
+  private:
+    std::thread thread;
+    jobs::SpscQueue<InputEvent> input_queue{INPUT_QUEUE_CAPACITY};
+
+    std::atomic<bool> quit{false};
+    std::atomic<bool> stopping{false};
+    std::atomic<uint64_t> drawable_extent{0}; // width in the high half
+    std::atomic<uint32_t> resize_count{0};
+    std::atomic<uint64_t> dropped_inputs{0};
+
+    // Guards the startup handshake and the minimized state
+    std::mutex mutex;
+    std::condition_variable changed;
+    struct SDL_Window *window{nullptr};
+    bool started{false};
+    bool minimized{false};
+
+    void thread_main(InitInfo const info);
+    // Event thread only
+    void update_drawable_extent();
+    void set_minimized(bool const value);
+};
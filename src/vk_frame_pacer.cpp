@@ -0,0 +1,39 @@
+#include <vk_frame_pacer.h>
+
+#include <thread>
+
+namespace {
+// Sleeps overshoot by up to a scheduler tick, so the end of the wait is spun
+constexpr std::chrono::microseconds SPIN_MARGIN{1500};
+} // namespace
+
+void FramePacer::set_target_fps(double const fps) {
+    interval = Clock::duration::zero();
+    if (fps > 0.0) {
+        interval = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(1.0 / fps));
+    }
+    next_frame = Clock::now();
+}
+
+double FramePacer::wait() {
+    if (!is_pacing()) {
+        return 0.0;
+    }
+
+    Clock::time_point const start = Clock::now();
+    if (start > next_frame + interval) {
+        next_frame = start;
+    }
+    if (next_frame - start > SPIN_MARGIN) {
+        std::this_thread::sleep_until(next_frame - SPIN_MARGIN);
+    }
+    Clock::time_point now = Clock::now();
+    while (now < next_frame) {
+        std::this_thread::yield();
+        now = Clock::now();
+    }
+
+    next_frame += interval;
+    return std::chrono::duration<double, std::milli>(now - start).count();
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <chrono>
+
+// Holds the main loop to a target frame rate. It waits at the start of each
+// frame, before input is polled, so that the input a frame sees is as fresh
+// as the rate allows. A frame that runs more than a whole interval late
+// starts the next one right away instead of being made up for.
+class FramePacer {
+  public:
+    // 0 leaves frames unpaced
+    void set_target_fps(double const fps);
+    bool is_pacing() const { return interval.count() > 0; }
+
+    // Waits until the next frame is due, returns the milliseconds waited
+    double wait();
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    Clock::duration interval{0};
+    Clock::time_point next_frame{};
+};
@@ -0,0 +1,267 @@
+#include <vk_frame_stats.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+namespace {
+// Nearest-rank percentile of an already sorted list
+double percentile(std::vector<double> const &sorted, double const p) {
+    size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+    rank = std::clamp(rank, (size_t)1, sorted.size());
+    return sorted[rank - 1];
+}
+} // namespace
+
+void FrameStats::init(size_t const capacity) {
+    samples.assign(capacity, Sample{});
+    added = 0;
+}
+
+void FrameStats::add_frame(
+    double const frame_ms, double const cpu_ms, double const record_ms,
+    uint64_t const allocations, uint64_t const arena_bytes
+) {
+    if (samples.empty()) {
+        return;
+    }
+
+    Sample &sample = samples[added % samples.size()];
+    sample = Sample{};
+    sample.frame_ms = frame_ms;
+    sample.cpu_ms = cpu_ms;
+    sample.record_ms = record_ms;
+    sample.allocations = (double)allocations;
+    sample.arena_bytes = (double)arena_bytes;
+    added++;
+}
+
+FrameStats::Sample *FrameStats::find(size_t const frame_idx) {
+    if (frame_idx >= added || frame_idx < first_frame()) {
+        return nullptr;
+    }
+    return &samples[frame_idx % samples.size()];
+}
+
+void FrameStats::set_gpu_time(size_t const frame_idx, double const gpu_ms) {
+    if (Sample *const sample = find(frame_idx)) {
+        sample->gpu_ms = gpu_ms;
+    }
+}
+
+void FrameStats::set_cull_time(size_t const frame_idx, double const cull_ms) {
+    if (Sample *const sample = find(frame_idx)) {
+        sample->cull_ms = cull_ms;
+    }
+}
+
+void FrameStats::set_triangles(size_t const frame_idx, uint32_t const drawn, uint32_t const skipped) {
+    if (Sample *const sample = find(frame_idx)) {
+        sample->triangles = drawn;
+        sample->skipped_triangles = skipped;
+    }
+}
+
+void FrameStats::set_render_graph(
+    size_t const frame_idx, uint32_t const barriers, uint32_t const barrier_batches,
+    uint64_t const aliased_bytes
+) {
+    if (Sample *const sample = find(frame_idx)) {
+        sample->barriers = barriers;
+        sample->barrier_batches = barrier_batches;
+        sample->aliased_bytes = (double)aliased_bytes;
+    }
+}
+
+void FrameStats::set_draws(
+    size_t const frame_idx, uint32_t const draws, uint32_t const binds,
+    uint32_t const instances
+) {
+    if (Sample *const sample = find(frame_idx)) {
+        sample->draws = draws;
+        sample->binds = binds;
+        sample->instances = instances;
+    }
+}
+
+void FrameStats::set_input_latency(size_t const frame_idx, double const input_ms) {
+    if (Sample *const sample = find(frame_idx)) {
+        sample->input_ms = input_ms;
+    }
+}
+
+void FrameStats::set_event_latency(size_t const frame_idx, double const event_ms) {
+    if (Sample *const sample = find(frame_idx)) {
+        sample->event_ms = event_ms;
+    }
+}
+
+void FrameStats::set_descriptors(size_t const frame_idx, uint32_t const writes, uint32_t const sets) {
+    if (Sample *const sample = find(frame_idx)) {
+        sample->descriptor_writes = writes;
+        sample->descriptor_sets = sets;
+    }
+}
+
+void FrameStats::set_hud_time(size_t const frame_idx, double const hud_ms) {
+    if (Sample *const sample = find(frame_idx)) {
+        sample->hud_ms = hud_ms;
+    }
+}
+
+void FrameStats::set_hud_gpu_time(size_t const frame_idx, double const hud_gpu_ms) {
+    if (Sample *const sample = find(frame_idx)) {
+        sample->hud_gpu_ms = hud_gpu_ms;
+    }
+}
+
+bool FrameStats::summarize(double Sample::*field, Summary &out_summary) const {
+    std::vector<double> values;
+    values.reserve(frame_count());
+    for (size_t i = 0; i < frame_count(); i++) {
+        double const value = get_sample(i).*field;
+        if (value >= 0.0) {
+            values.push_back(value);
+        }
+    }
+    if (values.empty()) {
+        return false;
+    }
+
+    std::sort(values.begin(), values.end());
+
+    double sum = 0.0;
+    for (double const value : values) {
+        sum += value;
+    }
+
+    out_summary.min = values.front();
+    out_summary.avg = sum / values.size();
+    out_summary.p50 = percentile(values, 50.0);
+    out_summary.p95 = percentile(values, 95.0);
+    out_summary.p99 = percentile(values, 99.0);
+    out_summary.max = values.back();
+    return true;
+}
+
+void FrameStats::report() const {
+    struct Row {
+        char const *name;
+        double Sample::*field;
+        bool optional; // left out rather than shown as n/a
+    };
+    Row const rows[] = {
+        {"frame", &Sample::frame_ms, false},
+        {"cpu", &Sample::cpu_ms, false},
+        {"record", &Sample::record_ms, false},
+        {"gpu", &Sample::gpu_ms, false},
+        {"cull", &Sample::cull_ms, true},
+        {"input", &Sample::input_ms, true}, // to present, frames with input
+        {"event", &Sample::event_ms, true}, // polled to taken, worst per frame
+        {"hud", &Sample::hud_ms, true},     // CPU side, frames showing it
+        {"hudgpu", &Sample::hud_gpu_ms, true},
+    };
+
+    if (frame_count() < added) {
+        std::printf("Frame timings over the last %zu of %zu frames (ms)\n", frame_count(), added);
+    } else {
+        std::printf("Frame timings over %zu frames (ms)\n", frame_count());
+    }
+    std::printf(
+        "%-6s %9s %9s %9s %9s %9s %9s\n", "", "min", "avg", "p50", "p95",
+        "p99", "max");
+    for (Row const &row : rows) {
+        Summary s;
+        if (!summarize(row.field, s)) {
+            if (row.optional) {
+                continue;
+            }
+            std::printf("%-6s %9s\n", row.name, "n/a");
+            continue;
+        }
+        std::printf(
+            "%-6s %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n", row.name, s.min,
+            s.avg, s.p50, s.p95, s.p99, s.max);
+    }
+
+    // Steady-state frames are expected to allocate nothing
+    double total_allocations = 0.0;
+    for (size_t i = 0; i < frame_count(); i++) {
+        total_allocations += get_sample(i).allocations;
+    }
+    Summary arena;
+    if (summarize(&Sample::arena_bytes, arena)) {
+        std::printf(
+            "Allocations during frames: %.0f, frame arena bytes: avg %.0f, max %.0f\n",
+            total_allocations, arena.avg, arena.max);
+    }
+
+    Summary drawn;
+    Summary skipped;
+    if (summarize(&Sample::triangles, drawn) && summarize(&Sample::skipped_triangles, skipped)) {
+        double const skipped_share = skipped.avg / (drawn.avg + skipped.avg);
+        std::printf(
+            "Triangles per frame: drawn avg %.0f (min %.0f, max %.0f), culled or simplified "
+            "away avg %.0f (%.1f%%)\n",
+            drawn.avg, drawn.min, drawn.max, skipped.avg, 100.0 * skipped_share);
+    }
+
+    Summary barriers;
+    Summary batches;
+    Summary aliased;
+    if (summarize(&Sample::barriers, barriers) && summarize(&Sample::barrier_batches, batches)
+        && summarize(&Sample::aliased_bytes, aliased)) {
+        std::printf(
+            "Render graph per frame: %.1f barriers (max %.0f) in %.1f vkCmdPipelineBarrier "
+            "calls (max %.0f), %.0f bytes of transient memory aliased\n",
+            barriers.avg, barriers.max, batches.avg, batches.max, aliased.avg);
+    }
+
+    Summary draws;
+    Summary binds;
+    Summary instances;
+    if (summarize(&Sample::draws, draws) && summarize(&Sample::binds, binds)
+        && summarize(&Sample::instances, instances)) {
+        std::printf(
+            "Draw submission per frame: %.1f draw calls (max %.0f), %.1f state binds "
+            "(max %.0f), %.1f instances\n",
+            draws.avg, draws.max, binds.avg, binds.max, instances.avg);
+    }
+
+    // Steady-state bindless frames are expected to write none
+    Summary writes;
+    Summary sets;
+    if (summarize(&Sample::descriptor_writes, writes)
+        && summarize(&Sample::descriptor_sets, sets)) {
+        std::printf(
+            "Descriptors per frame: %.1f written (max %.0f), %.1f sets allocated (max %.0f)\n",
+            writes.avg, writes.max, sets.avg, sets.max);
+    }
+}
+
+bool FrameStats::write_csv(char const *const filepath) const {
+    std::ofstream file(filepath);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    file << "frame,frame_ms,cpu_ms,record_ms,gpu_ms,allocations,arena_bytes,cull_ms,"
+            "triangles,skipped_triangles,barriers,barrier_batches,aliased_bytes,draws,binds,"
+            "instances,input_ms,event_ms,descriptor_writes,descriptor_sets,hud_ms,hud_gpu_ms\n";
+    for (size_t i = 0; i < frame_count(); i++) {
+        Sample const &sample = get_sample(i);
+        file << first_frame() + i << ',' << sample.frame_ms << ',' << sample.cpu_ms
+             << ',' << sample.record_ms << ',' << sample.gpu_ms
+             << ',' << sample.allocations << ',' << sample.arena_bytes
+             << ',' << sample.cull_ms << ',' << sample.triangles
+             << ',' << sample.skipped_triangles << ',' << sample.barriers
+             << ',' << sample.barrier_batches << ',' << sample.aliased_bytes
+             << ',' << sample.draws << ',' << sample.binds
+             << ',' << sample.instances << ',' << sample.input_ms
+             << ',' << sample.event_ms << ',' << sample.descriptor_writes
+             << ',' << sample.descriptor_sets << ',' << sample.hud_ms
+             << ',' << sample.hud_gpu_ms << '\n';
+    }
+    return true;
+}
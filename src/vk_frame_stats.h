@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Collects per-frame timings and summarizes them (used by benchmark runs).
+// Keeps the last frames in a ring allocated by init(), so that adding frames
+// never allocates, however long the run.
+class FrameStats {
+  public:
+    // Fields are < 0 until known
+    struct Sample {
+        double frame_ms{-1.0}; // wall time of the whole frame
+        double cpu_ms{-1.0};   // time spent recording and submitting
+        double record_ms{-1.0}; // part of cpu_ms spent recording the scene's draws
+        double gpu_ms{-1.0};   // time between the frame's timestamps
+        double allocations{-1.0}; // memory and resource allocations made by the frame
+        double arena_bytes{-1.0}; // bytes taken from the frame's linear allocator
+        double cull_ms{-1.0}; // GPU time of the culling dispatch, if GPU culling
+        // Unknown while the mesh isn't drawn yet
+        double triangles{-1.0};         // triangles drawn
+        double skipped_triangles{-1.0}; // full detail ones culled or simplified away
+        // Of the frame's render graph
+        double barriers{-1.0};        // hazards resolved with barriers
+        double barrier_batches{-1.0}; // vkCmdPipelineBarrier calls they took
+        double aliased_bytes{-1.0};   // transient memory saved by aliasing
+        // Recorded for the scene, unknown while the mesh isn't drawn yet
+        double draws{-1.0};     // draw calls, an indirect one counts once
+        double binds{-1.0};     // pipeline, descriptor, buffer binds and push constants
+        double instances{-1.0}; // objects the draws cover
+        // From the first input event the frame saw being polled to its
+        // present call, unknown if it saw none
+        double input_ms{-1.0};
+        // Longest an input event waited between the event thread polling it
+        // and the render thread taking it, unknown if the frame took none
+        double event_ms{-1.0};
+        // Descriptors written and sets allocated by the frame, bindless
+        // registrations included
+        double descriptor_writes{-1.0};
+        double descriptor_sets{-1.0};
+        // Building and recording the HUD on the CPU, and its pass on the
+        // GPU, unknown while it isn't shown
+        double hud_ms{-1.0};
+        double hud_gpu_ms{-1.0};
+    };
+
+    struct Summary {
+        double min;
+        double avg;
+        double p50;
+        double p95;
+        double p99;
+        double max;
+    };
+
+    // Keeps the last capacity frames, older ones are dropped. Frames added
+    // before init() are ignored.
+    void init(size_t const capacity);
+
+    // Adds a new sample for the next frame index, starting at 0. The GPU time
+    // usually arrives a few frames late, so it is filled in afterwards with
+    // set_gpu_time().
+    void add_frame(
+        double const frame_ms, double const cpu_ms, double const record_ms,
+        uint64_t const allocations, uint64_t const arena_bytes);
+    void set_gpu_time(size_t const frame_idx, double const gpu_ms);
+    // Culling results arrive as late as the GPU time
+    void set_cull_time(size_t const frame_idx, double const cull_ms);
+    void set_triangles(size_t const frame_idx, uint32_t const drawn, uint32_t const skipped);
+    void set_render_graph(
+        size_t const frame_idx, uint32_t const barriers, uint32_t const barrier_batches,
+        uint64_t const aliased_bytes);
+    void set_draws(
+        size_t const frame_idx, uint32_t const draws, uint32_t const binds,
+        uint32_t const instances);
+    void set_input_latency(size_t const frame_idx, double const input_ms);
+    void set_event_latency(size_t const frame_idx, double const event_ms);
+    void set_descriptors(size_t const frame_idx, uint32_t const writes, uint32_t const sets);
+    void set_hud_time(size_t const frame_idx, double const hud_ms);
+    // Arrives as late as the GPU time
+    void set_hud_gpu_time(size_t const frame_idx, double const hud_gpu_ms);
+
+    // Frames kept, and added since init()
+    size_t frame_count() const { return added < samples.size() ? added : samples.size(); }
+    size_t frames_added() const { return added; }
+    // The i-th oldest frame kept
+    Sample const &get_sample(size_t const i) const {
+        return samples[(first_frame() + i) % samples.size()];
+    }
+
+    // Summarizes one field of all samples, skipping unknown (negative) values.
+    // Returns false if there are no samples to summarize.
+    bool summarize(double Sample::*field, Summary &out_summary) const;
+
+    // Prints the summary table to stdout
+    void report() const;
+
+    // Writes one line per frame to a CSV file
+    bool write_csv(char const *const filepath) const;
+
+  private:
+    std::vector<Sample> samples; // ring, indexed by frame index modulo its size
+    size_t added{0};
+
+    size_t first_frame() const { return added - frame_count(); }
+    // Null once the frame has left the ring, or before it's added
+    Sample *find(size_t const frame_idx);
+};
@@ -0,0 +1,371 @@
+#include <vk_hud.h>
+
+#include <imgui.h>
+#include <vk_descriptors.h>
+#include <vk_initializers.h>
+#include <vk_profiler.h>
+#include <vk_upload.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+constexpr double MIB = 1024.0 * 1024.0;
+// Where the HUD window sits, and the size of its frame time graph
+constexpr float HUD_MARGIN = 10.0f;
+constexpr float GRAPH_WIDTH = 320.0f;
+constexpr float GRAPH_HEIGHT = 64.0f;
+
+// To clip space, see hud.vert
+struct HudPushConstants {
+    float scale[2];
+    float translate[2];
+};
+
+void *counting_alloc(size_t const size, void *const user_data) {
+    (*(uint64_t *)user_data)++;
+    return std::malloc(size);
+}
+
+void counting_free(void *const ptr, void *) {
+    std::free(ptr);
+}
+} // namespace
+
+void report_perf_counters(PerfCounters const &counters) {
+    std::printf(
+        "Queue submissions: %llu graphics, %llu upload batches, %llu presents; %u pipelines, "
+        "%u render graph compiles\n",
+        (unsigned long long)counters.graphics_submits,
+        (unsigned long long)counters.upload_submits, (unsigned long long)counters.presents,
+        counters.pipelines, counters.graph_compiles);
+    std::printf(
+        "Device memory: %llu blocks (%.1f MiB), %llu buffers and images created, budget %s\n",
+        (unsigned long long)counters.device_allocations, counters.device_bytes / MIB,
+        (unsigned long long)counters.resource_allocations,
+        counters.memory_budget_ext ? "from VK_EXT_memory_budget" : "estimated by VMA");
+    for (uint32_t i = 0; i < counters.heap_count; i++) {
+        HeapBudget const &heap = counters.heaps[i];
+        std::printf(
+            "  heap %u%s %9.1f of %9.1f MiB used, VMA blocks %.1f MiB (%.1f MiB allocated)\n", i,
+            heap.device_local ? " (device local)" : "               ", heap.usage / MIB,
+            heap.budget / MIB, heap.block_bytes / MIB, heap.allocation_bytes / MIB);
+    }
+    std::printf(
+        "Last frame: %llu buffers and images created, %llu HUD heap allocations\n",
+        (unsigned long long)counters.frame_allocations,
+        (unsigned long long)counters.hud_allocations);
+}
+
+void FrameTimeHistory::add(float const frame_ms) {
+    times[next] = frame_ms;
+    next = (next + 1) % PERF_HISTORY_FRAMES;
+    filled = std::min(filled + 1, PERF_HISTORY_FRAMES);
+}
+
+FrameStats::Summary FrameTimeHistory::summarize() const {
+    FrameStats::Summary summary = {};
+    if (filled == 0) {
+        return summary;
+    }
+
+    std::copy_n(times, filled, sorted);
+    std::sort(sorted, sorted + filled);
+    double sum = 0.0;
+    for (uint32_t i = 0; i < filled; i++) {
+        sum += sorted[i];
+    }
+    auto const percentile = [this](double const p) {
+        uint32_t const rank = (uint32_t)std::ceil(p / 100.0 * filled);
+        return (double)sorted[std::clamp(rank, 1u, filled) - 1];
+    };
+
+    summary.min = sorted[0];
+    summary.avg = sum / filled;
+    summary.p50 = percentile(50.0);
+    summary.p95 = percentile(95.0);
+    summary.p99 = percentile(99.0);
+    summary.max = sorted[filled - 1];
+    return summary;
+}
+
+void PerfHud::init(InitInfo const &info) {
+    device = info.device;
+    allocator = info.allocator;
+
+    // Counted to check that steady-state frames don't allocate, the
+    // functions are global to imgui
+    ImGui::SetAllocatorFunctions(counting_alloc, counting_free, &allocations);
+    context = ImGui::CreateContext();
+    ImGui::SetCurrentContext(context);
+
+    ImGuiIO &io = ImGui::GetIO();
+    io.IniFilename = nullptr; // nothing to remember, the window doesn't move
+    io.LogFilename = nullptr;
+    io.BackendRendererName = "vk_hud";
+    // Draw lists past 64K vertices are drawn from their own vertex offset
+    io.BackendFlags |= ImGuiBackendFlags_RendererHasVtxOffset;
+    ImGui::StyleColorsDark();
+
+    // The default font, uploaded once like any other texture
+    unsigned char *pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+
+    VkFormat const font_format = VK_FORMAT_R8G8B8A8_UNORM;
+    VkImageCreateInfo const image_info = vkinit::image_create_info(
+        font_format, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        {(uint32_t)width, (uint32_t)height, 1});
+    VmaAllocationCreateInfo alloc_info = {};
+    alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    VK_CHECK(vmaCreateImage(
+        allocator, &image_info, &alloc_info, &font_image.image, &font_image.allocation,
+        nullptr));
+    info.counters->resource_allocations++;
+
+    VkImageViewCreateInfo const view_info =
+        vkinit::imageview_create_info(font_format, font_image.image, VK_IMAGE_ASPECT_COLOR_BIT);
+    VK_CHECK(vkCreateImageView(device, &view_info, nullptr, &font_view));
+
+    ImageUploadLevel const level = {pixels, (uint32_t)width, (uint32_t)height};
+    upload_value = info.uploads->upload_image(
+        font_image.image, 1, 4, &level, 1, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    info.uploads->flush();
+    // Staged already, imgui doesn't need its copy anymore
+    io.Fonts->ClearTexData();
+
+    VkDescriptorSetLayoutBinding const binding = vkinit::descriptorset_layout_binding(
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0);
+    VkDescriptorSetLayoutCreateInfo set_info = {};
+    set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_info.pNext = nullptr;
+    set_info.flags = 0;
+    set_info.bindingCount = 1;
+    set_info.pBindings = &binding;
+    set_layout = info.layout_cache->get(set_info);
+
+    font_descriptor = info.descriptors->allocate(set_layout);
+    VkDescriptorImageInfo const image_descriptor = {
+        info.sampler, font_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkWriteDescriptorSet const write = vkinit::write_descriptor_image(
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, font_descriptor, &image_descriptor, 0);
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+    // The only texture, draw commands aren't told apart by it
+    io.Fonts->TexID = (ImTextureID)(intptr_t)font_descriptor;
+
+    VkPushConstantRange push_constants = {};
+    push_constants.offset = 0;
+    push_constants.size = sizeof(HudPushConstants);
+    push_constants.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    VkPipelineLayoutCreateInfo layout_info = vkinit::pipeline_layout_create_info();
+    layout_info.setLayoutCount = 1;
+    layout_info.pSetLayouts = &set_layout;
+    layout_info.pushConstantRangeCount = 1;
+    layout_info.pPushConstantRanges = &push_constants;
+    VK_CHECK(vkCreatePipelineLayout(device, &layout_info, nullptr, &pipeline_layout));
+}
+
+void PerfHud::cleanup() {
+    vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
+    vkDestroyImageView(device, font_view, nullptr);
+    vmaDestroyImage(allocator, font_image.image, font_image.allocation);
+    ImGui::DestroyContext(context);
+    context = nullptr;
+}
+
+VertexInputDescription PerfHud::get_vertex_description() {
+    VertexInputDescription description;
+
+    VkVertexInputBindingDescription binding = {};
+    binding.binding = 0;
+    binding.stride = sizeof(ImDrawVert);
+    binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    description.bindings.push_back(binding);
+
+    // Position in pixels, normalized UV, the color as 4 bytes
+    VkVertexInputAttributeDescription position = {};
+    position.binding = 0;
+    position.location = 0;
+    position.format = VK_FORMAT_R32G32_SFLOAT;
+    position.offset = offsetof(ImDrawVert, pos);
+
+    VkVertexInputAttributeDescription uv = {};
+    uv.binding = 0;
+    uv.location = 1;
+    uv.format = VK_FORMAT_R32G32_SFLOAT;
+    uv.offset = offsetof(ImDrawVert, uv);
+
+    VkVertexInputAttributeDescription color = {};
+    color.binding = 0;
+    color.location = 2;
+    color.format = VK_FORMAT_R8G8B8A8_UNORM;
+    color.offset = offsetof(ImDrawVert, col);
+
+    description.attributes.push_back(position);
+    description.attributes.push_back(uv);
+    description.attributes.push_back(color);
+    return description;
+}
+
+void PerfHud::build(
+    PerfCounters const &counters, FrameTimeHistory const &history, VkExtent2D const extent,
+    float const delta_s
+) {
+    PROFILE_ZONE("hud build");
+    ImGuiIO &io = ImGui::GetIO();
+    io.DisplaySize = ImVec2((float)extent.width, (float)extent.height);
+    io.DeltaTime = std::max(delta_s, 1e-4f);
+    ImGui::NewFrame();
+
+    ImGui::SetNextWindowPos(ImVec2(HUD_MARGIN, HUD_MARGIN));
+    ImGui::SetNextWindowBgAlpha(0.7f);
+    ImGuiWindowFlags const flags = ImGuiWindowFlags_NoDecoration
+        | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoInputs
+        | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing
+        | ImGuiWindowFlags_NoNav;
+    ImGui::Begin("Performance", nullptr, flags);
+
+    ImGui::Text(
+        "Frame %llu  %.2f ms (%.0f fps)", (unsigned long long)counters.frame,
+        counters.frame_ms, counters.frame_ms > 0.0 ? 1000.0 / counters.frame_ms : 0.0);
+    ImGui::Text(
+        "cpu %.2f ms  gpu %.2f ms  hud %.3f / %.3f ms", counters.cpu_ms, counters.gpu_ms,
+        counters.hud_ms, counters.hud_gpu_ms);
+
+    // Scaled to the slowest frame shown, but never below 60 fps
+    FrameStats::Summary const &times = counters.frame_times;
+    char overlay[64];
+    std::snprintf(
+        overlay, sizeof(overlay), "p50 %.2f  p95 %.2f  p99 %.2f", times.p50, times.p95,
+        times.p99);
+    ImGui::PlotLines(
+        "##frame times", history.values(), (int)history.count(), (int)history.offset(),
+        overlay, 0.0f, std::max((float)times.max, 1000.0f / 60.0f),
+        ImVec2(GRAPH_WIDTH, GRAPH_HEIGHT));
+    ImGui::Text(
+        "min %.2f  avg %.2f  max %.2f ms over %u frames", times.min, times.avg, times.max,
+        history.count());
+
+    ImGui::Separator();
+    ImGui::Text(
+        "Draws %u  binds %u  instances %u  triangles %u", counters.draws, counters.binds,
+        counters.instances, counters.triangles);
+    ImGui::Text(
+        "Descriptors %u written, %u sets  pipelines %u  graph compiles %u",
+        counters.descriptor_writes, counters.descriptor_sets, counters.pipelines,
+        counters.graph_compiles);
+    ImGui::Text(
+        "Submits %llu graphics, %llu upload  presents %llu",
+        (unsigned long long)counters.graphics_submits,
+        (unsigned long long)counters.upload_submits, (unsigned long long)counters.presents);
+
+    ImGui::Separator();
+    ImGui::Text(
+        "Allocations this frame %llu (hud %llu)  blocks %llu, %.1f MiB  resources %llu",
+        (unsigned long long)counters.frame_allocations,
+        (unsigned long long)counters.hud_allocations,
+        (unsigned long long)counters.device_allocations, counters.device_bytes / MIB,
+        (unsigned long long)counters.resource_allocations);
+    for (uint32_t i = 0; i < counters.heap_count; i++) {
+        HeapBudget const &heap = counters.heaps[i];
+        char label[64];
+        std::snprintf(
+            label, sizeof(label), "%.1f / %.1f MiB", heap.usage / MIB, heap.budget / MIB);
+        ImGui::Text("Heap %u%s", i, heap.device_local ? " local" : "      ");
+        ImGui::SameLine();
+        float const used = heap.budget > 0 ? (float)((double)heap.usage / heap.budget) : 0.0f;
+        ImGui::ProgressBar(std::min(used, 1.0f), ImVec2(GRAPH_WIDTH - 80.0f, 0.0f), label);
+    }
+    ImGui::TextUnformatted(
+        counters.memory_budget_ext ? "Budget from VK_EXT_memory_budget"
+                                   : "Budget estimated by VMA");
+
+    ImGui::End();
+    ImGui::Render();
+}
+
+bool PerfHud::record(
+    VkCommandBuffer const cmd, VkPipeline const pipeline, LinearAllocator &arena,
+    VkExtent2D const extent
+) {
+    ImDrawData const *const data = ImGui::GetDrawData();
+    if (!data || data->TotalVtxCount == 0) {
+        return true;
+    }
+
+    BufferSlice vertices;
+    BufferSlice indices;
+    if (!arena.allocate(data->TotalVtxCount * sizeof(ImDrawVert), sizeof(float), vertices)
+        || !arena.allocate(data->TotalIdxCount * sizeof(ImDrawIdx), sizeof(ImDrawIdx), indices)) {
+        return false;
+    }
+    // Only written, the arena may be write-combined memory
+    ImDrawVert *vertex_out = (ImDrawVert *)vertices.data;
+    ImDrawIdx *index_out = (ImDrawIdx *)indices.data;
+    for (int i = 0; i < data->CmdListsCount; i++) {
+        ImDrawList const *const list = data->CmdLists[i];
+        std::memcpy(vertex_out, list->VtxBuffer.Data, list->VtxBuffer.Size * sizeof(ImDrawVert));
+        std::memcpy(index_out, list->IdxBuffer.Data, list->IdxBuffer.Size * sizeof(ImDrawIdx));
+        vertex_out += list->VtxBuffer.Size;
+        index_out += list->IdxBuffer.Size;
+    }
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    vkCmdBindDescriptorSets(
+        cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &font_descriptor, 0,
+        nullptr);
+    vkCmdBindVertexBuffers(cmd, 0, 1, &vertices.buffer, &vertices.offset);
+    vkCmdBindIndexBuffer(
+        cmd, indices.buffer, indices.offset,
+        sizeof(ImDrawIdx) == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
+
+    // Pixels from the display's top left corner to clip space
+    HudPushConstants constants;
+    constants.scale[0] = 2.0f / data->DisplaySize.x;
+    constants.scale[1] = 2.0f / data->DisplaySize.y;
+    constants.translate[0] = -1.0f - data->DisplayPos.x * constants.scale[0];
+    constants.translate[1] = -1.0f - data->DisplayPos.y * constants.scale[1];
+    vkCmdPushConstants(
+        cmd, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+
+    // Each command is clipped with the scissor, the render graph resets it
+    // for the next pass
+    uint32_t list_first_vertex = 0;
+    uint32_t list_first_index = 0;
+    for (int i = 0; i < data->CmdListsCount; i++) {
+        ImDrawList const *const list = data->CmdLists[i];
+        for (ImDrawCmd const &draw : list->CmdBuffer) {
+            if (draw.UserCallback || draw.ElemCount == 0) {
+                continue;
+            }
+            float const x0 = std::max(draw.ClipRect.x - data->DisplayPos.x, 0.0f);
+            float const y0 = std::max(draw.ClipRect.y - data->DisplayPos.y, 0.0f);
+            float const x1 = std::min(draw.ClipRect.z - data->DisplayPos.x, (float)extent.width);
+            float const y1 = std::min(draw.ClipRect.w - data->DisplayPos.y, (float)extent.height);
+            if (x1 <= x0 || y1 <= y0) {
+                continue;
+            }
+            VkRect2D scissor;
+            scissor.offset = {(int32_t)x0, (int32_t)y0};
+            scissor.extent = {(uint32_t)(x1 - x0), (uint32_t)(y1 - y0)};
+            vkCmdSetScissor(cmd, 0, 1, &scissor);
+            vkCmdDrawIndexed(
+                cmd, draw.ElemCount, 1, list_first_index + draw.IdxOffset,
+                (int32_t)(list_first_vertex + draw.VtxOffset), 0);
+        }
+        list_first_vertex += list->VtxBuffer.Size;
+        list_first_index += list->IdxBuffer.Size;
+    }
+    return true;
+}
+
+uint64_t PerfHud::take_allocations() {
+    uint64_t const count = allocations;
+    allocations = 0;
+    return count;
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstdint>
+#include <vk_allocators.h>
+#include <vk_frame_stats.h>
+#include <vk_mesh.h>
+#include <vk_types.h>
+
+struct ImGuiContext;
+class DescriptorAllocator;
+class DescriptorLayoutCache;
+class UploadService;
+
+// Frames the frame time graph and its percentiles cover
+constexpr uint32_t PERF_HISTORY_FRAMES = 240;
+
+// Device memory of one heap, from VMA's budget. With VK_EXT_memory_budget the
+// usage and budget come from the driver and include memory allocated outside
+// of VMA, otherwise VMA estimates them from its own blocks and the heap size.
+struct HeapBudget {
+    uint64_t usage;
+    uint64_t budget;
+    uint64_t block_bytes;      // VkDeviceMemory blocks VMA allocated
+    uint64_t allocation_bytes; // the part of them buffers and images use
+    bool device_local;
+};
+
+// What the engine did in its last frame. Updated every frame whether the HUD
+// is shown or not, so that headless runs can read them too. Times are < 0
+// while unknown.
+struct PerfCounters {
+    uint64_t frame{0};
+    double frame_ms{-1.0};
+    double cpu_ms{-1.0};
+    // Building and recording the HUD, < 0 if it wasn't shown
+    double hud_ms{-1.0};
+    // Of the last frame whose timestamps were read, frames_in_flight frames
+    // back
+    double gpu_ms{-1.0};
+    double hud_gpu_ms{-1.0};
+    // Of the last PERF_HISTORY_FRAMES frames
+    FrameStats::Summary frame_times{};
+
+    // Recorded for the scene, see DrawCounters
+    uint32_t draws{0};
+    uint32_t binds{0};
+    uint32_t instances{0};
+    uint32_t triangles{0};
+    uint32_t descriptor_writes{0};
+    uint32_t descriptor_sets{0};
+    // Pipelines built so far and render graphs compiled, neither should grow
+    // once warmed up
+    uint32_t pipelines{0};
+    uint32_t graph_compiles{0};
+
+    // Queue submissions since startup, the upload service's batches on the
+    // transfer queue
+    uint64_t graphics_submits{0};
+    uint64_t upload_submits{0};
+    uint64_t presents{0};
+
+    // VkDeviceMemory blocks held and their bytes, buffers and images created
+    // since startup, and allocations of either made by the last frame
+    uint64_t device_allocations{0};
+    uint64_t device_bytes{0};
+    uint64_t resource_allocations{0};
+    uint64_t frame_allocations{0};
+    // Heap allocations imgui made while building the last frame's HUD
+    uint64_t hud_allocations{0};
+
+    // Usage and budget come from VK_EXT_memory_budget rather than VMA's
+    // estimate
+    bool memory_budget_ext{false};
+    uint32_t heap_count{0};
+    HeapBudget heaps[VK_MAX_MEMORY_HEAPS]{};
+};
+
+// Prints the counters that the frame stats don't cover: submissions,
+// pipelines and memory per heap
+void report_perf_counters(PerfCounters const &counters);
+
+// Frame times of the last PERF_HISTORY_FRAMES frames, in a ring. Never
+// allocates.
+class FrameTimeHistory {
+  public:
+    void add(float const frame_ms);
+
+    // Nearest-rank percentiles like FrameStats::summarize(), all zero while
+    // empty
+    FrameStats::Summary summarize() const;
+
+    // For ImGui::PlotLines(), oldest first from offset
+    float const *values() const { return times; }
+    uint32_t count() const { return filled; }
+    uint32_t offset() const { return filled < PERF_HISTORY_FRAMES ? 0 : next; }
+
+  private:
+    float times[PERF_HISTORY_FRAMES];
+    uint32_t filled{0};
+    uint32_t next{0};
+    // Sorted by summarize()
+    mutable float sorted[PERF_HISTORY_FRAMES];
+};
+
+// Overlay of the perf counters and frame time graph, drawn with Dear ImGui
+// over the render target. Only imgui's core is used: its vertices and indices
+// are copied into the frame's arena, the persistently mapped buffer each
+// frame in flight owns, and drawn with a pipeline the engine builds, so a
+// frame showing the HUD creates no buffers and maps no memory. The window
+// takes no input. Render thread only.
+class PerfHud {
+  public:
+    struct InitInfo {
+        VkDevice device;
+        VmaAllocator allocator;
+        MemoryCounters *counters;
+        // The font atlas is uploaded through it, its set comes from the
+        // allocator and layout cache
+        UploadService *uploads;
+        DescriptorLayoutCache *layout_cache;
+        DescriptorAllocator *descriptors;
+        VkSampler sampler;
+    };
+
+    void init(InitInfo const &info);
+    // The GPU must be done with every frame
+    void cleanup();
+
+    // The font atlas in set 0, the scale and translation to clip space in
+    // vertex push constants
+    VkPipelineLayout get_pipeline_layout() const { return pipeline_layout; }
+    // Vertex input matching ImDrawVert
+    static VertexInputDescription get_vertex_description();
+
+    // Nothing is drawn until the upload service has acquired this value
+    uint64_t get_upload_value() const { return upload_value; }
+
+    // Lays the HUD out for the counters, to be drawn by record()
+    void build(
+        PerfCounters const &counters, FrameTimeHistory const &history,
+        VkExtent2D const extent, float const delta_s);
+    // Draws what build() laid out inside a render pass over the target,
+    // copying the vertices and indices into the arena. Returns false if they
+    // don't fit, nothing is drawn then.
+    bool record(
+        VkCommandBuffer const cmd, VkPipeline const pipeline, LinearAllocator &arena,
+        VkExtent2D const extent);
+
+    // Heap allocations imgui made since the last call
+    uint64_t take_allocations();
+
+  private:
+    VkDevice device{VK_NULL_HANDLE};
+    VmaAllocator allocator{VK_NULL_HANDLE};
+    ImGuiContext *context{nullptr};
+
+    AllocatedImage font_image{VK_NULL_HANDLE, VK_NULL_HANDLE};
+    VkImageView font_view{VK_NULL_HANDLE};
+    uint64_t upload_value{0};
+
+    VkDescriptorSetLayout set_layout{VK_NULL_HANDLE}; // owned by the layout cache
+    VkDescriptorSet font_descriptor{VK_NULL_HANDLE};
+    VkPipelineLayout pipeline_layout{VK_NULL_HANDLE};
+
+    // Counted by the allocator functions handed to imgui
+    uint64_t allocations{0};
+};
@@ -71,4 +71,156 @@ vkinit::rasterization_state_create_info(VkPolygonMode const polygon_mode) {
     return info;
 }
 
-// Continue from "Multisampling State" in "Setting up render pipeline"
+VkPipelineMultisampleStateCreateInfo
+vkinit::multisampling_state_create_info() {
+    VkPipelineMultisampleStateCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    info.pNext = nullptr;
+    info.sampleShadingEnable = VK_FALSE;
+    info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT; // no multisampling
+    info.minSampleShading = 1.0f;
+    info.pSampleMask = nullptr;
+    info.alphaToCoverageEnable = VK_FALSE;
+    info.alphaToOneEnable = VK_FALSE;
+    return info;
+}
+
+VkPipelineColorBlendAttachmentState vkinit::color_blend_attachment_state() {
+    VkPipelineColorBlendAttachmentState state{};
+    state.colorWriteMask = VK_COLOR_COMPONENT_R_BIT |
+                           VK_COLOR_COMPONENT_G_BIT |
+                           VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    state.blendEnable = VK_FALSE;
+    return state;
+}
+
+VkPipelineDepthStencilStateCreateInfo vkinit::depth_stencil_create_info(
+    bool const depth_test, bool const depth_write,
+    VkCompareOp const compare_op) {
+    VkPipelineDepthStencilStateCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    info.pNext = nullptr;
+    info.depthTestEnable = depth_test ? VK_TRUE : VK_FALSE;
+    info.depthWriteEnable = depth_write ? VK_TRUE : VK_FALSE;
+    info.depthCompareOp = depth_test ? compare_op : VK_COMPARE_OP_ALWAYS;
+    info.depthBoundsTestEnable = VK_FALSE;
+    info.minDepthBounds = 0.0f;
+    info.maxDepthBounds = 1.0f;
+    info.stencilTestEnable = VK_FALSE;
+    return info;
+}
+
+VkPipelineLayoutCreateInfo vkinit::pipeline_layout_create_info() {
+    VkPipelineLayoutCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    info.pNext = nullptr;
+    // empty defaults
+    info.flags = 0;
+    info.setLayoutCount = 0;
+    info.pSetLayouts = nullptr;
+    info.pushConstantRangeCount = 0;
+    info.pPushConstantRanges = nullptr;
+    return info;
+}
+
+VkImageCreateInfo vkinit::image_create_info(
+    VkFormat const format, VkImageUsageFlags const usage_flags,
+    VkExtent3D const extent) {
+    VkImageCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    info.pNext = nullptr;
+    info.imageType = VK_IMAGE_TYPE_2D;
+    info.format = format;
+    info.extent = extent;
+    info.mipLevels = 1;
+    info.arrayLayers = 1;
+    info.samples = VK_SAMPLE_COUNT_1_BIT;
+    info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    info.usage = usage_flags;
+    return info;
+}
+
+VkImageViewCreateInfo vkinit::imageview_create_info(
+    VkFormat const format, VkImage const image,
+    VkImageAspectFlags const aspect_flags) {
+    VkImageViewCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    info.pNext = nullptr;
+    info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    info.image = image;
+    info.format = format;
+    info.subresourceRange.baseMipLevel = 0;
+    info.subresourceRange.levelCount = 1;
+    info.subresourceRange.baseArrayLayer = 0;
+    info.subresourceRange.layerCount = 1;
+    info.subresourceRange.aspectMask = aspect_flags;
+    return info;
+}
+
+VkBufferCreateInfo vkinit::buffer_create_info(
+    VkDeviceSize const size, VkBufferUsageFlags const usage_flags) {
+    VkBufferCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.pNext = nullptr;
+    info.size = size;
+    info.usage = usage_flags;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    return info;
+}
+
+VkDescriptorSetLayoutBinding vkinit::descriptorset_layout_binding(
+    VkDescriptorType const type, VkShaderStageFlags const stage_flags,
+    uint32_t const binding) {
+    VkDescriptorSetLayoutBinding info{};
+    info.binding = binding;
+    info.descriptorCount = 1;
+    info.descriptorType = type;
+    info.pImmutableSamplers = nullptr;
+    info.stageFlags = stage_flags;
+    return info;
+}
+
+VkWriteDescriptorSet vkinit::write_descriptor_buffer(
+    VkDescriptorType const type, VkDescriptorSet const dst_set,
+    VkDescriptorBufferInfo const *buffer_info, uint32_t const binding) {
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.pNext = nullptr;
+    write.dstBinding = binding;
+    write.dstSet = dst_set;
+    write.descriptorCount = 1;
+    write.descriptorType = type;
+    write.pBufferInfo = buffer_info;
+    return write;
+}
+
+VkWriteDescriptorSet vkinit::write_descriptor_image(
+    VkDescriptorType const type, VkDescriptorSet const dst_set,
+    VkDescriptorImageInfo const *image_info, uint32_t const binding) {
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.pNext = nullptr;
+    write.dstBinding = binding;
+    write.dstSet = dst_set;
+    write.descriptorCount = 1;
+    write.descriptorType = type;
+    write.pImageInfo = image_info;
+    return write;
+}
+
+VkSamplerCreateInfo vkinit::sampler_create_info(
+    VkFilter const filter, VkSamplerAddressMode const address_mode) {
+    VkSamplerCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    info.pNext = nullptr;
+    info.magFilter = filter;
+    info.minFilter = filter;
+    info.mipmapMode = filter == VK_FILTER_NEAREST ? VK_SAMPLER_MIPMAP_MODE_NEAREST
+                                                  : VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    info.addressModeU = address_mode;
+    info.addressModeV = address_mode;
+    info.addressModeW = address_mode;
+    // Every mip the image has
+    info.maxLod = VK_LOD_CLAMP_NONE;
+    return info;
+}
@@ -24,4 +24,40 @@ input_assembly_create_info(VkPrimitiveTopology const topology);
 
 VkPipelineRasterizationStateCreateInfo
 rasterization_state_create_info(VkPolygonMode const polygon_mode);
+
+VkPipelineMultisampleStateCreateInfo multisampling_state_create_info();
+
+VkPipelineColorBlendAttachmentState color_blend_attachment_state();
+
+VkPipelineDepthStencilStateCreateInfo depth_stencil_create_info(
+    bool const depth_test, bool const depth_write,
+    VkCompareOp const compare_op);
+
+VkPipelineLayoutCreateInfo pipeline_layout_create_info();
+
+VkImageCreateInfo image_create_info(
+    VkFormat const format, VkImageUsageFlags const usage_flags,
+    VkExtent3D const extent);
+
+VkImageViewCreateInfo imageview_create_info(
+    VkFormat const format, VkImage const image,
+    VkImageAspectFlags const aspect_flags);
+
+VkBufferCreateInfo buffer_create_info(
+    VkDeviceSize const size, VkBufferUsageFlags const usage_flags);
+
+VkDescriptorSetLayoutBinding descriptorset_layout_binding(
+    VkDescriptorType const type, VkShaderStageFlags const stage_flags,
+    uint32_t const binding);
+
+VkWriteDescriptorSet write_descriptor_buffer(
+    VkDescriptorType const type, VkDescriptorSet const dst_set,
+    VkDescriptorBufferInfo const *buffer_info, uint32_t const binding);
+
+VkWriteDescriptorSet write_descriptor_image(
+    VkDescriptorType const type, VkDescriptorSet const dst_set,
+    VkDescriptorImageInfo const *image_info, uint32_t const binding);
+
+VkSamplerCreateInfo sampler_create_info(
+    VkFilter const filter, VkSamplerAddressMode const address_mode);
 } // namespace vkinit
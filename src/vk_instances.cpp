@@ -0,0 +1,60 @@
+#include <vk_instances.h>
+
+#include <vk_initializers.h>
+
+#include <algorithm>
+
+void InstanceBuffers::init(InitInfo const &info) {
+    device = info.device;
+    allocator = info.allocator;
+    counters = info.counters;
+    max_instances = std::max(1u, info.max_instances);
+
+    VkDescriptorSetLayoutBinding const binding = vkinit::descriptorset_layout_binding(
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0);
+    VkDescriptorSetLayoutCreateInfo set_info = {};
+    set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_info.pNext = nullptr;
+    set_info.flags = 0;
+    set_info.bindingCount = 1;
+    set_info.pBindings = &binding;
+    set_layout = info.layout_cache->get(set_info);
+
+    frames.resize(info.frames_in_flight);
+    for (FrameBuffer &frame : frames) {
+        VkBufferCreateInfo const buffer_info = vkinit::buffer_create_info(
+            max_instances * sizeof(GPUObjectData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        VmaAllocationCreateInfo alloc_info = {};
+        alloc_info.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+        alloc_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+        VmaAllocationInfo allocation;
+        VK_CHECK(vmaCreateBuffer(
+            allocator, &buffer_info, &alloc_info, &frame.instances.buffer,
+            &frame.instances.allocation, &allocation));
+        counters->resource_allocations++;
+        frame.instances_mapped = (GPUObjectData *)allocation.pMappedData;
+
+        frame.descriptor = info.descriptors->allocate(set_layout);
+
+        VkDescriptorBufferInfo const descriptor_buffer = {
+            frame.instances.buffer, 0, VK_WHOLE_SIZE};
+        VkWriteDescriptorSet const write = vkinit::write_descriptor_buffer(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frame.descriptor, &descriptor_buffer, 0);
+        vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+    }
+}
+
+void InstanceBuffers::cleanup() {
+    for (FrameBuffer const &frame : frames) {
+        vmaDestroyBuffer(allocator, frame.instances.buffer, frame.instances.allocation);
+    }
+    frames.clear();
+}
+
+void InstanceBuffers::flush(uint32_t const frame_index, uint32_t const count) {
+    if (count > 0) {
+        vmaFlushAllocation(
+            allocator, frames[frame_index].instances.allocation, 0,
+            (VkDeviceSize)count * sizeof(GPUObjectData));
+    }
+}
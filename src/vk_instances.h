@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <vk_allocators.h>
+#include <vk_descriptors.h>
+#include <vk_culling.h>
+#include <vk_types.h>
+
+// Per-instance data of the CPU's instanced draws. Each frame in flight has
+// its own buffer, written by the CPU every frame and read by the vertex
+// shader at gl_InstanceIndex, the draw's firstInstance plus the instance.
+// The instance shaders are the indirect mesh shaders, which read the
+// culling pass' objects the same way.
+class InstanceBuffers {
+  public:
+    struct InitInfo {
+        VkDevice device;
+        VmaAllocator allocator;
+        MemoryCounters *counters;
+        // The set layout comes from the cache, the sets from the allocator,
+        // which must not be reset while they're in use
+        DescriptorLayoutCache *layout_cache;
+        DescriptorAllocator *descriptors;
+        uint32_t frames_in_flight;
+        uint32_t max_instances;
+    };
+
+    void init(InitInfo const &info);
+    void cleanup();
+
+    // The instances are set 1 of the instanced mesh pipelines, binding 0
+    VkDescriptorSetLayout get_set_layout() const { return set_layout; }
+    VkDescriptorSet get_descriptor(uint32_t const frame_index) const {
+        return frames[frame_index].descriptor;
+    }
+
+    // The frame's max_instances instances, mapped. Only written, the memory
+    // may be write-combined.
+    GPUObjectData *get_instances(uint32_t const frame_index) const {
+        return frames[frame_index].instances_mapped;
+    }
+    // Makes the first count instances written visible to the device
+    void flush(uint32_t const frame_index, uint32_t const count);
+
+    uint32_t get_max_instances() const { return max_instances; }
+
+  private:
+    struct FrameBuffer {
+        AllocatedBuffer instances;
+        GPUObjectData *instances_mapped;
+        VkDescriptorSet descriptor;
+    };
+
+    VkDevice device{VK_NULL_HANDLE};
+    VmaAllocator allocator{VK_NULL_HANDLE};
+    MemoryCounters *counters{nullptr};
+    uint32_t max_instances{0};
+
+    std::vector<FrameBuffer> frames;
+    VkDescriptorSetLayout set_layout{VK_NULL_HANDLE}; // owned by the layout cache
+};
@@ -0,0 +1,61 @@
+#include <vk_mesh.h>
+
+#include <cstddef>
+
+VertexInputDescription get_vertex_description(assets::VertexFormat const format) {
+    VertexInputDescription description;
+
+    // All vertex data is interleaved in a single binding
+    VkVertexInputBindingDescription main_binding = {};
+    main_binding.binding = 0;
+    main_binding.stride = (uint32_t)assets::vertex_size(format);
+    main_binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    description.bindings.push_back(main_binding);
+
+    VkVertexInputAttributeDescription position_attribute = {};
+    position_attribute.binding = 0;
+    position_attribute.location = 0;
+    position_attribute.format = VK_FORMAT_R32G32B32_SFLOAT;
+
+    VkVertexInputAttributeDescription normal_attribute = {};
+    normal_attribute.binding = 0;
+    normal_attribute.location = 1;
+
+    VkVertexInputAttributeDescription uv_attribute = {};
+    uv_attribute.binding = 0;
+    uv_attribute.location = 2;
+
+    if (format == assets::VertexFormat::Quantized) {
+        position_attribute.offset = offsetof(assets::VertexQuantized, position);
+        // Octahedral normal, decoded in the vertex shader
+        normal_attribute.format = VK_FORMAT_R16G16_SNORM;
+        normal_attribute.offset = offsetof(assets::VertexQuantized, normal);
+        uv_attribute.format = VK_FORMAT_R16G16_SFLOAT;
+        uv_attribute.offset = offsetof(assets::VertexQuantized, uv);
+    } else {
+        position_attribute.offset = offsetof(assets::VertexFull, position);
+        normal_attribute.format = VK_FORMAT_R32G32B32_SFLOAT;
+        normal_attribute.offset = offsetof(assets::VertexFull, normal);
+        uv_attribute.format = VK_FORMAT_R32G32_SFLOAT;
+        uv_attribute.offset = offsetof(assets::VertexFull, uv);
+    }
+
+    description.attributes.push_back(position_attribute);
+    description.attributes.push_back(normal_attribute);
+    description.attributes.push_back(uv_attribute);
+    return description;
+}
+
+uint32_t select_lod(
+    assets::MeshLod const *lods, uint32_t const lod_count, float const scale,
+    float const distance, float const error_scale
+) {
+    // Errors grow level by level, the last one within the limit wins
+    uint32_t lod = 0;
+    for (uint32_t i = 1; i < lod_count; i++) {
+        if (lods[i].error * scale * error_scale <= distance) {
+            lod = i;
+        }
+    }
+    return lod;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <mesh_asset.h>
+#include <vector>
+#include <vk_types.h>
+
+struct VertexInputDescription {
+    std::vector<VkVertexInputBindingDescription> bindings;
+    std::vector<VkVertexInputAttributeDescription> attributes;
+
+    VkPipelineVertexInputStateCreateFlags flags = 0;
+};
+
+// Matches the vertex layouts of assets::VertexFormat, so baked vertex data can
+// be uploaded without any conversion
+VertexInputDescription get_vertex_description(assets::VertexFormat const format);
+
+struct Mesh {
+    assets::VertexFormat vertex_format;
+    VkIndexType index_type;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    std::vector<assets::Submesh> submeshes;
+    // Cover the submeshes' triangles, which are ordered meshlet by meshlet
+    std::vector<assets::Meshlet> meshlets;
+    // The full detail level first, covering the submeshes. index_count
+    // includes the indices of all of them.
+    std::vector<assets::MeshLod> lods;
+
+    glm::vec3 bounds_min;
+    glm::vec3 bounds_max;
+
+    AllocatedBuffer vertex_buffer;
+    AllocatedBuffer index_buffer;
+
+    // Upload timeline value after which the buffers hold the mesh
+    uint64_t upload_value;
+};
+
+// Coarsest of the levels whose error, scaled to world units by scale and to
+// pixels by error_scale, projects to at most one pixel from distance away.
+// error_scale is the height in pixels of one unit at distance 1, divided by
+// the error allowed in pixels. cull.comp picks the same way.
+uint32_t select_lod(
+    assets::MeshLod const *lods, uint32_t const lod_count, float const scale,
+    float const distance, float const error_scale);
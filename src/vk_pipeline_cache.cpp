@@ -0,0 +1,210 @@
+#include <vk_pipeline_cache.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace {
+// "VKPC" in little endian
+constexpr uint32_t CACHE_FILE_MAGIC = 0x43504b56;
+// Bump whenever FileHeader changes
+constexpr uint32_t CACHE_FILE_VERSION = 1;
+
+// Size of the header that starts all VkPipelineCache data (header version one)
+constexpr size_t VK_CACHE_HEADER_SIZE = 16 + VK_UUID_SIZE;
+} // namespace
+
+void PipelineCache::init(
+    VkDevice const device, VkPhysicalDeviceProperties const &gpu_props,
+    char const *const filepath
+) {
+    this->device = device;
+    this->props = gpu_props;
+    this->filepath = filepath;
+
+    std::vector<char> data;
+    loaded_from_disk = read_file(data);
+
+    VkPipelineCacheCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    info.pNext = nullptr;
+    info.initialDataSize = loaded_from_disk ? data.size() : 0;
+    info.pInitialData = loaded_from_disk ? data.data() : nullptr;
+
+    // VkPipelineCache is internally synchronized, so it can be shared by
+    // pipelines being built on several threads at once.
+    // A cache the driver still rejects is not worth failing over, start empty
+    if (vkCreatePipelineCache(device, &info, nullptr, &cache) != VK_SUCCESS) {
+        LOG_ERROR("Pipeline cache data was rejected, starting with an empty cache.");
+        loaded_from_disk = false;
+        info.initialDataSize = 0;
+        info.pInitialData = nullptr;
+        VK_CHECK(vkCreatePipelineCache(device, &info, nullptr, &cache));
+    }
+
+    if (loaded_from_disk) {
+        LOG_INFO("Loaded pipeline cache \"" << filepath << "\" (" << data.size() << " bytes).");
+    }
+}
+
+void PipelineCache::cleanup() {
+    if (cache == VK_NULL_HANDLE) {
+        return;
+    }
+
+    if (!write_file()) {
+        LOG_ERROR("Failed to save pipeline cache to \"" << filepath << "\".");
+    }
+
+    for (auto const &entry : pipelines) {
+        vkDestroyPipeline(device, entry.second, nullptr);
+    }
+    pipelines.clear();
+
+    vkDestroyPipelineCache(device, cache, nullptr);
+    cache = VK_NULL_HANDLE;
+}
+
+void PipelineKey::add_string(char const *const value) {
+    size_t const length = std::strlen(value);
+    add(length);
+    bytes.append(value, length);
+}
+
+void PipelineKey::add_shader_stage(VkPipelineShaderStageCreateInfo const &stage) {
+    add(stage.flags);
+    add(stage.stage);
+    add(stage.module);
+    add_string(stage.pName);
+
+    VkSpecializationInfo const *const specialization = stage.pSpecializationInfo;
+    add(specialization != nullptr);
+    if (specialization) {
+        add(specialization->mapEntryCount);
+        for (uint32_t i = 0; i < specialization->mapEntryCount; i++) {
+            VkSpecializationMapEntry const &entry = specialization->pMapEntries[i];
+            add(entry.constantID);
+            add(entry.offset);
+            add(entry.size);
+        }
+        add(specialization->dataSize);
+        bytes.append((char const *)specialization->pData, specialization->dataSize);
+    }
+}
+
+VkPipeline PipelineCache::find(PipelineKey const &key) const {
+    std::lock_guard<std::mutex> lock(pipelines_mutex);
+    auto const it = pipelines.find(key);
+    return it != pipelines.end() ? it->second : VK_NULL_HANDLE;
+}
+
+VkPipeline PipelineCache::insert(PipelineKey const &key, VkPipeline const pipeline) {
+    std::lock_guard<std::mutex> lock(pipelines_mutex);
+    auto const inserted = pipelines.emplace(key, pipeline);
+    if (!inserted.second) {
+        vkDestroyPipeline(device, pipeline, nullptr);
+    }
+    return inserted.first->second;
+}
+
+uint32_t PipelineCache::size() const {
+    std::lock_guard<std::mutex> lock(pipelines_mutex);
+    return (uint32_t)pipelines.size();
+}
+
+PipelineCache::FileHeader PipelineCache::make_header(uint64_t const data_size) const {
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = CACHE_FILE_MAGIC;
+    header.version = CACHE_FILE_VERSION;
+    header.vendor_id = props.vendorID;
+    header.device_id = props.deviceID;
+    header.driver_version = props.driverVersion;
+    std::memcpy(header.cache_uuid, props.pipelineCacheUUID, VK_UUID_SIZE);
+    header.data_size = data_size;
+    return header;
+}
+
+bool PipelineCache::read_file(std::vector<char> &out_data) const {
+    std::ifstream file(filepath, std::ios::binary);
+
+    // No cache yet, this is a cold start
+    if (!file.is_open()) {
+        return false;
+    }
+
+    FileHeader header;
+    if (!file.read((char *)&header, sizeof(header))) {
+        LOG_INFO("Pipeline cache \"" << filepath << "\" is truncated, ignoring it.");
+        return false;
+    }
+
+    // Any difference in device or driver makes the driver's data useless
+    FileHeader const expected = make_header(header.data_size);
+    if (std::memcmp(&header, &expected, sizeof(header)) != 0) {
+        LOG_INFO("Pipeline cache \"" << filepath << "\" is from another device or driver, ignoring it.");
+        return false;
+    }
+
+    // The size was read from the file, so it must fit in what's left of it
+    // before anything is allocated for it
+    std::streamoff const data_start = file.tellg();
+    file.seekg(0, std::ios::end);
+    std::streamoff const file_end = file.tellg();
+    file.seekg(data_start);
+    if (data_start < 0 || file_end < data_start
+        || header.data_size > (uint64_t)(file_end - data_start)) {
+        LOG_INFO("Pipeline cache \"" << filepath << "\" is truncated, ignoring it.");
+        return false;
+    }
+
+    out_data.resize(header.data_size);
+    if (!file.read(out_data.data(), out_data.size())) {
+        LOG_INFO("Pipeline cache \"" << filepath << "\" is truncated, ignoring it.");
+        return false;
+    }
+
+    // Check the driver's own header too, in case the file was tampered with
+    uint32_t vk_header[4];
+    if (out_data.size() < VK_CACHE_HEADER_SIZE) {
+        return false;
+    }
+    std::memcpy(vk_header, out_data.data(), sizeof(vk_header));
+    bool const vk_header_valid = vk_header[0] >= VK_CACHE_HEADER_SIZE
+        && vk_header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        && vk_header[2] == props.vendorID
+        && vk_header[3] == props.deviceID
+        && std::memcmp(out_data.data() + 16, props.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    if (!vk_header_valid) {
+        LOG_INFO("Pipeline cache \"" << filepath << "\" has an invalid header, ignoring it.");
+        return false;
+    }
+
+    return true;
+}
+
+bool PipelineCache::write_file() const {
+    size_t data_size = 0;
+    VK_CHECK(vkGetPipelineCacheData(device, cache, &data_size, nullptr));
+    std::vector<char> data(data_size);
+    VK_CHECK(vkGetPipelineCacheData(device, cache, &data_size, data.data()));
+
+    FileHeader const header = make_header(data_size);
+
+    // Write to a temporary file first so a crash can't leave a half written cache
+    std::string const tmp_filepath = filepath + ".tmp";
+    {
+        std::ofstream file(tmp_filepath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        file.write((char const *)&header, sizeof(header));
+        file.write(data.data(), data_size);
+        if (!file) {
+            return false;
+        }
+    }
+
+    std::remove(filepath.c_str());
+    return std::rename(tmp_filepath.c_str(), filepath.c_str()) == 0;
+}
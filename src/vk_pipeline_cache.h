@@ -0,0 +1,98 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <vk_types.h>
+
+// All the state a pipeline is built from, written into a byte string field by
+// field. Two keys are equal only if every field is, so a hash collision can't
+// hand back a pipeline built from other state. Counts are written before
+// arrays, which keeps keys of different shapes apart.
+class PipelineKey {
+  public:
+    // Graphics and compute keys never compare equal
+    explicit PipelineKey(VkPipelineBindPoint const bind_point) { add(bind_point); }
+
+    // Scalars and handles only, structs may hold padding
+    template <typename T> void add(T const &value) {
+        static_assert(std::is_scalar<T>::value, "Add struct members one by one.");
+        bytes.append((char const *)&value, sizeof(value));
+    }
+    void add_string(char const *const value);
+    // Stage, module, entry point and specialization constants
+    void add_shader_stage(VkPipelineShaderStageCreateInfo const &stage);
+
+    bool operator==(PipelineKey const &other) const { return bytes == other.bytes; }
+
+    struct Hash {
+        size_t operator()(PipelineKey const &key) const {
+            return std::hash<std::string>{}(key.bytes);
+        }
+    };
+
+  private:
+    std::string bytes;
+};
+
+// Owns the driver pipeline cache, which is persisted to disk between runs, and
+// every pipeline built through it. Pipelines are deduplicated by the whole
+// state they were built from, so building the same state twice returns the
+// existing pipeline. Pipelines may be built and looked up from any thread.
+class PipelineCache {
+  public:
+    // Creates the driver cache, seeded from the file if it was written by the
+    // same device and driver. Stale or corrupt files are ignored.
+    void init(
+        VkDevice const device, VkPhysicalDeviceProperties const &gpu_props,
+        char const *const filepath);
+
+    // Saves the driver cache to disk and destroys all pipelines
+    void cleanup();
+
+    // True if init() found a valid cache file for this device and driver
+    bool was_loaded_from_disk() const { return loaded_from_disk; }
+
+    VkPipelineCache get_vk_cache() const { return cache; }
+
+    // Returns the pipeline built from the state, or VK_NULL_HANDLE if there
+    // is none yet
+    VkPipeline find(PipelineKey const &key) const;
+
+    // Takes ownership of a newly built pipeline and returns the pipeline to
+    // use. If another thread finished building the same state first, the new
+    // pipeline is destroyed and the existing one is returned instead.
+    VkPipeline insert(PipelineKey const &key, VkPipeline const pipeline);
+
+    // Pipelines built so far
+    uint32_t size() const;
+
+  private:
+    // Written in front of the driver's cache data, so that files from another
+    // device, driver or engine version are thrown away on load
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t vendor_id;
+        uint32_t device_id;
+        uint32_t driver_version;
+        uint8_t cache_uuid[VK_UUID_SIZE];
+        uint32_t reserved; // keeps data_size aligned without padding bytes
+        uint64_t data_size;
+    };
+
+    VkDevice device{VK_NULL_HANDLE};
+    VkPipelineCache cache{VK_NULL_HANDLE};
+    VkPhysicalDeviceProperties props;
+    std::string filepath;
+    bool loaded_from_disk{false};
+
+    mutable std::mutex pipelines_mutex;
+    std::unordered_map<PipelineKey, VkPipeline, PipelineKey::Hash> pipelines;
+
+    FileHeader make_header(uint64_t const data_size) const;
+    bool read_file(std::vector<char> &out_data) const;
+    bool write_file() const;
+};
@@ -0,0 +1,340 @@
+#include <vk_profiler.h>
+
+#include <vk_initializers.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t ZONES_PER_BLOCK = 4096;
+// About a million zones per track, later zones are dropped
+constexpr uint32_t MAX_BLOCKS = 256;
+
+struct Zone {
+    char const *name;
+    uint64_t start_ns;
+    uint64_t end_ns;
+};
+
+// Zones of one thread, only ever appended to by that thread. Blocks are
+// never moved or freed while the program runs, and the count is published
+// after the zone has been written, so readers see complete zones without
+// taking a lock.
+struct Track {
+    uint32_t id{0};
+    std::atomic<char const *> name{nullptr};
+    std::atomic<uint32_t> count{0};
+    std::atomic<uint32_t> dropped{0};
+    std::atomic<Zone *> blocks[MAX_BLOCKS] = {};
+
+    ~Track() {
+        for (std::atomic<Zone *> &block : blocks) {
+            delete[] block.load();
+        }
+    }
+
+    void append(char const *zone_name, uint64_t const start_ns, uint64_t const end_ns) {
+        uint32_t const index = count.load(std::memory_order_relaxed);
+        uint32_t const block = index / ZONES_PER_BLOCK;
+        if (block >= MAX_BLOCKS) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        Zone *zones = blocks[block].load(std::memory_order_relaxed);
+        if (!zones) {
+            zones = new Zone[ZONES_PER_BLOCK];
+            blocks[block].store(zones, std::memory_order_release);
+        }
+        zones[index % ZONES_PER_BLOCK] = {zone_name, start_ns, end_ns};
+        count.store(index + 1, std::memory_order_release);
+    }
+};
+
+// Every track ever created. The lock is only taken when a thread records its
+// first zone and when exporting.
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Track>> tracks;
+    Track gpu;
+
+    Registry() { gpu.name.store("GPU", std::memory_order_relaxed); }
+};
+
+Registry &registry() {
+    static Registry instance;
+    return instance;
+}
+
+Track &thread_track() {
+    thread_local Track *track = nullptr;
+    if (!track) {
+        Registry &reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.tracks.push_back(std::make_unique<Track>());
+        track = reg.tracks.back().get();
+        // The GPU track is 0
+        track->id = (uint32_t)reg.tracks.size();
+    }
+    return *track;
+}
+
+void write_track(std::FILE *file, Track const &track, bool &first) {
+    uint32_t const count = track.count.load(std::memory_order_acquire);
+    char const *name = track.name.load(std::memory_order_relaxed);
+
+    // Several threads may share a name, the id tells them apart
+    std::fprintf(
+        file,
+        "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+        "\"args\":{\"name\":\"%s %u\"}}",
+        first ? "" : ",", track.id, name ? name : "thread", track.id);
+    std::fprintf(
+        file,
+        ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+        "\"args\":{\"sort_index\":%u}}",
+        track.id, track.id);
+    first = false;
+
+    for (uint32_t i = 0; i < count; i++) {
+        Zone const &zone =
+            track.blocks[i / ZONES_PER_BLOCK].load(std::memory_order_acquire)[i % ZONES_PER_BLOCK];
+        // Complete events, in microseconds
+        std::fprintf(
+            file,
+            ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+            zone.name, track.id, zone.start_ns / 1000.0,
+            (zone.end_ns - zone.start_ns) / 1000.0);
+    }
+
+    uint32_t const dropped = track.dropped.load(std::memory_order_relaxed);
+    if (dropped > 0) {
+        LOG_INFO("Profiler track " << track.id << " dropped " << dropped << " zones.");
+    }
+}
+} // namespace
+
+namespace profiler {
+
+uint64_t now_ns() {
+    // Relative to the first call, which keeps trace timestamps small
+    static Clock::time_point const epoch = Clock::now();
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - epoch).count();
+}
+
+void set_thread_name(char const *name) {
+    thread_track().name.store(name, std::memory_order_relaxed);
+}
+
+void record_zone(char const *name, uint64_t const start_ns, uint64_t const end_ns) {
+    thread_track().append(name, start_ns, end_ns);
+}
+
+void record_gpu_zone(char const *name, uint64_t const start_ns, uint64_t const end_ns) {
+    registry().gpu.append(name, start_ns, end_ns);
+}
+
+bool write_chrome_trace(char const *const filepath) {
+    std::FILE *file = std::fopen(filepath, "w");
+    if (!file) {
+        return false;
+    }
+
+    Registry &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    bool first = true;
+    std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    write_track(file, reg.gpu, first);
+    for (std::unique_ptr<Track> const &track : reg.tracks) {
+        write_track(file, *track, first);
+    }
+    std::fprintf(file, "\n]}\n");
+
+    return std::fclose(file) == 0;
+}
+
+} // namespace profiler
+
+void GpuProfiler::init(InitInfo const &info) {
+    // The queue can't write timestamps, every call becomes a no-op
+    if (info.timestamp_mask == 0) {
+        LOG_INFO("Timestamps are not supported, GPU zones are unavailable.");
+        return;
+    }
+
+    device = info.device;
+    timestamp_period = info.timestamp_period;
+    timestamp_mask = info.timestamp_mask;
+    frames.resize(info.frames_in_flight);
+
+    VkQueryPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    pool_info.pNext = nullptr;
+    pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    pool_info.queryCount = 2 * MAX_GPU_ZONES * info.frames_in_flight;
+    VK_CHECK(vkCreateQueryPool(device, &pool_info, nullptr, &query_pool));
+
+    calibrate(info.queue, info.queue_family);
+}
+
+void GpuProfiler::cleanup() {
+    if (query_pool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device, query_pool, nullptr);
+        query_pool = VK_NULL_HANDLE;
+    }
+}
+
+void GpuProfiler::begin_frame(
+    VkCommandBuffer const cmd, uint32_t const frame_index, int const frame_number
+) {
+    if (!enabled()) {
+        return;
+    }
+
+    FrameQueries &frame = frames[frame_index];
+    frame.frame_number = frame_number;
+    frame.zone_count = 0;
+    vkCmdResetQueryPool(cmd, query_pool, frame_index * MAX_GPU_ZONES * 2, MAX_GPU_ZONES * 2);
+
+    begin_zone(cmd, frame_index, "frame");
+}
+
+void GpuProfiler::end_frame(VkCommandBuffer const cmd, uint32_t const frame_index) {
+    end_zone(cmd, frame_index, 0);
+}
+
+uint32_t GpuProfiler::begin_zone(
+    VkCommandBuffer const cmd, uint32_t const frame_index, char const *name,
+    VkPipelineStageFlagBits const stage
+) {
+    if (!enabled() || frames[frame_index].zone_count == MAX_GPU_ZONES) {
+        return MAX_GPU_ZONES;
+    }
+
+    FrameQueries &frame = frames[frame_index];
+    uint32_t const zone = frame.zone_count++;
+    frame.names[zone] = name;
+    vkCmdWriteTimestamp(cmd, stage, query_pool, (frame_index * MAX_GPU_ZONES + zone) * 2);
+    return zone;
+}
+
+void GpuProfiler::end_zone(
+    VkCommandBuffer const cmd, uint32_t const frame_index, uint32_t const zone,
+    VkPipelineStageFlagBits const stage
+) {
+    if (!enabled() || zone >= MAX_GPU_ZONES) {
+        return;
+    }
+
+    vkCmdWriteTimestamp(cmd, stage, query_pool, (frame_index * MAX_GPU_ZONES + zone) * 2 + 1);
+}
+
+bool GpuProfiler::collect(uint32_t const frame_index, int &out_frame_number, double &out_frame_ms) {
+    if (!enabled() || frames[frame_index].frame_number < 0) {
+        return false;
+    }
+
+    // Called once the frame's fence has signaled, so the results are
+    // available and this doesn't wait
+    FrameQueries &frame = frames[frame_index];
+    uint64_t timestamps[MAX_GPU_ZONES * 2];
+    VkResult const result = vkGetQueryPoolResults(
+        device, query_pool, frame_index * MAX_GPU_ZONES * 2, frame.zone_count * 2,
+        sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+    out_frame_number = frame.frame_number;
+    frame.frame_number = -1;
+    collected_count = 0;
+    if (result != VK_SUCCESS) {
+        return false;
+    }
+
+    for (uint32_t zone = 0; zone < frame.zone_count; zone++) {
+        profiler::record_gpu_zone(
+            frame.names[zone], ticks_to_ns(timestamps[zone * 2]),
+            ticks_to_ns(timestamps[zone * 2 + 1]));
+
+        uint64_t const zone_ticks = (timestamps[zone * 2 + 1] - timestamps[zone * 2]) & timestamp_mask;
+        collected_names[zone] = frame.names[zone];
+        collected_ms[zone] = zone_ticks * timestamp_period / 1e6;
+    }
+    collected_count = frame.zone_count;
+
+    uint64_t const ticks = (timestamps[1] - timestamps[0]) & timestamp_mask;
+    out_frame_ms = ticks * timestamp_period / 1e6;
+    return true;
+}
+
+bool GpuProfiler::collected_zone_ms(char const *name, double &out_ms) const {
+    for (uint32_t zone = 0; zone < collected_count; zone++) {
+        if (std::strcmp(collected_names[zone], name) == 0) {
+            out_ms = collected_ms[zone];
+            return true;
+        }
+    }
+    return false;
+}
+
+void GpuProfiler::calibrate(VkQueue const queue, uint32_t const queue_family) {
+    VkCommandPoolCreateInfo const pool_info = vkinit::command_pool_create_info(
+        queue_family, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+    VkCommandPool pool;
+    VK_CHECK(vkCreateCommandPool(device, &pool_info, nullptr, &pool));
+
+    VkCommandBufferAllocateInfo const alloc_info = vkinit::command_buffer_alloc_info(pool, 1);
+    VkCommandBuffer cmd;
+    VK_CHECK(vkAllocateCommandBuffers(device, &alloc_info, &cmd));
+
+    VkCommandBufferBeginInfo cmd_info = {};
+    cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmd_info.pNext = nullptr;
+    cmd_info.pInheritanceInfo = nullptr;
+    cmd_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(cmd, &cmd_info));
+    vkCmdResetQueryPool(cmd, query_pool, 0, 1);
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, 0);
+    VK_CHECK(vkEndCommandBuffer(cmd));
+
+    VkFenceCreateInfo fence_info = {};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fence_info.pNext = nullptr;
+    fence_info.flags = 0;
+    VkFence fence;
+    VK_CHECK(vkCreateFence(device, &fence_info, nullptr, &fence));
+
+    VkSubmitInfo submit = {};
+    submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit.pNext = nullptr;
+    submit.commandBufferCount = 1;
+    submit.pCommandBuffers = &cmd;
+
+    // The timestamp was taken somewhere between the submit and the fence,
+    // assume halfway
+    uint64_t const before_ns = profiler::now_ns();
+    VK_CHECK(vkQueueSubmit(queue, 1, &submit, fence));
+    VK_CHECK(vkWaitForFences(device, 1, &fence, true, 1000000000));
+    uint64_t const after_ns = profiler::now_ns();
+
+    VK_CHECK(vkGetQueryPoolResults(
+        device, query_pool, 0, 1, sizeof(calibration_ticks), &calibration_ticks,
+        sizeof(uint64_t), VK_QUERY_RESULT_64_BIT));
+    calibration_ns = before_ns + (after_ns - before_ns) / 2;
+
+    vkDestroyFence(device, fence, nullptr);
+    vkDestroyCommandPool(device, pool, nullptr);
+}
+
+uint64_t GpuProfiler::ticks_to_ns(uint64_t const ticks) const {
+    // Masking handles timestamps with fewer than 64 valid bits wrapping
+    // around once since calibration
+    uint64_t const elapsed = (ticks - calibration_ticks) & timestamp_mask;
+    return calibration_ns + (uint64_t)(elapsed * (double)timestamp_period);
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <vk_types.h>
+
+// Scoped CPU zones, recorded into a buffer per thread without locking, and
+// exported along with GPU zones as a Chrome trace (chrome://tracing or
+// ui.perfetto.dev). Zone names must be string literals, only the pointer is
+// stored.
+namespace profiler {
+
+// Nanoseconds on the clock all zones are measured with
+uint64_t now_ns();
+
+// Names the calling thread's track in the trace
+void set_thread_name(char const *name);
+
+// Adds a zone to the calling thread's track
+void record_zone(char const *name, uint64_t const start_ns, uint64_t const end_ns);
+
+// Adds a zone to the GPU track. Only to be called from the thread that
+// collects GPU timestamps.
+void record_gpu_zone(char const *name, uint64_t const start_ns, uint64_t const end_ns);
+
+// Writes every zone recorded so far, by all threads. Safe to call while other
+// threads keep recording.
+bool write_chrome_trace(char const *const filepath);
+
+class ScopedZone {
+  public:
+    explicit ScopedZone(char const *name) : name(name), start_ns(now_ns()) {}
+    ~ScopedZone() { record_zone(name, start_ns, now_ns()); }
+
+    ScopedZone(ScopedZone const &) = delete;
+    ScopedZone &operator=(ScopedZone const &) = delete;
+
+  private:
+    char const *name;
+    uint64_t start_ns;
+};
+
+} // namespace profiler
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+// Times the rest of the enclosing scope
+#define PROFILE_ZONE(name) profiler::ScopedZone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+
+// Upper bound on GPU zones per frame, including the one for the whole frame
+constexpr uint32_t MAX_GPU_ZONES = 32;
+
+// GPU zones written with vkCmdWriteTimestamp into a query range per frame in
+// flight. A frame's results are read once its fence has signaled, so reading
+// them never stalls, and then added to the trace's GPU track. Does nothing if
+// the queue can't write timestamps.
+class GpuProfiler {
+  public:
+    struct InitInfo {
+        VkDevice device;
+        uint32_t frames_in_flight;
+        float timestamp_period; // nanoseconds per tick
+        uint64_t timestamp_mask; // valid bits of a timestamp, 0 if unsupported
+        // Used once to line GPU timestamps up with the CPU clock
+        VkQueue queue;
+        uint32_t queue_family;
+    };
+
+    void init(InitInfo const &info);
+    void cleanup();
+
+    bool enabled() const { return query_pool != VK_NULL_HANDLE; }
+
+    // Starts recording the frame's zones into cmd, beginning with one
+    // covering the whole frame
+    void begin_frame(VkCommandBuffer const cmd, uint32_t const frame_index, int const frame_number);
+    // Ends the whole frame zone
+    void end_frame(VkCommandBuffer const cmd, uint32_t const frame_index);
+
+    // Returns the zone to pass to end_zone(). Zones past MAX_GPU_ZONES are
+    // dropped.
+    uint32_t begin_zone(
+        VkCommandBuffer const cmd, uint32_t const frame_index, char const *name,
+        VkPipelineStageFlagBits const stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+    void end_zone(
+        VkCommandBuffer const cmd, uint32_t const frame_index, uint32_t const zone,
+        VkPipelineStageFlagBits const stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+    // Reads the zones last recorded for the frame index into the trace. Must
+    // only be called once that frame's fence has signaled. Returns false if
+    // there was nothing to read, otherwise the frame number and GPU time of
+    // the whole frame.
+    bool collect(uint32_t const frame_index, int &out_frame_number, double &out_frame_ms);
+
+    // GPU time of the first zone with the given name in the frame last
+    // collected. Returns false if it had none.
+    bool collected_zone_ms(char const *name, double &out_ms) const;
+
+  private:
+    struct FrameQueries {
+        int frame_number{-1};
+        uint32_t zone_count{0};
+        char const *names[MAX_GPU_ZONES];
+    };
+
+    VkDevice device{VK_NULL_HANDLE};
+    VkQueryPool query_pool{VK_NULL_HANDLE};
+    float timestamp_period{0.0f};
+    uint64_t timestamp_mask{0};
+    // One per frame in flight
+    std::vector<FrameQueries> frames;
+
+    // Zones of the frame last collected
+    uint32_t collected_count{0};
+    char const *collected_names[MAX_GPU_ZONES];
+    double collected_ms[MAX_GPU_ZONES];
+
+    // A GPU timestamp and the CPU time it was taken at, give or take the
+    // submission latency
+    uint64_t calibration_ticks{0};
+    uint64_t calibration_ns{0};
+
+    void calibrate(VkQueue const queue, uint32_t const queue_family);
+    uint64_t ticks_to_ns(uint64_t const ticks) const;
+};
@@ -0,0 +1,1051 @@
+#include <vk_render_graph.h>
+
+#include <vk_initializers.h>
+#include <vk_profiler.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+struct AccessInfo {
+    VkPipelineStageFlags stages;
+    VkAccessFlags access;
+    // VK_IMAGE_LAYOUT_UNDEFINED for accesses only buffers have
+    VkImageLayout layout;
+    bool writes;
+};
+
+constexpr VkAccessFlags WRITE_ACCESS = VK_ACCESS_SHADER_WRITE_BIT
+    | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+    | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+AccessInfo access_info(GraphAccess const access) {
+    switch (access) {
+    case GraphAccess::None:
+        return {0, 0, VK_IMAGE_LAYOUT_UNDEFINED, false};
+    case GraphAccess::ColorAttachment:
+        return {
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true};
+    case GraphAccess::DepthAttachment:
+        return {
+            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT
+                | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true};
+    case GraphAccess::SampledFragment:
+        return {
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false};
+    case GraphAccess::ComputeRead:
+        return {
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false};
+    case GraphAccess::ComputeWrite:
+        return {
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL,
+            true};
+    case GraphAccess::IndirectRead:
+        return {
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED, false};
+    case GraphAccess::TransferRead:
+        return {
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false};
+    case GraphAccess::TransferWrite:
+        return {
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true};
+    case GraphAccess::HostRead:
+        return {
+            VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+            false};
+    case GraphAccess::Present:
+        return {
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, false};
+    }
+    return {0, 0, VK_IMAGE_LAYOUT_UNDEFINED, false};
+}
+
+VkImageUsageFlags image_usage(GraphAccess const access) {
+    switch (access) {
+    case GraphAccess::ColorAttachment:
+        return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    case GraphAccess::DepthAttachment:
+        return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    case GraphAccess::SampledFragment:
+        return VK_IMAGE_USAGE_SAMPLED_BIT;
+    case GraphAccess::ComputeRead:
+    case GraphAccess::ComputeWrite:
+        return VK_IMAGE_USAGE_STORAGE_BIT;
+    case GraphAccess::TransferRead:
+        return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    case GraphAccess::TransferWrite:
+        return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    default:
+        return 0;
+    }
+}
+
+bool is_depth_format(VkFormat const format) {
+    return format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_X8_D24_UNORM_PACK32
+        || format == VK_FORMAT_D32_SFLOAT || format == VK_FORMAT_D16_UNORM_S8_UINT
+        || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+VkImageAspectFlags image_aspect(VkFormat const format) {
+    return is_depth_format(format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+}
+
+// Everything a pass does to one resource, its usages of it combined
+struct PassAccess {
+    GraphResource resource;
+    AccessInfo info;
+    // Whether what was in the resource before the pass is used. Writes
+    // other than ComputeWrite and loaded attachments overwrite all of it.
+    bool reads_previous;
+};
+
+// What the resource's accesses since its last barrier still need
+// synchronizing with
+struct SyncState {
+    // The last write, not yet available unless write_access is 0
+    VkPipelineStageFlags write_stages;
+    VkAccessFlags write_access;
+    // Reads since the last write, which the next write has to wait for
+    VkPipelineStageFlags read_stages;
+    // Stages and accesses the last write has been made visible to
+    VkPipelineStageFlags visible_stages;
+    VkAccessFlags visible_access;
+    VkImageLayout layout;
+};
+
+constexpr uint32_t NO_TRANSIENT = UINT32_MAX;
+} // namespace
+
+void RenderGraph::init(InitInfo const &info) {
+    device = info.device;
+    allocator = info.allocator;
+    counters = info.counters;
+    profiler = info.profiler;
+}
+
+void RenderGraph::cleanup() {
+    for (std::unique_ptr<CompiledGraph> &graph : cache) {
+        destroy_graph(*graph);
+    }
+    cache.clear();
+    current = nullptr;
+
+    flush_framebuffers();
+    for (CachedRenderPass const &cached : render_passes) {
+        vkDestroyRenderPass(device, cached.render_pass, nullptr);
+    }
+    render_passes.clear();
+}
+
+void RenderGraph::begin(uint64_t const frame) {
+    this->frame = frame;
+    resources.clear();
+    usages.clear();
+    passes.clear();
+    current = nullptr;
+
+    // Frames in flight that used an old graph have finished long ago
+    for (size_t i = 0; i < cache.size();) {
+        if (frame - cache[i]->last_used_frame > GRAPH_CACHE_FRAMES) {
+            destroy_graph(*cache[i]);
+            cache.erase(cache.begin() + i);
+        } else {
+            i++;
+        }
+    }
+}
+
+GraphResource RenderGraph::import_image(
+    char const *name, GraphImageInfo const &info, VkImage const image, VkImageView const view,
+    GraphAccess const initial, GraphAccess const final, bool const preserve
+) {
+    ResourceDecl &resource = resources.emplace_back();
+    resource.name = name;
+    resource.is_image = true;
+    resource.imported = true;
+    resource.preserve = preserve;
+    resource.info = info;
+    resource.image = image;
+    resource.view = view;
+    resource.initial = initial;
+    resource.final = final;
+    return (GraphResource)resources.size() - 1;
+}
+
+GraphResource RenderGraph::import_buffer(
+    char const *name, GraphAccess const initial, GraphAccess const final
+) {
+    ResourceDecl &resource = resources.emplace_back();
+    resource.name = name;
+    resource.is_image = false;
+    resource.imported = true;
+    resource.preserve = true;
+    resource.info = {VK_FORMAT_UNDEFINED, {0, 0}};
+    resource.image = VK_NULL_HANDLE;
+    resource.view = VK_NULL_HANDLE;
+    resource.initial = initial;
+    resource.final = final;
+    return (GraphResource)resources.size() - 1;
+}
+
+GraphResource RenderGraph::create_image(char const *name, GraphImageInfo const &info) {
+    ResourceDecl &resource = resources.emplace_back();
+    resource.name = name;
+    resource.is_image = true;
+    resource.imported = false;
+    resource.preserve = false;
+    resource.info = info;
+    resource.image = VK_NULL_HANDLE;
+    resource.view = VK_NULL_HANDLE;
+    resource.initial = GraphAccess::None;
+    resource.final = GraphAccess::None;
+    return (GraphResource)resources.size() - 1;
+}
+
+void RenderGraph::read(
+    uint32_t const pass, GraphResource const resource, GraphAccess const access
+) {
+    if (access_info(access).writes) {
+        LOG_ERROR("Pass \"" << passes[pass].name << "\" reads with a writing access.");
+        abort();
+    }
+    add_usage(pass, resource, access, false, nullptr);
+}
+
+void RenderGraph::write(
+    uint32_t const pass, GraphResource const resource, GraphAccess const access
+) {
+    if (!access_info(access).writes) {
+        LOG_ERROR("Pass \"" << passes[pass].name << "\" writes with a reading access.");
+        abort();
+    }
+    add_usage(pass, resource, access, false, nullptr);
+}
+
+void RenderGraph::color_attachment(
+    uint32_t const pass, GraphResource const resource, VkClearValue const *clear_value
+) {
+    add_usage(pass, resource, GraphAccess::ColorAttachment, true, clear_value);
+}
+
+void RenderGraph::depth_attachment(
+    uint32_t const pass, GraphResource const resource, VkClearValue const *clear_value
+) {
+    add_usage(pass, resource, GraphAccess::DepthAttachment, true, clear_value);
+}
+
+void RenderGraph::add_usage(
+    uint32_t const pass, GraphResource const resource, GraphAccess const access,
+    bool const attachment, VkClearValue const *clear_value
+) {
+    // Keeps each pass' usages contiguous
+    if (pass + 1 != passes.size() || resource >= resources.size()) {
+        LOG_ERROR("Render graph usages must follow their pass and use declared resources.");
+        abort();
+    }
+    bool const image_only = access_info(access).layout != VK_IMAGE_LAYOUT_UNDEFINED;
+    bool const buffer_only = access == GraphAccess::IndirectRead;
+    if ((image_only && !resources[resource].is_image)
+        || (buffer_only && resources[resource].is_image)) {
+        LOG_ERROR(
+            "Pass \"" << passes[pass].name << "\" uses \"" << resources[resource].name
+            << "\" in a way its kind of resource can't be used.");
+        abort();
+    }
+    if (attachment && passes[pass].type == GraphPassType::Compute) {
+        LOG_ERROR("Compute pass \"" << passes[pass].name << "\" can't have attachments.");
+        abort();
+    }
+
+    UsageDecl &usage = usages.emplace_back();
+    usage.resource = resource;
+    usage.access = access;
+    usage.attachment = attachment;
+    usage.clear = clear_value != nullptr;
+    usage.clear_value = clear_value ? *clear_value : VkClearValue{};
+    passes[pass].usage_count++;
+}
+
+bool RenderGraph::compile() {
+    build_key(key_scratch);
+    for (std::unique_ptr<CompiledGraph> &graph : cache) {
+        if (graph->key == key_scratch) {
+            graph->last_used_frame = frame;
+            current = graph.get();
+            return false;
+        }
+    }
+
+    std::unique_ptr<CompiledGraph> graph = std::make_unique<CompiledGraph>();
+    graph->key = key_scratch;
+    graph->last_used_frame = frame;
+    compile_graph(*graph);
+    current = graph.get();
+    cache.push_back(std::move(graph));
+    compile_count++;
+    return true;
+}
+
+void RenderGraph::build_key(std::vector<uint64_t> &out_key) const {
+    out_key.clear();
+    out_key.push_back(resources.size());
+    for (ResourceDecl const &resource : resources) {
+        out_key.push_back(
+            (uint64_t)resource.is_image | (uint64_t)resource.imported << 1
+            | (uint64_t)resource.preserve << 2 | (uint64_t)resource.info.format << 32);
+        out_key.push_back((uint64_t)resource.info.extent.width << 32 | resource.info.extent.height);
+        out_key.push_back((uint64_t)resource.initial << 32 | (uint64_t)resource.final);
+    }
+    out_key.push_back(passes.size());
+    for (PassDecl const &pass : passes) {
+        // Names are string literals, so the same pass always has the same one
+        out_key.push_back((uint64_t)(uintptr_t)pass.name);
+        out_key.push_back((uint64_t)pass.type << 32 | pass.usage_count);
+        for (uint32_t i = 0; i < pass.usage_count; i++) {
+            UsageDecl const &usage = usages[pass.first_usage + i];
+            out_key.push_back(
+                (uint64_t)usage.resource << 32 | (uint64_t)usage.access << 2
+                | (uint64_t)usage.attachment << 1 | (uint64_t)usage.clear);
+        }
+    }
+}
+
+void RenderGraph::compile_graph(CompiledGraph &graph) {
+    uint32_t const resource_count = (uint32_t)resources.size();
+    uint32_t const pass_count = (uint32_t)passes.size();
+
+    // Combine each pass' usages of the same resource
+    std::vector<PassAccess> accesses;
+    std::vector<uint32_t> first_access(pass_count + 1);
+    for (uint32_t p = 0; p < pass_count; p++) {
+        first_access[p] = (uint32_t)accesses.size();
+        PassDecl const &pass = passes[p];
+        for (uint32_t u = pass.first_usage; u < pass.first_usage + pass.usage_count; u++) {
+            UsageDecl const &usage = usages[u];
+            AccessInfo const info = access_info(usage.access);
+            bool const reads_previous = !info.writes || usage.access == GraphAccess::ComputeWrite
+                || (usage.attachment && !usage.clear);
+
+            auto const existing = std::find_if(
+                accesses.begin() + first_access[p], accesses.end(),
+                [&](PassAccess const &a) { return a.resource == usage.resource; });
+            if (existing == accesses.end()) {
+                accesses.push_back({usage.resource, info, reads_previous});
+                continue;
+            }
+            if (resources[usage.resource].is_image && existing->info.layout != info.layout) {
+                LOG_ERROR(
+                    "Pass \"" << pass.name << "\" uses \"" << resources[usage.resource].name
+                    << "\" in two layouts at once.");
+                abort();
+            }
+            existing->info.stages |= info.stages;
+            existing->info.access |= info.access;
+            existing->info.writes |= info.writes;
+            existing->reads_previous |= reads_previous;
+        }
+    }
+    first_access[pass_count] = (uint32_t)accesses.size();
+
+    // Walking backwards from the imported resources that are used after the
+    // graph, keep the passes that write something a kept pass or the
+    // outside needs. A resource stops being needed before a kept pass that
+    // overwrites all of it.
+    std::vector<bool> needed(resource_count);
+    for (uint32_t r = 0; r < resource_count; r++) {
+        needed[r] = resources[r].imported && resources[r].final != GraphAccess::None;
+    }
+    std::vector<bool> live(pass_count);
+    for (uint32_t p = pass_count; p-- > 0;) {
+        for (uint32_t a = first_access[p]; a < first_access[p + 1]; a++) {
+            live[p] = live[p] || (accesses[a].info.writes && needed[accesses[a].resource]);
+        }
+        if (!live[p]) {
+            graph.culled_passes.push_back(p);
+            continue;
+        }
+        for (uint32_t a = first_access[p]; a < first_access[p + 1]; a++) {
+            if (accesses[a].info.writes && !accesses[a].reads_previous) {
+                needed[accesses[a].resource] = false;
+            }
+        }
+        for (uint32_t a = first_access[p]; a < first_access[p + 1]; a++) {
+            if (accesses[a].reads_previous) {
+                needed[accesses[a].resource] = true;
+            }
+        }
+    }
+    std::reverse(graph.culled_passes.begin(), graph.culled_passes.end());
+
+    for (uint32_t p = 0; p < pass_count; p++) {
+        if (live[p]) {
+            CompiledPass compiled = {};
+            compiled.pass = p;
+            graph.passes.push_back(compiled);
+        }
+    }
+    uint32_t const compiled_count = (uint32_t)graph.passes.size();
+
+    // Lifetimes, in compiled passes, and the transient images to create
+    std::vector<uint32_t> last_use(resource_count, 0);
+    graph.resource_transients.assign(resource_count, NO_TRANSIENT);
+    for (uint32_t c = 0; c < compiled_count; c++) {
+        uint32_t const p = graph.passes[c].pass;
+        for (uint32_t a = first_access[p]; a < first_access[p + 1]; a++) {
+            GraphResource const r = accesses[a].resource;
+            last_use[r] = c;
+            if (resources[r].imported) {
+                continue;
+            }
+            if (graph.resource_transients[r] == NO_TRANSIENT) {
+                graph.resource_transients[r] = (uint32_t)graph.transients.size();
+                TransientImage transient = {};
+                transient.resource = r;
+                transient.first_use = c;
+                graph.transients.push_back(transient);
+            }
+            TransientImage &transient = graph.transients[graph.resource_transients[r]];
+            transient.last_use = c;
+        }
+    }
+    for (uint32_t u = 0; u < (uint32_t)usages.size(); u++) {
+        uint32_t const t = graph.resource_transients[usages[u].resource];
+        if (t != NO_TRANSIENT) {
+            graph.transients[t].usage |= image_usage(usages[u].access);
+        }
+    }
+    allocate_transients(graph);
+
+    // The transient image using a block's memory before each one does, or
+    // for the first, the block's last one of the previous frame
+    std::vector<uint32_t> previous_occupant(graph.transients.size());
+    for (uint32_t t = 0; t < (uint32_t)graph.transients.size(); t++) {
+        uint32_t previous = NO_TRANSIENT;
+        uint32_t last = t;
+        for (uint32_t o = 0; o < (uint32_t)graph.transients.size(); o++) {
+            TransientImage const &other = graph.transients[o];
+            if (other.block != graph.transients[t].block) {
+                continue;
+            }
+            if (other.last_use < graph.transients[t].first_use
+                && (previous == NO_TRANSIENT
+                    || other.last_use > graph.transients[previous].last_use)) {
+                previous = o;
+            }
+            if (other.last_use > graph.transients[last].last_use) {
+                last = o;
+            }
+        }
+        previous_occupant[t] = previous != NO_TRANSIENT ? previous : last;
+    }
+    // Barriers of first uses that wait for the previous frame, whose states
+    // are only known once the whole graph has been walked
+    std::vector<std::pair<uint32_t, uint32_t>> wrapping_barriers;
+
+    std::vector<SyncState> states(resource_count);
+    for (uint32_t r = 0; r < resource_count; r++) {
+        AccessInfo const initial = access_info(resources[r].initial);
+        SyncState &state = states[r];
+        state = {};
+        if (initial.writes) {
+            state.write_stages = initial.stages;
+            state.write_access = initial.access & WRITE_ACCESS;
+        } else {
+            state.read_stages = initial.stages;
+        }
+        state.layout = resources[r].preserve ? initial.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+    }
+
+    // Places the barrier the access needs after the state, if any. A read's
+    // barrier also covers the reads that follow it in later passes with the
+    // same layout, so that they need none.
+    auto const add_access = [&](GraphResource const r, AccessInfo const &info, uint32_t const c) {
+        SyncState &state = states[r];
+        bool const is_image = resources[r].is_image;
+        bool const transition = is_image && info.layout != state.layout;
+        if (transition || info.writes) {
+            VkPipelineStageFlags const src_stages = state.write_stages | state.read_stages;
+            if (src_stages != 0 || transition) {
+                graph.barriers.push_back(
+                    {r, src_stages, state.write_access, info.stages, info.access, state.layout,
+                     is_image ? info.layout : VK_IMAGE_LAYOUT_UNDEFINED});
+            }
+            state.write_stages = info.stages;
+            if (info.writes) {
+                state.write_access = info.access & WRITE_ACCESS;
+                state.read_stages = 0;
+                state.visible_stages = 0;
+                state.visible_access = 0;
+            } else {
+                // The layout transition is the last write, and visible to
+                // this read
+                state.write_access = 0;
+                state.read_stages = info.stages;
+                state.visible_stages = info.stages;
+                state.visible_access = info.access;
+            }
+            state.layout = is_image ? info.layout : state.layout;
+            return;
+        }
+
+        bool const visible = (info.stages & ~state.visible_stages) == 0
+            && (info.access & ~state.visible_access) == 0;
+        if (state.write_stages != 0 && !visible) {
+            VkPipelineStageFlags dst_stages = info.stages;
+            VkAccessFlags dst_access = info.access;
+            for (uint32_t later = c + 1; later < compiled_count; later++) {
+                uint32_t const p = graph.passes[later].pass;
+                auto const end = accesses.begin() + first_access[p + 1];
+                auto const next = std::find_if(
+                    accesses.begin() + first_access[p], end,
+                    [&](PassAccess const &a) { return a.resource == r; });
+                if (next == end) {
+                    continue;
+                }
+                if (next->info.writes || next->info.layout != info.layout) {
+                    break;
+                }
+                dst_stages |= next->info.stages;
+                dst_access |= next->info.access;
+            }
+            graph.barriers.push_back(
+                {r, state.write_stages, state.write_access, dst_stages, dst_access, state.layout,
+                 state.layout});
+            state.visible_stages |= dst_stages;
+            state.visible_access |= dst_access;
+        }
+        state.read_stages |= info.stages;
+    };
+
+    for (uint32_t c = 0; c < compiled_count; c++) {
+        CompiledPass &compiled = graph.passes[c];
+        PassDecl const &pass = passes[compiled.pass];
+        compiled.batch.first_barrier = (uint32_t)graph.barriers.size();
+
+        // Load what earlier passes or the outside left in the attachments,
+        // and store what later passes or the outside use
+        if (pass.type != GraphPassType::Compute) {
+            RenderPassKey key = {};
+            uint32_t depth_usage = UINT32_MAX;
+            compiled.first_attachment = (uint32_t)graph.attachments.size();
+            for (uint32_t u = pass.first_usage; u < pass.first_usage + pass.usage_count; u++) {
+                if (!usages[u].attachment) {
+                    continue;
+                }
+                if (usages[u].access == GraphAccess::DepthAttachment) {
+                    depth_usage = u;
+                } else if (key.color_count < MAX_GRAPH_COLOR_ATTACHMENTS) {
+                    graph.attachments.push_back(u);
+                    key.color_count++;
+                } else {
+                    LOG_ERROR("Pass \"" << pass.name << "\" has too many color attachments.");
+                    abort();
+                }
+            }
+            if (depth_usage != UINT32_MAX) {
+                graph.attachments.push_back(depth_usage);
+            }
+            compiled.attachment_count =
+                (uint32_t)graph.attachments.size() - compiled.first_attachment;
+
+            for (uint32_t i = 0; i < compiled.attachment_count; i++) {
+                UsageDecl const &usage = usages[graph.attachments[compiled.first_attachment + i]];
+                ResourceDecl const &resource = resources[usage.resource];
+                key.formats[i] = resource.info.format;
+                if (usage.clear) {
+                    key.load_ops[i] = VK_ATTACHMENT_LOAD_OP_CLEAR;
+                } else if (states[usage.resource].layout != VK_IMAGE_LAYOUT_UNDEFINED) {
+                    key.load_ops[i] = VK_ATTACHMENT_LOAD_OP_LOAD;
+                } else {
+                    key.load_ops[i] = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                }
+                bool const used_after = last_use[usage.resource] > c
+                    || (resource.imported && resource.final != GraphAccess::None);
+                key.store_ops[i] = used_after
+                    ? VK_ATTACHMENT_STORE_OP_STORE
+                    : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            }
+            key.depth_format = depth_usage != UINT32_MAX
+                ? resources[usages[depth_usage].resource].info.format
+                : VK_FORMAT_UNDEFINED;
+            compiled.render_pass = get_render_pass(key);
+        }
+
+        for (uint32_t a = first_access[compiled.pass]; a < first_access[compiled.pass + 1]; a++) {
+            GraphResource const r = accesses[a].resource;
+            uint32_t const t = graph.resource_transients[r];
+            if (t != NO_TRANSIENT && graph.transients[t].first_use == c) {
+                // Its memory was last used by another image, or this one in
+                // the previous frame
+                uint32_t const previous = previous_occupant[t];
+                SyncState &state = states[r];
+                state = {};
+                if (graph.transients[previous].last_use < c) {
+                    SyncState const &previous_state = states[graph.transients[previous].resource];
+                    state.write_stages = previous_state.write_stages;
+                    state.write_access = previous_state.write_access;
+                    state.read_stages = previous_state.read_stages;
+                } else {
+                    wrapping_barriers.push_back({(uint32_t)graph.barriers.size(), previous});
+                }
+            }
+            add_access(r, accesses[a].info, c);
+        }
+        compiled.batch.barrier_count =
+            (uint32_t)graph.barriers.size() - compiled.batch.first_barrier;
+    }
+
+    graph.final_batch.first_barrier = (uint32_t)graph.barriers.size();
+    for (uint32_t r = 0; r < resource_count; r++) {
+        if (resources[r].imported && resources[r].final != GraphAccess::None) {
+            add_access(r, access_info(resources[r].final), compiled_count);
+        }
+    }
+    graph.final_batch.barrier_count =
+        (uint32_t)graph.barriers.size() - graph.final_batch.first_barrier;
+
+    for (std::pair<uint32_t, uint32_t> const &wrapping : wrapping_barriers) {
+        Barrier &barrier = graph.barriers[wrapping.first];
+        SyncState const &last_state = states[graph.transients[wrapping.second].resource];
+        barrier.src_stages |= last_state.write_stages | last_state.read_stages;
+        barrier.src_access |= last_state.write_access;
+    }
+
+    // Sum each batch up into what a single vkCmdPipelineBarrier needs
+    RenderGraphStats &stats = graph.stats;
+    stats.barriers = (uint32_t)graph.barriers.size();
+    auto const finish_batch = [&](BarrierBatch &batch) {
+        for (uint32_t b = batch.first_barrier; b < batch.first_barrier + batch.barrier_count; b++) {
+            Barrier const &barrier = graph.barriers[b];
+            batch.src_stages |= barrier.src_stages;
+            batch.dst_stages |= barrier.dst_stages;
+            if (resources[barrier.resource].is_image) {
+                batch.image_barrier_count++;
+            } else {
+                batch.buffer_src_access |= barrier.src_access;
+                batch.buffer_dst_access |= barrier.dst_access;
+            }
+        }
+        if (batch.barrier_count > 0) {
+            if (batch.src_stages == 0) {
+                batch.src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            }
+            if (batch.dst_stages == 0) {
+                batch.dst_stages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+            }
+            stats.barrier_batches++;
+        }
+    };
+    for (CompiledPass &compiled : graph.passes) {
+        finish_batch(compiled.batch);
+    }
+    finish_batch(graph.final_batch);
+
+    stats.passes = pass_count;
+    stats.culled_passes = (uint32_t)graph.culled_passes.size();
+}
+
+void RenderGraph::allocate_transients(CompiledGraph &graph) {
+    struct Block {
+        VkMemoryRequirements requirements;
+        std::vector<uint32_t> transients;
+    };
+    std::vector<Block> blocks;
+    std::vector<VkMemoryRequirements> requirements(graph.transients.size());
+
+    for (uint32_t t = 0; t < (uint32_t)graph.transients.size(); t++) {
+        TransientImage &transient = graph.transients[t];
+        ResourceDecl const &resource = resources[transient.resource];
+        VkExtent3D const extent = {resource.info.extent.width, resource.info.extent.height, 1};
+        VkImageCreateInfo const img_info =
+            vkinit::image_create_info(resource.info.format, transient.usage, extent);
+        VK_CHECK(vkCreateImage(device, &img_info, nullptr, &transient.image));
+        counters->resource_allocations++;
+        vkGetImageMemoryRequirements(device, transient.image, &requirements[t]);
+        transient.size = requirements[t].size;
+        graph.stats.transient_bytes += transient.size;
+    }
+
+    // Largest first, each into the first block of a compatible memory type
+    // whose images are all done with it before it's needed or needed after
+    std::vector<uint32_t> order(graph.transients.size());
+    for (uint32_t t = 0; t < (uint32_t)order.size(); t++) {
+        order[t] = t;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return graph.transients[a].size > graph.transients[b].size;
+    });
+    for (uint32_t const t : order) {
+        TransientImage &transient = graph.transients[t];
+        VkMemoryRequirements const &image_requirements = requirements[t];
+        auto const fits = [&](Block const &block) {
+            if ((block.requirements.memoryTypeBits & image_requirements.memoryTypeBits) == 0) {
+                return false;
+            }
+            for (uint32_t const o : block.transients) {
+                TransientImage const &other = graph.transients[o];
+                if (other.first_use <= transient.last_use
+                    && transient.first_use <= other.last_use) {
+                    return false;
+                }
+            }
+            return true;
+        };
+        auto const block = std::find_if(blocks.begin(), blocks.end(), fits);
+        if (block == blocks.end()) {
+            transient.block = (uint32_t)blocks.size();
+            blocks.push_back({image_requirements, {t}});
+            continue;
+        }
+        transient.block = (uint32_t)(block - blocks.begin());
+        block->requirements.size = std::max(block->requirements.size, image_requirements.size);
+        block->requirements.alignment =
+            std::max(block->requirements.alignment, image_requirements.alignment);
+        block->requirements.memoryTypeBits &= image_requirements.memoryTypeBits;
+        block->transients.push_back(t);
+    }
+
+    VmaAllocationCreateInfo alloc_info = {};
+    alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    uint64_t allocated_bytes = 0;
+    for (Block const &block : blocks) {
+        VmaAllocation allocation;
+        VK_CHECK(vmaAllocateMemory(
+            allocator, &block.requirements, &alloc_info, &allocation, nullptr));
+        counters->resource_allocations++;
+        graph.blocks.push_back(allocation);
+        allocated_bytes += block.requirements.size;
+
+        for (uint32_t const t : block.transients) {
+            VK_CHECK(vmaBindImageMemory(allocator, allocation, graph.transients[t].image));
+        }
+    }
+    graph.stats.transient_images = (uint32_t)graph.transients.size();
+    graph.stats.aliased_bytes = graph.stats.transient_bytes - allocated_bytes;
+
+    for (TransientImage &transient : graph.transients) {
+        VkFormat const format = resources[transient.resource].info.format;
+        VkImageViewCreateInfo const view_info =
+            vkinit::imageview_create_info(format, transient.image, image_aspect(format));
+        VK_CHECK(vkCreateImageView(device, &view_info, nullptr, &transient.view));
+    }
+}
+
+void RenderGraph::destroy_graph(CompiledGraph &graph) {
+    // Along with the framebuffers over its images, whose handles may be
+    // reused by later ones
+    auto const uses_graph = [&](CachedFramebuffer const &cached) {
+        for (TransientImage const &transient : graph.transients) {
+            if (std::find(cached.views, cached.views + cached.view_count, transient.view)
+                != cached.views + cached.view_count) {
+                vkDestroyFramebuffer(device, cached.framebuffer, nullptr);
+                return true;
+            }
+        }
+        return false;
+    };
+    framebuffers.erase(
+        std::remove_if(framebuffers.begin(), framebuffers.end(), uses_graph), framebuffers.end());
+
+    for (TransientImage const &transient : graph.transients) {
+        vkDestroyImageView(device, transient.view, nullptr);
+        vkDestroyImage(device, transient.image, nullptr);
+    }
+    for (VmaAllocation const allocation : graph.blocks) {
+        vmaFreeMemory(allocator, allocation);
+    }
+    graph.transients.clear();
+    graph.blocks.clear();
+}
+
+void RenderGraph::execute(VkCommandBuffer const cmd, uint32_t const frame_index) {
+    for (CompiledPass const &compiled : current->passes) {
+        record_batch(cmd, compiled.batch);
+
+        PassDecl &pass = passes[compiled.pass];
+        uint32_t zone = 0;
+        if (profiler) {
+            zone = profiler->begin_zone(cmd, frame_index, pass.name);
+        }
+
+        VkCommandBufferInheritanceInfo inheritance = {};
+        inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritance.pNext = nullptr;
+        inheritance.renderPass = compiled.render_pass;
+        inheritance.subpass = 0;
+        inheritance.framebuffer = VK_NULL_HANDLE;
+
+        if (compiled.render_pass == VK_NULL_HANDLE) {
+            pass.record(pass.storage, cmd, inheritance);
+        } else {
+            VkImageView views[MAX_GRAPH_COLOR_ATTACHMENTS + 1];
+            clear_value_scratch.clear();
+            VkExtent2D extent = {0, 0};
+            for (uint32_t i = 0; i < compiled.attachment_count; i++) {
+                uint32_t const u = current->attachments[compiled.first_attachment + i];
+                UsageDecl const &usage = usages[u];
+                ResourceDecl const &resource = resources[usage.resource];
+                uint32_t const t = current->resource_transients[usage.resource];
+                views[i] = t != NO_TRANSIENT ? current->transients[t].view : resource.view;
+                clear_value_scratch.push_back(usage.clear_value);
+                extent = resource.info.extent;
+            }
+            inheritance.framebuffer =
+                get_framebuffer(compiled.render_pass, views, compiled.attachment_count, extent);
+
+            VkRenderPassBeginInfo rp_info = {};
+            rp_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            rp_info.pNext = nullptr;
+            rp_info.renderPass = compiled.render_pass;
+            rp_info.renderArea.offset.x = 0;
+            rp_info.renderArea.offset.y = 0;
+            rp_info.renderArea.extent = extent;
+            rp_info.framebuffer = inheritance.framebuffer;
+            rp_info.clearValueCount = (uint32_t)clear_value_scratch.size();
+            rp_info.pClearValues = clear_value_scratch.data();
+            VkSubpassContents const contents = pass.type == GraphPassType::GraphicsSecondary
+                ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+                : VK_SUBPASS_CONTENTS_INLINE;
+            vkCmdBeginRenderPass(cmd, &rp_info, contents);
+            if (pass.type == GraphPassType::Graphics) {
+                VkViewport const viewport = {
+                    0.f, 0.f, (float)extent.width, (float)extent.height, 0.f, 1.f};
+                vkCmdSetViewport(cmd, 0, 1, &viewport);
+                vkCmdSetScissor(cmd, 0, 1, &rp_info.renderArea);
+            }
+            pass.record(pass.storage, cmd, inheritance);
+            vkCmdEndRenderPass(cmd);
+        }
+
+        if (profiler) {
+            profiler->end_zone(cmd, frame_index, zone);
+        }
+    }
+    record_batch(cmd, current->final_batch);
+}
+
+void RenderGraph::record_batch(VkCommandBuffer const cmd, BarrierBatch const &batch) {
+    if (batch.barrier_count == 0) {
+        return;
+    }
+
+    image_barrier_scratch.clear();
+    for (uint32_t b = batch.first_barrier; b < batch.first_barrier + batch.barrier_count; b++) {
+        Barrier const &barrier = current->barriers[b];
+        ResourceDecl const &resource = resources[barrier.resource];
+        if (!resource.is_image) {
+            continue;
+        }
+        uint32_t const t = current->resource_transients[barrier.resource];
+
+        VkImageMemoryBarrier image_barrier = {};
+        image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        image_barrier.pNext = nullptr;
+        image_barrier.srcAccessMask = barrier.src_access;
+        image_barrier.dstAccessMask = barrier.dst_access;
+        image_barrier.oldLayout = barrier.old_layout;
+        image_barrier.newLayout = barrier.new_layout;
+        image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        image_barrier.image = t != NO_TRANSIENT ? current->transients[t].image : resource.image;
+        image_barrier.subresourceRange.aspectMask = image_aspect(resource.info.format);
+        image_barrier.subresourceRange.baseMipLevel = 0;
+        image_barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+        image_barrier.subresourceRange.baseArrayLayer = 0;
+        image_barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+        image_barrier_scratch.push_back(image_barrier);
+    }
+
+    // Buffers share one global barrier, which is left out if the batch only
+    // needs their execution dependencies
+    VkMemoryBarrier memory_barrier = {};
+    memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memory_barrier.pNext = nullptr;
+    memory_barrier.srcAccessMask = batch.buffer_src_access;
+    memory_barrier.dstAccessMask = batch.buffer_dst_access;
+    uint32_t const memory_barrier_count =
+        (batch.buffer_src_access | batch.buffer_dst_access) != 0 ? 1 : 0;
+
+    vkCmdPipelineBarrier(
+        cmd, batch.src_stages, batch.dst_stages, 0, memory_barrier_count, &memory_barrier, 0,
+        nullptr, (uint32_t)image_barrier_scratch.size(), image_barrier_scratch.data());
+}
+
+RenderGraphStats const &RenderGraph::get_stats() const {
+    return current->stats;
+}
+
+void RenderGraph::dump() const {
+    RenderGraphStats const &stats = current->stats;
+    LOG_INFO(
+        "Render graph: " << stats.passes << " passes, " << stats.culled_passes << " culled, "
+        << stats.barriers << " barriers in " << stats.barrier_batches
+        << " vkCmdPipelineBarrier calls, " << stats.transient_images << " transient images of "
+        << stats.transient_bytes << " bytes in " << current->blocks.size() << " allocations, "
+        << stats.aliased_bytes << " bytes aliased.");
+
+    auto const dump_batch = [&](BarrierBatch const &batch) {
+        for (uint32_t b = batch.first_barrier; b < batch.first_barrier + batch.barrier_count; b++) {
+            Barrier const &barrier = current->barriers[b];
+            LOG_INFO(
+                "    barrier \"" << resources[barrier.resource].name << "\": stages 0x" << std::hex
+                << barrier.src_stages << " -> 0x" << barrier.dst_stages << ", access 0x"
+                << barrier.src_access << " -> 0x" << barrier.dst_access << std::dec
+                << ", layout " << barrier.old_layout << " -> " << barrier.new_layout);
+        }
+    };
+    for (CompiledPass const &compiled : current->passes) {
+        LOG_INFO("  pass \"" << passes[compiled.pass].name << "\"");
+        dump_batch(compiled.batch);
+    }
+    LOG_INFO("  end of graph");
+    dump_batch(current->final_batch);
+
+    for (uint32_t const p : current->culled_passes) {
+        LOG_INFO("  culled pass \"" << passes[p].name << "\"");
+    }
+    for (TransientImage const &transient : current->transients) {
+        LOG_INFO(
+            "  transient \"" << resources[transient.resource].name << "\": " << transient.size
+            << " bytes in allocation " << transient.block << ", passes " << transient.first_use
+            << " to " << transient.last_use);
+    }
+}
+
+VkRenderPass RenderGraph::get_compatible_render_pass(
+    VkFormat const *color_formats, uint32_t const color_count, VkFormat const depth_format
+) {
+    // Compatibility only depends on the formats, so the load and store ops
+    // are those a cleared, presented target and a cleared depth buffer get
+    RenderPassKey key = {};
+    key.color_count = std::min(color_count, MAX_GRAPH_COLOR_ATTACHMENTS);
+    for (uint32_t i = 0; i < key.color_count; i++) {
+        key.formats[i] = color_formats[i];
+        key.load_ops[i] = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        key.store_ops[i] = VK_ATTACHMENT_STORE_OP_STORE;
+    }
+    key.depth_format = depth_format;
+    if (depth_format != VK_FORMAT_UNDEFINED) {
+        key.formats[key.color_count] = depth_format;
+        key.load_ops[key.color_count] = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        key.store_ops[key.color_count] = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    }
+    return get_render_pass(key);
+}
+
+VkRenderPass RenderGraph::get_render_pass(RenderPassKey const &key) {
+    for (CachedRenderPass const &cached : render_passes) {
+        if (std::memcmp(&cached.key, &key, sizeof(key)) == 0) {
+            return cached.render_pass;
+        }
+    }
+
+    // The graph's barriers do every layout transition, so the attachments
+    // stay in the layout they're used in
+    VkAttachmentDescription attachments[MAX_GRAPH_COLOR_ATTACHMENTS + 1];
+    VkAttachmentReference color_refs[MAX_GRAPH_COLOR_ATTACHMENTS];
+    VkAttachmentReference depth_ref = {};
+    bool const has_depth = key.depth_format != VK_FORMAT_UNDEFINED;
+    uint32_t const attachment_count = key.color_count + (has_depth ? 1 : 0);
+    for (uint32_t i = 0; i < attachment_count; i++) {
+        VkImageLayout const layout = i < key.color_count
+            ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+            : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        attachments[i] = {};
+        attachments[i].format = key.formats[i];
+        attachments[i].samples = VK_SAMPLE_COUNT_1_BIT;
+        attachments[i].loadOp = key.load_ops[i];
+        attachments[i].storeOp = key.store_ops[i];
+        attachments[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachments[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachments[i].initialLayout = layout;
+        attachments[i].finalLayout = layout;
+        if (i < key.color_count) {
+            color_refs[i] = {i, layout};
+        } else {
+            depth_ref = {i, layout};
+        }
+    }
+
+    VkSubpassDescription subpass = {};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = key.color_count;
+    subpass.pColorAttachments = color_refs;
+    subpass.pDepthStencilAttachment = has_depth ? &depth_ref : nullptr;
+
+    VkRenderPassCreateInfo render_pass_info = {};
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    render_pass_info.attachmentCount = attachment_count;
+    render_pass_info.pAttachments = attachments;
+    render_pass_info.subpassCount = 1;
+    render_pass_info.pSubpasses = &subpass;
+
+    CachedRenderPass cached;
+    cached.key = key;
+    VK_CHECK(vkCreateRenderPass(device, &render_pass_info, nullptr, &cached.render_pass));
+    render_passes.push_back(cached);
+    return cached.render_pass;
+}
+
+VkFramebuffer RenderGraph::get_framebuffer(
+    VkRenderPass const render_pass, VkImageView const *views, uint32_t const view_count,
+    VkExtent2D const extent
+) {
+    for (CachedFramebuffer const &cached : framebuffers) {
+        if (cached.render_pass == render_pass && cached.view_count == view_count
+            && cached.extent.width == extent.width && cached.extent.height == extent.height
+            && std::equal(views, views + view_count, cached.views)) {
+            return cached.framebuffer;
+        }
+    }
+
+    VkFramebufferCreateInfo fb_info = {};
+    fb_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    fb_info.pNext = nullptr;
+    fb_info.renderPass = render_pass;
+    fb_info.attachmentCount = view_count;
+    fb_info.pAttachments = views;
+    fb_info.width = extent.width;
+    fb_info.height = extent.height;
+    fb_info.layers = 1;
+
+    CachedFramebuffer cached = {};
+    cached.render_pass = render_pass;
+    cached.view_count = view_count;
+    std::copy(views, views + view_count, cached.views);
+    cached.extent = extent;
+    VK_CHECK(vkCreateFramebuffer(device, &fb_info, nullptr, &cached.framebuffer));
+    framebuffers.push_back(cached);
+    return cached.framebuffer;
+}
+
+void RenderGraph::flush_framebuffers() {
+    for (CachedFramebuffer const &cached : framebuffers) {
+        vkDestroyFramebuffer(device, cached.framebuffer, nullptr);
+    }
+    framebuffers.clear();
+}
+
+void RenderGraph::flush_framebuffers(VkImageView const *views, uint32_t const view_count) {
+    auto const uses_views = [&](CachedFramebuffer const &cached) {
+        for (uint32_t i = 0; i < cached.view_count; i++) {
+            if (std::find(views, views + view_count, cached.views[i]) != views + view_count) {
+                vkDestroyFramebuffer(device, cached.framebuffer, nullptr);
+                return true;
+            }
+        }
+        return false;
+    };
+    framebuffers.erase(
+        std::remove_if(framebuffers.begin(), framebuffers.end(), uses_views), framebuffers.end());
+}
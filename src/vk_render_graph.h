@@ -0,0 +1,352 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <vk_allocators.h>
+#include <vk_types.h>
+
+class GpuProfiler;
+
+// Handle of a resource declared in the current frame's graph
+using GraphResource = uint32_t;
+
+// Upper bound on the color attachments of a graphics pass
+constexpr uint32_t MAX_GRAPH_COLOR_ATTACHMENTS = 4;
+// Bytes of captures a pass' recording function can hold
+constexpr size_t GRAPH_PASS_STORAGE_SIZE = 64;
+// Compiled graphs unused for this many frames are destroyed. Must exceed the
+// frames in flight, which may still be using them.
+constexpr uint64_t GRAPH_CACHE_FRAMES = 64;
+
+// How a pass uses a resource. Each maps to the pipeline stages, access mask
+// and, for images, layout of the use.
+enum class GraphAccess : uint32_t {
+    // Not used, as the state of an imported resource before or after the
+    // graph: nothing to wait for or to leave it ready for
+    None,
+    ColorAttachment,
+    DepthAttachment, // tested and written
+    SampledFragment,
+    ComputeRead,
+    // Read and written, so the previous contents are kept
+    ComputeWrite,
+    IndirectRead, // draw arguments and counts
+    TransferRead,
+    TransferWrite,
+    // Read by the CPU once the frame's fence has signaled, only as the final
+    // state of a buffer
+    HostRead,
+    // Only as the final state of a swapchain image
+    Present,
+};
+
+enum class GraphPassType : uint32_t {
+    // Recorded outside of a render pass: dispatches, copies and clears
+    Compute,
+    // Recorded inside a render pass over its attachments
+    Graphics,
+    // Like Graphics, but executes secondary command buffers
+    GraphicsSecondary,
+};
+
+struct GraphImageInfo {
+    VkFormat format;
+    VkExtent2D extent;
+};
+
+// What compiling the graph found, the same every frame until the graph
+// changes
+struct RenderGraphStats {
+    uint32_t passes;
+    uint32_t culled_passes;
+    // Hazards resolved, one per resource and pass at most
+    uint32_t barriers;
+    // vkCmdPipelineBarrier calls they're batched into
+    uint32_t barrier_batches;
+    uint32_t transient_images;
+    // Memory the transient images would need on their own, and how much of
+    // it is saved by aliasing the ones whose lifetimes don't overlap
+    uint64_t transient_bytes;
+    uint64_t aliased_bytes;
+};
+
+// Frame graph of passes that declare which resources they read and write.
+// The passes and resources are declared anew every frame, then compile()
+// culls the passes nothing uses, places the barriers between passes,
+// batching those before a pass into a single vkCmdPipelineBarrier, and
+// allocates the transient images, aliasing the memory of images whose
+// lifetimes don't overlap. Compiled graphs are cached, so a frame whose
+// declarations match an earlier one's only looks its compiled graph up.
+//
+// Imported resources live outside the graph, e.g. swapchain images and
+// per-frame buffers. Their handles may change every frame without
+// recompiling. Buffers are synchronized with global memory barriers, so only
+// their accesses are tracked. Every pass is recorded into the same command
+// buffer, for the graphics queue.
+class RenderGraph {
+  public:
+    struct InitInfo {
+        VkDevice device;
+        VmaAllocator allocator;
+        MemoryCounters *counters;
+        // Each pass gets a GPU zone named after it, if set
+        GpuProfiler *profiler;
+    };
+
+    void init(InitInfo const &info);
+    // The GPU must be done with every frame
+    void cleanup();
+
+    // Forgets the last frame's passes and resources, before declaring the
+    // given frame's
+    void begin(uint64_t const frame);
+
+    // initial is the access the graph's first use has to wait for, and
+    // final the one its last use has to be made visible to. The image's
+    // contents are discarded before the first use unless preserve is set.
+    GraphResource import_image(
+        char const *name, GraphImageInfo const &info, VkImage const image,
+        VkImageView const view, GraphAccess const initial, GraphAccess const final,
+        bool const preserve);
+    GraphResource import_buffer(
+        char const *name, GraphAccess const initial, GraphAccess const final);
+    // Image that only lives within the frame, owned by the graph. Its contents
+    // don't survive from one frame to the next.
+    GraphResource create_image(char const *name, GraphImageInfo const &info);
+
+    // Adds a pass that calls record(cmd, inheritance) when the graph is
+    // executed, unless it's culled. Graphics passes record inside their
+    // render pass, with the dynamic viewport and scissor set to cover its
+    // attachments, and inheritance describes it for secondary command
+    // buffers, which must set their own. The name must be a string literal,
+    // it names the pass' GPU zone. The captures are copied into the pass and
+    // must be trivially copyable, e.g. pointers and references, and fit in
+    // GRAPH_PASS_STORAGE_SIZE bytes. Returns the pass to declare the accesses
+    // of, which must follow right after.
+    template <typename F>
+    uint32_t add_pass(char const *name, GraphPassType const type, F &&record) {
+        using Function = std::decay_t<F>;
+        static_assert(
+            sizeof(Function) <= GRAPH_PASS_STORAGE_SIZE,
+            "Pass captures too much, capture a pointer to the data instead");
+        static_assert(alignof(Function) <= alignof(std::max_align_t), "Pass is over-aligned");
+        static_assert(
+            std::is_trivially_copyable<Function>::value
+                && std::is_trivially_destructible<Function>::value,
+            "Pass captures must be trivially copyable");
+
+        PassDecl &pass = passes.emplace_back();
+        pass.name = name;
+        pass.type = type;
+        pass.first_usage = (uint32_t)usages.size();
+        pass.usage_count = 0;
+        new (pass.storage) Function(std::forward<F>(record));
+        pass.record = [](
+            void *storage, VkCommandBuffer cmd, VkCommandBufferInheritanceInfo const &inheritance
+        ) {
+            (*std::launder(reinterpret_cast<Function *>(storage)))(cmd, inheritance);
+        };
+        return (uint32_t)passes.size() - 1;
+    }
+
+    void read(uint32_t const pass, GraphResource const resource, GraphAccess const access);
+    void write(uint32_t const pass, GraphResource const resource, GraphAccess const access);
+    // Attachments of a graphics pass, in attachment order. The attachment is
+    // cleared to clear_value if set, otherwise its contents are loaded.
+    void color_attachment(
+        uint32_t const pass, GraphResource const resource, VkClearValue const *clear_value);
+    void depth_attachment(
+        uint32_t const pass, GraphResource const resource, VkClearValue const *clear_value);
+
+    // Looks up the compiled graph matching this frame's declarations, and
+    // compiles it if there is none. Returns true if it compiled.
+    bool compile();
+    // Records the passes that weren't culled, with their barriers, into cmd.
+    // The GPU zones go to the given frame in flight.
+    void execute(VkCommandBuffer const cmd, uint32_t const frame_index);
+
+    // Of the graph last compiled or looked up
+    RenderGraphStats const &get_stats() const;
+    // Times compile() didn't find the graph in the cache
+    uint32_t get_compile_count() const { return compile_count; }
+    // Logs the passes, barriers and transient memory of the graph last
+    // compiled or looked up
+    void dump() const;
+
+    // Render pass compatible with those of graphics passes over attachments
+    // of these formats, for building pipelines before any frame's graph has
+    // been compiled. Owned by the graph.
+    VkRenderPass get_compatible_render_pass(
+        VkFormat const *color_formats, uint32_t const color_count, VkFormat const depth_format);
+
+    // Destroys the framebuffers over imported image views, which must be done
+    // before those views are. The GPU must be done with them.
+    void flush_framebuffers();
+    // Same for only the framebuffers over any of the given views, e.g. those
+    // of a replaced swapchain, while frames in flight use the others
+    void flush_framebuffers(VkImageView const *views, uint32_t const view_count);
+
+  private:
+    struct ResourceDecl {
+        char const *name;
+        bool is_image;
+        bool imported;
+        bool preserve;
+        GraphImageInfo info;
+        VkImage image;
+        VkImageView view;
+        GraphAccess initial;
+        GraphAccess final;
+    };
+
+    struct UsageDecl {
+        GraphResource resource;
+        GraphAccess access;
+        bool attachment;
+        bool clear;
+        VkClearValue clear_value;
+    };
+
+    struct PassDecl {
+        char const *name;
+        GraphPassType type;
+        uint32_t first_usage;
+        uint32_t usage_count;
+        void (*record)(
+            void *storage, VkCommandBuffer cmd, VkCommandBufferInheritanceInfo const &inheritance);
+        alignas(std::max_align_t) unsigned char storage[GRAPH_PASS_STORAGE_SIZE];
+    };
+
+    // Everything a render pass is created from. Render passes are shared by
+    // all graphs and passes with the same key.
+    struct RenderPassKey {
+        uint32_t color_count;
+        // Colors first, then the depth attachment if depth_format is set
+        VkFormat formats[MAX_GRAPH_COLOR_ATTACHMENTS + 1];
+        VkAttachmentLoadOp load_ops[MAX_GRAPH_COLOR_ATTACHMENTS + 1];
+        VkAttachmentStoreOp store_ops[MAX_GRAPH_COLOR_ATTACHMENTS + 1];
+        VkFormat depth_format;
+    };
+
+    struct CachedRenderPass {
+        RenderPassKey key;
+        VkRenderPass render_pass;
+    };
+
+    struct CachedFramebuffer {
+        VkRenderPass render_pass;
+        uint32_t view_count;
+        VkImageView views[MAX_GRAPH_COLOR_ATTACHMENTS + 1];
+        VkExtent2D extent;
+        VkFramebuffer framebuffer;
+    };
+
+    struct Barrier {
+        GraphResource resource;
+        VkPipelineStageFlags src_stages;
+        VkAccessFlags src_access;
+        VkPipelineStageFlags dst_stages;
+        VkAccessFlags dst_access;
+        VkImageLayout old_layout;
+        VkImageLayout new_layout;
+    };
+
+    // Barriers recorded with one vkCmdPipelineBarrier. Buffers share a
+    // single global memory barrier, images get one each.
+    struct BarrierBatch {
+        uint32_t first_barrier;
+        uint32_t barrier_count;
+        VkPipelineStageFlags src_stages;
+        VkPipelineStageFlags dst_stages;
+        // 0 if the batch has no buffer barriers
+        VkAccessFlags buffer_src_access;
+        VkAccessFlags buffer_dst_access;
+        uint32_t image_barrier_count;
+    };
+
+    struct CompiledPass {
+        uint32_t pass; // declaration index
+        BarrierBatch batch;
+        // VK_NULL_HANDLE for compute passes
+        VkRenderPass render_pass;
+        // Into CompiledGraph::attachments, in attachment order
+        uint32_t first_attachment;
+        uint32_t attachment_count;
+    };
+
+    struct TransientImage {
+        GraphResource resource;
+        VkImage image;
+        VkImageView view;
+        VkImageUsageFlags usage;
+        VkDeviceSize size;
+        uint32_t block;
+        // Compiled passes of the first and last use
+        uint32_t first_use;
+        uint32_t last_use;
+    };
+
+    struct CompiledGraph {
+        // Declarations the graph was compiled from, see build_key()
+        std::vector<uint64_t> key;
+        uint64_t last_used_frame;
+        std::vector<CompiledPass> passes;
+        std::vector<uint32_t> culled_passes;
+        // Before the first pass come those of each compiled pass, then
+        // those of final_batch
+        std::vector<Barrier> barriers;
+        BarrierBatch final_batch{};
+        std::vector<uint32_t> attachments; // usage declaration indices
+        std::vector<TransientImage> transients;
+        // Index into transients for each resource, UINT32_MAX if none
+        std::vector<uint32_t> resource_transients;
+        // One allocation per group of transient images sharing memory
+        std::vector<VmaAllocation> blocks;
+        RenderGraphStats stats{};
+    };
+
+    VkDevice device{VK_NULL_HANDLE};
+    VmaAllocator allocator{VK_NULL_HANDLE};
+    MemoryCounters *counters{nullptr};
+    GpuProfiler *profiler{nullptr};
+
+    // This frame's declarations
+    uint64_t frame{0};
+    std::vector<ResourceDecl> resources;
+    std::vector<UsageDecl> usages;
+    std::vector<PassDecl> passes;
+
+    std::vector<std::unique_ptr<CompiledGraph>> cache;
+    CompiledGraph *current{nullptr};
+    uint32_t compile_count{0};
+
+    std::vector<CachedRenderPass> render_passes;
+    std::vector<CachedFramebuffer> framebuffers;
+
+    // Reused every frame so that steady-state frames don't allocate
+    std::vector<uint64_t> key_scratch;
+    std::vector<VkImageMemoryBarrier> image_barrier_scratch;
+    std::vector<VkClearValue> clear_value_scratch;
+
+    void add_usage(
+        uint32_t const pass, GraphResource const resource, GraphAccess const access,
+        bool const attachment, VkClearValue const *clear_value);
+
+    // Serializes everything about the declarations that compiling depends
+    // on, leaving out imported handles and clear values
+    void build_key(std::vector<uint64_t> &out_key) const;
+    void compile_graph(CompiledGraph &graph);
+    void allocate_transients(CompiledGraph &graph);
+    void destroy_graph(CompiledGraph &graph);
+
+    VkRenderPass get_render_pass(RenderPassKey const &key);
+    VkFramebuffer get_framebuffer(
+        VkRenderPass const render_pass, VkImageView const *views, uint32_t const view_count,
+        VkExtent2D const extent);
+    void record_batch(VkCommandBuffer const cmd, BarrierBatch const &batch);
+};
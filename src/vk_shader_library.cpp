@@ -0,0 +1,85 @@
+#include <vk_shader_library.h>
+
+#include <mapped_file.h>
+#include <vk_profiler.h>
+
+#include <filesystem>
+#include <vector>
+
+namespace {
+VkShaderModule create_shader_module(VkDevice const device, std::string const &filepath) {
+    PROFILE_ZONE("create shader module");
+    MappedFile file;
+    if (!file.open(filepath.c_str())) {
+        LOG_ERROR("Failed to open file: \"" << filepath << "\".");
+        return VK_NULL_HANDLE;
+    }
+
+    // Vulkan requires shader code size to be a multiple of 4 (uint32_t is 4 bytes)
+    if (file.size() % 4 != 0) {
+        LOG_ERROR("File size of file \"" << filepath << "\" is not a multiple of 4.");
+        return VK_NULL_HANDLE;
+    }
+
+    // The mapping is page aligned, so the code can be passed straight to the
+    // driver without copying it into a buffer first
+    VkShaderModuleCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    info.pNext = nullptr;
+    info.codeSize = file.size();
+    info.pCode = (uint32_t const *)file.data();
+
+    VkShaderModule shader_module;
+    if (vkCreateShaderModule(device, &info, nullptr, &shader_module) != VK_SUCCESS) {
+        LOG_ERROR("Failed to build shader module for \"" << filepath << "\".");
+        return VK_NULL_HANDLE;
+    }
+    return shader_module;
+}
+} // namespace
+
+void ShaderLibrary::load_all(
+    VkDevice const device, char const *const dir, jobs::JobSystem &job_system
+) {
+    this->device = device;
+
+    std::vector<std::filesystem::path> paths;
+    std::error_code err;
+    for (auto const &entry : std::filesystem::directory_iterator(dir, err)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".spv") {
+            paths.push_back(entry.path());
+        }
+    }
+    if (err) {
+        LOG_ERROR("Failed to list shader directory \"" << dir << "\": " << err.message());
+        return;
+    }
+
+    std::vector<VkShaderModule> loaded(paths.size(), VK_NULL_HANDLE);
+    job_system.parallel_for((uint32_t)paths.size(), 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            loaded[i] = create_shader_module(device, paths[i].string());
+        }
+    });
+
+    for (size_t i = 0; i < paths.size(); i++) {
+        VkShaderModule const shader_module = loaded[i];
+        if (shader_module != VK_NULL_HANDLE) {
+            modules[paths[i].filename().string()] = shader_module;
+        }
+    }
+
+    LOG_INFO("Loaded " << modules.size() << " of " << paths.size() << " shader modules from \"" << dir << "\".");
+}
+
+void ShaderLibrary::cleanup() {
+    for (auto const &entry : modules) {
+        vkDestroyShaderModule(device, entry.second, nullptr);
+    }
+    modules.clear();
+}
+
+VkShaderModule ShaderLibrary::find(std::string const &name) const {
+    auto const it = modules.find(name);
+    return it != modules.end() ? it->second : VK_NULL_HANDLE;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <job_system.h>
+#include <string>
+#include <unordered_map>
+#include <vk_types.h>
+
+// All compiled shader modules, keyed by SPIR-V file name (e.g.
+// "triangle.vert.spv")
+class ShaderLibrary {
+  public:
+    // Maps every .spv file in the directory and creates the shader modules in
+    // parallel jobs. Returns once all of them have been created.
+    void load_all(VkDevice const device, char const *const dir, jobs::JobSystem &job_system);
+
+    void cleanup();
+
+    // Returns VK_NULL_HANDLE if the file didn't exist or failed to load
+    VkShaderModule find(std::string const &name) const;
+
+  private:
+    VkDevice device{VK_NULL_HANDLE};
+    std::unordered_map<std::string, VkShaderModule> modules;
+};
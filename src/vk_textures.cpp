@@ -0,0 +1,267 @@
+#include <vk_textures.h>
+
+#include <vk_allocators.h>
+#include <vk_initializers.h>
+#include <vk_profiler.h>
+#include <vk_upload.h>
+
+#include <job_system.h>
+#include <mapped_file.h>
+#include <texture_compression.h>
+#include <texture_importer.h>
+
+#include <chrono>
+#include <string>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+double elapsed_ms(Clock::time_point const start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+VkFormat to_vk_format(assets::TextureFormat const format, bool const srgb) {
+    switch (format) {
+    case assets::TextureFormat::Rgba8:
+        return srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+    case assets::TextureFormat::Bc1:
+        return srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    case assets::TextureFormat::Bc3:
+        return srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+    case assets::TextureFormat::Bc7:
+        return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+    }
+    return VK_FORMAT_UNDEFINED;
+}
+
+char const *format_name(assets::TextureFormat const format) {
+    switch (format) {
+    case assets::TextureFormat::Rgba8:
+        return "RGBA8";
+    case assets::TextureFormat::Bc1:
+        return "BC1";
+    case assets::TextureFormat::Bc3:
+        return "BC3";
+    case assets::TextureFormat::Bc7:
+        return "BC7";
+    }
+    return "unknown";
+}
+
+// Format a texture with or without alpha is built in
+assets::TextureFormat texture_format(
+    TextureMode const mode, bool const bc_supported, bool const alpha) {
+    if (mode == TextureMode::Raw || !bc_supported) {
+        return assets::TextureFormat::Rgba8;
+    }
+    if (mode == TextureMode::Bc7) {
+        return assets::TextureFormat::Bc7;
+    }
+    return alpha ? assets::TextureFormat::Bc3 : assets::TextureFormat::Bc1;
+}
+
+// A texture ready to be uploaded, either mapped from the cache or just built
+struct PreparedTexture {
+    bool loaded{false};
+    std::string error;
+    bool from_cache{false};
+    MappedFile cache;
+    assets::TextureAssetView view;
+    assets::TextureData built;
+    bool cache_written{false};
+    double ms{0.0};
+};
+
+void prepare_texture(
+    TextureSource const &source, TextureMode const mode, bool const bc_supported,
+    jobs::JobSystem &jobs, PreparedTexture &out) {
+    PROFILE_ZONE("prepare texture");
+    Clock::time_point const start = Clock::now();
+
+    MappedFile file;
+    if (!file.open(source.source_path)) {
+        out.error = "can't be opened";
+        return;
+    }
+    uint64_t const source_hash = assets::hash_bytes(file.data(), file.size());
+
+    // A cached build is current if it was built from the same source, for
+    // the same color space and in a format this mode could have picked
+    if (out.cache.open(source.cache_path)
+        && assets::read_texture_asset(out.cache.data(), out.cache.size(), out.view)) {
+        assets::TextureAssetHeader const &header = *out.view.header;
+        assets::TextureFormat const format = out.view.format();
+        if (header.source_hash == source_hash && (header.srgb != 0) == source.srgb
+            && (format == texture_format(mode, bc_supported, false)
+                || format == texture_format(mode, bc_supported, true))) {
+            out.loaded = true;
+            out.from_cache = true;
+            out.ms = elapsed_ms(start);
+            return;
+        }
+    }
+    out.cache.close();
+
+    assets::Rgba8Image image;
+    if (!assets::decode_image(file.data(), file.size(), image, out.error)) {
+        return;
+    }
+    file.close();
+
+    assets::TextureFormat const format =
+        texture_format(mode, bc_supported, assets::has_alpha(image));
+    assets::build_texture(std::move(image), format, source.srgb, &jobs, out.built);
+    out.cache_written = assets::write_texture_asset(source.cache_path, out.built, source_hash);
+    out.loaded = true;
+    out.ms = elapsed_ms(start);
+}
+} // namespace
+
+void TextureLoader::init(InitInfo const &info) {
+    device = info.device;
+    allocator = info.allocator;
+    counters = info.counters;
+    uploads = info.uploads;
+    jobs = info.jobs;
+    mode = info.mode;
+    bc_supported = info.bc_supported;
+}
+
+void TextureLoader::cleanup() {
+    for (Texture const &texture : textures) {
+        vkDestroyImageView(device, texture.view, nullptr);
+        vmaDestroyImage(allocator, texture.image.image, texture.image.allocation);
+    }
+    textures.clear();
+}
+
+bool TextureLoader::load(TextureSource const *sources, uint32_t const count) {
+    PROFILE_ZONE("load textures");
+    bool all_loaded = true;
+
+    if (mode == TextureMode::Raw) {
+        for (uint32_t i = 0; i < count; i++) {
+            Clock::time_point const start = Clock::now();
+            MappedFile file;
+            assets::Rgba8Image image;
+            std::string error = "can't be opened";
+            if (!file.open(sources[i].source_path)
+                || !assets::decode_image(file.data(), file.size(), image, error)) {
+                LOG_ERROR("Failed to load \"" << sources[i].source_path << "\": " << error);
+                all_loaded = false;
+                continue;
+            }
+
+            assets::TextureMip const mip{image.width, image.height, 0, image.pixels.size()};
+            create_texture(
+                assets::TextureFormat::Rgba8, sources[i].srgb, &mip, 1, image.pixels.data(),
+                false);
+            LOG_INFO(
+                "Loaded " << sources[i].source_path << " in " << elapsed_ms(start) << " ms: "
+                << image.width << "x" << image.height << " RGBA8, no mips, "
+                << textures.back().memory_size / (1024.0 * 1024.0) << " MiB.");
+        }
+        uploads->flush();
+        return all_loaded;
+    }
+
+    // Each texture is prepared in a job of its own, which splits its mips
+    // and compression over more jobs
+    std::vector<PreparedTexture> prepared(count);
+    jobs::Counter counter;
+    for (uint32_t i = 0; i < count; i++) {
+        TextureSource const *source = &sources[i];
+        PreparedTexture *out = &prepared[i];
+        jobs->run(counter, [this, source, out]() {
+            prepare_texture(*source, mode, bc_supported, *jobs, *out);
+        });
+    }
+    jobs->wait(counter);
+
+    // The upload service isn't thread safe, the uploads are queued from here
+    for (uint32_t i = 0; i < count; i++) {
+        PreparedTexture const &texture = prepared[i];
+        if (!texture.loaded) {
+            LOG_ERROR("Failed to load \"" << sources[i].source_path << "\": " << texture.error);
+            all_loaded = false;
+            continue;
+        }
+
+        if (texture.from_cache) {
+            assets::TextureAssetView const &view = texture.view;
+            create_texture(
+                view.format(), view.header->srgb != 0, view.mips, view.header->mip_count,
+                view.texels, true);
+        } else {
+            assets::TextureData const &built = texture.built;
+            create_texture(
+                built.format, built.srgb, built.mips.data(), (uint32_t)built.mips.size(),
+                built.texels.data(), false);
+            if (!texture.cache_written) {
+                LOG_ERROR("Failed to write \"" << sources[i].cache_path << "\".");
+            }
+        }
+
+        Texture const &loaded = textures.back();
+        LOG_INFO(
+            (texture.from_cache ? "Loaded " : "Built ")
+            << (texture.from_cache ? sources[i].cache_path : sources[i].source_path)
+            << " in " << texture.ms << " ms: " << loaded.width << "x" << loaded.height << " "
+            << format_name(texture.from_cache ? texture.view.format() : texture.built.format)
+            << ", " << loaded.mip_count << " mips, "
+            << loaded.memory_size / (1024.0 * 1024.0) << " MiB.");
+    }
+    uploads->flush();
+    return all_loaded;
+}
+
+VkDeviceSize TextureLoader::memory_size() const {
+    VkDeviceSize size = 0;
+    for (Texture const &texture : textures) {
+        size += texture.memory_size;
+    }
+    return size;
+}
+
+void TextureLoader::create_texture(
+    assets::TextureFormat const format, bool const srgb, assets::TextureMip const *mips,
+    uint32_t const mip_count, uint8_t const *texels, bool const from_cache
+) {
+    Texture texture;
+    texture.format = to_vk_format(format, srgb);
+    texture.width = mips[0].width;
+    texture.height = mips[0].height;
+    texture.mip_count = mip_count;
+    texture.from_cache = from_cache;
+
+    VkImageCreateInfo image_info = vkinit::image_create_info(
+        texture.format, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        {texture.width, texture.height, 1});
+    image_info.mipLevels = mip_count;
+
+    VmaAllocationCreateInfo alloc_info = {};
+    alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+    VmaAllocationInfo allocation;
+    VK_CHECK(vmaCreateImage(
+        allocator, &image_info, &alloc_info, &texture.image.image, &texture.image.allocation,
+        &allocation));
+    counters->resource_allocations++;
+    texture.memory_size = allocation.size;
+
+    VkImageViewCreateInfo view_info = vkinit::imageview_create_info(
+        texture.format, texture.image.image, VK_IMAGE_ASPECT_COLOR_BIT);
+    view_info.subresourceRange.levelCount = mip_count;
+    VK_CHECK(vkCreateImageView(device, &view_info, nullptr, &texture.view));
+
+    std::vector<ImageUploadLevel> levels(mip_count);
+    for (uint32_t i = 0; i < mip_count; i++) {
+        levels[i] = {texels + mips[i].offset, mips[i].width, mips[i].height};
+    }
+    texture.upload_value = uploads->upload_image(
+        texture.image.image, assets::texture_block_extent(format),
+        assets::texture_block_size(format), levels.data(), mip_count,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+    textures.push_back(texture);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <vk_types.h>
+
+#include <texture_asset.h>
+
+struct MemoryCounters;
+class UploadService;
+
+namespace jobs {
+class JobSystem;
+}
+
+// How textures are stored on the GPU
+enum class TextureMode {
+    // Decoded one after the other on the loading thread and uploaded as
+    // RGBA8 without mips, the way a PNG is loaded without a texture pipeline
+    Raw,
+    // BC1 for opaque textures and BC3 for the rest, with mips
+    Bc,
+    // BC7 for every texture, with mips
+    Bc7,
+};
+
+struct TextureSource {
+    char const *source_path;
+    // Where the built texture is cached
+    char const *cache_path;
+    // Color textures are sRGB, data like normals or masks isn't
+    bool srgb;
+};
+
+struct Texture {
+    AllocatedImage image;
+    VkImageView view;
+    VkFormat format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mip_count;
+    // Device memory the driver gave the image, with its mips and padding
+    VkDeviceSize memory_size;
+    // Usable once the upload service has acquired this value
+    uint64_t upload_value;
+    // Loaded from a current cached build rather than the source image
+    bool from_cache;
+};
+
+// Loads textures into sampled images. Outside of TextureMode::Raw each
+// texture is built in a job of its own: the source is decoded, its mip chain
+// generated and compressed, themselves split over jobs. The result is cached
+// on disk along with a hash of the source, and loaded straight from the cache
+// as long as the source doesn't change.
+class TextureLoader {
+  public:
+    struct InitInfo {
+        VkDevice device;
+        VmaAllocator allocator;
+        MemoryCounters *counters;
+        UploadService *uploads;
+        jobs::JobSystem *jobs;
+        TextureMode mode;
+        // Without BC support the compressed modes keep their mips but stay
+        // RGBA8
+        bool bc_supported;
+    };
+
+    void init(InitInfo const &info);
+    // Destroys every texture loaded. The GPU must be done with them.
+    void cleanup();
+
+    // Loads the textures and queues their uploads. Returns false if any of
+    // them couldn't be loaded, the others are still loaded.
+    bool load(TextureSource const *sources, uint32_t const count);
+
+    std::vector<Texture> const &get_textures() const { return textures; }
+    // Device memory of all the textures loaded
+    VkDeviceSize memory_size() const;
+
+  private:
+    VkDevice device{VK_NULL_HANDLE};
+    VmaAllocator allocator{VK_NULL_HANDLE};
+    MemoryCounters *counters{nullptr};
+    UploadService *uploads{nullptr};
+    jobs::JobSystem *jobs{nullptr};
+    TextureMode mode{TextureMode::Bc};
+    bool bc_supported{false};
+
+    std::vector<Texture> textures;
+
+    // Creates the image of a texture and queues the upload of its levels
+    void create_texture(
+        assets::TextureFormat const format, bool const srgb, assets::TextureMip const *mips,
+        uint32_t const mip_count, uint8_t const *texels, bool const from_cache);
+};
@@ -3,6 +3,33 @@
 
 #pragma once
 
-#include <vulkan/vulkan.h>
+// Before VMA, whose implementation fetches its functions through the
+// vkGetInstanceProcAddr and vkGetDeviceProcAddr volk loads
+#include <volk.h>
+#include <vk_mem_alloc.h>
+#include <logger.h>
 
-//we will add our main reusable types here
\ No newline at end of file
+#include <cstdlib>
+#include <iostream>
+
+// Errors are written before LOG_ERROR returns, so nothing is lost to abort()
+#define VK_CHECK(x)                                                            \
+    do {                                                                       \
+        VkResult err = x;                                                      \
+        if (err) {                                                             \
+            LOG_ERROR("Detected Vulkan error: " << err);                       \
+            abort();                                                           \
+        }                                                                      \
+    } while (0)
+
+//we will add our main reusable types here
+
+struct AllocatedBuffer {
+    VkBuffer buffer;
+    VmaAllocation allocation;
+};
+
+struct AllocatedImage {
+    VkImage image;
+    VmaAllocation allocation;
+};
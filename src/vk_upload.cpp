@@ -0,0 +1,389 @@
+#include <vk_upload.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vk_initializers.h>
+#include <vk_profiler.h>
+
+namespace {
+// Alignment that satisfies optimalBufferCopyOffsetAlignment everywhere
+constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+} // namespace
+
+void UploadService::init(InitInfo const &info) {
+    device = info.device;
+    transfer_queue = info.transfer_queue;
+    transfer_queue_family = info.transfer_queue_family;
+    graphics_queue_family = info.graphics_queue_family;
+
+    VkCommandPoolCreateInfo const pool_info = vkinit::command_pool_create_info(
+        transfer_queue_family, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+    VK_CHECK(vkCreateCommandPool(device, &pool_info, nullptr, &command_pool));
+
+    VkSemaphoreTypeCreateInfoKHR type_info = {};
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+    type_info.pNext = nullptr;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+    type_info.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphore_info = {};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_info.pNext = &type_info;
+    semaphore_info.flags = 0;
+    VK_CHECK(vkCreateSemaphore(device, &semaphore_info, nullptr, &timeline));
+
+    get_semaphore_counter_value = (PFN_vkGetSemaphoreCounterValueKHR)vkGetDeviceProcAddr(
+        device, "vkGetSemaphoreCounterValueKHR");
+    wait_semaphores = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(
+        device, "vkWaitSemaphoresKHR");
+
+    staging_ring.init(info.allocator, info.staging_size, *info.counters);
+}
+
+void UploadService::cleanup() {
+    if (device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    flush();
+    wait(next_value - 1);
+
+    staging_ring.cleanup();
+    vkDestroySemaphore(device, timeline, nullptr);
+    vkDestroyCommandPool(device, command_pool, nullptr);
+    device = VK_NULL_HANDLE;
+}
+
+uint64_t UploadService::upload_buffer(
+    VkBuffer const dst, VkDeviceSize const dst_offset, void const *data,
+    VkDeviceSize const size, VkPipelineStageFlags const dst_stage,
+    VkAccessFlags const dst_access
+) {
+    // Large uploads are split so that they never need more than part of the
+    // ring at once, and can stream through it
+    VkDeviceSize const max_chunk = staging_ring.get_capacity() / 4;
+
+    VkDeviceSize copied = 0;
+    while (copied < size) {
+        VkDeviceSize const chunk = std::min(size - copied, max_chunk);
+
+        BufferSlice staging;
+        allocate_staging(chunk, STAGING_ALIGNMENT, staging);
+        std::memcpy(staging.data, (char const *)data + copied, chunk);
+        staging_ring.flush(staging);
+
+        PendingCopy copy;
+        copy.dst = dst;
+        copy.region.srcOffset = staging.offset;
+        copy.region.dstOffset = dst_offset + copied;
+        copy.region.size = chunk;
+        copy.dst_stage = dst_stage;
+        copy.dst_access = dst_access;
+        copy.last = copied + chunk == size;
+        pending_copies.push_back(copy);
+
+        copied += chunk;
+    }
+
+    // allocate_staging() may have flushed earlier chunks, but the batch with
+    // the last chunk is the one that makes the buffer complete
+    return next_value;
+}
+
+uint64_t UploadService::upload_image(
+    VkImage const dst, uint32_t const block_extent, uint32_t const block_size,
+    ImageUploadLevel const *levels, uint32_t const level_count,
+    VkPipelineStageFlags const dst_stage
+) {
+    VkDeviceSize const max_chunk = staging_ring.get_capacity() / 4;
+
+    // Levels are split into bands of whole block rows, the smallest unit a
+    // copy into a block compressed image can start at
+    for (uint32_t level = 0; level < level_count; level++) {
+        ImageUploadLevel const &source = levels[level];
+        uint32_t const block_columns = (source.width + block_extent - 1) / block_extent;
+        uint32_t const block_rows = (source.height + block_extent - 1) / block_extent;
+        VkDeviceSize const row_size = (VkDeviceSize)block_columns * block_size;
+        uint32_t const rows_per_chunk = (uint32_t)std::max<VkDeviceSize>(max_chunk / row_size, 1);
+
+        for (uint32_t row = 0; row < block_rows; row += rows_per_chunk) {
+            uint32_t const rows = std::min(rows_per_chunk, block_rows - row);
+            VkDeviceSize const chunk = rows * row_size;
+
+            BufferSlice staging;
+            allocate_staging(chunk, STAGING_ALIGNMENT, staging);
+            std::memcpy(staging.data, (char const *)source.data + row * row_size, chunk);
+            staging_ring.flush(staging);
+
+            uint32_t const y = row * block_extent;
+            PendingImageCopy copy;
+            copy.dst = dst;
+            copy.region.bufferOffset = staging.offset;
+            copy.region.bufferRowLength = 0;
+            copy.region.bufferImageHeight = 0;
+            copy.region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+            copy.region.imageOffset = {0, (int32_t)y, 0};
+            // Blocks hanging over the edge of the level are copied whole
+            copy.region.imageExtent = {
+                source.width, std::min(rows * block_extent, source.height - y), 1};
+            copy.dst_stage = dst_stage;
+            copy.first = level == 0 && row == 0;
+            copy.last = level + 1 == level_count && row + rows == block_rows;
+            pending_image_copies.push_back(copy);
+        }
+    }
+
+    return next_value;
+}
+
+void UploadService::flush() {
+    if (pending_copies.empty() && pending_image_copies.empty()) {
+        return;
+    }
+    PROFILE_ZONE("upload flush");
+
+    VkCommandBuffer cmd;
+    if (free_command_buffers.empty()) {
+        VkCommandBufferAllocateInfo const alloc_info =
+            vkinit::command_buffer_alloc_info(command_pool, 1);
+        VK_CHECK(vkAllocateCommandBuffers(device, &alloc_info, &cmd));
+    } else {
+        cmd = free_command_buffers.back();
+        free_command_buffers.pop_back();
+        VK_CHECK(vkResetCommandBuffer(cmd, 0));
+    }
+
+    VkCommandBufferBeginInfo cmd_info = {};
+    cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmd_info.pNext = nullptr;
+    cmd_info.pInheritanceInfo = nullptr;
+    cmd_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(cmd, &cmd_info));
+
+    // One copy command per destination buffer, with all of its regions
+    std::stable_sort(
+        pending_copies.begin(), pending_copies.end(),
+        [](PendingCopy const &a, PendingCopy const &b) { return a.dst < b.dst; });
+
+    Batch batch;
+    batch.value = next_value++;
+    batch.cmd = cmd;
+    batch.dst_stages = 0;
+
+    std::vector<VkBufferCopy> regions;
+    std::vector<VkBufferMemoryBarrier> releases;
+    for (size_t i = 0; i < pending_copies.size();) {
+        VkBuffer const dst = pending_copies[i].dst;
+        VkAccessFlags dst_access = 0;
+        bool last = false;
+
+        regions.clear();
+        for (; i < pending_copies.size() && pending_copies[i].dst == dst; i++) {
+            regions.push_back(pending_copies[i].region);
+            dst_access |= pending_copies[i].dst_access;
+            batch.dst_stages |= pending_copies[i].dst_stage;
+            last = last || pending_copies[i].last;
+        }
+        vkCmdCopyBuffer(cmd, staging_ring.get_buffer(), dst, (uint32_t)regions.size(), regions.data());
+
+        // An upload split across batches when the staging ring filled up
+        // stays with the transfer queue until its last chunk is copied, like
+        // images do
+        if (uses_separate_family() && last) {
+            // Hand the whole buffer over to the graphics queue family
+            VkBufferMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.pNext = nullptr;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+            barrier.srcQueueFamilyIndex = transfer_queue_family;
+            barrier.dstQueueFamilyIndex = graphics_queue_family;
+            barrier.buffer = dst;
+            barrier.offset = 0;
+            barrier.size = VK_WHOLE_SIZE;
+            releases.push_back(barrier);
+
+            // The acquire repeats the transfer, with the access that follows
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = dst_access;
+            batch.acquires.push_back(barrier);
+        }
+    }
+    pending_copies.clear();
+
+    // Images first leave the undefined layout, all in one barrier
+    std::vector<VkImageMemoryBarrier> image_barriers;
+    VkImageMemoryBarrier image_barrier = {};
+    image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    image_barrier.pNext = nullptr;
+    image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_barrier.subresourceRange = {
+        VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1};
+    for (PendingImageCopy const &copy : pending_image_copies) {
+        if (copy.first) {
+            image_barrier.srcAccessMask = 0;
+            image_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            image_barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            image_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            image_barrier.image = copy.dst;
+            image_barriers.push_back(image_barrier);
+        }
+    }
+    if (!image_barriers.empty()) {
+        vkCmdPipelineBarrier(
+            cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            0, nullptr, 0, nullptr, (uint32_t)image_barriers.size(), image_barriers.data());
+    }
+
+    // One copy command per run of copies into the same image, then the
+    // complete images move to the layout they're read in. Across families
+    // that's done by the release and acquire pair.
+    image_barriers.clear();
+    std::vector<VkBufferImageCopy> image_regions;
+    for (size_t i = 0; i < pending_image_copies.size();) {
+        VkImage const dst = pending_image_copies[i].dst;
+        bool last = false;
+
+        image_regions.clear();
+        for (; i < pending_image_copies.size() && pending_image_copies[i].dst == dst; i++) {
+            image_regions.push_back(pending_image_copies[i].region);
+            last = last || pending_image_copies[i].last;
+            batch.dst_stages |= pending_image_copies[i].dst_stage;
+        }
+        vkCmdCopyBufferToImage(
+            cmd, staging_ring.get_buffer(), dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            (uint32_t)image_regions.size(), image_regions.data());
+
+        if (last) {
+            image_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            image_barrier.dstAccessMask = 0;
+            image_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            image_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            image_barrier.image = dst;
+            if (uses_separate_family()) {
+                image_barrier.srcQueueFamilyIndex = transfer_queue_family;
+                image_barrier.dstQueueFamilyIndex = graphics_queue_family;
+                image_barriers.push_back(image_barrier);
+
+                image_barrier.srcAccessMask = 0;
+                image_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+                batch.image_acquires.push_back(image_barrier);
+            } else {
+                // The timeline wait makes the image visible to the graphics
+                // queue, this only has to happen before the signal
+                image_barriers.push_back(image_barrier);
+            }
+        }
+    }
+    pending_image_copies.clear();
+
+    if (!releases.empty() || !image_barriers.empty()) {
+        vkCmdPipelineBarrier(
+            cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0, 0, nullptr, (uint32_t)releases.size(), releases.data(),
+            (uint32_t)image_barriers.size(), image_barriers.data());
+    }
+
+    VK_CHECK(vkEndCommandBuffer(cmd));
+
+    VkTimelineSemaphoreSubmitInfoKHR timeline_info = {};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+    timeline_info.pNext = nullptr;
+    timeline_info.signalSemaphoreValueCount = 1;
+    timeline_info.pSignalSemaphoreValues = &batch.value;
+
+    VkSubmitInfo submit = {};
+    submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit.pNext = &timeline_info;
+    submit.commandBufferCount = 1;
+    submit.pCommandBuffers = &cmd;
+    submit.signalSemaphoreCount = 1;
+    submit.pSignalSemaphores = &timeline;
+    VK_CHECK(vkQueueSubmit(transfer_queue, 1, &submit, VK_NULL_HANDLE));
+
+    // Everything staged so far is read by this batch
+    staging_ring.mark_submission(batch.value);
+    batches.push_back(std::move(batch));
+}
+
+uint64_t UploadService::record_acquires(
+    VkCommandBuffer const cmd, VkPipelineStageFlags &out_wait_stage
+) {
+    update_completed();
+
+    // Only finished batches are acquired, so the graphics queue never waits
+    // for copies still in progress
+    std::vector<VkBufferMemoryBarrier> &acquires = acquire_scratch;
+    std::vector<VkImageMemoryBarrier> &image_acquires = image_acquire_scratch;
+    acquires.clear();
+    image_acquires.clear();
+    VkPipelineStageFlags dst_stages = 0;
+    uint64_t wait_value = 0;
+    while (!batches.empty() && batches.front().value <= completed_value) {
+        Batch &batch = batches.front();
+        acquires.insert(acquires.end(), batch.acquires.begin(), batch.acquires.end());
+        image_acquires.insert(
+            image_acquires.end(), batch.image_acquires.begin(), batch.image_acquires.end());
+        dst_stages |= batch.dst_stages;
+        wait_value = batch.value;
+
+        free_command_buffers.push_back(batch.cmd);
+        batches.pop_front();
+    }
+
+    if (wait_value == 0) {
+        return 0;
+    }
+
+    if (!acquires.empty() || !image_acquires.empty()) {
+        vkCmdPipelineBarrier(
+            cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stages, 0, 0, nullptr,
+            (uint32_t)acquires.size(), acquires.data(), (uint32_t)image_acquires.size(),
+            image_acquires.data());
+    }
+
+    // Still waited on, which is free since the value has been reached, to
+    // order the acquires after the releases and make the copies visible
+    last_acquired_value = wait_value;
+    out_wait_stage = dst_stages;
+    return wait_value;
+}
+
+void UploadService::wait(uint64_t const value) {
+    if (value <= completed_value) {
+        return;
+    }
+
+    VkSemaphoreWaitInfoKHR wait_info = {};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+    wait_info.pNext = nullptr;
+    wait_info.flags = 0;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &timeline;
+    wait_info.pValues = &value;
+    VK_CHECK(wait_semaphores(device, &wait_info, UINT64_MAX));
+
+    update_completed();
+}
+
+void UploadService::update_completed() {
+    VK_CHECK(get_semaphore_counter_value(device, timeline, &completed_value));
+    staging_ring.release(completed_value);
+}
+
+void UploadService::allocate_staging(
+    VkDeviceSize const size, VkDeviceSize const alignment, BufferSlice &out_slice
+) {
+    if (staging_ring.allocate(size, alignment, out_slice)) {
+        return;
+    }
+
+    // The ring is full of data for queued and in-flight copies. Submit the
+    // queued ones and wait for batches to finish until there is room.
+    flush();
+    update_completed();
+    while (!staging_ring.allocate(size, alignment, out_slice)) {
+        wait(completed_value + 1);
+    }
+}
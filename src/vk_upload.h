@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <vk_allocators.h>
+#include <vk_types.h>
+
+// One mip level of an image upload, its texels or blocks in rows without
+// padding
+struct ImageUploadLevel {
+    void const *data;
+    uint32_t width;
+    uint32_t height;
+};
+
+// Uploads data to device local buffers and images from a transfer queue,
+// without stalling the graphics queue. Copies are staged in a ring buffer and
+// batched into one submission per flush(), which signals a timeline semaphore
+// with the batch's value. When the transfer queue belongs to another family,
+// buffers and images are released by the transfer queue once their last copy
+// is recorded, and acquired with record_acquires() on the graphics queue. Not
+// thread safe.
+class UploadService {
+  public:
+    struct InitInfo {
+        VkDevice device;
+        VmaAllocator allocator;
+        MemoryCounters *counters;
+        VkQueue transfer_queue;
+        uint32_t transfer_queue_family;
+        uint32_t graphics_queue_family;
+        VkDeviceSize staging_size;
+    };
+
+    void init(InitInfo const &info);
+    // Waits for all uploads, then destroys everything
+    void cleanup();
+
+    // Copies the data into staging memory and queues the copy into dst. The
+    // data will be read at dst_stage with dst_access on the graphics queue.
+    // Returns the timeline value after which the buffer is ready, once the
+    // batch has been flushed and acquired.
+    uint64_t upload_buffer(
+        VkBuffer const dst, VkDeviceSize const dst_offset, void const *data,
+        VkDeviceSize const size, VkPipelineStageFlags const dst_stage,
+        VkAccessFlags const dst_access);
+
+    // Copies every level of an image with a single layer, created in
+    // VK_IMAGE_LAYOUT_UNDEFINED, into staging memory and queues the copies.
+    // block_extent and block_size describe the format: texels per block side,
+    // 1 for uncompressed formats, and bytes per block. The image ends up in
+    // VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, read at dst_stage on the
+    // graphics queue. Returns the timeline value after which it's ready, like
+    // upload_buffer().
+    uint64_t upload_image(
+        VkImage const dst, uint32_t const block_extent, uint32_t const block_size,
+        ImageUploadLevel const *levels, uint32_t const level_count,
+        VkPipelineStageFlags const dst_stage);
+
+    // Submits all queued copies as one batch. Does nothing if there are none.
+    void flush();
+
+    // Records the graphics queue side of every batch the transfer queue has
+    // finished. Returns the timeline value the submission of cmd has to wait
+    // for at out_wait_stage, or 0 if nothing was acquired.
+    uint64_t record_acquires(VkCommandBuffer const cmd, VkPipelineStageFlags &out_wait_stage);
+
+    // Blocks until the batch with the given value has finished
+    void wait(uint64_t const value);
+
+    VkSemaphore get_timeline() const { return timeline; }
+    // Highest value whose buffers are usable by graphics command buffers
+    // recorded from now on
+    uint64_t acquired_value() const { return last_acquired_value; }
+    // Batches submitted to the transfer queue so far, one per flush() with
+    // copies queued
+    uint64_t submit_count() const { return next_value - 1; }
+    bool uses_separate_family() const {
+        return transfer_queue_family != graphics_queue_family;
+    }
+
+  private:
+    struct PendingCopy {
+        VkBuffer dst;
+        VkBufferCopy region;
+        VkPipelineStageFlags dst_stage;
+        VkAccessFlags dst_access;
+        // The last chunk of the upload, whose batch hands the buffer over to
+        // the graphics queue. Earlier chunks may go out in earlier batches.
+        bool last;
+    };
+
+    struct PendingImageCopy {
+        VkImage dst;
+        VkBufferImageCopy region;
+        VkPipelineStageFlags dst_stage;
+        // The first copy moves the whole image out of the undefined layout,
+        // the last one into the layout it's read in
+        bool first;
+        bool last;
+    };
+
+    // A submitted batch, kept until its buffers and images have been acquired
+    struct Batch {
+        uint64_t value;
+        VkCommandBuffer cmd;
+        VkPipelineStageFlags dst_stages;
+        std::vector<VkBufferMemoryBarrier> acquires;
+        std::vector<VkImageMemoryBarrier> image_acquires;
+    };
+
+    VkDevice device{VK_NULL_HANDLE};
+    VkQueue transfer_queue{VK_NULL_HANDLE};
+    uint32_t transfer_queue_family{0};
+    uint32_t graphics_queue_family{0};
+
+    VkCommandPool command_pool{VK_NULL_HANDLE};
+    std::vector<VkCommandBuffer> free_command_buffers;
+
+    VkSemaphore timeline{VK_NULL_HANDLE};
+    uint64_t next_value{1};
+    uint64_t completed_value{0};
+    uint64_t last_acquired_value{0};
+
+    // Timeline semaphores come from VK_KHR_timeline_semaphore, which the
+    // loader doesn't export
+    PFN_vkGetSemaphoreCounterValueKHR get_semaphore_counter_value{nullptr};
+    PFN_vkWaitSemaphoresKHR wait_semaphores{nullptr};
+
+    StagingRing staging_ring;
+    std::vector<PendingCopy> pending_copies;
+    // In the order they were queued, so that an image's first copy precedes
+    // its others
+    std::vector<PendingImageCopy> pending_image_copies;
+    std::deque<Batch> batches;
+    // Reused every frame so that record_acquires() doesn't allocate
+    std::vector<VkBufferMemoryBarrier> acquire_scratch;
+    std::vector<VkImageMemoryBarrier> image_acquire_scratch;
+
+    // Polls the timeline and frees the staging memory of finished batches
+    void update_completed();
+    // Makes room in the staging ring for an allocation, waiting for older
+    // batches if needed
+    void allocate_staging(
+        VkDeviceSize const size, VkDeviceSize const alignment, BufferSlice &out_slice);
+};